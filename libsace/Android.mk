@@ -21,6 +21,10 @@ LOCAL_SRC_FILES :=        \
     SaceTypes.cpp         \
     SaceServiceInfo.cpp   \
     SaceParams.cpp        \
+    SaceFrame.cpp         \
+    SaceCodec.cpp         \
+    SaceStatusPage.cpp    \
+    SaceRing.cpp          \
     ISaceListener.cpp     \
     ISaceManager.cpp      \
 
@@ -16,8 +16,12 @@
 
 #include <binder/IBinder.h>
 #include <binder/Parcel.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 
 #include "ISaceListener.h"
+#include "SaceLog.h"
 
 namespace android {
 
@@ -28,11 +32,21 @@ public:
 	void onResponsed (const SaceStatusResponse &response) {
 		Parcel data, reply;
 
-		data.writeInt32(1);
 		data.writeInterfaceToken(ISaceListener::getInterfaceDescriptor());
+		data.writeInt32(1);
 		response.writeToParcel(&data);
 		remote()->transact(TRANSACTION_ONRESPONSED, data, &reply, 0);
 	}
+
+	/* an excutor thread delivers this, it must not wait for the client */
+	void onResult (const SaceResult &result) {
+		Parcel data;
+
+		data.writeInterfaceToken(ISaceListener::getInterfaceDescriptor());
+		data.writeInt32(1);
+		result.writeToParcel(&data);
+		remote()->transact(TRANSACTION_ONRESULT, data, nullptr, IBinder::FLAG_ONEWAY);
+	}
 };
 
 IMPLEMENT_META_INTERFACE(SaceListener, "android.sace.SaceListener");
@@ -50,6 +64,25 @@ status_t BnSaceListener::onTransact (uint32_t code, const Parcel &data, Parcel *
 			onResponsed(response);
 			return NO_ERROR;
 		}
+		case TRANSACTION_ONRESULT: {
+			CHECK_INTERFACE(ISaceListener, data, reply);
+			SaceResult result;
+			if (data.readInt32() != 0)
+				result.readFromParcel(&data);
+
+			/* the parcel closes its own fd when the transaction is freed */
+			if (result.resultType == SACE_RESULT_TYPE_FD && result.resultFd >= 0) {
+				result.resultFd = fcntl(result.resultFd, F_DUPFD_CLOEXEC, 0);
+				if (result.resultFd < 0) {
+					SACE_LOGE("ISaceListener dup fd errno=%d errstr=%s", errno, strerror(errno));
+					result.resultType   = SACE_RESULT_TYPE_NONE;
+					result.resultStatus = SACE_RESULT_STATUS_FAIL;
+				}
+			}
+
+			onResult(result);
+			return NO_ERROR;
+		}
 		default:
 			return BBinder::onTransact(code, data, reply, flags);
 	}
@@ -25,6 +25,7 @@ namespace android {
 
 enum {
 	TRANSACTION_ONRESPONSED = IBinder::FIRST_CALL_TRANSACTION,
+	TRANSACTION_ONRESULT    = TRANSACTION_ONRESPONSED + 1,
 };
 
 class ISaceListener : public IInterface {
@@ -32,6 +33,9 @@ public:
 	DECLARE_META_INTERFACE(SaceListener);
 
 	virtual void onResponsed (const SaceStatusResponse &) = 0;
+	/* oneway, answers ISaceManager::sendCommandAsync by the command sequence.
+	 * A result fd belongs to the listener. */
+	virtual void onResult (const SaceResult &) = 0;
 };
 
 // ---------------------------------------------------------
@@ -33,7 +33,7 @@ status_t BnSaceManager::onTransact (uint32_t code, const Parcel &data, Parcel *r
             if (data.readInt32() != 0)
                 command.readFromParcel((Parcel*)&data);
 
-            SaceResult result = sendCommand(command);
+            SaceResult result = sendCommand(std::move(command));
             result.writeToParcel(reply);
 
             return NO_ERROR;
@@ -42,8 +42,19 @@ status_t BnSaceManager::onTransact (uint32_t code, const Parcel &data, Parcel *r
             CHECK_INTERFACE(ISaceManager, data, reply);
             sp<ISaceListener> listener =interface_cast<ISaceListener>(data.readStrongBinder());
             registerListener(listener);
+            /* newest transaction known here, older services leave it empty */
+            if (reply != nullptr)
+                reply->writeInt32(TRANSACT_SENDCOMMANDASYNC);
             return NO_ERROR;
         }
+        case TRANSACT_SENDCOMMANDASYNC: {
+            CHECK_INTERFACE(ISaceManager, data, reply);
+            SaceCommand command;
+            if (data.readInt32() != 0)
+                command.readFromParcel((Parcel*)&data);
+            sp<ISaceListener> listener = interface_cast<ISaceListener>(data.readStrongBinder());
+            return sendCommandAsync(std::move(command), listener);
+        }
         case TRANSACT_UNREGISTERLISTENER:
 			CHECK_INTERFACE(ISaceManager, data, reply);
 			unregisterListener();
@@ -54,7 +65,7 @@ status_t BnSaceManager::onTransact (uint32_t code, const Parcel &data, Parcel *r
 }
 
 // --------------------------------------------------------------------------------------------------
-SaceResult BpSaceManager::sendCommand (SaceCommand command) {
+SaceResult BpSaceManager::sendCommand (const SaceCommand &command) {
 	Parcel data, reply;
 
     data.writeInterfaceToken(ISaceManager::getInterfaceDescriptor());
@@ -68,12 +79,23 @@ SaceResult BpSaceManager::sendCommand (SaceCommand command) {
     return result;
 }
 
-void BpSaceManager::registerListener (sp<ISaceListener> listener) {
+status_t BpSaceManager::sendCommandAsync (const SaceCommand &command, const sp<ISaceListener> &listener) {
     Parcel data;
 
+    data.writeInterfaceToken(ISaceManager::getInterfaceDescriptor());
+    data.writeInt32(1);
+    command.writeToParcel(&data);
+    data.writeStrongBinder(IInterface::asBinder(listener));
+    return remote()->transact(TRANSACT_SENDCOMMANDASYNC, data, nullptr, IBinder::FLAG_ONEWAY);
+}
+
+void BpSaceManager::registerListener (sp<ISaceListener> listener) {
+    Parcel data, reply;
+
     data.writeInterfaceToken(ISaceManager::getInterfaceDescriptor());
     data.writeStrongBinder(IInterface::asBinder(listener));
-    remote()->transact(TRANSACT_REGISTERLISTENER, data, nullptr, 0);
+    if (remote()->transact(TRANSACT_REGISTERLISTENER, data, &reply, 0) == NO_ERROR)
+        mAsync = reply.dataAvail() >= sizeof(int32_t) && reply.readInt32() >= TRANSACT_SENDCOMMANDASYNC;
 }
 
 void BpSaceManager::unregisterListener () {
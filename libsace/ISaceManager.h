@@ -30,6 +30,7 @@ enum {
     TRANSACT_SENDCOMMAND        = IBinder::FIRST_CALL_TRANSACTION,
     TRANSACT_REGISTERLISTENER   = TRANSACT_SENDCOMMAND + 1,
 	TRANSACT_UNREGISTERLISTENER = TRANSACT_REGISTERLISTENER + 1,
+    TRANSACT_SENDCOMMANDASYNC   = TRANSACT_UNREGISTERLISTENER + 1,
 };
 
 // --------------------------------------------------------
@@ -37,7 +38,18 @@ class ISaceManager : public IInterface {
 public:
     DECLARE_META_INTERFACE(SaceManager);
 
-    virtual SaceResult sendCommand (SaceCommand) = 0;
+    virtual SaceResult sendCommand (const SaceCommand &) = 0;
+    /* BnSaceManager hands over the command read from the parcel */
+    virtual SaceResult sendCommand (SaceCommand &&command) {
+        return sendCommand(static_cast<const SaceCommand&>(command));
+    }
+    /* oneway, the binder thread returns once the command is posted and the
+     * result comes back through listener->onResult with the command sequence.
+     * listener must be the one registered by the calling process. */
+    virtual status_t sendCommandAsync (const SaceCommand &, const sp<ISaceListener> &listener) = 0;
+    virtual status_t sendCommandAsync (SaceCommand &&command, const sp<ISaceListener> &listener) {
+        return sendCommandAsync(static_cast<const SaceCommand&>(command), listener);
+    }
     virtual void registerListener (sp<ISaceListener>) = 0;
 	virtual void unregisterListener () = 0;
 };
@@ -51,11 +63,21 @@ public:
 // --------------------------------------------------------
 class BpSaceManager : public BpInterface<ISaceManager> {
 public:
-	explicit BpSaceManager (const sp<IBinder> impl):BpInterface<ISaceManager>(impl) {}
+	explicit BpSaceManager (const sp<IBinder> impl):BpInterface<ISaceManager>(impl),mAsync(false) {}
 
-	virtual SaceResult sendCommand (SaceCommand);
+	using ISaceManager::sendCommand;
+	using ISaceManager::sendCommandAsync;
+	virtual SaceResult sendCommand (const SaceCommand &);
+	virtual status_t sendCommandAsync (const SaceCommand &, const sp<ISaceListener> &listener);
 	virtual void registerListener (sp<ISaceListener>);
 	virtual void unregisterListener ();
+
+	/* the service answered registerListener knowing sendCommandAsync */
+	bool asyncSupported () const {
+		return mAsync;
+	}
+private:
+	bool mAsync;
 };
 
 }; //namespace android
@@ -0,0 +1,522 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <limits>
+
+#include "SaceCodec.h"
+
+namespace android {
+
+const uint8_t SaceCodec::MAGIC   = 0xc5;
+const uint8_t SaceCodec::VERSION = 1;
+const size_t  SaceCodec::HEADER_SIZE = sizeof(uint32_t) + 3;
+
+/* presence masks */
+enum {
+    CMD_LABEL    = 1 << 0,
+    CMD_NAME     = 1 << 1,
+    CMD_COMMAND  = 1 << 2,
+    CMD_EXTRA    = 1 << 3,
+    CMD_PARAMS   = 1 << 4,
+    CMD_EVENT_PARAMS = 1 << 5,
+};
+
+enum {
+    RSLT_NAME  = 1 << 0,
+    RSLT_EXTRA = 1 << 1,
+};
+
+// -------------- Writer/Reader -------------
+class SaceCodec::Writer {
+public:
+    string &data;
+
+    explicit Writer (string &out):data(out) {}
+
+    void put_u8 (uint8_t value) {
+        data.push_back(static_cast<char>(value));
+    }
+
+    void put_varint (uint64_t value) {
+        while (value >= 0x80) {
+            put_u8(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        put_u8(static_cast<uint8_t>(value));
+    }
+
+    void put_bytes (const void *bytes, size_t len) {
+        put_varint(len);
+        data.append(static_cast<const char*>(bytes), len);
+    }
+
+    void put_payload (const SacePayload &payload) {
+        put_bytes(payload.data(), payload.size());
+    }
+
+    void put_str (const string &str) {
+        put_bytes(str.data(), str.size());
+    }
+
+    void put_strs (const vector<string> &strs) {
+        put_varint(strs.size());
+        for (auto &str : strs)
+            put_str(str);
+    }
+
+    /* total length goes in front, same as the Parcel frames */
+    void finish () {
+        uint32_t len = data.size();
+        memcpy(&data[0], &len, sizeof(len));
+    }
+};
+
+class SaceCodec::Reader {
+    const uint8_t *mPos;
+    const uint8_t *mEnd;
+
+public:
+    Reader ():mPos(nullptr),mEnd(nullptr) {}
+
+    void reset (const uint8_t *data, size_t len) {
+        mPos = data;
+        mEnd = data + len;
+    }
+
+    bool done () const {
+        return mPos == mEnd;
+    }
+
+    bool get_u8 (uint8_t &value) {
+        if (mPos == mEnd)
+            return false;
+
+        value = *mPos++;
+        return true;
+    }
+
+    bool get_varint (uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!get_u8(byte))
+                return false;
+
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+
+        return false;
+    }
+
+    template<typename T> bool get_varint (T &value) {
+        uint64_t raw;
+        if (!get_varint(raw) || raw > numeric_limits<T>::max())
+            return false;
+
+        value = static_cast<T>(raw);
+        return true;
+    }
+
+    bool get_payload (SacePayload &payload) {
+        uint64_t len;
+        if (!get_varint(len) || len > SacePayload::MAX_SIZE || static_cast<uint64_t>(mEnd - mPos) < len)
+            return false;
+
+        payload.assign(mPos, len);
+        mPos += len;
+        return true;
+    }
+
+    bool get_str (string &str) {
+        uint64_t len;
+        if (!get_varint(len) || static_cast<uint64_t>(mEnd - mPos) < len)
+            return false;
+
+        str.assign(reinterpret_cast<const char*>(mPos), len);
+        mPos += len;
+        return true;
+    }
+
+    bool get_strs (vector<string> &strs) {
+        uint64_t count;
+        /* every string takes at least its length byte */
+        if (!get_varint(count) || static_cast<uint64_t>(mEnd - mPos) < count)
+            return false;
+
+        strs.resize(count);
+        for (auto &str : strs) {
+            if (!get_str(str))
+                return false;
+        }
+
+        return true;
+    }
+};
+
+// -------------- SaceCodec -------------
+bool SaceCodec::isCompact (const uint8_t *frame, size_t len) {
+    return len >= HEADER_SIZE && frame[sizeof(uint32_t)] == MAGIC;
+}
+
+int SaceCodec::kind (const uint8_t *frame, size_t len) {
+    if (!isCompact(frame, len) || frame[sizeof(uint32_t) + 1] != VERSION)
+        return -1;
+
+    return frame[sizeof(uint32_t) + 2];
+}
+
+void SaceCodec::begin (Writer &out, enum Kind kind) {
+    out.data.clear();
+    out.data.append(sizeof(uint32_t), '\0');
+    out.put_u8(MAGIC);
+    out.put_u8(VERSION);
+    out.put_u8(kind);
+}
+
+bool SaceCodec::open (const uint8_t *frame, size_t len, enum Kind kind, Reader &in) {
+    if (SaceCodec::kind(frame, len) != kind)
+        return false;
+
+    in.reset(frame + HEADER_SIZE, len - HEADER_SIZE);
+    return true;
+}
+
+void SaceCodec::put_params (Writer &out, const SaceCommandParams &params) {
+    out.put_str(params.uid);
+    out.put_str(params.gid);
+    out.put_strs(params.supp_gids);
+    out.put_str(params.seclabel);
+    out.put_varint(params.capabilities.to_ullong());
+    out.put_strs(params.rlimits);
+}
+
+bool SaceCodec::get_params (Reader &in, SaceCommandParams &params) {
+    uint64_t caps;
+
+    if (!in.get_str(params.uid) || !in.get_str(params.gid) || !in.get_strs(params.supp_gids)
+            || !in.get_str(params.seclabel) || !in.get_varint(caps) || !in.get_strs(params.rlimits))
+        return false;
+
+    params.capabilities = CapSet(caps);
+    return true;
+}
+
+void SaceCodec::put_command (Writer &out, const SaceCommand &cmd) {
+    shared_ptr<SaceEventParams> eventParams = dynamic_pointer_cast<SaceEventParams>(cmd.command_params);
+    uint8_t sub[2] = {0, 0};
+    uint32_t mask = 0;
+
+    if (cmd.type == SACE_TYPE_SERVICE) {
+        sub[0] = cmd.serviceCmdType;
+        sub[1] = cmd.serviceFlags;
+    }
+    else if (cmd.type == SACE_TYPE_EVENT) {
+        sub[0] = cmd.eventType;
+        sub[1] = cmd.eventFlags;
+    }
+    else {
+        sub[0] = cmd.normalCmdType;
+        sub[1] = cmd.flags;
+    }
+
+    if (cmd.label)
+        mask |= CMD_LABEL;
+    if (!cmd.name.empty())
+        mask |= CMD_NAME;
+    if (!cmd.command.empty())
+        mask |= CMD_COMMAND;
+    if (!cmd.extra.empty())
+        mask |= CMD_EXTRA;
+    if (cmd.command_params)
+        mask |= eventParams ? CMD_PARAMS | CMD_EVENT_PARAMS : CMD_PARAMS;
+
+    out.put_varint(cmd.type);
+    out.put_varint(cmd.sequence);
+    out.put_u8(sub[0]);
+    out.put_u8(sub[1]);
+    out.put_varint(mask);
+
+    if (mask & CMD_LABEL)
+        out.put_varint(cmd.label);
+    if (mask & CMD_NAME)
+        out.put_str(cmd.name);
+    if (mask & CMD_COMMAND)
+        out.put_str(cmd.command);
+    if (mask & CMD_EXTRA)
+        out.put_payload(cmd.extra);
+
+    if (mask & CMD_PARAMS)
+        put_params(out, *cmd.command_params);
+    if (mask & CMD_EVENT_PARAMS) {
+        out.put_u8(eventParams->boot);
+        out.put_strs(eventParams->property_key);
+        out.put_strs(eventParams->property_value);
+    }
+}
+
+bool SaceCodec::get_command (Reader &in, SaceCommand &cmd) {
+    uint8_t type, sub[2], boot;
+    uint32_t mask;
+
+    if (!in.get_varint(type) || !in.get_varint(cmd.sequence) || !in.get_u8(sub[0]) || !in.get_u8(sub[1])
+            || !in.get_varint(mask))
+        return false;
+
+    cmd.type = static_cast<enum SaceCommandType>(type);
+    if (cmd.type == SACE_TYPE_SERVICE) {
+        cmd.serviceCmdType = static_cast<enum SaceServiceCommandType>(sub[0]);
+        cmd.serviceFlags   = static_cast<enum SaceServiceFlags>(sub[1]);
+    }
+    else if (cmd.type == SACE_TYPE_EVENT) {
+        cmd.eventType  = static_cast<enum SaceEventType>(sub[0]);
+        cmd.eventFlags = static_cast<enum SaceEventFlags>(sub[1]);
+    }
+    else {
+        cmd.normalCmdType = static_cast<enum SaceNormalCommandType>(sub[0]);
+        cmd.flags = static_cast<enum SaceCommandFlags>(sub[1]);
+    }
+
+    cmd.label = 0;
+    cmd.name.clear();
+    cmd.command.clear();
+    cmd.extra.clear();
+    cmd.command_params = nullptr;
+
+    if ((mask & CMD_LABEL) && !in.get_varint(cmd.label))
+        return false;
+    if ((mask & CMD_NAME) && !in.get_str(cmd.name))
+        return false;
+    if ((mask & CMD_COMMAND) && !in.get_str(cmd.command))
+        return false;
+    if ((mask & CMD_EXTRA) && !in.get_payload(cmd.extra))
+        return false;
+
+    if (!(mask & CMD_PARAMS))
+        return true;
+
+    /* excutors expect event params on every event command */
+    if ((mask & CMD_EVENT_PARAMS) || cmd.type == SACE_TYPE_EVENT) {
+        shared_ptr<SaceEventParams> params = make_shared<SaceEventParams>();
+        cmd.command_params = params;
+
+        if (!get_params(in, *params))
+            return false;
+        if (mask & CMD_EVENT_PARAMS) {
+            if (!in.get_u8(boot) || !in.get_strs(params->property_key) || !in.get_strs(params->property_value)
+                    || params->property_key.size() != params->property_value.size())
+                return false;
+            params->boot = boot;
+        }
+
+        return true;
+    }
+
+    cmd.command_params = make_shared<SaceCommandParams>();
+    return get_params(in, *cmd.command_params);
+}
+
+void SaceCodec::put_result (Writer &out, const SaceResult &rslt) {
+    uint32_t mask = 0;
+
+    if (!rslt.name.empty())
+        mask |= RSLT_NAME;
+    if (!rslt.resultExtra.empty())
+        mask |= RSLT_EXTRA;
+
+    out.put_varint(rslt.sequence);
+    out.put_u8(rslt.resultType);
+    out.put_u8(rslt.resultStatus);
+    out.put_varint(mask);
+
+    if (mask & RSLT_NAME)
+        out.put_str(rslt.name);
+    if (mask & RSLT_EXTRA)
+        out.put_payload(rslt.resultExtra);
+}
+
+bool SaceCodec::get_result (Reader &in, SaceResult &rslt) {
+    uint8_t type, status;
+    uint32_t mask;
+
+    if (!in.get_varint(rslt.sequence) || !in.get_u8(type) || !in.get_u8(status) || !in.get_varint(mask))
+        return false;
+
+    rslt.resultType   = static_cast<enum SaceResultType>(type);
+    rslt.resultStatus = static_cast<enum SaceResultStatus>(status);
+    rslt.name.clear();
+    rslt.resultExtra.clear();
+    /* fds only travel as SCM_RIGHTS */
+    rslt.resultFd = -1;
+
+    if ((mask & RSLT_NAME) && !in.get_str(rslt.name))
+        return false;
+    if ((mask & RSLT_EXTRA) && !in.get_payload(rslt.resultExtra))
+        return false;
+
+    return true;
+}
+
+void SaceCodec::encode (const SaceCommand &cmd, string &out) {
+    Writer writer(out);
+    begin(writer, KIND_COMMAND);
+    put_command(writer, cmd);
+    writer.finish();
+}
+
+void SaceCodec::encode (const SaceBatchCommand &batch, string &out) {
+    Writer writer(out);
+    begin(writer, KIND_BATCH);
+
+    writer.put_varint(batch.sequence);
+    writer.put_varint(batch.commands.size());
+    for (auto &cmd : batch.commands)
+        put_command(writer, cmd);
+
+    writer.finish();
+}
+
+void SaceCodec::encode (const SaceResult &rslt, string &out) {
+    Writer writer(out);
+    begin(writer, KIND_RESULT);
+    put_result(writer, rslt);
+    writer.finish();
+}
+
+void SaceCodec::encode (const SaceBatchResult &batchRslt, string &out) {
+    Writer writer(out);
+    begin(writer, KIND_BATCH_RESULT);
+
+    writer.put_varint(batchRslt.sequence);
+    writer.put_varint(batchRslt.results.size());
+    for (auto &rslt : batchRslt.results)
+        put_result(writer, rslt);
+
+    writer.finish();
+}
+
+void SaceCodec::encode (const SaceStatusResponse &response, string &out) {
+    Writer writer(out);
+    begin(writer, KIND_RESPONSE);
+
+    uint32_t mask = 0;
+    if (!response.name.empty())
+        mask |= RSLT_NAME;
+    if (!response.extra.empty())
+        mask |= RSLT_EXTRA;
+
+    writer.put_varint(response.label);
+    writer.put_u8(response.type);
+    writer.put_u8(response.status);
+    writer.put_varint(mask);
+
+    if (mask & RSLT_NAME)
+        writer.put_str(response.name);
+    if (mask & RSLT_EXTRA)
+        writer.put_payload(response.extra);
+
+    writer.finish();
+}
+
+bool SaceCodec::decode (const uint8_t *frame, size_t len, SaceCommand &cmd) {
+    Reader in;
+    return open(frame, len, KIND_COMMAND, in) && get_command(in, cmd) && in.done();
+}
+
+bool SaceCodec::decode (const uint8_t *frame, size_t len, SaceBatchCommand &batch) {
+    Reader in;
+    uint32_t count;
+
+    if (!open(frame, len, KIND_BATCH, in) || !in.get_varint(batch.sequence) || !in.get_varint(count)
+            || count > SACE_BATCH_MAX_ITEMS)
+        return false;
+
+    batch.commands.resize(count);
+    for (auto &cmd : batch.commands) {
+        if (!get_command(in, cmd))
+            return false;
+    }
+
+    return in.done();
+}
+
+bool SaceCodec::decode (const uint8_t *frame, size_t len, uint64_t &sequence, vector<sp<SaceCommand>> &commands) {
+    Reader in;
+    uint32_t count;
+
+    if (!open(frame, len, KIND_BATCH, in) || !in.get_varint(sequence) || !in.get_varint(count)
+            || count > SACE_BATCH_MAX_ITEMS)
+        return false;
+
+    commands.clear();
+    commands.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        sp<SaceCommand> cmd = new SaceCommand();
+        if (!get_command(in, *cmd))
+            return false;
+        commands.push_back(cmd);
+    }
+
+    return in.done();
+}
+
+bool SaceCodec::decode (const uint8_t *frame, size_t len, SaceResult &rslt) {
+    Reader in;
+    return open(frame, len, KIND_RESULT, in) && get_result(in, rslt) && in.done();
+}
+
+bool SaceCodec::decode (const uint8_t *frame, size_t len, SaceBatchResult &batchRslt) {
+    Reader in;
+    uint32_t count;
+
+    if (!open(frame, len, KIND_BATCH_RESULT, in) || !in.get_varint(batchRslt.sequence) || !in.get_varint(count)
+            || count > SACE_BATCH_MAX_ITEMS)
+        return false;
+
+    batchRslt.results.resize(count);
+    for (auto &rslt : batchRslt.results) {
+        if (!get_result(in, rslt))
+            return false;
+    }
+
+    return in.done();
+}
+
+bool SaceCodec::decode (const uint8_t *frame, size_t len, SaceStatusResponse &response) {
+    Reader in;
+    uint8_t type, status;
+    uint32_t mask;
+
+    if (!open(frame, len, KIND_RESPONSE, in) || !in.get_varint(response.label) || !in.get_u8(type)
+            || !in.get_u8(status) || !in.get_varint(mask))
+        return false;
+
+    response.type   = static_cast<enum SaceResponseType>(type);
+    response.status = static_cast<enum SaceResponseStatus>(status);
+    response.name.clear();
+    response.extra.clear();
+
+    if ((mask & RSLT_NAME) && !in.get_str(response.name))
+        return false;
+    if ((mask & RSLT_EXTRA) && !in.get_payload(response.extra))
+        return false;
+
+    return in.done();
+}
+
+}; //namespace android
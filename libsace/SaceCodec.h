@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_CODEC_H
+#define _SACE_CODEC_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utils/RefBase.h>
+
+#include "SaceTypes.h"
+
+using namespace std;
+
+/* encodings of a connection, negotiated by SACE_TYPE_HELLO */
+#define SACE_CODEC_PARCEL   0
+#define SACE_CODEC_COMPACT  1
+
+namespace android {
+
+/* Compact wire codec.
+ * Frame: uint32 len | MAGIC | VERSION | kind | body. Integers are varints,
+ * strings raw UTF-8 with varint length, absent fields are left out behind a
+ * presence mask. MAGIC sits where a Parcel frame keeps its small type value,
+ * so every frame tells its own encoding and both can share a connection.
+ */
+class SaceCodec {
+public:
+    enum Kind {
+        KIND_COMMAND = 1,
+        KIND_BATCH,
+        KIND_RESULT,
+        KIND_BATCH_RESULT,
+        KIND_RESPONSE,
+    };
+
+    static const uint8_t MAGIC;
+    static const uint8_t VERSION;
+
+    static bool isCompact (const uint8_t *frame, size_t len);
+    /* Kind of a compact frame, -1 if not one */
+    static int kind (const uint8_t *frame, size_t len);
+
+    static void encode (const SaceCommand &cmd, string &out);
+    static void encode (const SaceBatchCommand &batch, string &out);
+    static void encode (const SaceResult &rslt, string &out);
+    static void encode (const SaceBatchResult &batchRslt, string &out);
+    static void encode (const SaceStatusResponse &response, string &out);
+
+    /* false on truncated or malformed input */
+    static bool decode (const uint8_t *frame, size_t len, SaceCommand &cmd);
+    static bool decode (const uint8_t *frame, size_t len, SaceBatchCommand &batch);
+    /* items straight into the commands handed on, no SaceBatchCommand in between */
+    static bool decode (const uint8_t *frame, size_t len, uint64_t &sequence, vector<sp<SaceCommand>> &commands);
+    static bool decode (const uint8_t *frame, size_t len, SaceResult &rslt);
+    static bool decode (const uint8_t *frame, size_t len, SaceBatchResult &batchRslt);
+    static bool decode (const uint8_t *frame, size_t len, SaceStatusResponse &response);
+
+private:
+    static const size_t HEADER_SIZE;
+
+    class Writer;
+    class Reader;
+
+    static void begin (Writer &out, enum Kind kind);
+    static bool open (const uint8_t *frame, size_t len, enum Kind kind, Reader &in);
+
+    static void put_command (Writer &out, const SaceCommand &cmd);
+    static bool get_command (Reader &in, SaceCommand &cmd);
+    static void put_params (Writer &out, const SaceCommandParams &params);
+    static bool get_params (Reader &in, SaceCommandParams &params);
+    static void put_result (Writer &out, const SaceResult &rslt);
+    static bool get_result (Reader &in, SaceResult &rslt);
+};
+
+}; //namespace android
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "SaceFrame.h"
+
+namespace android {
+
+const size_t SaceFrameBuffer::DEFAULT_MAX_FRAME = 64 * 1024;
+
+SaceFrameBuffer::SaceFrameBuffer (size_t max_frame) {
+    mStart = 0;
+    mEnd   = 0;
+    mMaxFrame  = max_frame;
+    mCorrupted = false;
+}
+
+uint8_t* SaceFrameBuffer::reserve (size_t len) {
+    /* move the partial frame to front before growing */
+    if (mStart > 0) {
+        memmove(mData.data(), mData.data() + mStart, mEnd - mStart);
+        mEnd  -= mStart;
+        mStart = 0;
+    }
+
+    if (mData.size() < mEnd + len)
+        mData.resize(mEnd + len);
+
+    return mData.data() + mEnd;
+}
+
+void SaceFrameBuffer::commit (size_t len) {
+    mEnd += len;
+}
+
+void SaceFrameBuffer::append (const void *data, size_t len) {
+    memcpy(reserve(len), data, len);
+    commit(len);
+}
+
+ssize_t SaceFrameBuffer::peek (const uint8_t *data, size_t len, size_t max_frame) {
+    uint32_t frame_len;
+
+    if (len < sizeof(frame_len))
+        return 0;
+
+    memcpy(&frame_len, data, sizeof(frame_len));
+    if (frame_len < sizeof(frame_len) || frame_len > max_frame)
+        return -1;
+
+    return len < frame_len ? 0 : frame_len;
+}
+
+bool SaceFrameBuffer::next (const uint8_t **frame, size_t *len) {
+    if (mCorrupted)
+        return false;
+
+    ssize_t frame_len = peek(mData.data() + mStart, mEnd - mStart, mMaxFrame);
+    if (frame_len < 0) {
+        mCorrupted = true;
+        return false;
+    }
+
+    if (frame_len == 0)
+        return false;
+
+    *frame = mData.data() + mStart;
+    *len   = frame_len;
+    mStart += frame_len;
+
+    if (mStart == mEnd)
+        mStart = mEnd = 0;
+
+    return true;
+}
+
+void SaceFrameBuffer::clear () {
+    mStart = 0;
+    mEnd   = 0;
+    mCorrupted = false;
+}
+
+void SaceFrameBuffer::release () {
+    clear();
+    vector<uint8_t>().swap(mData);
+}
+
+}; //namespace android
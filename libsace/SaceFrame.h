@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_FRAME_H
+#define _SACE_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <vector>
+
+using namespace std;
+
+namespace android {
+
+/* Reassembly of a byte stream into frames.
+ * Every parcel on the sockets starts with its total length as uint32
+ * (SaceCommandHeader::len / SaceResultHeader::len), which is the frame
+ * boundary. A length below the prefix or above max frame corrupts the
+ * stream, the connection should be dropped then.
+ */
+class SaceFrameBuffer {
+public:
+    static const size_t DEFAULT_MAX_FRAME;
+
+    explicit SaceFrameBuffer (size_t max_frame = DEFAULT_MAX_FRAME);
+
+    /* writable space for at least len bytes, then commit what was received */
+    uint8_t* reserve (size_t len);
+    void commit (size_t len);
+    void append (const void *data, size_t len);
+
+    /* next complete frame, valid until next reserve/append */
+    bool next (const uint8_t **frame, size_t *len);
+
+    /* length of the complete frame at data, 0 if more bytes are needed,
+     * -1 if the length prefix is invalid. Lets a caller walk frames in a
+     * buffer of its own and keep only the incomplete tail here.
+     */
+    static ssize_t peek (const uint8_t *data, size_t len, size_t max_frame = DEFAULT_MAX_FRAME);
+
+    bool corrupted () const {
+        return mCorrupted;
+    }
+
+    size_t pending () const {
+        return mEnd - mStart;
+    }
+
+    void clear ();
+    /* clear and give the storage back, for idle connections */
+    void release ();
+
+private:
+    vector<uint8_t> mData;
+    size_t mStart;
+    size_t mEnd;
+    size_t mMaxFrame;
+    bool mCorrupted;
+};
+
+}; //namespace android
+
+#endif
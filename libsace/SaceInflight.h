@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_INFLIGHT_H
+#define _SACE_INFLIGHT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+namespace android {
+
+/* Requests waiting for their result, keyed by 64 bit sequence.
+ * Open addressing with linear probing in one power of two array, so
+ * completion is one hash and a short scan without a node allocation.
+ * Erase shifts the following entries back instead of leaving tombstones.
+ * Sequence 0 marks a free slot, SaceCommandHeader never generates it.
+ * Not synchronized, the owner holds its own lock.
+ */
+template<typename V> class SaceInflightTable {
+public:
+    static const size_t MIN_CAPACITY = 16;
+
+    explicit SaceInflightTable (size_t capacity = MIN_CAPACITY):mSize(0) {
+        size_t cap = MIN_CAPACITY;
+        while (cap < capacity)
+            cap <<= 1;
+        mSlots.resize(cap);
+    }
+
+    size_t size () const {
+        return mSize;
+    }
+
+    bool empty () const {
+        return mSize == 0;
+    }
+
+    /* false if sequence is in flight already */
+    bool insert (uint64_t sequence, const V &value) {
+        if (sequence == 0)
+            return false;
+
+        /* load factor stays at or below 1/2 */
+        if ((mSize + 1) * 2 > mSlots.size())
+            rehash(mSlots.size() * 2);
+
+        size_t index = probe(sequence);
+        if (mSlots[index].sequence == sequence)
+            return false;
+
+        mSlots[index].sequence = sequence;
+        mSlots[index].value    = value;
+        mSize++;
+        return true;
+    }
+
+    V* find (uint64_t sequence) {
+        if (sequence == 0)
+            return nullptr;
+
+        size_t index = probe(sequence);
+        return mSlots[index].sequence == sequence ? &mSlots[index].value : nullptr;
+    }
+
+    bool erase (uint64_t sequence) {
+        if (sequence == 0)
+            return false;
+
+        size_t index = probe(sequence);
+        if (mSlots[index].sequence != sequence)
+            return false;
+
+        erase_at(index);
+        return true;
+    }
+
+    /* erase entries pred(sequence, value) returns true for.
+     * A kept entry may be shifted past the cursor and seen twice.
+     */
+    template<typename P> void erase_if (P pred) {
+        for (size_t i = 0; i < mSlots.size(); i++) {
+            while (mSlots[i].sequence != 0 && pred(mSlots[i].sequence, mSlots[i].value))
+                erase_at(i);
+        }
+    }
+
+    template<typename F> void for_each (F func) {
+        for (auto &slot : mSlots) {
+            if (slot.sequence != 0)
+                func(slot.sequence, slot.value);
+        }
+    }
+
+    void clear () {
+        for (auto &slot : mSlots)
+            slot = Slot();
+        mSize = 0;
+    }
+
+private:
+    struct Slot {
+        uint64_t sequence;
+        V value;
+
+        Slot ():sequence(0),value() {}
+    };
+
+    vector<Slot> mSlots;
+    size_t mSize;
+
+    /* sequences are mostly consecutive, spread them over the whole array */
+    size_t home (uint64_t sequence) const {
+        return (sequence * 0x9e3779b97f4a7c15ull) >> 32 & (mSlots.size() - 1);
+    }
+
+    /* slot holding sequence, or the free slot ending its probe */
+    size_t probe (uint64_t sequence) const {
+        size_t mask  = mSlots.size() - 1;
+        size_t index = home(sequence);
+
+        while (mSlots[index].sequence != 0 && mSlots[index].sequence != sequence)
+            index = (index + 1) & mask;
+        return index;
+    }
+
+    void erase_at (size_t index) {
+        size_t mask = mSlots.size() - 1;
+        size_t hole = index;
+
+        /* move back every following entry whose probe passes the hole */
+        for (size_t next = (hole + 1) & mask; mSlots[next].sequence != 0; next = (next + 1) & mask) {
+            size_t want = home(mSlots[next].sequence);
+            if (((next - want) & mask) >= ((next - hole) & mask)) {
+                mSlots[hole] = std::move(mSlots[next]);
+                hole = next;
+            }
+        }
+
+        mSlots[hole] = Slot();
+        mSize--;
+    }
+
+    void rehash (size_t capacity) {
+        vector<Slot> old(capacity);
+        old.swap(mSlots);
+
+        mSize = 0;
+        for (auto &slot : old) {
+            if (slot.sequence == 0)
+                continue;
+
+            size_t index = probe(slot.sequence);
+            mSlots[index] = std::move(slot);
+            mSize++;
+        }
+    }
+};
+
+}; //namespace android
+
+#endif
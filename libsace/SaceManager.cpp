@@ -15,26 +15,42 @@
  */
 
 #include <sys/socket.h>
+#include <time.h>
 #include <utils/Mutex.h>
+#include <cutils/properties.h>
 
 #include "sace/SaceManager.h"
 #include <sace/SaceServiceInfo.h>
 
 #define SACE_SENDER SACE_SENDER_SOCKEET
+#define SEQPACKET_PROPERTY "persist.sace.seqpacket"
+#define RING_PROPERTY      "persist.sace.ring"
 
 namespace android {
 
+/* saced serves all, persist.sace.seqpacket=1 keeps frame boundaries in the kernel,
+ * persist.sace.ring=1 moves commands and results into shared memory */
+static sp<SaceSender> createSocketSender () {
+    if (property_get_bool(RING_PROPERTY, false))
+        return new SaceRingSender("sace_ring");
+    if (property_get_bool(SEQPACKET_PROPERTY, false))
+        return new SaceSocketSender("sace_seqpacket", SOCK_SEQPACKET);
+
+    return new SaceSocketSender("sace_socket", SOCK_STREAM);
+}
+
 static sp<SaceSender> createSaceSender () {
 #if   SACE_SENDER == SACE_SENDER_SOCKEET
-    return new SaceSocketSender("sace_socket", SOCK_STREAM);
+    return createSocketSender();
 #elif SACE_SENDER == SACE_SENDER_BINDER
     return new SaceBinderSender();
 #else
-    return new SaceSocketSender("sace_socket", SOCK_STREAM);
+    return createSocketSender();
 #endif
 }
 
 SaceManager* SaceManager::mInstance = nullptr;
+const int SaceManager::PAGE_RETRY_INTERVAL = 5; //s
 
 SaceManager::SaceManager () {
     /* Command Params */
@@ -55,6 +71,9 @@ SaceManager::SaceManager () {
     event_param->set_gid(DEF_SERVICE_GID);
     event_param->set_seclabel(DEF_SERVICE_SEC);
 
+    mPageMapped = false;
+    mPageRetry  = 0;
+
     mSender = createSaceSender();
     mSender->setCallback(this);
 }
@@ -64,159 +83,428 @@ SaceManager::~SaceManager () {
 }
 
 SaceManager* SaceManager::getInstance () {
-    Mutex mutex;
-    if (mInstance == nullptr) {
-        mutex.lock();
-        if (mInstance == nullptr)
-            mInstance = new SaceManager();
-        mutex.unlock();
-    }
+    static Mutex mutex;
+
+    AutoMutex _lock(mutex);
+    if (mInstance == nullptr)
+        mInstance = new SaceManager();
 
     return mInstance;
 }
 
-sp<SaceCommandObj> SaceManager::runCommand (const char* cmd, shared_ptr<SaceCommandParams> param, bool in) {
-    sp<SaceCommandObj> cmdObj = new SaceCommandObj(ERR_UNKNOWN);
+// ---- requests and results {
+SaceCommand SaceManager::run_request (const char* cmd, shared_ptr<SaceCommandParams> param, bool in) {
+    SaceCommand request;
+    request.type = SACE_TYPE_NORMAL;
+    request.normalCmdType = SACE_NORMAL_CMD_START;
+    request.command.assign(cmd);
+    request.flags = in? SACE_CMD_FLAG_IN : SACE_CMD_FLAG_OUT;
+
+    if (!param)
+        request.command_params = cmd_param;
+    else
+        request.command_params = param;
+
+    return request;
+}
 
-    mCmd.init();
-    mCmd.type = SACE_TYPE_NORMAL;
-    mCmd.normalCmdType = SACE_NORMAL_CMD_START;
-    mCmd.command.assign(cmd);
-    mCmd.flags = in? SACE_CMD_FLAG_IN : SACE_CMD_FLAG_OUT;
+SaceCommand SaceManager::query_request (const char* name, bool event) {
+    SaceCommand request;
+    if (event) {
+        request.type = SACE_TYPE_EVENT;
+        request.eventType  = SACE_EVENT_TYPE_INFO;
+        request.eventFlags = SACE_EVENT_FLAG_NONE;
+    }
+    else {
+        request.type = SACE_TYPE_SERVICE;
+        request.serviceCmdType = SACE_SERVICE_CMD_INFO;
+        request.serviceFlags   = SACE_SERVICE_FLAG_NORMAL;
+    }
+    request.command.assign(SaceServiceInfo::SERVICE_GET_BY_NAME);
+    request.name.assign(name);
+
+    return request;
+}
+
+SaceCommand SaceManager::start_request (const char* name, const char* cmd, shared_ptr<SaceCommandParams> param) {
+    SaceCommand request;
+    request.type = SACE_TYPE_SERVICE;
+    request.serviceCmdType = SACE_SERVICE_CMD_START;
+    request.serviceFlags   = SACE_SERVICE_FLAG_NORMAL;
+    request.name.assign(name);
+    request.command.assign(cmd);
+
+    if (!param)
+        request.command_params = service_param;
+    else
+        request.command_params = param;
+
+    return request;
+}
+
+SaceCommand SaceManager::add_event_request (const char* name, const char* cmd, shared_ptr<SaceEventParams> param) {
+    SaceCommand request;
+    request.type = SACE_TYPE_EVENT;
+    request.eventType  = SACE_EVENT_TYPE_ADD;
+    request.eventFlags = SACE_EVENT_FLAG_NONE;
+    request.command.assign(cmd);
+    request.name.assign(name);
 
     if (!param)
-        mCmd.command_params = cmd_param;
+        request.command_params = static_pointer_cast<SaceCommandParams>(event_param);
+    else
+        request.command_params = static_pointer_cast<SaceCommandParams>(param);
 
-    mRlt = mSender->excuteCommand(mCmd);
-    if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
-        if (mRlt.resultType == SACE_RESULT_TYPE_FD) {
-            uint64_t label;
-            memcpy(&label, mRlt.resultExtra, mRlt.resultExtraLen);
-            cmdObj = new SaceCommandObj(mSender, label, cmd, mRlt.resultFd, in);
+    return request;
+}
+
+SaceCommand SaceManager::delete_event_request (const char* name, bool stop) {
+    SaceCommand request;
+    request.type = SACE_TYPE_EVENT;
+    request.eventType = SACE_EVENT_TYPE_DEL;
+    request.name.assign(name);
+
+    request.extra.put(stop);
+
+    return request;
+}
+
+sp<SaceCommandObj> SaceManager::command_result (const string &cmd, bool in, const SaceResult &rlt) {
+    sp<SaceCommandObj> cmdObj = new SaceCommandObj(ERR_UNKNOWN);
+
+    if (rlt.resultStatus == SACE_RESULT_STATUS_OK) {
+        if (rlt.resultType == SACE_RESULT_TYPE_FD) {
+            uint64_t label = 0;
+            rlt.resultExtra.get(label);
+            cmdObj = new SaceCommandObj(mSender, label, cmd.c_str(), rlt.resultFd, in);
 
             AutoMutex _lock(mMutex);
             mCommands.insert(pair<uint64_t, sp<SaceCommandObj>>(label, cmdObj));
         }
         else
-            SACE_LOGW("finish runCommand with invalid fd %s", mCmd.to_string().c_str());
+            SACE_LOGW("finish runCommand with invalid fd %s", cmd.c_str());
     }
     else
-        SACE_LOGE("error runCommand %s", mCmd.to_string().c_str());
+        SACE_LOGE("error runCommand %s %s", cmd.c_str(), rlt.to_string().c_str());
 
     return cmdObj;
 }
 
-sp<SaceServiceObj> SaceManager::queryService (const char* name) {
-    mCmd.init();
-    mCmd.type = SACE_TYPE_SERVICE;
-    mCmd.serviceCmdType = SACE_SERVICE_CMD_INFO;
-    mCmd.serviceFlags   = SACE_SERVICE_FLAG_NORMAL;
-    mCmd.command.assign(SaceServiceInfo::SERVICE_GET_BY_NAME);
-    mCmd.name.assign(name);
-
-    /* query normal service */
-    mRlt = mSender->excuteCommand(mCmd);
-    if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
-        SaceServiceInfo::ServiceInfo info;
-        memcpy(&info, mRlt.resultExtra, mRlt.resultExtraLen);
-        return new SaceServiceObj(mSender, info.label, info.name, info.cmd);
+sp<SaceServiceObj> SaceManager::query_result (const SaceResult &rlt) {
+    if (rlt.resultStatus != SACE_RESULT_STATUS_OK)
+        return nullptr;
+
+    SaceServiceInfo::ServiceInfo info;
+    if (!info.readFrom(rlt.resultExtra)) {
+        SACE_LOGE("Invalid Service Info %s", rlt.to_string().c_str());
+        return nullptr;
     }
+    sp<SaceServiceObj> sve = new SaceServiceObj(mSender, info.label, info.name.c_str(), info.cmd.c_str());
 
-    return nullptr;
+    AutoMutex _lock(mMutex);
+    mServices.insert(pair<uint64_t, sp<SaceServiceObj>>(sve->label, sve));
+    return sve;
 }
 
-sp<SaceServiceObj> SaceManager::queryEventService (const char* name) {
-    mCmd.init();
-    mCmd.type = SACE_TYPE_EVENT;
-    mCmd.eventType  = SACE_EVENT_TYPE_INFO;
-    mCmd.eventFlags = SACE_EVENT_FLAG_NONE;
-    mCmd.command.assign(SaceServiceInfo::SERVICE_GET_BY_NAME);
-    mCmd.name.assign(name);
+sp<SaceServiceObj> SaceManager::start_result (const string &name, const string &cmd, const SaceResult &rlt) {
+    if (rlt.resultStatus == SACE_RESULT_STATUS_OK) {
+        if (rlt.resultType == SACE_RESULT_TYPE_LABEL) {
+            uint64_t label = 0;
+            rlt.resultExtra.get(label);
+            sp<SaceServiceObj> sve = new SaceServiceObj(mSender, label, name.c_str(), cmd.c_str());
 
-    mRlt = mSender->excuteCommand(mCmd);
-    if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
-        SaceServiceInfo::ServiceInfo info;
-        memcpy(&info, mRlt.resultExtra, mRlt.resultExtraLen);
-        return new SaceServiceObj(mSender, info.label, info.name, info.cmd);
+            AutoMutex _lock(mMutex);
+            mServices.insert(pair<uint64_t, sp<SaceServiceObj>>(label, sve));
+            return sve;
+        }
+        else
+            SACE_LOGE("Invalid Result Data %s", rlt.to_string().c_str());
     }
+    else
+        SACE_LOGE("error start service %s %s", name.c_str(), rlt.to_string().c_str());
 
-    return nullptr;
+    return new SaceServiceObj(ERR_UNKNOWN);
+} //}
+
+// ---- synchronous {
+sp<SaceCommandObj> SaceManager::runCommand (const char* cmd, shared_ptr<SaceCommandParams> param, bool in) {
+    return command_result(cmd, in, mSender->excuteCommand(run_request(cmd, param, in)));
 }
 
 sp<SaceServiceObj> SaceManager::checkService (const char *name, const char *cmd, shared_ptr<SaceCommandParams> param) {
     sp<SaceServiceObj> sve;
 
-    if ((sve = queryService(name)).get() || (sve = queryEventService(name)).get()) {
-        AutoMutex _lock(mMutex);
-        mServices.insert(pair<uint64_t, sp<SaceServiceObj>>(sve->label, sve));
+    /* normal service first, then event service */
+    if ((sve = query_result(mSender->excuteCommand(query_request(name, false)))).get()
+            || (sve = query_result(mSender->excuteCommand(query_request(name, true)))).get())
         return sve;
-    }
 
     if (!cmd)
         return new SaceServiceObj(ERR_NOT_EXISTS);
-    else
-        sve = new SaceServiceObj(ERR_UNKNOWN);
-
-    /* start service */
-    mCmd.init();
-    mCmd.type = SACE_TYPE_SERVICE;
-    mCmd.serviceCmdType = SACE_SERVICE_CMD_START;
-    mCmd.serviceFlags   = SACE_SERVICE_FLAG_NORMAL;
-    mCmd.name.assign(name);
-    mCmd.command.assign(cmd);
-    if (!param)
-        mCmd.command_params = service_param;
 
-    mRlt = mSender->excuteCommand(mCmd);
-    if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
-        if (mRlt.resultType == SACE_RESULT_TYPE_LABEL) {
-            uint64_t label;
-            memcpy(&label, mRlt.resultExtra, mRlt.resultExtraLen);
-            sve = new SaceServiceObj(mSender, label, name, cmd);
+    return start_result(name, cmd, mSender->excuteCommand(start_request(name, cmd, param)));
+}
 
-            AutoMutex _lock(mMutex);
-            mServices.insert(pair<uint64_t, sp<SaceServiceObj>>(label, sve));
-            return sve;
+int SaceManager::addEvent (const char* name, const char* cmd, shared_ptr<SaceEventParams> param) {
+    SaceResult rlt = mSender->excuteCommand(add_event_request(name, cmd, param));
+    return rlt.resultStatus == SACE_RESULT_STATUS_OK;
+}
+
+int SaceManager::deleteEvent (const char* name, bool stop) {
+    SaceResult rlt = mSender->excuteCommand(delete_event_request(name, stop));
+    return rlt.resultStatus == SACE_RESULT_STATUS_OK;
+}
+
+vector<sp<SaceCommandObj>> SaceManager::runCommands (const vector<string> &cmds, shared_ptr<SaceCommandParams> param, bool in) {
+    vector<sp<SaceCommandObj>> cmdObjs;
+
+    for (size_t begin = 0; begin < cmds.size(); begin += SACE_BATCH_MAX_ITEMS) {
+        size_t end = min(cmds.size(), begin + SACE_BATCH_MAX_ITEMS);
+
+        SaceBatchCommand batch;
+        for (size_t i = begin; i < end; i++)
+            batch.commands.push_back(run_request(cmds[i].c_str(), param, in));
+
+        SaceBatchResult batchRslt = mSender->excuteBatch(batch);
+        for (size_t i = begin; i < end; i++) {
+            SaceResult rslt;
+            rslt.resultStatus = SACE_RESULT_STATUS_FAIL;
+            if (i - begin < batchRslt.results.size())
+                rslt = batchRslt.results[i - begin];
+
+            cmdObjs.push_back(command_result(cmds[i], in, rslt));
         }
+    }
+
+    return cmdObjs;
+}
+
+vector<sp<SaceServiceObj>> SaceManager::startServices (const vector<pair<string, string>> &services, shared_ptr<SaceCommandParams> param) {
+    vector<sp<SaceServiceObj>> sves;
+
+    for (size_t begin = 0; begin < services.size(); begin += SACE_BATCH_MAX_ITEMS) {
+        size_t end = min(services.size(), begin + SACE_BATCH_MAX_ITEMS);
+
+        SaceBatchCommand batch;
+        for (size_t i = begin; i < end; i++)
+            batch.commands.push_back(start_request(services[i].first.c_str(), services[i].second.c_str(), param));
+
+        SaceBatchResult batchRslt = mSender->excuteBatch(batch);
+        for (size_t i = begin; i < end; i++) {
+            SaceResult rslt;
+            rslt.resultStatus = SACE_RESULT_STATUS_FAIL;
+            if (i - begin < batchRslt.results.size())
+                rslt = batchRslt.results[i - begin];
+
+            sves.push_back(start_result(services[i].first, services[i].second, rslt));
+        }
+    }
+
+    return sves;
+}
+
+int SaceManager::reloadEvents () {
+    SaceCommand request;
+    request.type = SACE_TYPE_EVENT;
+    request.eventType  = SACE_EVENT_TYPE_RELOAD;
+    request.eventFlags = SACE_EVENT_FLAG_NONE;
+
+    SaceResult rlt = mSender->excuteCommand(request);
+    return rlt.resultStatus == SACE_RESULT_STATUS_OK;
+} //}
+
+// ---- asynchronous {
+void SaceManager::runCommandAsync (const char* cmd, shared_ptr<SaceCommandParams> param, bool in, CommandCallback callback) {
+    string cmdLine(cmd);
+
+    mSender->excuteCommandAsync(run_request(cmd, param, in), [this, cmdLine, in, callback] (const SaceResult &rlt) {
+        callback(command_result(cmdLine, in, rlt));
+    });
+}
+
+future<sp<SaceCommandObj>> SaceManager::runCommandAsync (const char* cmd, shared_ptr<SaceCommandParams> param, bool in) {
+    auto done = make_shared<promise<sp<SaceCommandObj>>>();
+
+    runCommandAsync(cmd, param, in, [done] (sp<SaceCommandObj> cmdObj) {
+        done->set_value(cmdObj);
+    });
+    return done->get_future();
+}
+
+void SaceManager::checkServiceAsync (const char* name, const char* cmd, shared_ptr<SaceCommandParams> param, ServiceCallback callback) {
+    string sveName(name);
+    string cmdLine(cmd ? cmd : "");
+    bool start = cmd != nullptr;
+
+    /* same order as checkService, each step issued from the previous completion */
+    auto start_service = [this, sveName, cmdLine, param, callback] () {
+        mSender->excuteCommandAsync(start_request(sveName.c_str(), cmdLine.c_str(), param),
+                [this, sveName, cmdLine, callback] (const SaceResult &rlt) {
+            callback(start_result(sveName, cmdLine, rlt));
+        });
+    };
+
+    auto query_event = [this, sveName, start, start_service, callback] () {
+        mSender->excuteCommandAsync(query_request(sveName.c_str(), true),
+                [this, start, start_service, callback] (const SaceResult &rlt) {
+            sp<SaceServiceObj> sve = query_result(rlt);
+            if (sve.get())
+                callback(sve);
+            else if (start)
+                start_service();
+            else
+                callback(new SaceServiceObj(ERR_NOT_EXISTS));
+        });
+    };
+
+    mSender->excuteCommandAsync(query_request(name, false), [this, query_event, callback] (const SaceResult &rlt) {
+        sp<SaceServiceObj> sve = query_result(rlt);
+        if (sve.get())
+            callback(sve);
         else
-            SACE_LOGE("Invalid Result Data %s", mCmd.to_string().c_str());
+            query_event();
+    });
+}
+
+future<sp<SaceServiceObj>> SaceManager::checkServiceAsync (const char* name, const char* cmd, shared_ptr<SaceCommandParams> param) {
+    auto done = make_shared<promise<sp<SaceServiceObj>>>();
+
+    checkServiceAsync(name, cmd, param, [done] (sp<SaceServiceObj> sve) {
+        done->set_value(sve);
+    });
+    return done->get_future();
+}
+
+void SaceManager::addEventAsync (const char* name, const char* cmd, shared_ptr<SaceEventParams> param, EventCallback callback) {
+    mSender->excuteCommandAsync(add_event_request(name, cmd, param), [callback] (const SaceResult &rlt) {
+        callback(rlt.resultStatus == SACE_RESULT_STATUS_OK);
+    });
+}
+
+future<int> SaceManager::addEventAsync (const char* name, const char* cmd, shared_ptr<SaceEventParams> param) {
+    auto done = make_shared<promise<int>>();
+
+    addEventAsync(name, cmd, param, [done] (int ok) {
+        done->set_value(ok);
+    });
+    return done->get_future();
+}
+
+void SaceManager::deleteEventAsync (const char* name, bool stop, EventCallback callback) {
+    mSender->excuteCommandAsync(delete_event_request(name, stop), [callback] (const SaceResult &rlt) {
+        callback(rlt.resultStatus == SACE_RESULT_STATUS_OK);
+    });
+}
+
+future<int> SaceManager::deleteEventAsync (const char* name, bool stop) {
+    auto done = make_shared<promise<int>>();
+
+    deleteEventAsync(name, stop, [done] (int ok) {
+        done->set_value(ok);
+    });
+    return done->get_future();
+} //}
+
+// ---- status page {
+bool SaceManager::map_status_page () {
+    if (mPageMapped.load(memory_order_acquire))
+        return true;
+
+    AutoMutex _lock(mPageMutex);
+    if (mPageMapped)
+        return true;
+
+    /* a saced without page would cost one request per peek, ask again later */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (mPageRetry != 0 && now.tv_sec < mPageRetry)
+        return false;
+
+    SaceCommand request;
+    request.type = SACE_TYPE_SERVICE;
+    request.serviceCmdType = SACE_SERVICE_CMD_STATUS;
+
+    SaceResult rlt = mSender->excuteCommand(request);
+    if (rlt.resultStatus == SACE_RESULT_STATUS_OK && rlt.resultType == SACE_RESULT_TYPE_FD && rlt.resultFd >= 0
+            && mStatusPage.attach(rlt.resultFd)) {
+        mPageMapped = true;
+        return true;
     }
-    else
-        SACE_LOGE("error runCommand %s", mCmd.to_string().c_str());
 
-    return sve;
+    SACE_LOGW("no status page %s", rlt.to_string().c_str());
+    mPageRetry = now.tv_sec + PAGE_RETRY_INTERVAL;
+    return false;
 }
 
-int SaceManager::addEvent (const char* name, const char* cmd, shared_ptr<SaceEventParams> param) {
-    mCmd.init();
-    mCmd.type = SACE_TYPE_EVENT;
-    mCmd.eventType  = SACE_EVENT_TYPE_ADD;
-    mCmd.eventFlags = SACE_EVENT_FLAG_NONE;
-    mCmd.command.assign(cmd);
-    mCmd.name.assign(name);
+bool SaceManager::peekService (uint64_t label, SaceServiceInfo::ServiceStatus &status) {
+    return map_status_page() && mStatusPage.read(label, status);
+}
 
-    if (!param)
-        mCmd.command_params = static_pointer_cast<SaceCommandParams>(event_param);
-    else
-        mCmd.command_params = static_pointer_cast<SaceCommandParams>(param);
+bool SaceManager::peekService (const char* name, SaceServiceInfo::ServiceStatus &status) {
+    return map_status_page() && mStatusPage.find(name, status);
+} //}
 
-    mRlt = mSender->excuteCommand(mCmd);
-    return mRlt.resultStatus == SACE_RESULT_STATUS_OK;
+// ---- subscriptions {
+uint64_t SaceManager::subscribe (SaceCommand &&request, StateCallback callback) {
+    request.type = SACE_TYPE_SERVICE;
+    request.serviceCmdType = SACE_SERVICE_CMD_SUBSCRIBE;
+
+    /* the current states may arrive before the result, be ready for them */
+    uint64_t subscription = request.sequence;
+    {
+        AutoMutex _lock(mMutex);
+        mSubscriptions[subscription] = callback;
+    }
+
+    SaceResult rlt = mSender->excuteCommand(request);
+    if (rlt.resultStatus == SACE_RESULT_STATUS_OK)
+        return subscription;
+
+    SACE_LOGE("error subscribe %s %s", request.command.c_str(), rlt.to_string().c_str());
+    AutoMutex _lock(mMutex);
+    mSubscriptions.erase(subscription);
+    return 0;
 }
 
-int SaceManager::deleteEvent (const char* name, bool __unused stop) {
-    mCmd.init();
-    mCmd.type = SACE_TYPE_EVENT;
-    mCmd.eventType = SACE_EVENT_TYPE_DEL;
-    mCmd.name.assign(name);
+uint64_t SaceManager::subscribe (const char* name, StateCallback callback) {
+    SaceCommand request;
+    request.command.assign(SaceServiceInfo::SERVICE_GET_BY_NAME);
+    request.name.assign(name);
+
+    return subscribe(std::move(request), callback);
+}
 
-    memcpy(mCmd.extra, &stop, sizeof(bool));
-    mCmd.extraLen = sizeof(bool);
+uint64_t SaceManager::subscribe (uint64_t label, StateCallback callback) {
+    SaceCommand request;
+    request.command.assign(SaceServiceInfo::SERVICE_GET_BY_LABEL);
+    request.label = label;
 
-    mRlt = mSender->excuteCommand(mCmd);
-    return mRlt.resultStatus == SACE_RESULT_STATUS_OK;
+    return subscribe(std::move(request), callback);
 }
 
+uint64_t SaceManager::subscribeAll (StateCallback callback) {
+    SaceCommand request;
+    request.command.assign(SaceServiceInfo::SERVICE_GET_ALL);
+
+    return subscribe(std::move(request), callback);
+}
+
+bool SaceManager::unsubscribe (uint64_t subscription) {
+    {
+        AutoMutex _lock(mMutex);
+        if (mSubscriptions.erase(subscription) == 0)
+            return false;
+    }
+
+    SaceCommand request;
+    request.type = SACE_TYPE_SERVICE;
+    request.serviceCmdType = SACE_SERVICE_CMD_UNSUBSCRIBE;
+    request.label = subscription;
+
+    /* events already on the way find no callback and are dropped */
+    return mSender->excuteCommand(request).resultStatus == SACE_RESULT_STATUS_OK;
+} //}
+
 static enum ErrorCode status_to_error (SaceResponseStatus status) {
     switch (status) {
         case SACE_RESPONSE_STATUS_EXIT:
@@ -233,6 +521,28 @@ static enum ErrorCode status_to_error (SaceResponseStatus status) {
 void SaceManager::onResponse (const SaceStatusResponse &response) {
     uint64_t label = response.label;
 
+    if (response.type == SACE_RESPONSE_TYPE_STATE) {
+        SaceServiceInfo::StateEvent event;
+        if (!event.readFrom(response.extra)) {
+            SACE_LOGE("Invalid State Event %s", response.to_string().c_str());
+            return;
+        }
+
+        StateCallback callback;
+        {
+            AutoMutex _lock(mMutex);
+            auto it = mSubscriptions.find(event.subscription);
+            if (it != mSubscriptions.end())
+                callback = it->second;
+        }
+
+        /* unlocked, the callback may unsubscribe */
+        if (callback)
+            callback(event);
+        return;
+    }
+
+    AutoMutex _lock(mMutex);
     if (response.type == SACE_RESPONSE_TYPE_SERVICE) {
         auto it = mServices.find(label);
         if (it == mServices.end()) {
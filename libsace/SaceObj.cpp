@@ -18,6 +18,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sace/SaceObj.h>
+#include <sace/SaceManager.h>
 
 namespace android {
 
@@ -178,13 +179,21 @@ enum SaceServiceInfo::ServiceState SaceServiceObj::getState() throw(RemoteExcept
     mCmd.command.assign(SaceServiceInfo::SERVICE_GET_BY_LABEL);
 
     mRlt = excute(mCmd);
-    if (mRlt.resultStatus == SACE_RESULT_STATUS_OK) {
-        SaceServiceInfo::ServiceInfo info;
-        memcpy(&info, mRlt.resultExtra, mRlt.resultExtraLen);
+
+    SaceServiceInfo::ServiceInfo info;
+    if (mRlt.resultStatus == SACE_RESULT_STATUS_OK && info.readFrom(mRlt.resultExtra))
         return info.state;
-    }
     else
         return SaceServiceInfo::SERVICE_DIED_UNKNOWN;
 }
 
+enum SaceServiceInfo::ServiceState SaceServiceObj::peekState() throw(RemoteException,InvalidOperation) {
+    SaceServiceInfo::ServiceStatus status;
+
+    if (SaceManager::getInstance()->peekService(label, status))
+        return status.state;
+
+    return getState();
+}
+
 }; //namespace android
@@ -92,7 +92,7 @@ sp<CommandParams> SaceCommandParams::parseCommandParams () const {
 
     gid_t supp_gid;
     for (auto g : supp_gids) {
-        if (!decode_uid(g, &supp_gid)) cmdParams->supp_gids.push_back(supp_gid);
+        if (decode_uid(g, &supp_gid)) cmdParams->supp_gids.push_back(supp_gid);
     }
 
     int resource;
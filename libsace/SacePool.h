@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_POOL_H
+#define _SACE_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+
+using namespace std;
+
+namespace android {
+
+/* hits are served from the free list, misses went to the global heap */
+struct SacePoolStats {
+    size_t   pooled;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+/* Free list for objects created once per command.
+ * Deriving from SacePooled<T> gives T class operator new/delete that reuse
+ * freed blocks of sizeof(T), so a steady stream of commands stops hitting
+ * the allocator. Subclasses of other sizes and overflow past MAX_POOLED go
+ * to the global heap as before. Works with sp<>, RefBase deletes through
+ * the virtual destructor which picks this operator delete.
+ */
+template<typename T> class SacePooled {
+public:
+    static const size_t MAX_POOLED = 256;
+
+    static void* operator new (size_t size) {
+        if (size == sizeof(T)) {
+            pthread_mutex_lock(&sMutex);
+            Node *node = sFree;
+            if (node != nullptr) {
+                sFree = node->next;
+                sPooled--;
+                sHits++;
+            }
+            else
+                sMisses++;
+            pthread_mutex_unlock(&sMutex);
+
+            if (node != nullptr)
+                return node;
+        }
+
+        return ::operator new(size);
+    }
+
+    static void operator delete (void *ptr, size_t size) {
+        if (ptr == nullptr)
+            return;
+
+        if (size == sizeof(T)) {
+            bool kept = false;
+
+            pthread_mutex_lock(&sMutex);
+            if (sPooled < MAX_POOLED) {
+                Node *node = static_cast<Node*>(ptr);
+                node->next = sFree;
+                sFree = node;
+                sPooled++;
+                kept = true;
+            }
+            pthread_mutex_unlock(&sMutex);
+
+            if (kept)
+                return;
+        }
+
+        ::operator delete(ptr);
+    }
+
+    /* blocks waiting for reuse */
+    static size_t pooled () {
+        pthread_mutex_lock(&sMutex);
+        size_t count = sPooled;
+        pthread_mutex_unlock(&sMutex);
+        return count;
+    }
+
+    static SacePoolStats stats () {
+        SacePoolStats stats;
+
+        pthread_mutex_lock(&sMutex);
+        stats.pooled = sPooled;
+        stats.hits   = sHits;
+        stats.misses = sMisses;
+        pthread_mutex_unlock(&sMutex);
+        return stats;
+    }
+
+private:
+    struct Node {
+        Node *next;
+    };
+
+    /* no destructor, objects may still be freed during exit */
+    static pthread_mutex_t sMutex;
+    static Node  *sFree;
+    static size_t sPooled;
+    static uint64_t sHits;
+    static uint64_t sMisses;
+};
+
+template<typename T> pthread_mutex_t SacePooled<T>::sMutex = PTHREAD_MUTEX_INITIALIZER;
+template<typename T> typename SacePooled<T>::Node* SacePooled<T>::sFree = nullptr;
+template<typename T> size_t SacePooled<T>::sPooled = 0;
+template<typename T> uint64_t SacePooled<T>::sHits = 0;
+template<typename T> uint64_t SacePooled<T>::sMisses = 0;
+
+}; //namespace android
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+
+#include "SaceRing.h"
+#include "SaceLog.h"
+
+namespace android {
+
+const uint32_t SaceRing::PAD = 0xFFFFFFFF;
+
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t), "control words must be plain words in shared memory");
+
+static inline uint32_t entry_size (size_t len) {
+    return (sizeof(uint32_t) + len + 7) & ~7u;
+}
+
+SaceRing::SaceRing () {
+    mControl = nullptr;
+    mData  = nullptr;
+    mSize  = 0;
+    mHead  = mTail = mNext = 0;
+    mBroken = true;
+}
+
+void SaceRing::attach (Control *control, uint8_t *data, uint32_t size) {
+    mControl = control;
+    mData  = data;
+    mSize  = size;
+    mHead  = control->head.load(memory_order_acquire);
+    mTail  = control->tail.load(memory_order_acquire);
+    mNext  = mHead;
+    mBroken = (size & (size - 1)) != 0 || (uint32_t)(mTail - mHead) > size;
+}
+
+bool SaceRing::check (uint32_t head, uint32_t tail) {
+    if ((uint32_t)(tail - head) > mSize)
+        mBroken = true;
+
+    return !mBroken;
+}
+
+bool SaceRing::push (const void *frame, size_t len) {
+    if (mBroken || len > maxFrame())
+        return false;
+
+    uint32_t head = mControl->head.load(memory_order_acquire);
+    if (!check(head, mTail))
+        return false;
+
+    uint32_t need   = entry_size(len);
+    uint32_t offset = mTail & (mSize - 1);
+    uint32_t to_end = mSize - offset;
+    uint32_t total  = need <= to_end ? need : to_end + need;
+    if (total > mSize - (mTail - head))
+        return false;
+
+    /* entries are never split, skip what is left up to the end */
+    if (need > to_end) {
+        memcpy(mData + offset, &PAD, sizeof(PAD));
+        mTail += to_end;
+        offset = 0;
+    }
+
+    uint32_t len32 = len;
+    memcpy(mData + offset, &len32, sizeof(len32));
+    memcpy(mData + offset + sizeof(len32), frame, len);
+    mTail += need;
+
+    mControl->tail.store(mTail, memory_order_release);
+    return true;
+}
+
+bool SaceRing::wakeup () {
+    /* pairs with the fence in sleep(), one of us sees the other */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (mControl->sleeping.load(memory_order_relaxed) == 0)
+        return false;
+
+    return mControl->sleeping.exchange(0, memory_order_relaxed) != 0;
+}
+
+bool SaceRing::next (const uint8_t **frame, size_t *len) {
+    if (mBroken)
+        return false;
+
+    uint32_t tail = mControl->tail.load(memory_order_acquire);
+    if (!check(mHead, tail) || mHead == tail)
+        return false;
+
+    uint32_t offset = mHead & (mSize - 1);
+    uint32_t len32;
+    memcpy(&len32, mData + offset, sizeof(len32));
+
+    if (len32 == PAD) {
+        uint32_t to_end = mSize - offset;
+        if (tail - mHead <= to_end) {
+            mBroken = true;
+            return false;
+        }
+
+        mHead += to_end;
+        offset = 0;
+        memcpy(&len32, mData, sizeof(len32));
+    }
+
+    if (len32 > maxFrame() || entry_size(len32) > tail - mHead) {
+        mBroken = true;
+        return false;
+    }
+
+    *frame = mData + offset + sizeof(len32);
+    *len   = len32;
+    mNext  = mHead + entry_size(len32);
+    return true;
+}
+
+void SaceRing::pop () {
+    mHead = mNext;
+    mControl->head.store(mHead, memory_order_release);
+}
+
+bool SaceRing::drained () {
+    return mBroken || mControl->head.load(memory_order_acquire) == mTail;
+}
+
+bool SaceRing::empty () {
+    return mBroken || mControl->tail.load(memory_order_acquire) == mHead;
+}
+
+bool SaceRing::sleep () {
+    mControl->sleeping.store(1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!empty() || mBroken) {
+        awake();
+        return false;
+    }
+
+    return true;
+}
+
+void SaceRing::awake () {
+    mControl->sleeping.store(0, memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+const uint32_t SaceAdaptiveSpin::MIN_SPIN_US = 2;
+const uint32_t SaceAdaptiveSpin::MAX_SPIN_US = 100;
+
+SaceAdaptiveSpin::SaceAdaptiveSpin () {
+    mSpinUs = MAX_SPIN_US;
+}
+
+uint64_t SaceAdaptiveSpin::now_us () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+// ---------------------------------------------------------------------------
+const uint32_t SaceRingRegion::MAGIC     = 0x53524e47; // SRNG
+const uint32_t SaceRingRegion::VERSION   = 1;
+const uint32_t SaceRingRegion::RING_SIZE = 256 * 1024;
+
+SaceRingRegion::SaceRingRegion () {
+    mBase = nullptr;
+    mSize = 0;
+    mFd   = -1;
+}
+
+SaceRingRegion::~SaceRingRegion () {
+    detach();
+}
+
+/* the rings start on their own page */
+size_t SaceRingRegion::data_offset () {
+    return (sizeof(Header) + 4095) & ~(size_t)4095;
+}
+
+void SaceRingRegion::setup_rings () {
+    Header *header = (Header*)mBase;
+    uint8_t *data  = (uint8_t*)mBase + header->dataOffset;
+
+    mSubmissions.attach(&header->submissions, data, header->ringSize);
+    mCompletions.attach(&header->completions, data + header->ringSize, header->ringSize);
+}
+
+bool SaceRingRegion::create () {
+    size_t size = data_offset() + RING_SIZE * 2;
+    void *base;
+
+    /* bionic declares memfd_create from API 30 only */
+    int fd = syscall(__NR_memfd_create, "sace_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        SACE_LOGE("SaceRingRegion memfd_create errno=%d errstr=%s", errno, strerror(errno));
+        return false;
+    }
+
+    if (ftruncate(fd, size) < 0) {
+        SACE_LOGE("SaceRingRegion ftruncate errno=%d errstr=%s", errno, strerror(errno));
+        goto err;
+    }
+
+    /* the client writes its side, it must never shrink under our mapping */
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+        SACE_LOGE("SaceRingRegion seal size errno=%d errstr=%s", errno, strerror(errno));
+        goto err;
+    }
+
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        SACE_LOGE("SaceRingRegion mmap errno=%d errstr=%s", errno, strerror(errno));
+        goto err;
+    }
+
+    detach();
+    mBase = base;
+    mSize = size;
+    mFd   = fd;
+
+    /* a fresh memfd is zero, so are all indexes */
+    ((Header*)mBase)->magic      = MAGIC;
+    ((Header*)mBase)->version    = VERSION;
+    ((Header*)mBase)->ringSize   = RING_SIZE;
+    ((Header*)mBase)->dataOffset = data_offset();
+    setup_rings();
+    return true;
+
+err:
+    close(fd);
+    return false;
+}
+
+bool SaceRingRegion::attach (int fd) {
+    struct stat st;
+    void *base = MAP_FAILED;
+    Header *header;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < data_offset()) {
+        SACE_LOGE("SaceRingRegion invalid fd %d errno=%d errstr=%s", fd, errno, strerror(errno));
+        goto out;
+    }
+
+    base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        SACE_LOGE("SaceRingRegion mmap errno=%d errstr=%s", errno, strerror(errno));
+        goto out;
+    }
+
+    header = (Header*)base;
+    if (header->magic != MAGIC || header->version != VERSION || header->dataOffset != data_offset()
+            || header->ringSize == 0 || (header->ringSize & (header->ringSize - 1)) != 0
+            || (size_t)st.st_size < data_offset() + (size_t)header->ringSize * 2) {
+        SACE_LOGE("SaceRingRegion layout mismatch version=%u", header->version);
+        munmap(base, st.st_size);
+        base = MAP_FAILED;
+        goto out;
+    }
+
+    detach();
+    mBase = base;
+    mSize = st.st_size;
+    setup_rings();
+
+out:
+    close(fd);
+    return base != MAP_FAILED;
+}
+
+void SaceRingRegion::detach () {
+    if (mBase != nullptr)
+        munmap(mBase, mSize);
+    if (mFd >= 0)
+        close(mFd);
+
+    mBase = nullptr;
+    mSize = 0;
+    mFd   = -1;
+    mSubmissions = SaceRing();
+    mCompletions = SaceRing();
+}
+
+}; //namespace android
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_RING_H
+#define _SACE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+using namespace std;
+
+namespace android {
+
+/* One direction of the ring transport, single producer single consumer.
+ * The control words and the data live in shared memory, each side keeps
+ * its own copy of the index it owns. An entry is a whole frame: its length
+ * as uint32 then the frame, 8 byte aligned, never split at the end of the
+ * ring (a PAD length skips the rest). Nothing the other side wrote is
+ * trusted, an index or length out of range marks the ring broken.
+ *
+ * Wakeups follow io_uring's SQ_NEED_WAKEUP: a consumer about to block sets
+ * sleeping and looks again, a producer that finds it set after publishing
+ * kicks the consumer's eventfd.
+ */
+class SaceRing {
+public:
+    struct Control {
+        alignas(64) atomic<uint32_t> tail;
+        alignas(64) atomic<uint32_t> head;
+        alignas(64) atomic<uint32_t> sleeping;
+    };
+
+    SaceRing ();
+
+    /* size is a power of two, the indexes continue from control */
+    void attach (Control *control, uint8_t *data, uint32_t size);
+
+    /* producer, false if there is no room, frame is too big or broken */
+    bool push (const void *frame, size_t len);
+    /* producer after push, true once if the consumer sleeps */
+    bool wakeup ();
+    /* producer, true once the consumer popped every entry */
+    bool drained ();
+
+    /* consumer, the next entry stays valid until pop */
+    bool next (const uint8_t **frame, size_t *len);
+    void pop ();
+    bool empty ();
+    /* consumer before blocking, false if entries came in meanwhile */
+    bool sleep ();
+    void awake ();
+
+    bool broken () const {
+        return mBroken;
+    }
+
+    /* bigger frames go another way, a ring never fills with one */
+    size_t maxFrame () const {
+        return mSize / 4;
+    }
+
+private:
+    static const uint32_t PAD;
+
+    Control *mControl;
+    uint8_t *mData;
+    uint32_t mSize;
+    /* own index of each role, the shared one is only published */
+    uint32_t mHead;
+    uint32_t mTail;
+    uint32_t mNext;
+    bool mBroken;
+
+    bool check (uint32_t head, uint32_t tail);
+};
+
+/* Polling time before sleeping: doubles while polling finds work, halves
+ * while it does not, so a busy client never pays a wakeup and an idle one
+ * stops burning cpu. */
+class SaceAdaptiveSpin {
+public:
+    static const uint32_t MIN_SPIN_US;
+    static const uint32_t MAX_SPIN_US;
+
+    SaceAdaptiveSpin ();
+
+    /* polls until ready returns true or the budget is spent */
+    template<typename F> bool spin (F ready) {
+        uint64_t deadline = now_us() + mSpinUs;
+
+        do {
+            if (ready()) {
+                mSpinUs = mSpinUs * 2 > MAX_SPIN_US ? MAX_SPIN_US : mSpinUs * 2;
+                return true;
+            }
+        } while (now_us() < deadline);
+
+        mSpinUs = mSpinUs / 2 < MIN_SPIN_US ? MIN_SPIN_US : mSpinUs / 2;
+        return false;
+    }
+
+private:
+    uint32_t mSpinUs;
+
+    static uint64_t now_us ();
+};
+
+/* Both rings of one connection in one memfd.
+ * saced creates it per connection, sealed against resizing, and passes
+ * the fd with the two eventfds on the side channel socket. The client
+ * produces commands into the submission ring, saced results and responses
+ * without fds into the completion ring.
+ */
+class SaceRingRegion {
+public:
+    static const uint32_t MAGIC;
+    static const uint32_t VERSION;
+    static const uint32_t RING_SIZE;
+
+    SaceRingRegion ();
+    ~SaceRingRegion ();
+
+    /* saced */
+    bool create ();
+    /* client, maps fd and closes it */
+    bool attach (int fd);
+    void detach ();
+
+    /* -1 unless created here */
+    int fd () const {
+        return mFd;
+    }
+
+    SaceRing& submissions () {
+        return mSubmissions;
+    }
+
+    SaceRing& completions () {
+        return mCompletions;
+    }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t ringSize;
+        uint32_t dataOffset;
+        SaceRing::Control submissions;
+        SaceRing::Control completions;
+    };
+
+    void *mBase;
+    size_t mSize;
+    int mFd;
+    SaceRing mSubmissions;
+    SaceRing mCompletions;
+
+    static size_t data_offset ();
+    void setup_rings ();
+};
+
+}; //namespace android
+
+#endif
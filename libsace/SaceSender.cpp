@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/eventfd.h>
 #include <sys/select.h>
@@ -28,11 +30,32 @@
 
 namespace android {
 
+// -------------------------------------------------------------------------- {
+void SaceSender::excuteCommandAsync (const SaceCommand &cmd, ResultHandler handler) {
+    handler(excuteCommand(cmd));
+}
+
+SaceBatchResult SaceSender::excuteBatch (const SaceBatchCommand &batch) {
+    SaceBatchResult batchRslt;
+    batchRslt.sequence = batch.sequence;
+
+    for (auto &cmd : batch.commands)
+        batchRslt.results.push_back(excuteCommand(cmd));
+
+    return batchRslt;
+} //}
+
 // -------------------------------------------------------------------------- {
 const char *SaceBinderSender::NAME = "SSBinder";
 
 bool SaceBinderSender::init () {
-    sp<IBinder> binder = defaultServiceManager()->getService(String16("SaceService"));
+    sp<IBinder> binder = service;
+    if (binder == nullptr)
+        binder = defaultServiceManager()->getService(String16("SaceService"));
+    if (binder == nullptr) {
+        SACE_LOGE("%s SaceService not found", NAME);
+        return false;
+    }
 
     manager = new BpSaceManager(binder);
     if ((listener = new SaceListenerService(this)) == nullptr) {
@@ -40,6 +63,10 @@ bool SaceBinderSender::init () {
         return false;
     }
 
+    death = new ManagerDeath(this);
+    if (binder->linkToDeath(death) != NO_ERROR)
+        SACE_LOGW("%s linkToDeath failed", NAME);
+
     ProcessState::self()->startThreadPool();
     /* register callback */
     manager->registerListener(listener);
@@ -47,18 +74,101 @@ bool SaceBinderSender::init () {
 }
 
 SaceResult SaceBinderSender::excuteCommand (const SaceCommand &cmd) {
-    mRlt.resultType   = SACE_RESULT_TYPE_NONE;
-    mRlt.resultStatus = SACE_RESULT_STATUS_FAIL;
-
-    if (manager == nullptr && !init())
-        return mRlt;
+    if (manager == nullptr && !init()) {
+        SaceResult rlt;
+        rlt.resultType   = SACE_RESULT_TYPE_NONE;
+        rlt.resultStatus = SACE_RESULT_STATUS_FAIL;
+        return rlt;
+    }
     else
         return manager->sendCommand(cmd);
+}
+
+void SaceBinderSender::excuteCommandAsync (const SaceCommand &cmd, ResultHandler handler) {
+    SaceResult result;
+    result.sequence     = cmd.sequence;
+    result.resultType   = SACE_RESULT_TYPE_NONE;
+    result.resultStatus = SACE_RESULT_STATUS_FAIL;
+
+    if (manager == nullptr && !init()) {
+        handler(result);
+        return;
+    }
+
+    if (!manager->asyncSupported()) {
+        SaceSender::excuteCommandAsync(cmd, handler);
+        return;
+    }
+
+    pthread_mutex_lock(&asyncMutex);
+    bool added = mAsyncInflight.insert(cmd.sequence, handler);
+    pthread_mutex_unlock(&asyncMutex);
+
+    if (!added) {
+        SACE_LOGE("%s sequence in flight already %s", NAME, cmd.to_string().c_str());
+        handler(result);
+        return;
+    }
+
+    status_t status = manager->sendCommandAsync(cmd, listener);
+    /* onResult may have come first on another binder thread */
+    if (status != NO_ERROR && take_async(cmd.sequence, handler)) {
+        SACE_LOGE("%s sendCommandAsync status=%d", NAME, status);
+        handler(result);
+    }
+}
+
+bool SaceBinderSender::take_async (uint64_t sequence, ResultHandler &handler) {
+    pthread_mutex_lock(&asyncMutex);
+    ResultHandler *found = mAsyncInflight.find(sequence);
+    if (found != nullptr) {
+        handler = std::move(*found);
+        mAsyncInflight.erase(sequence);
+    }
+    pthread_mutex_unlock(&asyncMutex);
+
+    return found != nullptr;
+}
+
+void SaceBinderSender::handleAsyncResult (const SaceResult &result) {
+    ResultHandler handler;
+
+    if (!take_async(result.sequence, handler)) {
+        SACE_LOGW("%s drop result not in flight : %s", NAME, result.to_string().c_str());
+        if (result.resultType == SACE_RESULT_TYPE_FD && result.resultFd >= 0)
+            close(result.resultFd);
+        return;
+    }
+
+    handler(result);
+}
+
+void SaceBinderSender::fail_async () {
+    vector<pair<uint64_t, ResultHandler>> failed;
+
+    pthread_mutex_lock(&asyncMutex);
+    mAsyncInflight.for_each([&failed] (uint64_t sequence, ResultHandler &handler) {
+        failed.emplace_back(sequence, std::move(handler));
+    });
+    mAsyncInflight.clear();
+    pthread_mutex_unlock(&asyncMutex);
+
+    for (auto &entry : failed) {
+        SaceResult result;
+        result.sequence     = entry.first;
+        result.resultType   = SACE_RESULT_TYPE_NONE;
+        result.resultStatus = SACE_RESULT_STATUS_FAIL;
+        entry.second(result);
+    }
 } //}
 
 // ---------------------------------------------------------------------------- {
 const int SaceSocketSender::SEM_WAIT_TIMEOUT = 3;
-const uint64_t SaceSocketSender::RECV_THREAD_EXIT = 0x01;
+const int SaceSocketSender::MAX_RECV_FDS = SACE_BATCH_MAX_ITEMS;
+const int SaceSocketSender::SWEEP_INTERVAL = 100; //ms
+const int SaceSocketSender::HELLO_TIMEOUT = 500; //ms, older saced never answers
+const uint64_t SaceSocketSender::RECV_THREAD_WAKE = 0x01;
+const uint64_t SaceSocketSender::RECV_THREAD_EXIT = 0x01ull << 32;
 
 const char *SaceSocketSender::THREAD_NAME = "SSSocket.MT";
 const char *SaceSocketSender::NAME = "SSSocket";
@@ -70,33 +180,30 @@ bool SaceSocketSender::init () {
         goto err;
     }
 
-    if ((event_fd = eventfd(0, 0)) < 0) {
+    if ((event_fd = eventfd(0, EFD_CLOEXEC)) < 0) {
         SACE_LOGE("%s eventfd errno=%d errstr=%s", NAME, errno, strerror(errno));
         goto err1;
     }
 
-    if (pthread_mutex_init(&syncMutex, nullptr) < 0) {
-        SACE_LOGE("%s pthread_mutex_init errno=%d errstr=%s", NAME, errno, strerror(errno));
+    if (!on_connected()) {
+        SACE_LOGE("%s %s setup failed", NAME, mSockName.c_str());
         goto err2;
     }
 
-    if (pthread_cond_init(&syncCond, nullptr) < 0) {
-        SACE_LOGE("%s pthread_cond_init errno=%d errstr=%s", NAME, errno, strerror(errno));
-        goto err3;
-    }
-
     /* setup receive thread */
-    if (pthread_create(&recv_thread, nullptr, recv_thread_run, (void*)this) < 0) {
+    recv_exited = false;
+    if (pthread_create(&recv_thread, nullptr, recv_thread_run, (void*)this) != 0) {
         SACE_LOGE("%s pthread_create errno=%d errstr=%s", NAME, errno, strerror(errno));
-        goto err4;
+        goto err3;
     }
 
-    return (initlized = true);
+    pthread_mutex_lock(&sendMutex);
+    initlized = true;
+    pthread_mutex_unlock(&sendMutex);
+    return true;
 
-err4:
-    pthread_cond_destroy(&syncCond);
 err3:
-    pthread_mutex_destroy(&syncMutex);
+    on_disconnected();
 err2:
     close(event_fd);
 err1:
@@ -106,22 +213,220 @@ err:
 }
 
 void SaceSocketSender::uninit () {
-    close(sockfd);
+    vector<Inflight*> failed;
+
+    pthread_mutex_lock(&initMutex);
+    uninit_locked(failed);
+    pthread_mutex_unlock(&initMutex);
+
+    complete_async(failed, SACE_RESULT_STATUS_FAIL);
+}
+
+void SaceSocketSender::uninit_locked (vector<Inflight*> &failed) {
+    if (!initlized)
+        return;
+
+    /* wait for writer in progress */
+    pthread_mutex_lock(&sendMutex);
+    initlized = false;
+    pthread_mutex_unlock(&sendMutex);
 
     /* exit recv_thread_run */
     uint64_t value = RECV_THREAD_EXIT;
-    int ret = write(event_fd, &value, sizeof(value));
+    if (write(event_fd, &value, sizeof(value)) < 0)
+        SACE_LOGE("%s notify recv thread errno=%d errstr=%s", NAME, errno, strerror(errno));
+    pthread_join(recv_thread, nullptr);
+    on_disconnected();
 
-    pthread_cond_destroy(&syncCond);
-    pthread_mutex_destroy(&syncMutex);
+    close(event_fd);
+    close(sockfd);
 
-    initlized = false;
+    /* recv thread is gone, nobody would complete them */
+    fail_inflight(failed);
+}
+
+bool SaceSocketSender::send_command (const Frame &frame) {
+    return send_frame(frame.data(), frame.size());
+}
+
+bool SaceSocketSender::send_frame (const uint8_t *data, size_t len) {
+    bool ok = true;
+
+    pthread_mutex_lock(&sendMutex);
+    if (!initlized)
+        ok = false;
+
+    while (ok && len > 0) {
+        ssize_t ret = TEMP_FAILURE_RETRY(send(sockfd, data, len, MSG_NOSIGNAL));
+        if (ret <= 0) {
+            SACE_LOGE("%s excuteCommand errno=%d errstr=%s", NAME, errno, strerror(errno));
+            /* recv thread sees EOF, fails the waiters, next command reconnects */
+            shutdown(sockfd, SHUT_RDWR);
+            ok = false;
+            break;
+        }
+
+        data += ret;
+        len  -= ret;
+    }
+    pthread_mutex_unlock(&sendMutex);
+
+    return ok;
+}
+
+bool SaceSocketSender::ensure_connected () {
+    /* from an async handler, uninit may be joining us while holding initMutex */
+    if (recv_thread_id == gettid())
+        return true;
+
+    vector<Inflight*> failed;
+    pthread_mutex_lock(&initMutex);
+
+    /* reconnect once the peer went away */
+    if (initlized && recv_exited)
+        uninit_locked(failed);
+    bool ready = initlized;
+    if (!ready && (ready = init()))
+        negotiate_codec();
+
+    pthread_mutex_unlock(&initMutex);
+
+    /* a handler may send again and come back here */
+    complete_async(failed, SACE_RESULT_STATUS_FAIL);
+    return ready;
+}
+
+void SaceSocketSender::negotiate_codec () {
+    SaceCommand hello;
+    hello.type = SACE_TYPE_HELLO;
+    hello.extra.put<uint8_t>(1 << SACE_CODEC_COMPACT);
+
+    Inflight inflight;
+    inflight.batch = nullptr;
+    inflight.result.resultStatus = SACE_RESULT_STATUS_FAIL;
+
+    /* saced reads both encodings, the answer decides what comes back */
+    mCodec = SACE_CODEC_PARCEL;
+    if (!excute_frame(hello.sequence, Frame(hello, SACE_CODEC_PARCEL), inflight, HELLO_TIMEOUT))
+        return;
+
+    const SaceResult &rslt = inflight.result;
+    if (rslt.resultStatus == SACE_RESULT_STATUS_OK && rslt.resultType == SACE_RESULT_TYPE_EXTRA
+            && !rslt.resultExtra.empty() && rslt.resultExtra[0] == SACE_CODEC_COMPACT)
+        mCodec = SACE_CODEC_COMPACT;
+
+    SACE_LOGI("%s codec %d", NAME, mCodec.load());
+}
+
+bool SaceSocketSender::add_inflight (uint64_t sequence, Inflight *inflight) {
+    bool wake = false;
+
+    pthread_mutex_lock(&syncMutex);
+    bool registered = mInflight.insert(sequence, inflight);
+    if (registered && inflight->handler)
+        wake = mAsyncInflight++ == 0;
+    pthread_mutex_unlock(&syncMutex);
+
+    /* recv thread may be blocked without timeout, let it start sweeping */
+    if (wake) {
+        uint64_t value = RECV_THREAD_WAKE;
+        if (write(event_fd, &value, sizeof(value)) < 0)
+            SACE_LOGE("%s wake recv thread errno=%d errstr=%s", NAME, errno, strerror(errno));
+    }
+
+    return registered;
+}
+
+/* nullptr if nobody waits for sequence */
+SaceSocketSender::Inflight* SaceSocketSender::take_inflight_locked (uint64_t sequence) {
+    Inflight **found = mInflight.find(sequence);
+    if (found == nullptr)
+        return nullptr;
+
+    Inflight *inflight = *found;
+    mInflight.erase(sequence);
+    if (inflight->handler)
+        mAsyncInflight--;
+
+    return inflight;
+}
+
+bool SaceSocketSender::remove_inflight (uint64_t sequence, Inflight *inflight) {
+    bool removed = false;
+
+    pthread_mutex_lock(&syncMutex);
+    Inflight **found = mInflight.find(sequence);
+    if (found != nullptr && *found == inflight) {
+        take_inflight_locked(sequence);
+        removed = true;
+    }
+    pthread_mutex_unlock(&syncMutex);
+
+    return removed;
+}
+
+void SaceSocketSender::complete_async (vector<Inflight*> &completed, SaceResultStatus status) {
+    for (auto inflight : completed) {
+        SaceResult result;
+        result.sequence     = inflight->result.sequence;
+        result.resultType   = SACE_RESULT_TYPE_NONE;
+        result.resultStatus = status;
+
+        inflight->handler(result);
+        delete inflight;
+    }
+}
+
+void SaceSocketSender::fail_inflight () {
+    vector<Inflight*> completed;
+
+    fail_inflight(completed);
+    /* handlers may issue new commands, never call them locked */
+    complete_async(completed, SACE_RESULT_STATUS_FAIL);
+}
+
+/* waiters are woken here, async ones are appended to failed */
+void SaceSocketSender::fail_inflight (vector<Inflight*> &failed) {
+    pthread_mutex_lock(&syncMutex);
+    mInflight.for_each([&failed] (uint64_t, Inflight *inflight) {
+        if (inflight->handler) {
+            failed.push_back(inflight);
+            return;
+        }
+
+        inflight->result.resultStatus = SACE_RESULT_STATUS_FAIL;
+        inflight->done = true;
+        pthread_cond_signal(&inflight->cond);
+    });
+    mInflight.clear();
+    mAsyncInflight = 0;
+    pthread_mutex_unlock(&syncMutex);
+}
+
+void SaceSocketSender::sweep_timeouts () {
+    vector<Inflight*> completed;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&syncMutex);
+    mInflight.erase_if([&completed, &now] (uint64_t sequence, Inflight *inflight) {
+        if (!inflight->handler || now.tv_sec < inflight->deadline.tv_sec
+                || (now.tv_sec == inflight->deadline.tv_sec && now.tv_nsec < inflight->deadline.tv_nsec))
+            return false;
+
+        SACE_LOGI("%s TIMEOUT RESULT sequence=%" PRIu64, NAME, sequence);
+        completed.push_back(inflight);
+        return true;
+    });
+    mAsyncInflight -= completed.size();
+    pthread_mutex_unlock(&syncMutex);
+
+    complete_async(completed, SACE_RESULT_STATUS_TIMEOUT);
 }
 
 void* SaceSocketSender::recv_thread_run (void *data) {
     SaceSocketSender *self = (SaceSocketSender*)data;
     fd_set fd_reads;
-    char buf[SACE_RESULT_BUF_SIZE];
 
     prctl(PR_SET_NAME, THREAD_NAME);
     self->recv_thread_id = gettid();
@@ -131,26 +436,48 @@ void* SaceSocketSender::recv_thread_run (void *data) {
         FD_SET(self->sockfd, &fd_reads);
         FD_SET(self->event_fd, &fd_reads);
 
-        int max_fd = max(self->sockfd, self->event_fd);
-        int ret = select(max_fd + 1, &fd_reads, nullptr, nullptr, nullptr);
-        if (ret <= 0) {
+        int wake_fd = self->wait_fd();
+        if (wake_fd >= 0)
+            FD_SET(wake_fd, &fd_reads);
+
+        /* async commands expire here, sync ones time out on their own */
+        pthread_mutex_lock(&self->syncMutex);
+        bool sweep = self->mAsyncInflight > 0;
+        pthread_mutex_unlock(&self->syncMutex);
+
+        bool pending = self->poll_completions();
+
+        struct timeval tick;
+        tick.tv_sec  = 0;
+        tick.tv_usec = pending ? 0 : SWEEP_INTERVAL * 1000;
+
+        int max_fd = max(max(self->sockfd, self->event_fd), wake_fd);
+        int ret = select(max_fd + 1, &fd_reads, nullptr, nullptr, sweep || pending ? &tick : nullptr);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
             SACE_LOGE("%s exit select errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
-            return 0;
+            goto out;
         }
 
+        if (sweep)
+            self->sweep_timeouts();
+        if (ret == 0)
+            continue;
+
         if (FD_ISSET(self->sockfd, &fd_reads)) {
             struct msghdr msg;
-            uint32_t size;
-
             union {
                 struct cmsghdr cm;
-                char control[CMSG_SPACE(sizeof(int))];
+                char control[CMSG_SPACE(sizeof(int) * MAX_RECV_FDS)];
             } control_un;
             struct cmsghdr *pcmsg = nullptr;
 
+            /* a packet must be taken whole, the rest of it would be dropped */
+            size_t recv_len = self->mSockType == SOCK_SEQPACKET ? SaceFrameBuffer::DEFAULT_MAX_FRAME : SACE_RESULT_BUF_SIZE;
             struct iovec iov[1];
-            iov[0].iov_base = buf;
-            iov[0].iov_len  = sizeof(buf);
+            iov[0].iov_base = self->mFrames.reserve(recv_len);
+            iov[0].iov_len  = recv_len;
 
             msg.msg_name    = nullptr;
             msg.msg_namelen = 0;
@@ -159,123 +486,327 @@ void* SaceSocketSender::recv_thread_run (void *data) {
             msg.msg_control    = control_un.control;
             msg.msg_controllen = sizeof(control_un.control);
 
-            ret = TEMP_FAILURE_RETRY(recvmsg(self->sockfd, &msg, 0));
+            ret = TEMP_FAILURE_RETRY(recvmsg(self->sockfd, &msg, MSG_CMSG_CLOEXEC));
             if (ret <= 0) {
                 if (ret == 0)
                     SACE_LOGE("%s exit peer close", THREAD_NAME);
                 else
                     SACE_LOGE("%s exit recvmsg errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
-                return 0;
+                goto out;
             }
+            self->mFrames.commit(ret);
 
-            if ((size_t)ret < SaceResultHeader::parcelSize()) {
-                SACE_LOGE("%s smaller Req : %d Real : %d", THREAD_NAME, SaceResultHeader::parcelSize(), ret);
-                continue;
+            if (msg.msg_flags & MSG_CTRUNC)
+                SACE_LOGE("%s ancillary data truncated, fds lost", THREAD_NAME);
+
+            if (msg.msg_flags & MSG_TRUNC) {
+                SACE_LOGE("%s exit packet truncated", THREAD_NAME);
+                goto out;
             }
 
-            // transform from bytes
-            Parcel parcel;
-            parcel.setData((uint8_t*)buf, ret);
+            /* fds travel with the first byte of their frame, keep them in order */
+            for (pcmsg = CMSG_FIRSTHDR(&msg); pcmsg != nullptr; pcmsg = CMSG_NXTHDR(&msg, pcmsg)) {
+                if (pcmsg->cmsg_level != SOL_SOCKET || pcmsg->cmsg_type != SCM_RIGHTS)
+                    continue;
 
-            SaceResultHeader headerRslt;
-            headerRslt.readFromParcel(&parcel);
+                int *fds = (int*)CMSG_DATA(pcmsg);
+                size_t nfds = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < nfds; i++)
+                    self->mPendingFds.push(fds[i]);
+            }
 
-            // reset
-            parcel.setDataPosition(0);
+            const uint8_t *frame;
+            size_t len;
+            while (self->mFrames.next(&frame, &len))
+                self->handleFrame(frame, len);
 
-            if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
-                if (parcel.dataSize() < headerRslt.len) {
-                    SACE_LOGE("%s receive invalid result Req : %d Real : %d", THREAD_NAME, headerRslt.len, (uint32_t)parcel.dataSize());
-                    continue;
-                }
-                else {
-                    SaceResult rslt;
-                    rslt.readFromParcel(&parcel);
-
-                    pcmsg = CMSG_FIRSTHDR(&msg);
-                    if (pcmsg != nullptr && pcmsg->cmsg_len == CMSG_LEN(sizeof(int)) &&
-                        pcmsg->cmsg_level == SOL_SOCKET && pcmsg->cmsg_type == SCM_RIGHTS)
-                        rslt.resultFd = *((int*)CMSG_DATA(pcmsg));
-                    else
-                        rslt.resultFd = -1;
-
-                    self->handleResult(rslt);
-                }
-            }
-            else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
-                if (parcel.dataSize() < headerRslt.len) {
-                    SACE_LOGE("%s receive invalid response Req : %d Real : %d", THREAD_NAME, headerRslt.len, (uint32_t)parcel.dataSize());
-                    continue;
-                }
-                else {
-                    SaceStatusResponse response;
-                    response.readFromParcel(&parcel);
-                    self->handleResponse(response);
-                }
+            if (self->mFrames.corrupted()) {
+                SACE_LOGE("%s exit invalid frame length", THREAD_NAME);
+                goto out;
             }
-            else
-                SACE_LOGW("%s receive invalid type %d", THREAD_NAME, headerRslt.type);
+        }
+
+        if (wake_fd >= 0 && FD_ISSET(wake_fd, &fd_reads)) {
+            uint64_t value;
+            /* only a doorbell, poll_completions takes what it rang for */
+            if (read(wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                SACE_LOGE("%s read wakeup errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
         }
 
         if (FD_ISSET(self->event_fd, &fd_reads)) {
-            close(self->event_fd);
-            SACE_LOGI("%s exit recv_thread_run %s", NAME, THREAD_NAME);
-            pthread_exit(0);
+            uint64_t value = 0;
+            if (read(self->event_fd, &value, sizeof(value)) < 0)
+                SACE_LOGE("%s read event errno=%d errstr=%s", THREAD_NAME, errno, strerror(errno));
+
+            if (value >= RECV_THREAD_EXIT) {
+                SACE_LOGI("%s exit recv_thread_run %s", NAME, THREAD_NAME);
+                break;
+            }
         }
     }
+
+out:
+    self->clear_pending_fds();
+    self->mFrames.clear();
+
+    /* connection is unusable, waiters fail now instead of timing out */
+    self->recv_exited = true;
+    self->fail_inflight();
+    self->recv_thread_id = 0;
+    return nullptr;
+}
+
+bool SaceSocketSender::excute_frame (uint64_t sequence, const Frame &frame, Inflight &inflight, int timeout) {
+    /* register before sending, result may arrive before send returns */
+    inflight.done = false;
+    pthread_cond_init(&inflight.cond, nullptr);
+
+    if (!add_inflight(sequence, &inflight)) {
+        SACE_LOGE("%s sequence in flight already %" PRIu64, NAME, sequence);
+        pthread_cond_destroy(&inflight.cond);
+        return false;
+    }
+
+    if (!send_command(frame)) {
+        remove_inflight(sequence, &inflight);
+        pthread_cond_destroy(&inflight.cond);
+        return false;
+    }
+
+    struct timeval now;
+    struct timespec deadline;
+    gettimeofday(&now, nullptr);
+    uint64_t nsec = now.tv_usec * 1000ull + (timeout % 1000) * 1000000ull;
+    deadline.tv_sec  = now.tv_sec + timeout / 1000 + nsec / 1000000000;
+    deadline.tv_nsec = nsec % 1000000000;
+
+    int ret = 0;
+    pthread_mutex_lock(&syncMutex);
+    while (!inflight.done && ret == 0)
+        ret = pthread_cond_timedwait(&inflight.cond, &syncMutex, &deadline);
+
+    if (!inflight.done) {
+        Inflight **found = mInflight.find(sequence);
+        if (found != nullptr && *found == &inflight)
+            take_inflight_locked(sequence);
+
+        if (ret == ETIMEDOUT) {
+            SACE_LOGI("%s TIMEOUT RESULT sequence=%" PRIu64, NAME, sequence);
+            inflight.result.resultStatus = SACE_RESULT_STATUS_TIMEOUT;
+        }
+        else
+            SACE_LOGI("%s WAIT RESULT errno=%d", NAME, ret);
+    }
+    pthread_mutex_unlock(&syncMutex);
+
+    pthread_cond_destroy(&inflight.cond);
+    return inflight.done;
 }
 
 SaceResult SaceSocketSender::excuteCommand (const SaceCommand &cmd) {
+    Inflight inflight;
+    inflight.batch = nullptr;
+    inflight.result.resultType   = SACE_RESULT_TYPE_NONE;
+    inflight.result.resultStatus = SACE_RESULT_STATUS_FAIL;
+
+    /* excute error for initialize fail */
+    if (!ensure_connected())
+        return inflight.result;
+
+    /* translate to bytes */
+    excute_frame(cmd.sequence, Frame(cmd, mCodec), inflight, SEM_WAIT_TIMEOUT * 1000);
+    return std::move(inflight.result);
+}
+
+SaceBatchResult SaceSocketSender::excuteBatch (const SaceBatchCommand &batch) {
+    SaceBatchResult batchRslt;
+    batchRslt.sequence = batch.sequence;
+
+    Inflight inflight;
+    inflight.batch = &batchRslt;
+    inflight.result.resultStatus = SACE_RESULT_STATUS_FAIL;
+
+    if (batch.commands.size() > SACE_BATCH_MAX_ITEMS) {
+        SACE_LOGE("%s batch too large %zu", NAME, batch.commands.size());
+        return batchRslt;
+    }
+
+    if (!ensure_connected())
+        return batchRslt;
+
+    /* all or nothing, failed items are filled by the caller */
+    if (!excute_frame(batch.sequence, Frame(batch, mCodec), inflight, SEM_WAIT_TIMEOUT * 1000))
+        batchRslt.results.clear();
+
+    return batchRslt;
+}
+
+void SaceSocketSender::excuteCommandAsync (const SaceCommand &cmd, ResultHandler handler) {
     SaceResult result;
+    result.sequence     = cmd.sequence;
     result.resultType   = SACE_RESULT_TYPE_NONE;
     result.resultStatus = SACE_RESULT_STATUS_FAIL;
 
-    /* excute error for initialize fail */
-    if (!initlized && !init())
-        return result;
+    if (!ensure_connected()) {
+        handler(result);
+        return;
+    }
 
-    /* translate to bytes */
+    Frame frame(cmd, mCodec);
+
+    Inflight *inflight = new Inflight();
+    inflight->done = false;
+    inflight->batch = nullptr;
+    inflight->result.sequence = cmd.sequence;
+    inflight->handler = handler;
+    clock_gettime(CLOCK_MONOTONIC, &inflight->deadline);
+    inflight->deadline.tv_sec += SEM_WAIT_TIMEOUT;
+
+    if (!add_inflight(cmd.sequence, inflight)) {
+        SACE_LOGE("%s sequence in flight already %s", NAME, cmd.to_string().c_str());
+        delete inflight;
+        handler(result);
+        return;
+    }
+
+    /* if the recv thread failed it already, handler has run */
+    if (!send_command(frame) && remove_inflight(cmd.sequence, inflight)) {
+        delete inflight;
+        handler(result);
+    }
+}
+
+void SaceSocketSender::take_result_fd (SaceResult &rslt) {
+    rslt.resultFd = -1;
+    if (rslt.resultType != SACE_RESULT_TYPE_FD)
+        return;
+
+    if (!mPendingFds.empty()) {
+        rslt.resultFd = mPendingFds.front();
+        mPendingFds.pop();
+    }
+    else
+        SACE_LOGE("%s result without fd %s", THREAD_NAME, rslt.to_string().c_str());
+}
+
+void SaceSocketSender::handleCompactFrame (const uint8_t *frame, size_t len) {
+    switch (SaceCodec::kind(frame, len)) {
+        case SaceCodec::KIND_RESULT: {
+            SaceResult rslt;
+            if (!SaceCodec::decode(frame, len, rslt))
+                break;
+
+            take_result_fd(rslt);
+            handleResult(std::move(rslt));
+            return;
+        }
+        case SaceCodec::KIND_BATCH_RESULT: {
+            SaceBatchResult batchRslt;
+            if (!SaceCodec::decode(frame, len, batchRslt))
+                break;
+
+            for (auto &rslt : batchRslt.results)
+                take_result_fd(rslt);
+            handleBatchResult(batchRslt);
+            return;
+        }
+        case SaceCodec::KIND_RESPONSE: {
+            SaceStatusResponse response;
+            if (!SaceCodec::decode(frame, len, response))
+                break;
+
+            handleResponse(response);
+            return;
+        }
+        default:
+            break;
+    }
+
+    SACE_LOGW("%s receive invalid compact frame kind %d len %zu", THREAD_NAME, SaceCodec::kind(frame, len), len);
+}
+
+void SaceSocketSender::handleFrame (const uint8_t *frame, size_t len) {
+    if (SaceCodec::isCompact(frame, len)) {
+        handleCompactFrame(frame, len);
+        return;
+    }
+
+    if (len < SaceResultHeader::parcelSize()) {
+        SACE_LOGE("%s smaller Req : %d Real : %zu", THREAD_NAME, SaceResultHeader::parcelSize(), len);
+        return;
+    }
+
+    // transform from bytes
     Parcel parcel;
-    cmd.writeToParcel(&parcel);
+    parcel.setData(frame, len);
+
+    SaceResultHeader headerRslt;
+    headerRslt.readFromParcel(&parcel);
+
+    // reset
+    parcel.setDataPosition(0);
+
+    if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
+        SaceResult rslt;
+        rslt.readFromParcel(&parcel);
 
-    int ret = TEMP_FAILURE_RETRY(write(sockfd, (char*)parcel.data(), parcel.dataSize()));
-    if (ret <= 0) {
-        SACE_LOGE("%s excuteCommand errno=%d errstr=%s", NAME, errno, strerror(errno));
-        uninit();
-        return result;
+        take_result_fd(rslt);
+        handleResult(std::move(rslt));
     }
+    else if (headerRslt.type == SACE_BASE_RESULT_TYPE_BATCH) {
+        SaceBatchResult batchRslt;
+        if (batchRslt.readFromParcel(&parcel) != OK) {
+            SACE_LOGE("%s invalid batch result", THREAD_NAME);
+            return;
+        }
+
+        /* fds of the whole batch arrived together, in item order */
+        for (auto &rslt : batchRslt.results)
+            take_result_fd(rslt);
 
-    if ((size_t)ret != parcel.dataSize()) {
-        SACE_LOGE("%s excuteCommand Require %d Real %d", NAME, (uint32_t)parcel.dataSize(), ret);
-        return result;
+        handleBatchResult(batchRslt);
+    }
+    else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
+        SaceStatusResponse response;
+        response.readFromParcel(&parcel);
+        handleResponse(response);
     }
+    else
+        SACE_LOGW("%s receive invalid type %d", THREAD_NAME, headerRslt.type);
+}
 
-    pthread_mutex_lock(&syncMutex);
-    syncSequence = cmd.sequence;
+void SaceSocketSender::handleBatchResult (const SaceBatchResult &batchRslt) {
+    bool consumed = false;
 
-	struct timeval now;
-    struct timespec timeout;
-    gettimeofday(&now, nullptr);
-    timeout.tv_sec  = now.tv_sec + SEM_WAIT_TIMEOUT;
-    timeout.tv_nsec = now.tv_usec * 1000;
-	ret = pthread_cond_timedwait(&syncCond, &syncMutex, &timeout);
+    SACE_LOGI("%s handle batch result %s", NAME, batchRslt.to_string().c_str());
 
-    syncSequence = 0;
+    pthread_mutex_lock(&syncMutex);
+    Inflight **found = mInflight.find(batchRslt.sequence);
+    if (found != nullptr && (*found)->batch != nullptr) {
+        Inflight *inflight = take_inflight_locked(batchRslt.sequence);
+
+        *inflight->batch = batchRslt;
+        inflight->result.resultStatus = SACE_RESULT_STATUS_OK;
+        inflight->done = true;
+        pthread_cond_signal(&inflight->cond);
+        consumed = true;
+    }
     pthread_mutex_unlock(&syncMutex);
 
-    if (ret != 0) {
-        if (ret == ETIMEDOUT) {
-            SACE_LOGI("%s TIMEOUT RESULT %s", NAME, cmd.to_string().c_str());
-            result.resultStatus = SACE_RESULT_STATUS_TIMEOUT;
-        }
-        else {
-            SACE_LOGI("%s WAIT RESULT errno=%d", NAME, ret);
-            result.resultStatus = SACE_RESULT_STATUS_FAIL;
+    if (!consumed) {
+        SACE_LOGE("%s no waiter, may handle older Result %s", NAME, batchRslt.to_string().c_str());
+        for (auto &rslt : batchRslt.results) {
+            if (rslt.resultFd >= 0)
+                close(rslt.resultFd);
         }
-        return result;
     }
-    else
-        return mResult;
+}
+
+void SaceSocketSender::clear_pending_fds () {
+    while (!mPendingFds.empty()) {
+        close(mPendingFds.front());
+        mPendingFds.pop();
+    }
 }
 
 void SaceSocketSender::handleResponse (const SaceStatusResponse &response) {
@@ -283,19 +814,188 @@ void SaceSocketSender::handleResponse (const SaceStatusResponse &response) {
 	onCommandResponse(response);
 }
 
-void SaceSocketSender::handleResult (const SaceResult &result) {
-    SACE_LOGI("%s handle result %s", NAME, result.to_string().c_str());
+void SaceSocketSender::handleResult (SaceResult &&result) {
+    Inflight *async = nullptr;
+
+    /* no to_string here, it would allocate for every result */
+    SACE_LOGI("%s handle result sequence=%" PRIu64 " status=%d", NAME, result.sequence, result.resultStatus);
 
     pthread_mutex_lock(&syncMutex);
-    if (syncSequence) {
-		if (syncSequence != result.sequence) {
-			SACE_LOGE("%s May handle older Result %s", NAME, result.to_string().c_str());
-			return;
-		}
-        mResult = result;
-        pthread_cond_signal(&syncCond);
+    Inflight *inflight = take_inflight_locked(result.sequence);
+    if (inflight == nullptr) {
+        SACE_LOGE("%s no waiter, may handle older Result %s", NAME, result.to_string().c_str());
+        if (result.resultFd >= 0)
+            close(result.resultFd);
+    }
+    else {
+        if (inflight->handler)
+            async = inflight;
+        else {
+            inflight->result = std::move(result);
+            inflight->done = true;
+            pthread_cond_signal(&inflight->cond);
+        }
     }
     pthread_mutex_unlock(&syncMutex);
+
+    if (async != nullptr) {
+        async->handler(result);
+        delete async;
+    }
 } //}
 
+// ----------------------------------------------------
+const char *SaceRingSender::NAME = "SSRing";
+const int SaceRingSender::SETUP_TIMEOUT = 500; //ms
+
+bool SaceRingSender::on_connected () {
+    struct pollfd pfd = { sockfd, POLLIN, 0 };
+    uint32_t magic = 0;
+    struct iovec iov = { &magic, sizeof(magic) };
+    struct msghdr msg;
+    union {
+        struct cmsghdr cm;
+        char control[CMSG_SPACE(sizeof(int) * 3)];
+    } control_un;
+    int fds[3] = { -1, -1, -1 };
+    size_t nfds = 0;
+
+    /* region, submission and completion eventfds, first thing saced sends */
+    if (TEMP_FAILURE_RETRY(poll(&pfd, 1, SETUP_TIMEOUT)) <= 0) {
+        SACE_LOGE("%s no ring from saced errno=%d errstr=%s", NAME, errno, strerror(errno));
+        return false;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control    = control_un.control;
+    msg.msg_controllen = sizeof(control_un.control);
+
+    ssize_t ret = TEMP_FAILURE_RETRY(recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC));
+    for (struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg); ret > 0 && pcmsg != nullptr; pcmsg = CMSG_NXTHDR(&msg, pcmsg)) {
+        if (pcmsg->cmsg_level != SOL_SOCKET || pcmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int *recv_fds = (int*)CMSG_DATA(pcmsg);
+        size_t count = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++) {
+            if (nfds < 3)
+                fds[nfds++] = recv_fds[i];
+            else
+                close(recv_fds[i]);
+        }
+    }
+
+    if (ret != sizeof(magic) || magic != SaceRingRegion::MAGIC || nfds != 3) {
+        SACE_LOGE("%s invalid ring setup len=%zd fds=%zu", NAME, ret, nfds);
+        goto err;
+    }
+
+    /* attach closes the region fd either way */
+    if (!mRegion.attach(fds[0])) {
+        fds[0] = -1;
+        goto err;
+    }
+
+    pthread_mutex_lock(&mRingMutex);
+    mSubmitFd   = fds[1];
+    mCompleteFd = fds[2];
+    mAttached   = true;
+    pthread_mutex_unlock(&mRingMutex);
+    return true;
+
+err:
+    for (size_t i = 0; i < nfds; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    return false;
+}
+
+void SaceRingSender::on_disconnected () {
+    pthread_mutex_lock(&mRingMutex);
+    mAttached = mSpilled = false;
+    mRegion.detach();
+    if (mSubmitFd >= 0)
+        close(mSubmitFd);
+    if (mCompleteFd >= 0)
+        close(mCompleteFd);
+    mSubmitFd = mCompleteFd = -1;
+    pthread_mutex_unlock(&mRingMutex);
+}
+
+bool SaceRingSender::send_frame (const uint8_t *data, size_t len) {
+    SaceRing &ring = mRegion.submissions();
+    bool ok;
+
+    pthread_mutex_lock(&mRingMutex);
+    /* saced handles a ring frame as it pops it, on the thread reading the
+     * socket; behind a spilled frame the socket is used until the ring is out */
+    if (mSpilled && ring.drained())
+        mSpilled = false;
+
+    if (mAttached && !mSpilled && len <= ring.maxFrame() && ring.push(data, len)) {
+        if (ring.wakeup()) {
+            uint64_t value = 1;
+            if (write(mSubmitFd, &value, sizeof(value)) < 0)
+                SACE_LOGE("%s wake saced errno=%d errstr=%s", NAME, errno, strerror(errno));
+        }
+        pthread_mutex_unlock(&mRingMutex);
+        return true;
+    }
+
+    /* full or too big, still under the ring lock so no frame passes it */
+    mSpilled = mAttached && !ring.drained();
+    ok = SaceSocketSender::send_frame(data, len);
+    pthread_mutex_unlock(&mRingMutex);
+
+    return ok;
+}
+
+bool SaceRingSender::drain_completions () {
+    SaceRing &ring = mRegion.completions();
+    const uint8_t *frame;
+    size_t len;
+    bool found = false;
+
+    while (ring.next(&frame, &len)) {
+        if (SaceFrameBuffer::peek(frame, len) != (ssize_t)len) {
+            SACE_LOGE("%s invalid completion len %zu", NAME, len);
+            ring.pop();
+            continue;
+        }
+
+        /* handled in place, saced does not reuse it before pop */
+        handleFrame(frame, len);
+        ring.pop();
+        found = true;
+    }
+
+    /* the receive thread sees the hangup and fails the waiters */
+    if (ring.broken()) {
+        SACE_LOGE("%s completion ring broken", NAME);
+        shutdown(sockfd, SHUT_RDWR);
+    }
+
+    return found;
+}
+
+bool SaceRingSender::poll_completions () {
+    SaceRing &ring = mRegion.completions();
+
+    if (ring.broken())
+        return false;
+
+    /* saced need not ring while we look */
+    ring.awake();
+    if (drain_completions()) {
+        /* busy, the next results are likely a few microseconds away */
+        while (mSpin.spin([this] { return drain_completions(); }))
+            ;
+    }
+
+    return !ring.broken() && !ring.sleep();
+}
+
 }; //namespace android
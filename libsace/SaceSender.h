@@ -17,12 +17,20 @@
 #ifndef _SACE_SENDER_H
 #define _SACE_SENDER_H
 
+#include <atomic>
+#include <functional>
+#include <map>
+#include <queue>
 #include <semaphore.h>
 #include <utils/RefBase.h>
 
 #include "ISaceListener.h"
 #include "ISaceManager.h"
 #include "SaceLog.h"
+#include "SaceFrame.h"
+#include "SaceCodec.h"
+#include "SaceInflight.h"
+#include "SaceRing.h"
 
 namespace android {
 
@@ -33,7 +41,15 @@ public:
         virtual void onResponse (const SaceStatusResponse &response) = 0;
     };
 
+    /* completion of excuteCommandAsync */
+    typedef function<void (const SaceResult &)> ResultHandler;
+
     virtual SaceResult excuteCommand (const SaceCommand &) = 0;
+    /* handler runs exactly once; default implementation blocks and runs it inline */
+    virtual void excuteCommandAsync (const SaceCommand &, ResultHandler handler);
+    /* one result per item in order, empty if the batch failed as a whole;
+     * default implementation sends the items one by one */
+    virtual SaceBatchResult excuteBatch (const SaceBatchCommand &);
     virtual ~SaceSender() {}
 
     void setCallback (sp<Callback> callback) {
@@ -54,8 +70,13 @@ class SaceBinderSender : public SaceSender {
     static const char *NAME;
 
     sp<ISaceListener> listener;
-    sp<ISaceManager>  manager;
-	SaceResult mRlt;
+    sp<BpSaceManager> manager;
+    /* looked up in servicemanager when not handed in */
+    sp<IBinder> service;
+
+    /* excuteCommandAsync handlers by sequence, completed by onResult */
+    pthread_mutex_t asyncMutex;
+    SaceInflightTable<ResultHandler> mAsyncInflight;
 
    /* Callback */
     class SaceListenerService : public BnSaceListener {
@@ -68,15 +89,58 @@ class SaceBinderSender : public SaceSender {
         void onResponsed (const SaceStatusResponse &response) {
             self->onCommandResponse(response);
         }
+
+        void onResult (const SaceResult &result) {
+            self->handleAsyncResult(result);
+        }
+    };
+
+    /* saced went away, nothing in flight will be answered */
+    class ManagerDeath : public IBinder::DeathRecipient {
+        SaceBinderSender *self;
+    public:
+        ManagerDeath (SaceBinderSender *sender) {
+            self = sender;
+        }
+
+        void binderDied (const wp<IBinder> &who __unused) {
+            self->fail_async();
+        }
     };
+    sp<ManagerDeath> death;
 
     bool init();
+    bool take_async (uint64_t sequence, ResultHandler &handler);
+    void handleAsyncResult (const SaceResult &result);
+
+protected:
+    /* what binderDied does, every pending handler fails */
+    void fail_async ();
+
 public:
+    SaceBinderSender () {
+        pthread_mutex_init(&asyncMutex, nullptr);
+    }
+
+    /* talks to binder instead of SaceService, a local one in tests */
+    explicit SaceBinderSender (const sp<IBinder> &binder):service(binder) {
+        pthread_mutex_init(&asyncMutex, nullptr);
+    }
+
     virtual SaceResult excuteCommand (const SaceCommand &);
+    /* oneway to saced, handler runs on a binder thread of this process.
+     * Services without sendCommandAsync get the blocking default. */
+    virtual void excuteCommandAsync (const SaceCommand &, ResultHandler handler);
 
     virtual ~SaceBinderSender() {
-        if (manager != nullptr)
+        if (manager != nullptr) {
+            if (death != nullptr)
+                IInterface::asBinder(manager)->unlinkToDeath(death);
             manager->unregisterListener();
+        }
+        fail_async();
+
+        pthread_mutex_destroy(&asyncMutex);
     }
 };
 
@@ -85,29 +149,119 @@ class SaceSocketSender : public SaceSender {
     static const char *THREAD_NAME;
     static const char *NAME;
     static const int   SEM_WAIT_TIMEOUT;
+    static const int   MAX_RECV_FDS;
+    static const int   SWEEP_INTERVAL;
+    static const int   HELLO_TIMEOUT;
+    static const uint64_t RECV_THREAD_WAKE;
     static const uint64_t RECV_THREAD_EXIT;
 
     pthread_t recv_thread;
-    pid_t recv_thread_id;
+    atomic<pid_t> recv_thread_id;
+    int event_fd;
+
+    /* one command waiting for its result */
+    struct Inflight {
+        pthread_cond_t cond;
+        bool done;
+        SaceResult result;
+        /* batch only, filled by recv thread */
+        SaceBatchResult *batch;
+        /* async only, owned by the map until completed */
+        ResultHandler handler;
+        struct timespec deadline;   /* CLOCK_MONOTONIC */
+    };
 
-    /* synchronized with recv_thread_run */
-    pthread_cond_t syncCond;
+    /* synchronized with recv_thread_run, keyed by command sequence */
     pthread_mutex_t syncMutex;
-    uint32_t syncSequence;
-    int event_fd;
+    SaceInflightTable<Inflight*> mInflight;
+    int mAsyncInflight;
+    /* commands from different threads must not interleave on the socket */
+    pthread_mutex_t sendMutex;
+    /* init and uninit */
+    pthread_mutex_t initMutex;
+    atomic<bool> recv_exited;
 
     string mSockName;
     int mSockType;
-    int sockfd;
-    SaceStatusResponse mResponse;
-    SaceResult mResult;
     bool initlized;
 
+    /* codec our commands go out in, agreed by SACE_TYPE_HELLO */
+    atomic<int> mCodec;
+
+    /* one command in the codec of the connection */
+    class Frame {
+        Parcel mParcel;
+        string mCompact;
+        bool   mIsCompact;
+    public:
+        template<typename T> Frame (const T &msg, int codec) {
+            mIsCompact = codec == SACE_CODEC_COMPACT;
+            if (mIsCompact)
+                SaceCodec::encode(msg, mCompact);
+            else
+                msg.writeToParcel(&mParcel);
+        }
+
+        const uint8_t* data () const {
+            return mIsCompact ? (const uint8_t*)mCompact.data() : mParcel.data();
+        }
+
+        size_t size () const {
+            return mIsCompact ? mCompact.size() : mParcel.dataSize();
+        }
+    };
+
+    /* only touched by recv_thread_run */
+    SaceFrameBuffer mFrames;
+    queue<int> mPendingFds;
+
+protected:
+    int sockfd;
+
+    /* Transports next to the socket hook in here. on_connected runs once
+     * the socket is up and before the receive thread, on_disconnected once
+     * the thread is gone. The receive thread also waits on wait_fd, and
+     * calls poll_completions before every wait, true means do not block.
+     * A subclass must uninit in its own destructor, the thread calls it.
+     */
+    virtual bool on_connected () {
+        return true;
+    }
+    virtual void on_disconnected () {}
+    virtual int wait_fd () {
+        return -1;
+    }
+    virtual bool poll_completions () {
+        return false;
+    }
+    /* one whole frame, commands of all threads go through here */
+    virtual bool send_frame (const uint8_t *data, size_t len);
+
+    void uninit();
+    /* receive thread only */
+    void handleFrame (const uint8_t *frame, size_t len);
+
 private:
     bool init();
-    void uninit();
+    /* async handlers failed on the way are left in failed, run them unlocked */
+    void uninit_locked(vector<Inflight*> &failed);
+    bool ensure_connected ();
+    void negotiate_codec ();
+    bool send_command (const Frame &frame);
+    bool excute_frame (uint64_t sequence, const Frame &frame, Inflight &inflight, int timeout);
+    bool add_inflight (uint64_t sequence, Inflight *inflight);
+    bool remove_inflight (uint64_t sequence, Inflight *inflight);
+    Inflight* take_inflight_locked (uint64_t sequence);
+    void complete_async (vector<Inflight*> &completed, SaceResultStatus status);
+    void fail_inflight ();
+    void fail_inflight (vector<Inflight*> &failed);
+    void sweep_timeouts ();
     void handleResponse (const SaceStatusResponse &response);
-    void handleResult (const SaceResult &result);
+    void handleResult (SaceResult &&result);
+    void handleCompactFrame (const uint8_t *frame, size_t len);
+    void take_result_fd (SaceResult &rslt);
+    void handleBatchResult (const SaceBatchResult &batchRslt);
+    void clear_pending_fds ();
     static void* recv_thread_run (void *data);
 
 public:
@@ -115,14 +269,76 @@ public:
         mSockName = string(sock_name);
         mSockType = sock_type;
 		initlized = false;
+        recv_exited = false;
+        mAsyncInflight = 0;
+        recv_thread_id = 0;
+        mCodec = SACE_CODEC_PARCEL;
+
+        pthread_mutex_init(&syncMutex, nullptr);
+        pthread_mutex_init(&sendMutex, nullptr);
+        pthread_mutex_init(&initMutex, nullptr);
     }
 
-    ~SaceSocketSender () {
-        if (initlized)
-            uninit();
+    virtual ~SaceSocketSender () {
+        uninit();
+
+        pthread_mutex_destroy(&initMutex);
+        pthread_mutex_destroy(&sendMutex);
+        pthread_mutex_destroy(&syncMutex);
     }
 
+    /* thread safe, any number of commands may wait on one connection */
     SaceResult excuteCommand (const SaceCommand &);
+    /* handler runs on the receive thread, it must not block on this sender */
+    void excuteCommandAsync (const SaceCommand &, ResultHandler handler);
+    SaceBatchResult excuteBatch (const SaceBatchCommand &);
+};
+
+// ----------------------------------------------------
+/* Commands and fd-less results through shared memory rings.
+ * saced hands out the rings and their eventfds on the side channel socket
+ * right after connect. Frames the ring has no room for and results with
+ * fds take the socket, so nothing ever waits for the rings.
+ */
+class SaceRingSender : public SaceSocketSender {
+    static const char *NAME;
+    static const int   SETUP_TIMEOUT;
+
+    SaceRingRegion mRegion;
+    /* we ring saced's, saced rings ours */
+    int mSubmitFd;
+    int mCompleteFd;
+    bool mAttached;
+    /* a frame took the socket, the ring is skipped until saced drained it */
+    bool mSpilled;
+    /* the submission ring has one producer at a time, it also orders
+     * the frames that take the socket */
+    pthread_mutex_t mRingMutex;
+    /* receive thread only */
+    SaceAdaptiveSpin mSpin;
+
+    bool drain_completions ();
+
+protected:
+    virtual bool on_connected ();
+    virtual void on_disconnected ();
+    virtual int wait_fd () {
+        return mCompleteFd;
+    }
+    virtual bool poll_completions ();
+    virtual bool send_frame (const uint8_t *data, size_t len);
+
+public:
+    explicit SaceRingSender (const char *sock_name):SaceSocketSender(sock_name, SOCK_SEQPACKET) {
+        mSubmitFd = mCompleteFd = -1;
+        mAttached = mSpilled = false;
+        pthread_mutex_init(&mRingMutex, nullptr);
+    }
+
+    virtual ~SaceRingSender () {
+        uninit();
+        pthread_mutex_destroy(&mRingMutex);
+    }
 };
 
 }; //namespace android
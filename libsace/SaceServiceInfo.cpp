@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include <sace/SaceServiceInfo.h>
 
 using namespace std;
@@ -22,6 +24,7 @@ namespace android {
 /* String Command */
 const string SaceServiceInfo::SERVICE_GET_BY_NAME  = "GET_BY_NAME";
 const string SaceServiceInfo::SERVICE_GET_BY_LABEL = "GET_BY_LABEL";
+const string SaceServiceInfo::SERVICE_GET_ALL      = "GET_ALL";
 
 string SaceServiceInfo::mapStateStr (enum ServiceState state) {
     switch (state) {
@@ -40,4 +43,155 @@ string SaceServiceInfo::mapStateStr (enum ServiceState state) {
     }
 }
 
+// ServiceInfo ------------------------------------------------
+/* What saced of older builds memcpy'd into resultExtra, and what their
+ * clients read. Parcel frames still carry it, the client may be old.
+ */
+struct LegacyServiceInfo {
+    char name[64];
+    char cmd[128];
+    enum SaceServiceInfo::ServiceState state;
+    uint64_t label;
+};
+
+/* first word of the full layout, a legacy name never starts with 0xff */
+static const uint32_t SERVICE_INFO_VERSION_2 = 0xff534902;
+
+/* version | label | state | pid | name | cmd | startTime, strings behind a uint32 length */
+static void put_str (SacePayload &payload, const string &str) {
+    uint32_t len = str.size();
+    payload.append(&len, sizeof(len));
+    payload.append(str.data(), len);
+}
+
+static bool get_str (const SacePayload &payload, size_t &offset, string &str) {
+    uint32_t len;
+
+    if (payload.size() - offset < sizeof(len))
+        return false;
+    memcpy(&len, payload.data() + offset, sizeof(len));
+    offset += sizeof(len);
+
+    if (payload.size() - offset < len)
+        return false;
+    str.assign((const char*)payload.data() + offset, len);
+    offset += len;
+    return true;
+}
+
+void SaceServiceInfo::ServiceInfo::writeTo (SacePayload &payload) const {
+    int32_t state = this->state;
+    int32_t pid   = this->pid;
+
+    payload.clear();
+    payload.reserve(sizeof(SERVICE_INFO_VERSION_2) + sizeof(label) + sizeof(state) + sizeof(pid)
+        + 3 * sizeof(uint32_t) + name.size() + cmd.size() + startTime.size());
+
+    payload.append(&SERVICE_INFO_VERSION_2, sizeof(SERVICE_INFO_VERSION_2));
+    payload.append(&label, sizeof(label));
+    payload.append(&state, sizeof(state));
+    payload.append(&pid, sizeof(pid));
+    put_str(payload, name);
+    put_str(payload, cmd);
+    put_str(payload, startTime);
+}
+
+void SaceServiceInfo::ServiceInfo::writeLegacyTo (SacePayload &payload) const {
+    LegacyServiceInfo info;
+
+    memset(&info, 0x00, sizeof(info));
+    info.label = label;
+    info.state = state;
+    strncpy(info.name, name.c_str(), sizeof(info.name) - 1);
+    strncpy(info.cmd, cmd.c_str(), sizeof(info.cmd) - 1);
+
+    payload.assign(&info, sizeof(info));
+}
+
+bool SaceServiceInfo::ServiceInfo::readFrom (const SacePayload &payload) {
+    uint32_t version;
+    int32_t state, pid;
+    size_t offset = sizeof(version);
+
+    if (payload.size() >= sizeof(version))
+        memcpy(&version, payload.data(), sizeof(version));
+    if (payload.size() < sizeof(version) || version != SERVICE_INFO_VERSION_2)
+        return read_legacy(payload);
+
+    if (payload.size() - offset < sizeof(label) + sizeof(state) + sizeof(pid))
+        return false;
+
+    memcpy(&label, payload.data() + offset, sizeof(label));
+    offset += sizeof(label);
+    memcpy(&state, payload.data() + offset, sizeof(state));
+    offset += sizeof(state);
+    memcpy(&pid, payload.data() + offset, sizeof(pid));
+    offset += sizeof(pid);
+    this->state = static_cast<enum ServiceState>(state);
+    this->pid   = pid;
+
+    return get_str(payload, offset, name) && get_str(payload, offset, cmd)
+        && get_str(payload, offset, startTime);
+}
+
+bool SaceServiceInfo::ServiceInfo::read_legacy (const SacePayload &payload) {
+    LegacyServiceInfo info;
+
+    if (payload.size() != sizeof(info))
+        return false;
+
+    memcpy(&info, payload.data(), sizeof(info));
+    label = info.label;
+    state = info.state;
+    pid   = -1;
+    name.assign(info.name, strnlen(info.name, sizeof(info.name)));
+    cmd.assign(info.cmd, strnlen(info.cmd, sizeof(info.cmd)));
+    startTime.clear();
+    return true;
+}
+
+// StateEvent ------------------------------------------------
+/* subscription | label | state | pid | exitCode | coalesced | name */
+void SaceServiceInfo::StateEvent::writeTo (SacePayload &payload) const {
+    int32_t state = this->state;
+    int32_t pid   = this->pid;
+
+    payload.clear();
+    payload.reserve(sizeof(subscription) + sizeof(label) + sizeof(state) + sizeof(pid) + sizeof(exitCode)
+        + sizeof(coalesced) + sizeof(uint32_t) + name.size());
+
+    payload.append(&subscription, sizeof(subscription));
+    payload.append(&label, sizeof(label));
+    payload.append(&state, sizeof(state));
+    payload.append(&pid, sizeof(pid));
+    payload.append(&exitCode, sizeof(exitCode));
+    payload.append(&coalesced, sizeof(coalesced));
+    put_str(payload, name);
+}
+
+bool SaceServiceInfo::StateEvent::readFrom (const SacePayload &payload) {
+    int32_t state, pid;
+    size_t offset = 0;
+
+    if (payload.size() < sizeof(subscription) + sizeof(label) + sizeof(state) + sizeof(pid) + sizeof(exitCode) + sizeof(coalesced))
+        return false;
+
+    memcpy(&subscription, payload.data() + offset, sizeof(subscription));
+    offset += sizeof(subscription);
+    memcpy(&label, payload.data() + offset, sizeof(label));
+    offset += sizeof(label);
+    memcpy(&state, payload.data() + offset, sizeof(state));
+    offset += sizeof(state);
+    memcpy(&pid, payload.data() + offset, sizeof(pid));
+    offset += sizeof(pid);
+    memcpy(&exitCode, payload.data() + offset, sizeof(exitCode));
+    offset += sizeof(exitCode);
+    memcpy(&coalesced, payload.data() + offset, sizeof(coalesced));
+    offset += sizeof(coalesced);
+
+    this->state = static_cast<enum ServiceState>(state);
+    this->pid   = pid;
+    return get_str(payload, offset, name);
+}
+
 }; //namespace android
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+
+#include "SaceStatusPage.h"
+#include "SaceLog.h"
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+namespace android {
+
+const uint32_t SaceStatusPage::MAGIC    = 0x53414345; // SACE
+const uint32_t SaceStatusPage::VERSION  = 1;
+/* header and records fill 8 pages */
+const uint32_t SaceStatusPage::CAPACITY = 255;
+const size_t   SaceStatusPage::NAME_MAX_LEN = sizeof(((Record*)nullptr)->name) - 1;
+/* a reader racing the writer retries once or twice, spinning longer means
+ * the writer was preempted, and past the maximum saced died mid write */
+const int      SaceStatusPage::SPIN_READ_RETRY = 100;
+const int      SaceStatusPage::MAX_READ_RETRY  = 1000;
+
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t), "seq must be a plain word in shared memory");
+
+SaceStatusPage::SaceStatusPage () {
+    mBase = nullptr;
+    mFd   = -1;
+}
+
+SaceStatusPage::~SaceStatusPage () {
+    detach();
+}
+
+size_t SaceStatusPage::size () {
+    return sizeof(Header) + sizeof(Record) * CAPACITY;
+}
+
+bool SaceStatusPage::create () {
+    void *base;
+
+    /* bionic declares memfd_create from API 30 only */
+    int fd = syscall(__NR_memfd_create, "sace_status", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        SACE_LOGE("SaceStatusPage memfd_create errno=%d errstr=%s", errno, strerror(errno));
+        return false;
+    }
+
+    if (ftruncate(fd, size()) < 0) {
+        SACE_LOGE("SaceStatusPage ftruncate errno=%d errstr=%s", errno, strerror(errno));
+        goto err;
+    }
+
+    base = mmap(nullptr, size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        SACE_LOGE("SaceStatusPage mmap errno=%d errstr=%s", errno, strerror(errno));
+        goto err;
+    }
+
+    /* clients never see it shrink under their mapping nor map it writable,
+     * our own writable mapping predates the seal */
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE) < 0) {
+        SACE_LOGW("SaceStatusPage seal write errno=%d errstr=%s", errno, strerror(errno));
+        if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+            SACE_LOGE("SaceStatusPage seal size errno=%d errstr=%s", errno, strerror(errno));
+            munmap(base, size());
+            goto err;
+        }
+    }
+
+    mBase = base;
+    mFd   = fd;
+    header()->capacity   = CAPACITY;
+    header()->recordSize = sizeof(Record);
+    header()->version    = VERSION;
+    atomic_thread_fence(memory_order_release);
+    header()->magic      = MAGIC;
+    return true;
+
+err:
+    close(fd);
+    return false;
+}
+
+bool SaceStatusPage::attach (int fd) {
+    struct stat st;
+    void *base = MAP_FAILED;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Header)) {
+        SACE_LOGE("SaceStatusPage invalid fd %d errno=%d errstr=%s", fd, errno, strerror(errno));
+        goto out;
+    }
+
+    base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        SACE_LOGE("SaceStatusPage mmap errno=%d errstr=%s", errno, strerror(errno));
+        goto out;
+    }
+
+    /* a saced of another layout, better no page than wrong states */
+    if (((Header*)base)->magic != MAGIC || ((Header*)base)->version != VERSION
+            || ((Header*)base)->capacity != CAPACITY || ((Header*)base)->recordSize != sizeof(Record)
+            || (size_t)st.st_size < size()) {
+        SACE_LOGE("SaceStatusPage layout mismatch version=%u", ((Header*)base)->version);
+        munmap(base, st.st_size);
+        base = MAP_FAILED;
+        goto out;
+    }
+
+    detach();
+    mBase = base;
+
+out:
+    close(fd);
+    return base != MAP_FAILED;
+}
+
+void SaceStatusPage::detach () {
+    if (mBase != nullptr)
+        munmap(mBase, size());
+    if (mFd >= 0)
+        close(mFd);
+
+    mBase = nullptr;
+    mFd   = -1;
+}
+
+bool SaceStatusPage::covers (uint64_t label) {
+    uint32_t slot = (uint32_t)label;
+    return slot > 0 && slot <= CAPACITY;
+}
+
+void SaceStatusPage::write (const SaceServiceInfo::ServiceStatus &status) {
+    if (mBase == nullptr || !covers(status.label))
+        return;
+
+    Record *rec = record((uint32_t)status.label - 1);
+    uint32_t seq = rec->seq.load(memory_order_relaxed);
+
+    rec->seq.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    rec->state     = status.state;
+    rec->label     = status.label;
+    rec->startTime = status.startTime;
+    rec->cpuTimeMs = status.cpuTimeMs;
+    rec->pid       = status.pid;
+    rec->exitCode  = status.exitCode;
+    strncpy(rec->name, status.name.c_str(), NAME_MAX_LEN);
+    rec->name[NAME_MAX_LEN] = '\0';
+
+    rec->seq.store(seq + 2, memory_order_release);
+}
+
+bool SaceStatusPage::copy_record (const Record *rec, Record &copy) const {
+    for (int i = 0; i < MAX_READ_RETRY; i++) {
+        /* the writer got preempted inside the record, let it finish */
+        if (i >= SPIN_READ_RETRY)
+            sched_yield();
+
+        uint32_t seq = rec->seq.load(memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        copy.state     = rec->state;
+        copy.label     = rec->label;
+        copy.startTime = rec->startTime;
+        copy.cpuTimeMs = rec->cpuTimeMs;
+        copy.pid       = rec->pid;
+        copy.exitCode  = rec->exitCode;
+        memcpy(copy.name, rec->name, sizeof(copy.name));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (rec->seq.load(memory_order_relaxed) == seq) {
+            copy.name[NAME_MAX_LEN] = '\0';
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SaceStatusPage::to_status (const Record &rec, SaceServiceInfo::ServiceStatus &status) {
+    status.name      = rec.name;
+    status.label     = rec.label;
+    status.pid       = rec.pid;
+    status.state     = (enum SaceServiceInfo::ServiceState)rec.state;
+    status.startTime = rec.startTime;
+    status.exitCode  = rec.exitCode;
+    status.cpuTimeMs = rec.cpuTimeMs;
+}
+
+bool SaceStatusPage::read (uint64_t label, SaceServiceInfo::ServiceStatus &status) const {
+    Record copy;
+
+    if (mBase == nullptr || !covers(label))
+        return false;
+
+    if (!copy_record(record((uint32_t)label - 1), copy) || copy.label != label)
+        return false;
+
+    to_status(copy, status);
+    return true;
+}
+
+bool SaceStatusPage::find (const char *name, SaceServiceInfo::ServiceStatus &status) const {
+    Record copy;
+    bool found = false, live = false;
+
+    if (mBase == nullptr || strlen(name) >= NAME_MAX_LEN)
+        return false;
+
+    for (uint32_t i = 0; i < CAPACITY && !live; i++) {
+        if (!copy_record(record(i), copy) || copy.label == 0 || strcmp(copy.name, name) != 0)
+            continue;
+
+        live = copy.state == SaceServiceInfo::SERVICE_RUNNING || copy.state == SaceServiceInfo::SERVICE_PAUSED
+            || copy.state == SaceServiceInfo::SERVICE_FINISHING_USER;
+        if (!found || live || copy.startTime >= status.startTime)
+            to_status(copy, status);
+        found = true;
+    }
+
+    return found;
+}
+
+}; //namespace android
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_STATUS_PAGE_H
+#define _SACE_STATUS_PAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include <sace/SaceServiceInfo.h>
+
+using namespace std;
+
+namespace android {
+
+/* Service status shared with clients through one memfd.
+ * saced maps it writable and is the only writer (SEService.MT), clients
+ * get the fd once with SACE_SERVICE_CMD_STATUS and map it read only, then
+ * read without IPC or syscalls. Every record is a seqlock: the writer makes
+ * its sequence odd, stores the fields and makes it even again; a reader
+ * retries until it copied the record between two equal even sequences, and
+ * only yields if it caught the writer preempted inside a record.
+ *
+ * The record of a service is the slot of its label, the low word of a
+ * label is slot index + 1 (SaceSlotMap). Reaped services keep their last
+ * record until the slot is reused, so exit code and cpu time stay readable.
+ * Services past CAPACITY have no record, ask saced for those.
+ */
+class SaceStatusPage {
+public:
+    static const uint32_t MAGIC;
+    static const uint32_t VERSION;
+    static const uint32_t CAPACITY;
+    /* names this long and longer are cut, find() misses them */
+    static const size_t NAME_MAX_LEN;
+
+    SaceStatusPage ();
+    ~SaceStatusPage ();
+
+    /* saced, a new memfd mapped writable, sealed against resizing */
+    bool create ();
+    /* client, maps fd read only and closes it */
+    bool attach (int fd);
+    void detach ();
+
+    bool mapped () const {
+        return mBase != nullptr;
+    }
+
+    /* -1 unless created here */
+    int fd () const {
+        return mFd;
+    }
+
+    /* false if services with label have no record in any page */
+    static bool covers (uint64_t label);
+
+    /* single writer, the record of status.label */
+    void write (const SaceServiceInfo::ServiceStatus &status);
+
+    /* false if the record is not of label (anymore) */
+    bool read (uint64_t label, SaceServiceInfo::ServiceStatus &status) const;
+    /* live service of that name first, else the latest one started */
+    bool find (const char *name, SaceServiceInfo::ServiceStatus &status) const;
+
+private:
+    static const int SPIN_READ_RETRY;
+    static const int MAX_READ_RETRY;
+
+    /* fixed layout, same offsets for 32 and 64 bit processes */
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t capacity;
+        uint32_t recordSize;
+        uint8_t  reserved[112];
+    };
+
+    struct Record {
+        atomic<uint32_t> seq;
+        int32_t  state;
+        uint64_t label;
+        int64_t  startTime;
+        uint64_t cpuTimeMs;
+        int32_t  pid;
+        int32_t  exitCode;
+        char     name[88];
+    };
+
+    Header *header () const {
+        return (Header*)mBase;
+    }
+
+    Record *record (uint32_t index) const {
+        return (Record*)((uint8_t*)mBase + sizeof(Header)) + index;
+    }
+
+    static size_t size ();
+    bool copy_record (const Record *rec, Record &copy) const;
+    static void to_status (const Record &rec, SaceServiceInfo::ServiceStatus &status);
+
+    void  *mBase;
+    int    mFd;
+};
+
+}; //namespace android
+
+#endif
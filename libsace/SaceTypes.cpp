@@ -14,12 +14,29 @@
 #include "SaceTypes.h"
 
 namespace android {
-uint16_t SaceCommandHeader::mSequence = 0;
+atomic<uint32_t> SaceCommandHeader::mSequence(0);
+
+static void write_payload (Parcel *data, const SacePayload &payload) {
+    data->writeUint32(payload.size());
+    data->write(payload.data(), payload.size());
+}
+
+/* length comes from the peer, a bad one leaves the payload empty */
+static void read_payload (const Parcel *data, SacePayload &payload) {
+    uint32_t len = data->readUint32();
+
+    payload.clear();
+    if (len > SacePayload::MAX_SIZE || len > data->dataAvail())
+        return;
+
+    payload.resize(len);
+    data->read(payload.data(), len);
+}
 
 void SaceCommandHeader::reserveSpace (Parcel *data) const {
     data->writeUint32(0);
     data->writeByte(static_cast<int8_t>(type));
-    data->writeUint32(sequence);
+    data->writeUint32(static_cast<uint32_t>(sequence));
 }
 
 status_t SaceCommandHeader::writeToParcel (Parcel *data) const {
@@ -44,6 +61,16 @@ uint32_t SaceCommandHeader::parcelSize () {
     return sizeof(uint32_t)*2 + sizeof(int8_t);
 }
 
+uint64_t SaceCommandHeader::nextSequence () {
+    uint32_t sequence;
+
+    do {
+        sequence = ++mSequence;
+    } while (sequence == 0);
+
+    return sequence;
+}
+
 string SaceCommandHeader::mapCmdTypeStr (enum SaceCommandType type) {
     switch (type) {
         case SACE_TYPE_NORMAL:
@@ -52,6 +79,10 @@ string SaceCommandHeader::mapCmdTypeStr (enum SaceCommandType type) {
             return "SACE_TYPE_SERVICE";
         case SACE_TYPE_EVENT:
             return "SACE_TYPE_EVENT";
+        case SACE_TYPE_BATCH:
+            return "SACE_TYPE_BATCH";
+        case SACE_TYPE_HELLO:
+            return "SACE_TYPE_HELLO";
         default:
             return "UNKNOWN";
     }
@@ -60,12 +91,23 @@ string SaceCommandHeader::mapCmdTypeStr (enum SaceCommandType type) {
 // SaceCommand ----------------------------------------------------
 status_t SaceCommand::writeToParcel (Parcel *data) const {
     reserveSpace(data);
+    writeBody(data);
+
+    return SaceCommandHeader::writeToParcel(data);
+}
+
+status_t SaceCommand::readFromParcel (const Parcel *data) {
+    SaceCommandHeader::readFromParcel(data);
+    readBody(data);
+
+    return OK;
+}
 
+void SaceCommand::writeBody (Parcel *data) const {
     data->writeUint64(label);
     data->writeUtf8AsUtf16(name);
     data->writeUtf8AsUtf16(command);
-    data->writeUint32(extraLen);
-    data->write(extra, extraLen);
+    write_payload(data, extra);
 
     if (type == SACE_TYPE_NORMAL) {
         data->writeByte(static_cast<int8_t>(normalCmdType));
@@ -87,18 +129,13 @@ status_t SaceCommand::writeToParcel (Parcel *data) const {
     }
     else
         data->writeBool(false);
-
-    return SaceCommandHeader::writeToParcel(data);
 }
 
-status_t SaceCommand::readFromParcel (const Parcel *data) {
-    SaceCommandHeader::readFromParcel(data);
-
+void SaceCommand::readBody (const Parcel *data) {
     label = data->readUint64();
     data->readUtf8FromUtf16(&name);
     data->readUtf8FromUtf16(&command);
-    extraLen = data->readUint32();
-    data->read(extra, extraLen);
+    read_payload(data, extra);
 
     if (type == SACE_TYPE_NORMAL) {
         normalCmdType = static_cast<enum SaceNormalCommandType>(data->readByte());
@@ -118,8 +155,6 @@ status_t SaceCommand::readFromParcel (const Parcel *data) {
         command_params = (type == SACE_TYPE_EVENT)? make_shared<SaceEventParams>() : make_shared<SaceCommandParams>();
         command_params->readFromParcel(data);
     }
-
-    return OK;
 }
 
 string SaceCommand::mapServiceCmdTypeStr (enum SaceServiceCommandType type) {
@@ -134,6 +169,16 @@ string SaceCommand::mapServiceCmdTypeStr (enum SaceServiceCommandType type) {
             return "SACE_SERVICE_CMD_PAUSE";
         case SACE_SERVICE_CMD_RESTART:
             return "SACE_SERVICE_CMD_RESTART";
+        case SACE_SERVICE_CMD_ATTACH:
+            return "SACE_SERVICE_CMD_ATTACH";
+        case SACE_SERVICE_CMD_STATUS:
+            return "SACE_SERVICE_CMD_STATUS";
+        case SACE_SERVICE_CMD_SUBSCRIBE:
+            return "SACE_SERVICE_CMD_SUBSCRIBE";
+        case SACE_SERVICE_CMD_UNSUBSCRIBE:
+            return "SACE_SERVICE_CMD_UNSUBSCRIBE";
+        case SACE_SERVICE_CMD_DETACH:
+            return "SACE_SERVICE_CMD_DETACH";
         default:
             return "UNKNOWN";
     }
@@ -191,6 +236,8 @@ string SaceCommand::mapEventTypeStr (enum SaceEventType type) {
             return "SACE_EVENT_TYPE_DEL";
         case SACE_EVENT_TYPE_INFO:
             return "SACE_EVENT_TYPE_INFO";
+        case SACE_EVENT_TYPE_RELOAD:
+            return "SACE_EVENT_TYPE_RELOAD";
         default:
             return "UNKNOWN";
     }
@@ -220,6 +267,42 @@ const string SaceCommand::to_string() const {
     return cmdDescriptor;
 }
 
+// SaceBatchCommand ----------------------------------------------
+status_t SaceBatchCommand::writeToParcel (Parcel *data) const {
+    reserveSpace(data);
+
+    data->writeUint32(commands.size());
+    for (auto &cmd : commands) {
+        data->writeByte(static_cast<int8_t>(cmd.type));
+        data->writeUint32(static_cast<uint32_t>(cmd.sequence));
+        cmd.writeBody(data);
+    }
+
+    return SaceCommandHeader::writeToParcel(data);
+}
+
+status_t SaceBatchCommand::readFromParcel (const Parcel *data) {
+    SaceCommandHeader::readFromParcel(data);
+
+    uint32_t count = data->readUint32();
+    if (count > SACE_BATCH_MAX_ITEMS)
+        return BAD_VALUE;
+
+    commands.resize(count);
+    for (auto &cmd : commands) {
+        cmd.type = static_cast<enum SaceCommandType>(data->readByte());
+        cmd.sequence = data->readUint32();
+        cmd.readBody(data);
+    }
+
+    return OK;
+}
+
+const string SaceBatchCommand::to_string() const {
+    return string("SaceBatchCommand={sequence=") + ::to_string(sequence)
+        + " commands=" + ::to_string(commands.size()) + "}";
+}
+
 // SaceResultHeader --------------------------------------------
 uint32_t SaceResultHeader::parcelSize () {
     return sizeof(uint32_t) + sizeof(int8_t);
@@ -250,34 +333,38 @@ status_t SaceResultHeader::readFromParcel (const Parcel *data) {
 // SaceResult ------------------------------------------------
 status_t SaceResult::writeToParcel (Parcel *data) const {
     reserveSpace(data);
+    writeBody(data);
 
-    data->writeUint32(sequence);
+    return SaceResultHeader::writeToParcel(data);
+}
+
+status_t SaceResult::readFromParcel (const Parcel *data) {
+    SaceResultHeader::readFromParcel(data);
+    readBody(data);
+
+    return OK;
+}
+
+void SaceResult::writeBody (Parcel *data) const {
+    data->writeUint32(static_cast<uint32_t>(sequence));
     data->writeUtf8AsUtf16(name);
     data->writeByte(static_cast<int8_t>(resultType));
     data->writeByte(static_cast<int8_t>(resultStatus));
-    data->writeUint32(resultExtraLen);
-    data->write(resultExtra, resultExtraLen);
+    write_payload(data, resultExtra);
 
     if (resultType == SACE_RESULT_TYPE_FD)
         data->writeFileDescriptor(resultFd);
-
-    return SaceResultHeader::writeToParcel(data);
 }
 
-status_t SaceResult::readFromParcel (const Parcel *data) {
-    SaceResultHeader::readFromParcel(data);
-
+void SaceResult::readBody (const Parcel *data) {
     sequence = data->readUint32();
     data->readUtf8FromUtf16(&name);
     resultType   = static_cast<enum SaceResultType>(data->readByte());
     resultStatus = static_cast<enum SaceResultStatus>(data->readByte());
-    resultExtraLen = data->readUint32();
-    data->read(resultExtra, resultExtraLen);
+    read_payload(data, resultExtra);
 
    if (resultType == SACE_RESULT_TYPE_FD)
         resultFd = data->readFileDescriptor();
-
-    return OK;
 }
 
 string SaceResult::mapResultTypeStr (enum SaceResultType type) {
@@ -323,6 +410,38 @@ const string SaceResult::to_string() const {
     return resultDescriptor;
 }
 
+// SaceBatchResult ------------------------------------------------------
+status_t SaceBatchResult::writeToParcel (Parcel *data) const {
+    reserveSpace(data);
+
+    data->writeUint32(static_cast<uint32_t>(sequence));
+    data->writeUint32(results.size());
+    for (auto &rslt : results)
+        rslt.writeBody(data);
+
+    return SaceResultHeader::writeToParcel(data);
+}
+
+status_t SaceBatchResult::readFromParcel (const Parcel *data) {
+    SaceResultHeader::readFromParcel(data);
+
+    sequence = data->readUint32();
+    uint32_t count = data->readUint32();
+    if (count > SACE_BATCH_MAX_ITEMS)
+        return BAD_VALUE;
+
+    results.resize(count);
+    for (auto &rslt : results)
+        rslt.readBody(data);
+
+    return OK;
+}
+
+const string SaceBatchResult::to_string() const {
+    return string("SaceBatchResult={sequence=") + ::to_string(sequence)
+        + " results=" + ::to_string(results.size()) + "}";
+}
+
 // SaceResponse ---------------------------------------------------------
 status_t SaceStatusResponse::writeToParcel (Parcel *data) const {
     reserveSpace(data);
@@ -331,8 +450,7 @@ status_t SaceStatusResponse::writeToParcel (Parcel *data) const {
     data->writeUtf8AsUtf16(name);
     data->writeByte(static_cast<int8_t>(type));
     data->writeByte(static_cast<int8_t>(status));
-    data->writeUint32(extraLen);
-    data->write(extra, extraLen);
+    write_payload(data, extra);
 
     return SaceResultHeader::writeToParcel(data);
 }
@@ -344,8 +462,7 @@ status_t SaceStatusResponse::readFromParcel (const Parcel *data) {
     data->readUtf8FromUtf16(&name);
     type   = static_cast<enum SaceResponseType>(data->readByte());
     status = static_cast<enum SaceResponseStatus>(data->readByte());
-    extraLen = data->readUint32();
-    data->read(extra, extraLen);
+    read_payload(data, extra);
 
     return OK;
 }
@@ -360,6 +477,8 @@ string SaceStatusResponse::mapStatusStr (enum SaceResponseStatus status) {
             return "SACE_RESPONSE_STATUS_USER";
         case SACE_RESPONSE_STATUS_UNKNOWN:
             return "SACE_RESPONSE_STATUS_UNKNOWN";
+        case SACE_RESPONSE_STATUS_CHANGED:
+            return "SACE_RESPONSE_STATUS_CHANGED";
         default:
             return "UNKNOWN";
     }
@@ -371,6 +490,8 @@ string SaceStatusResponse::mapTypeStr (enum SaceResponseType type) {
             return "SACE_RESPONSE_TYPE_NORMAL";
         case SACE_RESPONSE_TYPE_SERVICE:
             return "SACE_RESPONSE_TYPE_SERVICE";
+        case SACE_RESPONSE_TYPE_STATE:
+            return "SACE_RESPONSE_TYPE_STATE";
         default:
             return "UNKNOWN";
     }
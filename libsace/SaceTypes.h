@@ -20,13 +20,17 @@
 #include <binder/Parcelable.h>
 #include <binder/Parcel.h>
 #include <utils/RefBase.h>
+#include <atomic>
 
 #include <sace/SaceServiceInfo.h>
 #include <sace/SaceParams.h>
+#include "SacePool.h"
 
 using namespace std;
 
 #define SACE_RESULT_BUF_SIZE  1024
+/* items of one batch, all fds of a batch result travel in one SCM_RIGHTS */
+#define SACE_BATCH_MAX_ITEMS  64
 
 /* Note : we consider ENUM as uint8_t when parcelable
  */
@@ -36,16 +40,24 @@ enum SaceCommandType {
     SACE_TYPE_NORMAL,
     SACE_TYPE_SERVICE,
     SACE_TYPE_EVENT,
+    SACE_TYPE_BATCH,
+    /* codec negotiation, extra[0] is the mask of codecs the client decodes */
+    SACE_TYPE_HELLO,
 };
 
 class SaceCommandHeader : public Parcelable, public RefBase {
 private:
-    static uint16_t mSequence;
+    /* Process wide, so unique on every connection of this process, and
+     * never 0. It wraps within 32 bits: Parcel frames carry the sequence
+     * as uint32 as they always did, so clients and saced of older builds
+     * still read them. The compact codec takes the full width.
+     */
+    static atomic<uint32_t> mSequence;
 public:
     /* record receive dataSize while tranfer */
     uint32_t len;
     enum SaceCommandType type;
-    uint32_t sequence;
+    uint64_t sequence;
 
     SaceCommandHeader () {
         init();
@@ -60,7 +72,7 @@ public:
     void init () {
         len  = 0;
         type = SACE_TYPE_NORMAL;
-        sequence = gettid() << 16 | ++mSequence;
+        sequence = nextSequence();
     }
 
     SaceCommandHeader& operator= (const SaceCommandHeader &header) {
@@ -80,6 +92,7 @@ public:
 
     static uint32_t parcelSize();
     static string mapCmdTypeStr (enum SaceCommandType type);
+    static uint64_t nextSequence();
 };
 
 enum SaceServiceCommandType {
@@ -88,6 +101,18 @@ enum SaceServiceCommandType {
     SACE_SERVICE_CMD_PAUSE,
     SACE_SERVICE_CMD_RESTART,
     SACE_SERVICE_CMD_INFO,
+    /* saced internal, add the writer of an INFO answered by a reader */
+    SACE_SERVICE_CMD_ATTACH,
+    /* result is the fd of the shared status page, see SaceStatusPage */
+    SACE_SERVICE_CMD_STATUS,
+    /* push transitions of the services command selects (GET_BY_NAME,
+     * GET_BY_LABEL or GET_ALL) as SACE_RESPONSE_TYPE_STATE, the sequence
+     * of this command is the subscription */
+    SACE_SERVICE_CMD_SUBSCRIBE,
+    /* label is the subscription */
+    SACE_SERVICE_CMD_UNSUBSCRIBE,
+    /* saced internal, the connection of the writer closed */
+    SACE_SERVICE_CMD_DETACH,
 };
 
 enum SaceNormalCommandType {
@@ -99,6 +124,7 @@ enum SaceEventType {
     SACE_EVENT_TYPE_ADD,
     SACE_EVENT_TYPE_DEL,
     SACE_EVENT_TYPE_INFO,
+    SACE_EVENT_TYPE_RELOAD,
 };
 
 enum SaceServiceFlags {
@@ -116,14 +142,14 @@ enum SaceEventFlags {
     SACE_EVENT_FLAG_RESTART,
 };
 
-class SaceCommand : public SaceCommandHeader {
+/* heap copies come from a free list, saced makes one per request */
+class SaceCommand : public SaceCommandHeader, public SacePooled<SaceCommand> {
 public:
     uint64_t label;
     string name;
     string command;
     shared_ptr<SaceCommandParams> command_params;
-    uint8_t  extra[EXTRA_BUFER_LEN];
-    uint32_t extraLen;
+    SacePayload extra;
 
     union {
         /* SACE_TYPE_SERVICE */
@@ -150,10 +176,9 @@ public:
 
         label = 0;
         name = ::to_string(getpid()).append(":").append(::to_string(gettid()));
-        memset(extra, 0x00, sizeof(extra));
+        extra.clear();
         command = "";
         command_params = nullptr;
-        extraLen = 0;
         normalCmdType = SACE_NORMAL_CMD_START;
         flags = SACE_CMD_FLAG_IN;
     }
@@ -167,21 +192,17 @@ public:
         name  = cmd.name;
         command = cmd.command;
         command_params = cmd.command_params;
-        extraLen = cmd.extraLen;
-        memcpy(extra, cmd.extra, extraLen);
+        extra = cmd.extra;
+        copy_sub_type(cmd);
+    }
 
-        if (type == SACE_TYPE_SERVICE) {
-            serviceCmdType = cmd.serviceCmdType;
-            serviceFlags   = cmd.serviceFlags;
-        }
-        else if (type == SACE_TYPE_NORMAL) {
-            normalCmdType = cmd.normalCmdType;
-            flags = cmd.flags;
-        }
-        else if (type == SACE_TYPE_EVENT) {
-            eventType  = cmd.eventType;
-            eventFlags = cmd.eventFlags;
-        }
+    SaceCommand (SaceCommand &&cmd):SaceCommandHeader(cmd) {
+        label = cmd.label;
+        name  = std::move(cmd.name);
+        command = std::move(cmd.command);
+        command_params = std::move(cmd.command_params);
+        extra = std::move(cmd.extra);
+        copy_sub_type(cmd);
     }
 
     SaceCommand& operator= (const SaceCommand &cmd) {
@@ -190,10 +211,43 @@ public:
         label    = cmd.label;
         name     = cmd.name;
         command  = cmd.command;
-        extraLen = cmd.extraLen;
-        memcpy(extra, cmd.extra, extraLen);
+        extra    = cmd.extra;
         command_params = cmd.command_params;
+        copy_sub_type(cmd);
+
+        return *this;
+    }
+
+    SaceCommand& operator= (SaceCommand &&cmd) {
+        SaceCommandHeader::operator=(cmd);
+
+        label    = cmd.label;
+        name     = std::move(cmd.name);
+        command  = std::move(cmd.command);
+        extra    = std::move(cmd.extra);
+        command_params = std::move(cmd.command_params);
+        copy_sub_type(cmd);
+
+        return *this;
+    }
+
+    virtual status_t writeToParcel (Parcel *data) const override;
+    virtual status_t readFromParcel (const Parcel *data) override;
+    /* everything after the header, shared with SaceBatchCommand */
+    void writeBody (Parcel *data) const;
+    void readBody (const Parcel *data);
 
+    static string mapCmdTypeStr(enum SaceCommandType type);
+    static string mapServiceCmdTypeStr(enum SaceServiceCommandType type);
+    static string mapServiceFlagStr (enum SaceServiceFlags flag);
+    static string mapNormalCmdTypeStr(enum SaceNormalCommandType type);
+    static string mapNormalCmdFlagStr(enum SaceCommandFlags flag);
+    static string mapEventFlagStr (enum SaceEventFlags flag);
+    static string mapEventTypeStr (enum SaceEventType type);
+
+    const string to_string() const;
+private:
+    void copy_sub_type (const SaceCommand &cmd) {
         if (type == SACE_TYPE_SERVICE) {
             serviceCmdType = cmd.serviceCmdType;
             serviceFlags   = cmd.serviceFlags;
@@ -206,21 +260,25 @@ public:
             eventType  = cmd.eventType;
             eventFlags = cmd.eventFlags;
         }
+    }
+};
 
-        return *this;
+// ----------------------------------------------------
+/* Several commands in one frame.
+ * Items keep their own type and sequence, saced dispatches them one by one
+ * and answers with a single SaceBatchResult carrying the batch sequence.
+ */
+class SaceBatchCommand : public SaceCommandHeader {
+public:
+    vector<SaceCommand> commands;
+
+    SaceBatchCommand ():SaceCommandHeader() {
+        type = SACE_TYPE_BATCH;
     }
 
     virtual status_t writeToParcel (Parcel *data) const override;
     virtual status_t readFromParcel (const Parcel *data) override;
 
-    static string mapCmdTypeStr(enum SaceCommandType type);
-    static string mapServiceCmdTypeStr(enum SaceServiceCommandType type);
-    static string mapServiceFlagStr (enum SaceServiceFlags flag);
-    static string mapNormalCmdTypeStr(enum SaceNormalCommandType type);
-    static string mapNormalCmdFlagStr(enum SaceCommandFlags flag);
-    static string mapEventFlagStr (enum SaceEventFlags flag);
-    static string mapEventTypeStr (enum SaceEventType type);
-
     const string to_string() const;
 };
 
@@ -228,6 +286,7 @@ public:
 enum SaceResultHeaderType {
     SACE_BASE_RESULT_TYPE_NORMAL,
     SACE_BASE_RESULT_TYPE_RESPONSE,
+    SACE_BASE_RESULT_TYPE_BATCH,
 };
 
 class SaceResultHeader : public Parcelable {
@@ -246,6 +305,12 @@ public:
         len  = header.len;
     }
 
+    SaceResultHeader& operator= (const SaceResultHeader &header) {
+        type = header.type;
+        len  = header.len;
+        return *this;
+    }
+
     // must invoke after SubClass
     virtual status_t writeToParcel (Parcel *data) const override;
     // must invoke before SubClass
@@ -273,16 +338,18 @@ enum SaceResultType {
 
 class SaceResult : public SaceResultHeader {
 public:
-    uint32_t sequence;   // Corresponding to command
+    uint64_t sequence;   // Corresponding to command
     string name;         // Command|Service name
     enum SaceResultType   resultType;
     enum SaceResultStatus resultStatus;
-    uint8_t  resultExtra[EXTRA_BUFER_LEN];
-    uint32_t resultExtraLen;
+    SacePayload resultExtra;
     int resultFd;
 
     virtual status_t writeToParcel (Parcel *data) const override;
     virtual status_t readFromParcel (const Parcel *data) override;
+    /* everything after the header, shared with SaceBatchResult */
+    void writeBody (Parcel *data) const;
+    void readBody (const Parcel *data);
 
     static string mapResultTypeStr (enum SaceResultType type);
     static string mapResultStatusStr (enum SaceResultStatus status);
@@ -292,8 +359,7 @@ public:
         name = "";
         resultType   = SACE_RESULT_TYPE_NONE;
         resultStatus = SACE_RESULT_STATUS_OK;
-        resultExtraLen = 0;
-        memset(resultExtra, 0, EXTRA_BUFER_LEN);
+        resultFd = -1;
     }
 
     SaceResult (const SaceResult &rslt):SaceResultHeader(rslt) {
@@ -302,10 +368,59 @@ public:
         resultType   = rslt.resultType;
         resultStatus = rslt.resultStatus;
         resultFd = rslt.resultFd;
-        resultExtraLen = rslt.resultExtraLen;
-        memcpy(resultExtra, rslt.resultExtra, resultExtraLen);
+        resultExtra  = rslt.resultExtra;
+    }
+
+    SaceResult (SaceResult &&rslt):SaceResultHeader(rslt) {
+        sequence = rslt.sequence;
+        name = std::move(rslt.name);
+        resultType   = rslt.resultType;
+        resultStatus = rslt.resultStatus;
+        resultFd = rslt.resultFd;
+        resultExtra  = std::move(rslt.resultExtra);
+    }
+
+    SaceResult& operator= (const SaceResult &rslt) {
+        SaceResultHeader::operator=(rslt);
+        sequence = rslt.sequence;
+        name = rslt.name;
+        resultType   = rslt.resultType;
+        resultStatus = rslt.resultStatus;
+        resultFd = rslt.resultFd;
+        resultExtra  = rslt.resultExtra;
+        return *this;
+    }
+
+    SaceResult& operator= (SaceResult &&rslt) {
+        SaceResultHeader::operator=(rslt);
+        sequence = rslt.sequence;
+        name = std::move(rslt.name);
+        resultType   = rslt.resultType;
+        resultStatus = rslt.resultStatus;
+        resultFd = rslt.resultFd;
+        resultExtra  = std::move(rslt.resultExtra);
+        return *this;
+    }
+
+    const string to_string() const;
+};
+
+/* Results of a SaceBatchCommand in item order.
+ * Fds of SACE_RESULT_TYPE_FD items follow the frame in one SCM_RIGHTS, in the
+ * same order.
+ */
+class SaceBatchResult : public SaceResultHeader {
+public:
+    uint64_t sequence;   // Corresponding to batch
+    vector<SaceResult> results;
+
+    SaceBatchResult ():SaceResultHeader(SACE_BASE_RESULT_TYPE_BATCH) {
+        sequence = 0;
     }
 
+    virtual status_t writeToParcel (Parcel *data) const override;
+    virtual status_t readFromParcel (const Parcel *data) override;
+
     const string to_string() const;
 };
 
@@ -315,11 +430,14 @@ enum SaceResponseStatus {
     SACE_RESPONSE_STATUS_SIGNAL,    // Exit By Signal
     SACE_RESPONSE_STATUS_USER,      // User By User
     SACE_RESPONSE_STATUS_UNKNOWN,   // Exit Unknown
+    SACE_RESPONSE_STATUS_CHANGED,   // State Changed
 };
 
 enum SaceResponseType {
     SACE_RESPONSE_TYPE_NORMAL,
     SACE_RESPONSE_TYPE_SERVICE,
+    /* extra is a SaceServiceInfo::StateEvent */
+    SACE_RESPONSE_TYPE_STATE,
 };
 
 class SaceStatusResponse : public SaceResultHeader {
@@ -328,8 +446,7 @@ public:
     string name;                // Service name
     enum SaceResponseType type;
     enum SaceResponseStatus status;
-    uint8_t  extra[EXTRA_BUFER_LEN];
-    uint32_t extraLen;
+    SacePayload extra;
 
     virtual status_t writeToParcel (Parcel *data) const override;
     virtual status_t readFromParcel (const Parcel *data) override;
@@ -342,8 +459,6 @@ public:
         name     = "";
         type     = SACE_RESPONSE_TYPE_SERVICE;
         status   = SACE_RESPONSE_STATUS_EXIT;
-        extraLen = 0;
-        memset(extra, 0, EXTRA_BUFER_LEN);
     }
 
     SaceStatusResponse (const SaceStatusResponse &response):SaceResultHeader(response) {
@@ -351,8 +466,35 @@ public:
         name     = response.name;
         type     = response.type;
         status   = response.status;
-        extraLen = response.extraLen;
-        memcpy(extra, response.extra, extraLen);
+        extra    = response.extra;
+    }
+
+    SaceStatusResponse (SaceStatusResponse &&response):SaceResultHeader(response) {
+        label    = response.label;
+        name     = std::move(response.name);
+        type     = response.type;
+        status   = response.status;
+        extra    = std::move(response.extra);
+    }
+
+    SaceStatusResponse& operator= (const SaceStatusResponse &response) {
+        SaceResultHeader::operator=(response);
+        label    = response.label;
+        name     = response.name;
+        type     = response.type;
+        status   = response.status;
+        extra    = response.extra;
+        return *this;
+    }
+
+    SaceStatusResponse& operator= (SaceStatusResponse &&response) {
+        SaceResultHeader::operator=(response);
+        label    = response.label;
+        name     = std::move(response.name);
+        type     = response.type;
+        status   = response.status;
+        extra    = std::move(response.extra);
+        return *this;
     }
 
     const string to_string() const;
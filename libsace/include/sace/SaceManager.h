@@ -17,11 +17,14 @@
 #ifndef _SACE_MANAAGER_H
 #define _SACE_MANAAGER_H
 
+#include <functional>
+#include <future>
 #include <utils/Mutex.h>
 #include <utils/RefBase.h>
 #include <memory>
 
 #include "../../SaceSender.h"
+#include "../../SaceStatusPage.h"
 #include "SaceObj.h"
 
 #define SACE_SENDER_SOCKEET 0x01
@@ -39,21 +42,40 @@ class SaceManager : public SaceSender::Callback {
     map<uint64_t, sp<SaceServiceObj>> mServices;
     map<uint64_t, sp<SaceCommandObj>> mCommands;
     sp<SaceSender> mSender;
+    /* guard mServices and mCommands, commands themselves may run concurrently */
     Mutex mMutex;
-    SaceCommand mCmd;
-    SaceResult  mRlt;
     sp<SaceManagerCallback> mCallback;
     static SaceManager *mInstance;
     shared_ptr<SaceCommandParams> cmd_param;
     shared_ptr<SaceCommandParams> service_param;
     shared_ptr<SaceEventParams>   event_param;
 
+    static const int PAGE_RETRY_INTERVAL;
+    /* read only once mapped, mPageMutex serializes mapping it */
+    SaceStatusPage mStatusPage;
+    atomic<bool> mPageMapped;
+    time_t mPageRetry;
+    Mutex mPageMutex;
+
     SaceManager ();
     ~SaceManager ();
 
-    sp<SaceServiceObj> queryService (const char* name);
-    sp<SaceServiceObj> queryEventService (const char* name);
+    SaceCommand run_request (const char* cmd, shared_ptr<SaceCommandParams> param, bool in);
+    SaceCommand query_request (const char* name, bool event);
+    SaceCommand start_request (const char* name, const char* cmd, shared_ptr<SaceCommandParams> param);
+    SaceCommand add_event_request (const char* name, const char* cmd, shared_ptr<SaceEventParams> param);
+    SaceCommand delete_event_request (const char* name, bool stop);
+    bool map_status_page ();
+
+    sp<SaceCommandObj> command_result (const string &cmd, bool in, const SaceResult &rlt);
+    sp<SaceServiceObj> query_result (const SaceResult &rlt);
+    sp<SaceServiceObj> start_result (const string &name, const string &cmd, const SaceResult &rlt);
 public:
+    typedef function<void (sp<SaceCommandObj>)> CommandCallback;
+    typedef function<void (sp<SaceServiceObj>)> ServiceCallback;
+    typedef function<void (int)> EventCallback;
+    typedef function<void (const SaceServiceInfo::StateEvent &)> StateCallback;
+
     static SaceManager* getInstance ();
 
     void setCallback (sp<SaceManagerCallback> callback) {
@@ -64,6 +86,51 @@ public:
     sp<SaceServiceObj> checkService (const char* name, const char* cmd = nullptr, shared_ptr<SaceCommandParams> params = nullptr);
     int addEvent (const char* name, const char* cmd, shared_ptr<SaceEventParams> param = nullptr);
     int deleteEvent (const char* name, bool stop = true);
+    /* re-read changed event configs, running events are kept */
+    int reloadEvents ();
+
+    /* one round trip per SACE_BATCH_MAX_ITEMS, results keep the input order */
+    vector<sp<SaceCommandObj>> runCommands (const vector<string> &cmds, shared_ptr<SaceCommandParams> param = nullptr, bool in = true);
+    /* services as (name, command) */
+    vector<sp<SaceServiceObj>> startServices (const vector<pair<string, string>> &services, shared_ptr<SaceCommandParams> param = nullptr);
+
+    /* Status from the page saced shares, the first call maps it and later
+     * ones neither do IPC nor syscalls. false if saced has no page or the
+     * page has no such service, reaped services stay until their record is
+     * reused; checkService and getState still answer then.
+     */
+    bool peekService (uint64_t label, SaceServiceInfo::ServiceStatus &status);
+    bool peekService (const char* name, SaceServiceInfo::ServiceStatus &status);
+
+    /* State transitions pushed by saced, starting with the current state of
+     * every matching service. A name also matches services started later.
+     * A subscriber that falls behind gets the latest state per service,
+     * StateEvent::coalesced counts what it missed. Callbacks run on the
+     * sender receive thread like the async ones. 0 if saced refused.
+     */
+    uint64_t subscribe (const char* name, StateCallback callback);
+    uint64_t subscribe (uint64_t label, StateCallback callback);
+    uint64_t subscribeAll (StateCallback callback);
+    bool unsubscribe (uint64_t subscription);
+
+    /* Asynchronous variants, nothing blocks for the result.
+     * Callbacks run once on the sender receive thread and must not call the
+     * synchronous API; futures can be waited anywhere. Timeouts complete
+     * them the same as the synchronous calls would fail.
+     */
+    void runCommandAsync (const char* cmd, shared_ptr<SaceCommandParams> param, bool in, CommandCallback callback);
+    future<sp<SaceCommandObj>> runCommandAsync (const char* cmd, shared_ptr<SaceCommandParams> param = nullptr, bool in = true);
+    void checkServiceAsync (const char* name, const char* cmd, shared_ptr<SaceCommandParams> param, ServiceCallback callback);
+    future<sp<SaceServiceObj>> checkServiceAsync (const char* name, const char* cmd = nullptr, shared_ptr<SaceCommandParams> param = nullptr);
+    void addEventAsync (const char* name, const char* cmd, shared_ptr<SaceEventParams> param, EventCallback callback);
+    future<int> addEventAsync (const char* name, const char* cmd, shared_ptr<SaceEventParams> param = nullptr);
+    void deleteEventAsync (const char* name, bool stop, EventCallback callback);
+    future<int> deleteEventAsync (const char* name, bool stop = true);
+private:
+    /* by subscription, guarded by mMutex */
+    map<uint64_t, StateCallback> mSubscriptions;
+
+    uint64_t subscribe (SaceCommand &&request, StateCallback callback);
 protected:
     virtual void onResponse (const SaceStatusResponse &response);
 };
@@ -140,6 +140,8 @@ public:
     }
 
     enum SaceServiceInfo::ServiceState getState() throw (RemoteException, InvalidOperation);
+    /* getState from the status page without IPC, asks saced if the page cannot tell */
+    enum SaceServiceInfo::ServiceState peekState() throw (RemoteException, InvalidOperation);
 };
 
 }; //namespace android
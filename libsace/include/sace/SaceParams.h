@@ -50,7 +50,7 @@ namespace android {
 class Trigger {
 public:
     virtual bool triggered () = 0;
-    virtual string to_string () const;
+    virtual string to_string () const = 0;
     virtual ~Trigger () {}
 };
 
@@ -98,6 +98,8 @@ struct EventParams : public RefBase {
 
 /* User friendly Comamnd Params */
 class SaceEvent;
+class SaceEventCache;
+class SaceCodec;
 class SaceCommandParams : public Parcelable {
     string uid;
     string gid;
@@ -107,6 +109,8 @@ class SaceCommandParams : public Parcelable {
     CapSet capabilities;
 
     friend class SaceEvent;
+    friend class SaceEventCache;
+    friend class SaceCodec;
 private:
     bool decode_uid (string uid_str, uid_t* uid) const;
 
@@ -134,7 +138,7 @@ public:
 
     void add_rlimits (int rlimit, int soft, int hard) {
         stringstream in_stream;
-        in_stream<<rlimit<<soft<<hard;
+        in_stream<<rlimit<<" "<<soft<<" "<<hard;
         rlimits.push_back(in_stream.str());
     }
 
@@ -153,6 +157,8 @@ class SaceEventParams : public SaceCommandParams {
 
     friend class SaceManager;
     friend class SaceEvent;
+    friend class SaceEventCache;
+    friend class SaceCodec;
 public:
     SaceEventParams () {
         boot = true;
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_PAYLOAD_H
+#define _SACE_PAYLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace android {
+
+/* Variable length extra bytes of commands, results and responses.
+ * Labels, exit status and flags fit the inline buffer; larger payloads such
+ * as a serialized ServiceInfo go to the heap. Moves steal the heap buffer.
+ */
+class SacePayload {
+public:
+    static const size_t INLINE_SIZE = 16;
+    /* bound for lengths read from the wire */
+    static const size_t MAX_SIZE = 64 * 1024;
+
+    SacePayload ():mSize(0),mCapacity(INLINE_SIZE) {}
+
+    SacePayload (const void *data, size_t len):SacePayload() {
+        assign(data, len);
+    }
+
+    SacePayload (const SacePayload &payload):SacePayload() {
+        assign(payload.data(), payload.size());
+    }
+
+    SacePayload (SacePayload &&payload):SacePayload() {
+        steal(payload);
+    }
+
+    ~SacePayload () {
+        if (onHeap())
+            delete[] mHeap;
+    }
+
+    SacePayload& operator= (const SacePayload &payload) {
+        if (this != &payload)
+            assign(payload.data(), payload.size());
+        return *this;
+    }
+
+    SacePayload& operator= (SacePayload &&payload) {
+        if (this != &payload) {
+            reset();
+            steal(payload);
+        }
+        return *this;
+    }
+
+    const uint8_t* data () const {
+        return onHeap() ? mHeap : mInline;
+    }
+
+    uint8_t* data () {
+        return onHeap() ? mHeap : mInline;
+    }
+
+    size_t size () const {
+        return mSize;
+    }
+
+    bool empty () const {
+        return mSize == 0;
+    }
+
+    uint8_t operator[] (size_t index) const {
+        return data()[index];
+    }
+
+    void clear () {
+        mSize = 0;
+    }
+
+    /* keeps the first len bytes that fit, new bytes are undefined */
+    void resize (size_t len) {
+        if (len > mCapacity) {
+            uint8_t *heap = new uint8_t[len];
+            memcpy(heap, data(), mSize);
+            if (onHeap())
+                delete[] mHeap;
+            mHeap = heap;
+            mCapacity = len;
+        }
+        mSize = len;
+    }
+
+    void assign (const void *bytes, size_t len) {
+        mSize = 0;
+        resize(len);
+        if (len > 0)
+            memcpy(data(), bytes, len);
+    }
+
+    void append (const void *bytes, size_t len) {
+        size_t offset = mSize;
+        if (offset + len > mCapacity)
+            reserve(offset + len > 2 * mCapacity ? offset + len : 2 * mCapacity);
+        mSize = offset + len;
+        if (len > 0)
+            memcpy(data() + offset, bytes, len);
+    }
+
+    void reserve (size_t len) {
+        size_t size = mSize;
+        if (len > mCapacity) {
+            resize(len);
+            mSize = size;
+        }
+    }
+
+    /* trivially copyable values only */
+    template<typename T> void put (const T &value) {
+        assign(&value, sizeof(T));
+    }
+
+    template<typename T> bool get (T &value) const {
+        if (mSize < sizeof(T))
+            return false;
+
+        memcpy(&value, data(), sizeof(T));
+        return true;
+    }
+
+private:
+    uint32_t mSize;
+    uint32_t mCapacity;
+    union {
+        uint8_t  mInline[INLINE_SIZE];
+        uint8_t *mHeap;
+    };
+
+    bool onHeap () const {
+        return mCapacity > INLINE_SIZE;
+    }
+
+    void reset () {
+        if (onHeap())
+            delete[] mHeap;
+        mSize = 0;
+        mCapacity = INLINE_SIZE;
+    }
+
+    void steal (SacePayload &payload) {
+        if (payload.onHeap()) {
+            mHeap = payload.mHeap;
+            mSize = payload.mSize;
+            mCapacity = payload.mCapacity;
+            payload.mSize = 0;
+            payload.mCapacity = INLINE_SIZE;
+        }
+        else
+            assign(payload.mInline, payload.mSize);
+    }
+};
+
+}; //namespace android
+
+#endif
@@ -20,21 +20,13 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#include <time.h>
 #include <string>
 
-using namespace std;
-
-#define EXTRA_BUFER_LEN  256
-#define CMD_BUFFER_LEN   128
-#define SERVICE_NAME_LEN 64
+#include "SacePayload.h"
 
-#if CMD_BUFFER_LEN + EXTRA_BUFER_LEN > 1024
-    #error "CMD_BUFFER_LEN And EXTRA_BUFER_LEN Larger Than 1k"
-#endif
-
-#if CMD_BUFFER_LEN + SERVICE_NAME_LEN + 4*2 >= EXTRA_BUFER_LEN
-    #error "EXTRA_BUFER_LEN TOO SMALL"
-#endif
+using namespace std;
 
 namespace android {
 class SaceServiceExcutor;
@@ -57,15 +49,61 @@ public:
     /* Info Command */
     static const string SERVICE_GET_BY_NAME;
 	static const string SERVICE_GET_BY_LABEL;
+    /* subscriptions only */
+    static const string SERVICE_GET_ALL;
 
     static string mapStateStr (enum ServiceState);
 
-    /* sizeof(ServiceInfo) < EXTRA_BUFER_LEN */
+    /* resultExtra of SACE_SERVICE_CMD_INFO, full length strings */
     struct ServiceInfo {
-        char name[SERVICE_NAME_LEN];
-        char cmd[CMD_BUFFER_LEN];
+        string name;
+        string cmd;
         enum ServiceState state;
         uint64_t label;
+        pid_t pid;
+        string startTime;
+
+        ServiceInfo ():state(SERVICE_UNKNOWN),label(0),pid(-1) {}
+
+        /* versioned, for clients that negotiated the compact codec */
+        void writeTo (SacePayload &payload) const;
+        /* fixed struct of older builds: name and cmd cut to 63 and 127
+         * bytes, no pid or start time */
+        void writeLegacyTo (SacePayload &payload) const;
+        /* either layout, false if payload is truncated */
+        bool readFrom (const SacePayload &payload);
+    private:
+        bool read_legacy (const SacePayload &payload);
+    };
+
+    /* one service read from the shared status page, see SaceManager::peekService */
+    struct ServiceStatus {
+        string name;
+        uint64_t label;
+        pid_t pid;
+        enum ServiceState state;
+        time_t startTime;       /* CLOCK_REALTIME seconds */
+        int32_t exitCode;       /* exit code or signal once finished, 0 before */
+        uint64_t cpuTimeMs;     /* user + system, refreshed every second while running */
+
+        ServiceStatus ():label(0),pid(-1),state(SERVICE_UNKNOWN),startTime(0),exitCode(0),cpuTimeMs(0) {}
+    };
+
+    /* extra of SACE_RESPONSE_TYPE_STATE, one transition pushed to a subscriber */
+    struct StateEvent {
+        uint64_t subscription;
+        uint64_t label;
+        string name;
+        pid_t pid;
+        enum ServiceState state;
+        int32_t exitCode;       /* exit code or signal once finished */
+        uint32_t coalesced;     /* earlier transitions this one replaced, the subscriber was behind */
+
+        StateEvent ():subscription(0),label(0),pid(-1),state(SERVICE_UNKNOWN),exitCode(0),coalesced(0) {}
+
+        void writeTo (SacePayload &payload) const;
+        /* false if payload is truncated */
+        bool readFrom (const SacePayload &payload);
     };
 };
 
@@ -24,13 +24,31 @@ LOCAL_SRC_FILES :=               \
 	SaceCommandDispatcher.cpp    \
 	SaceCommandMonitor.cpp       \
 	SaceEvent.cpp 				 \
+	SaceEventCache.cpp		 \
+	SaceEventJournal.cpp		 \
+	SaceEventLoader.cpp		 \
 	SaceExcutor.cpp				 \
 	sace_main.cpp				 \
 	SaceMessage.cpp				 \
 	SaceReader.cpp				 \
+	SaceRingReader.cpp			 \
+	SaceServiceTable.cpp		 \
+	SaceStats.cpp				 \
+	SaceSubscription.cpp		 \
+	SaceUring.cpp				 \
 	SaceWriter.cpp				 \
 
 LOCAL_C_INCLUDES := $(LIB_SACE_INCLUDE)
+LOCAL_CPPFLAGS += -std=c++17
+
+# io_uring engine for the socket readers, the kernel is still probed at
+# runtime and epoll serves where it falls short. Off until sace.te grants
+# the io_uring class and its anon_inode, enforcing devices deny the setup
+SACE_IO_URING ?= false
+ifeq ($(SACE_IO_URING),true)
+LOCAL_CFLAGS += -DSACE_IO_URING
+endif
+
 LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libselinux libcap
 LOCAL_STATIC_LIBRARIES := libsace
 LOCAL_MODULE := saced
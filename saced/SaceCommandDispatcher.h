@@ -68,7 +68,10 @@ protected:
     void post(sp<SaceMessageHeader> msg);
 
 private:
-    class MessageHandlerWrapper : public MessageHandler {
+    friend class SaceStats;
+
+    /* one per posted message */
+    class MessageHandlerWrapper : public MessageHandler, public SacePooled<MessageHandlerWrapper> {
         MessageDistributable *self;
         sp<SaceMessageHeader> msg;
         void handleMessage (const Message &message);
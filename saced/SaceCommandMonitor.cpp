@@ -19,6 +19,8 @@
 
 namespace android {
 const char *SaceCommandMonitor::SOCKET_NAME = "sace_socket";
+const char *SaceCommandMonitor::SEQPACKET_SOCKET_NAME = "sace_seqpacket";
+const char *SaceCommandMonitor::RING_SOCKET_NAME = "sace_ring";
 
 bool SaceCommandMonitor::startListen () {
     vector<SaceReader*> startedReaders;
@@ -31,8 +33,13 @@ bool SaceCommandMonitor::startListen () {
             success = false;
     }
 
-    if (success)
+    if (success) {
+        for (vector<SaceReader*>::iterator it = mOptionalReaders.begin(); it != mOptionalReaders.end(); it++) {
+            if (!(*it)->startRead())
+                SACE_LOGE("SaceCommandMonitor optional transport failed, keep serving on %s", SOCKET_NAME);
+        }
         return true;
+    }
 
     for (vector<SaceReader*>::reverse_iterator it = startedReaders.rbegin(); it != startedReaders.rend(); it++) {
         (*it)->stopRead();
@@ -42,11 +49,15 @@ bool SaceCommandMonitor::startListen () {
 }
 
 void SaceCommandMonitor::stopListen () {
+    for (vector<SaceReader*>::iterator it = mOptionalReaders.begin(); it != mOptionalReaders.end(); it++)
+        (*it)->stopRead();
     for (vector<SaceReader*>::iterator it = mReaders.begin(); it != mReaders.end(); it++)
         (*it)->stopRead();
 }
 
 SaceCommandMonitor::~SaceCommandMonitor () {
+    for (vector<SaceReader*>::iterator it = mOptionalReaders.begin(); it != mOptionalReaders.end(); it++)
+        delete *it;
     for (vector<SaceReader*>::iterator it = mReaders.begin(); it != mReaders.end(); it++)
         delete *it;
 }
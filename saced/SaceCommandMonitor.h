@@ -21,17 +21,26 @@
 #include <vector>
 
 #include "SaceReader.h"
+#include "SaceRingReader.h"
 #include "SaceMessage.h"
 
 namespace android {
 
 class SaceCommandMonitor {
     static const char *SOCKET_NAME;
+    static const char *SEQPACKET_SOCKET_NAME;
+    static const char *RING_SOCKET_NAME;
     std::vector<SaceReader*> mReaders;
+    /* extra transports, saced keeps serving on SOCKET_NAME without them */
+    std::vector<SaceReader*> mOptionalReaders;
 
 public:
     SaceCommandMonitor () {
         mReaders.push_back(new SaceSocketReader(SOCKET_NAME, SOCK_STREAM));
+        /* one frame per packet, clients pick it by persist.sace.seqpacket */
+        mOptionalReaders.push_back(new SaceSocketReader(SEQPACKET_SOCKET_NAME, SOCK_SEQPACKET));
+        /* shared memory rings, clients pick it by persist.sace.ring */
+        mOptionalReaders.push_back(new SaceRingReader(RING_SOCKET_NAME));
         mReaders.push_back(new SaceBinderReader());
     }
 
@@ -15,15 +15,16 @@
  */
 
 #include <cutils/sched_policy.h>
+#include <sys/inotify.h>
 #include <sys/prctl.h>
 #include <pthread.h>
 #include <thread>
 #include <unistd.h>
 #include <sys/types.h>
-#include <fstream>
 #include <sstream>
 
 #include "SaceEvent.h"
+#include "SaceEventLoader.h"
 #include <SaceLog.h>
 #include <sace/SaceParams.h>
 
@@ -33,66 +34,6 @@ const char* SaceEvent::EVENT_THREAD_NAME  = "SEEvent.EMT";
 const char* SaceEvent::NAME = "SEEvent";
 const char* SaceEvent::THREAD_NAME = "SEEvent.MT";
 
-#define CAP_MAP_ENTRY(cap)  { #cap, CAP_##cap }
-static const map<string, int> cap_map = {
-    CAP_MAP_ENTRY(CHOWN),
-    CAP_MAP_ENTRY(DAC_OVERRIDE),
-    CAP_MAP_ENTRY(DAC_READ_SEARCH),
-    CAP_MAP_ENTRY(FOWNER),
-    CAP_MAP_ENTRY(FSETID),
-    CAP_MAP_ENTRY(KILL),
-    CAP_MAP_ENTRY(SETGID),
-    CAP_MAP_ENTRY(SETUID),
-    CAP_MAP_ENTRY(SETPCAP),
-    CAP_MAP_ENTRY(LINUX_IMMUTABLE),
-    CAP_MAP_ENTRY(NET_BIND_SERVICE),
-    CAP_MAP_ENTRY(NET_BROADCAST),
-    CAP_MAP_ENTRY(NET_ADMIN),
-    CAP_MAP_ENTRY(NET_RAW),
-    CAP_MAP_ENTRY(IPC_LOCK),
-    CAP_MAP_ENTRY(IPC_OWNER),
-    CAP_MAP_ENTRY(SYS_MODULE),
-    CAP_MAP_ENTRY(SYS_RAWIO),
-    CAP_MAP_ENTRY(SYS_CHROOT),
-    CAP_MAP_ENTRY(SYS_PTRACE),
-    CAP_MAP_ENTRY(SYS_PACCT),
-    CAP_MAP_ENTRY(SYS_ADMIN),
-    CAP_MAP_ENTRY(SYS_BOOT),
-    CAP_MAP_ENTRY(SYS_NICE),
-    CAP_MAP_ENTRY(SYS_RESOURCE),
-    CAP_MAP_ENTRY(SYS_TIME),
-    CAP_MAP_ENTRY(SYS_TTY_CONFIG),
-    CAP_MAP_ENTRY(MKNOD),
-    CAP_MAP_ENTRY(LEASE),
-    CAP_MAP_ENTRY(AUDIT_WRITE),
-    CAP_MAP_ENTRY(AUDIT_CONTROL),
-    CAP_MAP_ENTRY(SETFCAP),
-    CAP_MAP_ENTRY(MAC_OVERRIDE),
-    CAP_MAP_ENTRY(MAC_ADMIN),
-    CAP_MAP_ENTRY(SYSLOG),
-    CAP_MAP_ENTRY(WAKE_ALARM),
-    CAP_MAP_ENTRY(BLOCK_SUSPEND),
-    CAP_MAP_ENTRY(AUDIT_READ),
-};
-
-#define RLIMIT_MAP_ENTRY(rlm) { #rlm, RLIMIT_##rlm }
-static const map<string, int> rlimit_map = {
-    RLIMIT_MAP_ENTRY(AS),
-    RLIMIT_MAP_ENTRY(CORE),
-    RLIMIT_MAP_ENTRY(CPU),
-    RLIMIT_MAP_ENTRY(DATA),
-    RLIMIT_MAP_ENTRY(FSIZE),
-    RLIMIT_MAP_ENTRY(LOCKS),
-    RLIMIT_MAP_ENTRY(MEMLOCK),
-    RLIMIT_MAP_ENTRY(MSGQUEUE),
-    RLIMIT_MAP_ENTRY(NICE),
-    RLIMIT_MAP_ENTRY(NOFILE),
-    RLIMIT_MAP_ENTRY(NPROC),
-    RLIMIT_MAP_ENTRY(RTPRIO),
-    RLIMIT_MAP_ENTRY(SIGPENDING),
-    RLIMIT_MAP_ENTRY(STACK),
-};
-
 // -------------- SaceEventWriter -------
 void SaceEventWriter::sendResult (const SaceResult &result) {
     Parcel parcel;
@@ -141,10 +82,19 @@ SaceEvent::SaceEvent ():SaceExcutor(SACE_MESSAGE_HANDLER_EVENT, NAME, THREAD_NAM
     mStopMsg->msgHandler = SACE_MESSAGE_HANDLER_SERVICE;
     mStopMsg->msgCmd    = saceCmd;
     mStopMsg->msgWriter = new SaceEventStopWriter();
+
+    journal = make_unique<SaceEventJournal>(DATA_JOURNAL_FILE, DATA_INI_FILE, this);
+
+    cache_stale = false;
+    config_from = "none";
+    inotify_fd  = -1;
+    first_triggered.store(false);
 }
 
 bool SaceEvent::onInit () {
     int pfd[2];
+    clock_gettime(CLOCK_MONOTONIC, &init_time);
+
     if (pipe(pfd) < 0) {
         SACE_LOGE("%s open writer pipe errno=%d errstr=%s", getName(), errno, strerror(errno));
         return false;
@@ -154,6 +104,12 @@ bool SaceEvent::onInit () {
     event_writer = new SaceEventWriter(pfd[1], getpid());
 
     read_ini_file();
+    replay_journal();
+    watch_config_dirs();
+
+    /* dynamic events are still served without persistence */
+    if (!journal->start())
+        SACE_LOGE("%s start journal fail, ADD/DEL won't persist", getName());
 
     running.store(true);
     if (pthread_create(&event_monitor, nullptr, event_monitor_thread, (void*)this)) {
@@ -162,15 +118,75 @@ bool SaceEvent::onInit () {
         return false;
     }
 
+    /* off the trigger path, boot events are already running */
+    store_cache();
     return true;
 }
 
+void SaceEvent::watch_config_dirs () {
+    static const char *dirs[] = { SYSTEM_CONF_DIR, DATA_CONF_DIR };
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        SACE_LOGE("%s inotify_init1 errno=%d errstr=%s", getName(), errno, strerror(errno));
+        return;
+    }
+
+    for (auto dir : dirs) {
+        if (inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0
+                && errno != ENOENT)
+            SACE_LOGE("%s watch %s errno=%d errstr=%s", getName(), dir, errno, strerror(errno));
+    }
+}
+
+/* drain inotify, true if any drop-in config changed */
+bool SaceEvent::config_changed () {
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+
+    while ((len = TEMP_FAILURE_RETRY(read(inotify_fd, buf, sizeof(buf)))) > 0) {
+        for (char *ptr = buf; ptr < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (!event->len)
+                continue;
+
+            /* own snapshot is written by journal, skip it */
+            string name(event->name);
+            if (name.size() > 4 && !name.compare(name.size() - 4, 4, ".ini")
+                    && strcmp(DATA_INI_FILE, (string(DATA_CONF_DIR) + "/" + name).c_str()))
+                changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void SaceEvent::post_reload () {
+    sp<SaceCommand> saceCmd = new SaceCommand();
+    saceCmd->type = SACE_TYPE_EVENT;
+    saceCmd->eventType = SACE_EVENT_TYPE_RELOAD;
+
+    sp<SaceReaderMessage> reloadMsg = new SaceReaderMessage();
+    reloadMsg->msgHandler = SACE_MESSAGE_HANDLER_EVENT;
+    reloadMsg->msgCmd    = saceCmd;
+    reloadMsg->msgWriter = new SaceEventStopWriter();
+
+    post(static_cast<sp<SaceMessageHeader>>(reloadMsg));
+}
+
 void SaceEvent::onUninit () {
     running.store(false);
     pthread_join(event_monitor, nullptr);
 
     close(writer_fd);
     event_writer->close();
+    journal->stop();
+
+    if (inotify_fd >= 0)
+        close(inotify_fd);
 
     for (auto event : running_events) {
         pair<string, uint64_t> sve(event.first, event.second);
@@ -181,18 +197,25 @@ void SaceEvent::onUninit () {
     }
 }
 
-void SaceEvent::stop_event (pair<string, uint64_t> run_event, long sequence) {
-    mStopMsg->msgCmd->label = run_event.second;
+void SaceEvent::stop_event (pair<string, uint64_t> run_event, uint64_t sequence) {
+    /* several stops may be queued at once by reload */
+    sp<SaceReaderMessage> stopMsg = new SaceReaderMessage();
+    stopMsg->msgHandler = mStopMsg->msgHandler;
+    stopMsg->msgCmd     = new SaceCommand(*mStopMsg->msgCmd.get());
+    stopMsg->msgWriter  = mStopMsg->msgWriter;
 
+    stopMsg->msgCmd->label = run_event.second;
     if (sequence)
-        mStopMsg->msgCmd->sequence = sequence;
+        stopMsg->msgCmd->sequence = sequence;
 
-    post(static_cast<sp<SaceMessageHeader>>(mStopMsg));
+    post(static_cast<sp<SaceMessageHeader>>(stopMsg));
 }
 
 void* SaceEvent::event_monitor_thread (void *obj) {
     fd_set fds;
-    char buf[SACE_RESULT_BUF_SIZE];
+    SaceFrameBuffer frames;
+    const uint8_t *frame;
+    size_t len;
     struct timeval timeout;
     SaceEvent *self = static_cast<SaceEvent*>(obj);
 
@@ -229,6 +252,12 @@ void* SaceEvent::event_monitor_thread (void *obj) {
         FD_SET(self->writer_fd, &fds);
         int max_fd = self->writer_fd;
 
+        /* Config Changed */
+        if (self->inotify_fd >= 0) {
+            FD_SET(self->inotify_fd, &fds);
+            max_fd = max(max_fd, self->inotify_fd);
+        }
+
         /* 300ms timeout */
         timeout.tv_sec  = 0;
         timeout.tv_usec = 300 * 1000;
@@ -240,7 +269,13 @@ void* SaceEvent::event_monitor_thread (void *obj) {
             continue;
         }
 
-        ret = TEMP_FAILURE_RETRY(read(self->writer_fd, buf, sizeof(buf)));
+        if (self->inotify_fd >= 0 && FD_ISSET(self->inotify_fd, &fds) && self->config_changed())
+            self->post_reload();
+
+        if (!FD_ISSET(self->writer_fd, &fds))
+            continue;
+
+        ret = TEMP_FAILURE_RETRY(read(self->writer_fd, frames.reserve(SACE_RESULT_BUF_SIZE), SACE_RESULT_BUF_SIZE));
         if (ret == 0) {
             SACE_LOGE("%s Writer Peer Close. Exiting...", self->getName());
             break;
@@ -249,25 +284,37 @@ void* SaceEvent::event_monitor_thread (void *obj) {
             SACE_LOGE("%s result fail errno=%d errstr=%s", self->getName(), errno, strerror(errno));
             continue;
         }
-
-        Parcel parcel;
-        SaceResultHeader headerRslt;
-        parcel.setData((uint8_t*)buf, ret);
-        headerRslt.readFromParcel(&parcel);
-
-        parcel.setDataPosition(0);
-        if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
-            SaceResult rslt;
-            rslt.readFromParcel(&parcel);
-            self->handle_result(rslt);
+        frames.commit(ret);
+
+        /* several results may be queued in the pipe, or one split across reads */
+        while (frames.next(&frame, &len)) {
+            if (len < SaceResultHeader::parcelSize())
+                continue;
+
+            Parcel parcel;
+            SaceResultHeader headerRslt;
+            parcel.setData(frame, len);
+            headerRslt.readFromParcel(&parcel);
+
+            parcel.setDataPosition(0);
+            if (headerRslt.type == SACE_BASE_RESULT_TYPE_NORMAL) {
+                SaceResult rslt;
+                rslt.readFromParcel(&parcel);
+                self->handle_result(rslt);
+            }
+            else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
+                SaceStatusResponse response;
+                response.readFromParcel(&parcel);
+                self->handle_result(response);
+            }
+            else
+                SACE_LOGD("%s unkown Response Type", self->getName());
         }
-        else if (headerRslt.type == SACE_BASE_RESULT_TYPE_RESPONSE) {
-            SaceStatusResponse response;
-            response.readFromParcel(&parcel);
-            self->handle_result(response);
+
+        if (frames.corrupted()) {
+            SACE_LOGE("%s Writer stream corrupted, drop pending", self->getName());
+            frames.clear();
         }
-        else
-            SACE_LOGD("%s unkown Response Type", self->getName());
 
         usleep(100 * 1000);  //100ms
     }
@@ -351,7 +398,7 @@ void SaceEvent::handle_result (SaceResult &result) {
     else {
         if (result.resultType == SACE_RESULT_TYPE_LABEL) {
             uint64_t label;
-            memcpy(&label, result.resultExtra, result.resultExtraLen);
+            result.resultExtra.get(label);
 
             event_mutex.lock();
             starting_events.erase(eventName);
@@ -377,8 +424,7 @@ writer:
 
 static sp<SaceCommand> clone_service_command (sp<SaceCommand> old) {
     sp<SaceCommand> saceCmd = new SaceCommand(*old.get());
-    memset(saceCmd->extra, 0, sizeof(saceCmd->extra));
-    saceCmd->extraLen = 0;
+    saceCmd->extra.clear();
 
     /* Start Service */
     saceCmd->type = SACE_TYPE_SERVICE;
@@ -392,6 +438,15 @@ void SaceEvent::start_event (shared_ptr<Service> service) {
     sp<SaceCommand> saceCmd = service->cmd;
     sp<SaceReaderMessage> cmdMsg = new SaceReaderMessage();
 
+    if (!first_triggered.exchange(true)) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        long elapsed_us = (now.tv_sec - init_time.tv_sec) * 1000000 + (now.tv_nsec - init_time.tv_nsec) / 1000;
+        SACE_LOGI("%s first trigger %s after %ldus, config from %s", getName(), saceCmd->name.c_str(),
+            elapsed_us, config_from);
+    }
+
     cmdMsg->msgHandler = SACE_MESSAGE_HANDLER_SERVICE;
     cmdMsg->msgCmd  = clone_service_command(service->cmd);
     cmdMsg->msgWriter = event_writer;
@@ -418,13 +473,15 @@ void SaceEvent::excuteNormal (sp<SaceMessageHeader> msg) {
     string eventName = saceCmd->name;
     if (saceCmd->eventType == SACE_EVENT_TYPE_DEL) {
         bool ok = false, stop = false;
-        memcpy(&stop, saceCmd->extra, saceCmd->extraLen);
+        saceCmd->extra.get(stop);
 
         auto e = events.find(eventName);
         if (e != events.end()) {
             event_mutex.lock();
             events.erase(e);
+            event_sources.erase(eventName);
             event_mutex.unlock();
+            journal->append(SaceEventJournal::RECORD_DEL, eventName, string());
             result.resultStatus = SACE_RESULT_STATUS_OK;
         }
         else {
@@ -466,7 +523,9 @@ void SaceEvent::excuteNormal (sp<SaceMessageHeader> msg) {
 
         event_mutex.lock();
         events.insert(pair<string, shared_ptr<Service>>(saceCmd->name, service));
+        event_sources.erase(saceCmd->name);
         event_mutex.unlock();
+        journal->append(SaceEventJournal::RECORD_ADD, saceCmd->name, event_to_ini(service));
 
         result.resultStatus = SACE_RESULT_STATUS_OK;
     }
@@ -499,8 +558,11 @@ void SaceEvent::excuteNormal (sp<SaceMessageHeader> msg) {
         post(static_cast<sp<SaceMessageHeader>>(cmdMsg));
         return;
     }
+    else if (saceCmd->eventType == SACE_EVENT_TYPE_RELOAD) {
+        if (reload_events())
+            result.resultStatus = SACE_RESULT_STATUS_OK;
+    }
 
-    write_ini_file();
 err:
     writer->sendResult(result);
 }
@@ -521,157 +583,253 @@ void SaceEvent::add_writers (string name, sp<SaceWriter> wr) {
     }
 }
 
-SaceEvent::TokenState SaceEvent::next_token (string& line, string& token) {
-    /* trim right space */
-    int j = 0;
-    for (j = static_cast<int>(line.size()) - 1; j >= 0 && isspace(line[j]); j--);
-    line.erase(j, line.size());
-
-    if (line.empty())
-        return TOKEN_EMPTY;
-
-    string str;
-    for (size_t i = 0; i < line.length(); i++) {
-        switch (line[i]) {
-        case '\"':
-            str.push_back('"');
-            while (i < line.length() && line[i] != '\"') str.push_back(line[i++]);
-            if (i >= line.length())
-                return TOKEN_ERR;
-
-            str.push_back('"');
-            break;
-        case '\\':
-            str.push_back('\\');
-            break;
-        case '\t':
-        case ' ' :
-        case '\n':
-            goto success;
-        default:
-            str.push_back(line[i]);
-            break;
-        }
-    }
+void SaceEvent::list_config_files (const string &base, vector<string> &files) {
+    files.push_back(base);
 
-success:
-    line.erase(0, str.size());
-    token.assign(str);
-    return TOKEN_TEXT;
+    /* drop-in configs, later files override earlier events by name */
+    SaceEventLoader::list_dir(SYSTEM_CONF_DIR, files);
+    SaceEventLoader::list_dir(DATA_CONF_DIR, files, DATA_INI_FILE);
 }
 
-bool SaceEvent::read_ini_file () {
-    static string empty_str = "";
-    ifstream conf_in(DATA_INI_FILE);
+/* parse sources in parallel, unreadable ones are dropped */
+bool SaceEvent::load_config_files (vector<SaceEventCache::Source> &sources, vector<vector<sp<SaceCommand>>> &cmds) {
+    vector<string> files;
+    vector<SaceEventLoader::Result> results;
+    vector<SaceEventCache::Source> loaded;
+
+    for (auto &source : sources)
+        files.push_back(source.path);
+    SaceEventLoader::load_files(files, results);
+
+    cmds.clear();
+    for (size_t i = 0; i < results.size(); i++) {
+        SaceEventLoader::log_errors(results[i]);
+        if (!results[i].loaded)
+            continue;
 
-    if (!conf_in.is_open()) {
-        SACE_LOGE("%s open %s errno=%d errstr=%s", getName(), DATA_INI_FILE, errno, strerror(errno));
-        conf_in.open(DEFAULT_INI_FILE);
-        if (!conf_in.is_open())
-            SACE_LOGE("%s open %s errno=%d errstr=%s", getName(), DEFAULT_INI_FILE, errno, strerror(errno));
+        loaded.push_back(sources[i]);
+        cmds.emplace_back();
+        for (auto &entry : results[i].entries)
+            cmds.back().push_back(entry.cmd);
     }
 
-    if (!conf_in.is_open()) {
+    sources.swap(loaded);
+    return !sources.empty();
+}
+
+void SaceEvent::set_config_file (const SaceEventCache::Source &source, const vector<sp<SaceCommand>> &cmds) {
+    ConfigFile &file = config_files[source.path];
+
+    file.source = source;
+    file.cmds   = cmds;
+    file.names.clear();
+    for (auto &cmd : cmds)
+        file.names[cmd->name] = cmd;
+}
+
+bool SaceEvent::read_ini_file () {
+    vector<string> files;
+    vector<SaceEventCache::Source> sources;
+    vector<vector<sp<SaceCommand>>> cmds;
+
+    /* base config, the data copy is the snapshot of dynamic events */
+    config_base = access(DATA_INI_FILE, F_OK)? DEFAULT_INI_FILE : DATA_INI_FILE;
+    list_config_files(config_base, files);
+    SaceEventCache::stat_sources(files, sources);
+
+    lock_guard<mutex> _l(config_mutex);
+    if (SaceEventCache::load(DATA_CACHE_FILE, sources, cmds))
+        config_from = "cache";
+    else if (load_config_files(sources, cmds)) {
+        config_from = "text";
+        cache_stale = true;
+    }
+    else {
         SACE_LOGE("Can't Acess Any Config File");
         return false;
     }
 
-    char buf[128] = {0};
-    string line;
-    while (conf_in.good()) {
-        conf_in.getline(buf, sizeof(buf));
-        line.assign(buf, conf_in.gcount());
+    size_t count = 0;
+    event_mutex.lock();
+    for (size_t i = 0; i < sources.size(); i++) {
+        set_config_file(sources[i], cmds[i]);
+        config_order.push_back(sources[i].path);
 
-        /* file over */
-        if (conf_in.eof()) {
-            if (line.size() > 0)
-                parse_event_from_ini(line);
-            break;
+        for (auto &cmd : cmds[i]) {
+            add_parsed_event(cmd);
+            event_sources[cmd->name] = sources[i].path;
         }
-
-        parse_event_from_ini(line);
+        count += cmds[i].size();
     }
+    event_mutex.unlock();
 
-    /* finish finally event */
-    parse_event_from_ini(empty_str);
-
+    SACE_LOGI("%s load %zu events from %zu files, config from %s", getName(), count, sources.size(), config_from);
     return true;
 }
 
-static string trim_space_char (string line) {
-    size_t i = 0, j = 0;
+void SaceEvent::store_cache () {
+    vector<SaceEventCache::Source> sources;
+    vector<vector<sp<SaceCommand>>> cmds;
 
-    /* skip left space */
-    for (i = 0; i < line.size() && isspace(line[i]); i++);
-    line.erase(0, i);
+    lock_guard<mutex> _l(config_mutex);
+    if (!cache_stale)
+        return;
 
-    // skip right space
-    size_t len = line.size();
-    for (i = len > 0? len -1 : 0, j = len; i > 0 && isspace(line[i]); i--, j--);
-    line.erase(j);
+    for (auto &path : config_order) {
+        sources.push_back(config_files[path].source);
+        cmds.push_back(config_files[path].cmds);
+    }
 
-    return line;
+    SaceEventCache::store(DATA_CACHE_FILE, sources, cmds);
+    cache_stale = false;
 }
 
-void SaceEvent::parse_event_from_ini (string line_token) {
-    static sp<SaceCommand> parse_command = nullptr;
-    static enum ParseState parse_state = PARSE_NONE;
+void SaceEvent::add_parsed_event (sp<SaceCommand> cmd) {
+    sp<EventParams> param = static_pointer_cast<SaceEventParams>(cmd->command_params)->parseEventParams();
+    events[cmd->name] = make_shared<Service>(param, cmd);
+}
 
-    string line = trim_space_char(line_token);
+static bool same_source (const SaceEventCache::Source &a, const SaceEventCache::Source &b) {
+    return a.ino == b.ino && a.size == b.size && a.mtime_ns == b.mtime_ns;
+}
 
-    /* over last event. getline add '\0' */
-    if (line.empty() || (line.size() == 1 && line[0] == '\0')) {
-        if (parse_state == PARSE_SERVICE) {
-            sp<EventParams> parse_event_param = static_pointer_cast<SaceEventParams>(parse_command->command_params)->parseEventParams();
-            shared_ptr<Service> parse_service = make_shared<Service>(parse_event_param, parse_command);
-            events.insert(pair<string, shared_ptr<Service>>(parse_command->name, parse_service));
-            parse_command = nullptr;
+/* definition of name from the last config file defining it */
+sp<SaceCommand> SaceEvent::find_config_event (const string &name, string &source) {
+    for (auto it = config_order.rbegin(); it != config_order.rend(); it++) {
+        ConfigFile &file = config_files[*it];
+        auto e = file.names.find(name);
+        if (e != file.names.end()) {
+            source = *it;
+            return e->second;
         }
+    }
 
-        parse_state = PARSE_NONE;
-        return;
+    return nullptr;
+}
+
+/* Only files whose stat changed are parsed again, and only events defined in
+ * them are compared, so the cost follows the diff rather than whole config.
+ */
+bool SaceEvent::reload_events () {
+    vector<string> files;
+    vector<SaceEventCache::Source> sources, changed;
+    vector<vector<sp<SaceCommand>>> cmds;
+    set<string> paths, candidates;
+    size_t added = 0, removed = 0, updated = 0;
+
+    lock_guard<mutex> _l(config_mutex);
+    list_config_files(config_base, files);
+    SaceEventCache::stat_sources(files, sources);
+
+    for (auto &source : sources) {
+        paths.insert(source.path);
+
+        /* the snapshot is rewritten by journal, keep what was loaded at boot */
+        if (source.path == DATA_INI_FILE)
+            continue;
+
+        auto it = config_files.find(source.path);
+        if (it == config_files.end() || !same_source(it->second.source, source))
+            changed.push_back(source);
     }
 
-    /* skip commit line */
-    if (line[0] == '#')
-        return;
+    for (auto it = config_files.begin(); it != config_files.end(); ) {
+        if (paths.count(it->first) || it->first == DATA_INI_FILE) {
+            it++;
+            continue;
+        }
+
+        SACE_LOGI("%s config %s removed", getName(), it->first.c_str());
+        for (auto &name : it->second.names)
+            candidates.insert(name.first);
+        it = config_files.erase(it);
+    }
+
+    /* unreadable files keep their old state and are retried next time */
+    if (!changed.empty() && load_config_files(changed, cmds)) {
+        for (size_t i = 0; i < changed.size(); i++) {
+            auto it = config_files.find(changed[i].path);
+            if (it != config_files.end()) {
+                for (auto &name : it->second.names)
+                    candidates.insert(name.first);
+            }
 
-    string service_name, service_cmd;
-    switch (parse_state) {
-    case PARSE_NONE:
-        if (next_token(line, service_name) == TOKEN_TEXT && line.size() > 0) {
-            parse_state = PARSE_SERVICE;
-            parse_command = new SaceCommand();
-            parse_command->command_params = make_shared<SaceEventParams>();
-            parse_command->name = service_name;
-            parse_command->command = line;
+            set_config_file(changed[i], cmds[i]);
+            for (auto &cmd : cmds[i])
+                candidates.insert(cmd->name);
         }
-        else
-            SACE_LOGE("%s parse invalid service : %s", getName(), line.c_str());
-        break;
-    case PARSE_SERVICE:
-        parse_service_attr(line, parse_command);
-        break;
-    default:
-        parse_state = PARSE_NONE;
-        break;
     }
-}
 
-static int parse_capability_name (string capability_name) {
-    auto e = cap_map.find(capability_name);
-    if (e != cap_map.end())
-        return e->second;
-    else
-        return -1;
-}
+    config_order.clear();
+    for (auto &source : sources) {
+        if (config_files.count(source.path))
+            config_order.push_back(source.path);
+    }
 
-static int parse_rlimits_name (string rlimit_name) {
-    auto e = rlimit_map.find(rlimit_name);
-    if (e != rlimit_map.end())
-        return e->second;
-    else
-        return -1;
+    for (auto &name : candidates) {
+        string source;
+        sp<SaceCommand> cmd = find_config_event(name, source);
+
+        auto current = events.find(name);
+        auto owner   = event_sources.find(name);
+        if (current != events.end() && owner == event_sources.end()) {
+            SACE_LOGW("%s Event[%s] added dynamically, ignore config", getName(), name.c_str());
+            continue;
+        }
+
+        if (cmd == nullptr) {
+            if (current == events.end())
+                continue;
+
+            event_mutex.lock();
+            events.erase(name);
+            event_sources.erase(name);
+
+            auto e = running_events.find(name);
+            if (e != running_events.end())
+                stop_event(pair<string, uint64_t>(e->first, e->second), 0);
+            event_mutex.unlock();
+
+            removed++;
+            continue;
+        }
+
+        sp<EventParams> param = static_pointer_cast<SaceEventParams>(cmd->command_params)->parseEventParams();
+        shared_ptr<Service> service = make_shared<Service>(param, cmd);
+
+        if (current == events.end()) {
+            event_mutex.lock();
+            events.insert(pair<string, shared_ptr<Service>>(name, service));
+            event_sources[name] = source;
+            event_mutex.unlock();
+
+            added++;
+            continue;
+        }
+
+        event_mutex.lock();
+        event_sources[name] = source;
+        event_mutex.unlock();
+
+        if (event_to_ini(current->second) == event_to_ini(service))
+            continue;
+
+        /* running instance is kept, consume current trigger state so that
+         * new definition takes effect on next trigger instead of now
+         */
+        for (auto &trigger : service->params->triggers)
+            trigger->triggered();
+
+        event_mutex.lock();
+        current->second = service;
+        event_mutex.unlock();
+
+        updated++;
+    }
+
+    SACE_LOGI("%s reload %zu changed files : added %zu, removed %zu, updated %zu", getName(),
+        changed.size(), added, removed, updated);
+    return true;
 }
 
 /* Service Ini Format
@@ -685,177 +843,106 @@ static int parse_rlimits_name (string rlimit_name) {
  * trigger boot <true | false>
  * rlimits limit_name hard_limit soft_limit
  */
-void SaceEvent::parse_service_attr (string line, sp<SaceCommand> cmd) {
-    shared_ptr<SaceEventParams> cmd_params = static_pointer_cast<SaceEventParams>(cmd->command_params);
-    stringstream out_stream(line);
-    string tag, str_value;
-    int int_value;
-
-    out_stream>>tag;
-    if (!out_stream.good()) {
-        SACE_LOGE("Ignore Invalid Token : %s", line.c_str());
-        return;
+string SaceEvent::event_to_ini (shared_ptr<Service> service) const {
+    sp<SaceCommand> cmd = service->cmd;
+    sp<EventParams> event_param = service->params;
+    shared_ptr<SaceCommandParams> cmd_param = cmd->command_params;
+    string service_str;
+
+    // Service Name
+    service_str.append(cmd->name).append(" ").append(cmd->command).append("\n");
+
+    // User/Group
+    if (!cmd_param->uid.empty())
+        service_str.append("  user ").append(cmd_param->uid).append("\n");
+    if (!cmd_param->gid.empty())
+        service_str.append("  group ").append(cmd_param->gid).append("\n");
+    if (!cmd_param->seclabel.empty())
+        service_str.append("  seclabel ").append(cmd_param->seclabel).append("\n");
+
+    // Capability
+    if (cmd_param->capabilities.any()) {
+        service_str.append("  capability");
+        for (auto cap : SaceEventLoader::capability_map()) {
+            if (cmd_param->capabilities.test(cap.second))
+                service_str.append(" ").append(cap.first);
+        }
+        service_str.append("\n");
     }
 
-    if (tag == "user") {
-        out_stream>>str_value;
-        if (!out_stream.fail())
-            cmd_params->set_uid(str_value);
-        else
-            SACE_LOGE("%s parse service_attr_user fail : %s", getName(), line.c_str());
+    // Groups
+    if (cmd_param->supp_gids.size() > 0) {
+        service_str.append("  groups ");
+        for (auto gp : cmd_param->supp_gids)
+            service_str.append(gp).append(" ");
+        service_str.append("\n");
     }
-    else if (tag == "group") {
-        out_stream>>str_value;
-        if (!out_stream.fail())
-            cmd_params->set_gid(str_value);
-        else
-            SACE_LOGE("%s parse service_attr_group fail : %s", getName(), line.c_str());
-    }
-    else if (tag == "seclabel") {
-        out_stream>>str_value;
-        if (!out_stream.fail())
-            cmd_params->set_seclabel(str_value);
-        else
-            SACE_LOGE("%s parse service_attr_group fail : %s", getName(), line.c_str());
-    }
-    else if (tag == "capability") {
-        do {
-            out_stream>>str_value;
-            if (out_stream.fail())
-                break;
-            cmd_params->set_capabilities(parse_capability_name(str_value));
-        } while(true);
-    }
-    else if (tag == "groups") {
-        do {
-            out_stream>>str_value;
-            if (out_stream.fail())
-                break;
-            cmd_params->add_gids(str_value);
-        } while(true);
-    }
-    else if (tag == "trigger") {
-        out_stream>>str_value;
-        if (out_stream.fail()) {
-            SACE_LOGE("Invalide Trigger : %s", line.c_str());
-            return;
-        }
 
-        if (!strncmp(str_value.data(), "property", strlen("property"))) {
-            size_t colon_pos = str_value.find(':');
-            if (colon_pos != string::npos) {
-                size_t equal_pos = str_value.find('=', colon_pos);
-                if (equal_pos != string::npos) {
-                    cmd_params->add_property(str_value.substr(colon_pos, equal_pos - colon_pos),
-                        str_value.substr(equal_pos));
-                }
-                else
-                    SACE_LOGE("%s Invalide [equal] in %s", getName(), str_value.c_str());
-            }
-            else
-                SACE_LOGE("%s Invalide [colon] in %s", getName(), str_value.c_str());
-        }
-        else if (!strncmp(str_value.data(), "boot", strlen("boot"))) {
-            cmd_params->set_boot(true);
-        }
-        else
-            SACE_LOGE("Invalide Trigger : %s", str_value.c_str());
-    }
-    else if (tag == "rlimits") {
-        string rlm_name;
-        int rlm_hard, rlm_soft;
+    // Rlimits
+    for (auto rlms : cmd_param->rlimits) {
+        int resource;
+        long soft, hard;
+        stringstream out_stream(rlms);
+        out_stream>>resource>>soft>>hard;
 
-        out_stream>>rlm_name>>rlm_hard>>rlm_soft;
-        if (!out_stream.fail())
-            cmd_params->add_rlimits(parse_rlimits_name(rlm_name), rlm_hard, rlm_soft);
-        else
-            SACE_LOGE("Invalide Rlimits Format : %s", line.c_str());
-    }
-    else {
-        SACE_LOGE("Invalide Service Attr : %s", tag.c_str());
-        return;
-    }
-}
+        for (auto rlm : SaceEventLoader::rlimit_map()) {
+            if (rlm.second != resource)
+                continue;
 
-bool SaceEvent::write_ini_file () const {
-    if (!access(DATA_INI_FILE, F_OK)) {
-        /* create new config file */
-        int fd = open(DATA_INI_FILE, O_WRONLY, O_CREAT | S_IRUSR | S_IWUSR);
-        if (fd < 0) {
-            SACE_LOGE("%s create %s fail errno=%d errstr=%s", getName(), DATA_INI_FILE, errno, strerror(errno));
-            return false;
+            service_str.append("  rlimits ").append(rlm.first).append(" ")
+                .append(::to_string(hard)).append(" ")
+                .append(::to_string(soft)).append("\n");
         }
-        close(fd);
-    }
-
-    ofstream conf_out(DATA_INI_FILE);
-    if (!conf_out.is_open()) {
-        SACE_LOGE("%s open %s fail errno=%d errstr=%s", getName(), DATA_INI_FILE, errno, strerror(errno));
-        return false;
     }
 
-    char buf[128] = {0};
-    for (auto event : events) {
-        /* Service Ini Format
-         * service_name service_cmd
-         * user   <uid | user_name>
-         * group  <gid | group_name>
-         * groups <gid | group_name> ...
-         * seclabel secontext
-         * capability capability_name ...
-         * trigger property:proper_name=property_value
-         * trigger boot <true | false>
-         * rlimits limit_name hard_limit soft_limit
-         */
+    // Triggers
+    for (auto tg : event_param->triggers)
+        service_str.append("  trigger ").append(tg->to_string()).append("\n");
 
-        sp<SaceCommand> cmd = event.second->cmd;
-        sp<EventParams> event_param = event.second->params;
-        shared_ptr<SaceCommandParams> cmd_param = cmd->command_params;
+    return service_str;
+}
 
-        int last_index = conf_out.tellp();
-        string service_str;
+/* invoke in journal thread */
+string SaceEvent::onSnapshot () {
+    map<string, shared_ptr<Service>> snapshot;
 
-        // Service Name
-        sprintf(buf, "%s %s\n", cmd->name.c_str(), cmd->command.c_str());
-        service_str.append(buf, strlen(buf));
+    event_mutex.lock();
+    for (auto &event : events) {
+        /* drop-in events belong to their files */
+        auto owner = event_sources.find(event.first);
+        if (owner != event_sources.end() && owner->second != DEFAULT_INI_FILE && owner->second != DATA_INI_FILE)
+            continue;
+        snapshot.insert(event);
+    }
+    event_mutex.unlock();
 
-        // User/Group
-        sprintf(buf, "  user %s\n  group %s\n  seclabel %s\n",
-            cmd_param->uid.c_str(), cmd_param->gid.c_str(), cmd_param->seclabel.c_str());
-        service_str.append(buf, strlen(buf));
+    string conf;
+    for (auto event : snapshot)
+        conf.append(event_to_ini(event.second)).append("\n");
 
-        //capability
-        if (cmd_param->capabilities.to_ulong() > 0)
-            service_str.append("  capability ").append(::to_string(cmd_param->capabilities.to_ulong()));
+    return conf;
+}
 
-        // Groups
-        if (cmd_param->supp_gids.size() > 0) {
-            service_str.append("  groups ");
-            for (auto gp : cmd_param->supp_gids)
-                service_str.append(gp).append(" ");
-            service_str.append("\n");
-        }
+void SaceEvent::replay_journal () {
+    vector<SaceEventJournal::Record> records;
+    if (!journal->replay(records))
+        return;
 
-        // Rlimits
-        for (auto rlms : cmd_param->rlimits) {
-            service_str.append("  rlimits ").append(::to_string(rlms[0])).append(" ")
-                .append(::to_string(rlms[1])).append(" ")
-                .append(::to_string(rlms[2])).append(" ");
-        }
+    for (auto &record : records) {
+        events.erase(record.name);
+        event_sources.erase(record.name);
+        if (record.type != SaceEventJournal::RECORD_ADD)
+            continue;
 
-        // Triggers
-        for (auto tg : event_param->triggers)
-            service_str.append("  trigger ").append(tg->to_string()).append("\n");
+        SaceEventLoader::Result result;
+        result.path = DATA_JOURNAL_FILE;
+        SaceEventLoader::parse(record.body, result);
+        SaceEventLoader::log_errors(result);
 
-        conf_out<<service_str;
-        if (!conf_out.good()) {
-            SACE_LOGE("%s write Event[%s %s] fail", getName(), cmd->name.c_str(), cmd->command.c_str());
-            conf_out.seekp(last_index, ios_base::beg);
-        }
-        else
-            conf_out<<endl;
+        for (auto &entry : result.entries)
+            add_parsed_event(entry.cmd);
     }
 
-    return true;
+    SACE_LOGI("%s replay %zu journal records", getName(), records.size());
 }
 }; // namespace
@@ -25,9 +25,14 @@
 #include "SaceExcutor.h"
 #include "SaceWriter.h"
 #include "SaceCommandDispatcher.h"
+#include "SaceEventJournal.h"
+#include "SaceEventCache.h"
+#include "SaceFrame.h"
 
 #define DEFAULT_INI_FILE "/system/etc/sace_event.ini"
 #define DATA_INI_FILE    "/data/sace/sace_event.ini"
+#define SYSTEM_CONF_DIR  "/system/etc/sace"
+#define DATA_CONF_DIR    "/data/sace"
 
 #define SACE_STOP_WRITER  "SaceEventStopWriter"
 #define SACE_EVENT_WRITER "SaceEventWriter"
@@ -58,7 +63,7 @@ public:
     virtual void sendResponse (const SaceStatusResponse &) {}
 };
 
-class SaceEvent : public SaceExcutor, public MessageDistributable {
+class SaceEvent : public SaceExcutor, public MessageDistributable, public SaceEventJournal::Snapshot {
     static const char* EVENT_THREAD_NAME;
     static const char* NAME;
     static const char* THREAD_NAME;
@@ -71,17 +76,6 @@ class SaceEvent : public SaceExcutor, public MessageDistributable {
         bool triggered ();
     };
 
-    enum ParseState {
-        PARSE_SERVICE,
-        PARSE_NONE,
-    };
-
-    enum TokenState {
-        TOKEN_EMPTY,
-        TOKEN_TEXT,
-        TOKEN_ERR,
-    };
-
     pthread_t event_monitor;
     atomic_bool running;
 
@@ -96,16 +90,48 @@ class SaceEvent : public SaceExcutor, public MessageDistributable {
     sp<SaceEventWriter> event_writer;
     int writer_fd;
     sp<SaceReaderMessage> mStopMsg;
+    unique_ptr<SaceEventJournal> journal;
+
+    /* config changed since cache written */
+    bool cache_stale;
+
+    struct ConfigFile {
+        SaceEventCache::Source source;
+        vector<sp<SaceCommand>> cmds;
+        map<string, sp<SaceCommand>> names;
+    };
+
+    /* need config_mutex protect */
+    mutex config_mutex;
+    string config_base;
+    vector<string> config_order;
+    map<string, ConfigFile> config_files;
+    /* config file of each ini event, need event_mutex protect */
+    map<string, string> event_sources;
+    int inotify_fd;
+
+    struct timespec init_time;
+    const char *config_from;
+    atomic_bool first_triggered;
 
     bool read_ini_file ();
-    bool write_ini_file () const;
+    void store_cache ();
+    void list_config_files (const string &base, vector<string> &files);
+    bool load_config_files (vector<SaceEventCache::Source> &sources, vector<vector<sp<SaceCommand>>> &cmds);
+    void set_config_file (const SaceEventCache::Source &source, const vector<sp<SaceCommand>> &cmds);
+    sp<SaceCommand> find_config_event (const string &name, string &source);
+
+    bool reload_events ();
+    void watch_config_dirs ();
+    bool config_changed ();
+    void post_reload ();
+    void replay_journal ();
+    string event_to_ini (shared_ptr<Service>) const;
 
-    void parse_event_from_ini (string line);
-    TokenState next_token (string& line, string& token);
-    void parse_service_attr (string line, sp<SaceCommand> cmd);
+    void add_parsed_event (sp<SaceCommand> cmd);
 
     void start_event (shared_ptr<Service>);
-    void stop_event (pair<string, uint64_t>, long);
+    void stop_event (pair<string, uint64_t>, uint64_t);
     bool restart_event (string);
 
     void handle_result (SaceResult &);
@@ -123,6 +149,7 @@ protected:
     virtual void excuteNormal (sp<SaceMessageHeader>) override;
     virtual bool onInit () override;
     virtual void onUninit () override;
+    virtual string onSnapshot () override;
 };
 
 }; // namespace android
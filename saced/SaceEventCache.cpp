@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SaceEventCache.h"
+#include "SaceFileUtil.h"
+#include <SaceLog.h>
+#include <sace/SaceParams.h>
+
+namespace android {
+
+const char* SaceEventCache::NAME = "SEEventCache";
+const uint32_t SaceEventCache::CACHE_MAGIC   = 0x53414331; // SAC1
+const uint32_t SaceEventCache::CACHE_VERSION = 2;
+const uint32_t SaceEventCache::ID_NONE = 0xffffffff;
+
+// -------------- Writer/Reader -------------
+class SaceEventCache::Writer {
+public:
+    string data;
+
+    template<typename T> void put (T value) {
+        data.append((const char*)&value, sizeof(value));
+    }
+
+    void put_str (const string &str) {
+        put<uint32_t>(str.size());
+        data.append(str);
+    }
+};
+
+class SaceEventCache::Reader {
+    const char *mPos;
+    const char *mEnd;
+
+public:
+    Reader (const char *data, size_t len):mPos(data),mEnd(data + len) {}
+
+    bool done () const {
+        return mPos == mEnd;
+    }
+
+    template<typename T> bool get (T &value) {
+        if (static_cast<size_t>(mEnd - mPos) < sizeof(value))
+            return false;
+
+        memcpy(&value, mPos, sizeof(value));
+        mPos += sizeof(value);
+        return true;
+    }
+
+    bool get_str (string &str) {
+        uint32_t len;
+        if (!get(len) || static_cast<size_t>(mEnd - mPos) < len)
+            return false;
+
+        str.assign(mPos, len);
+        mPos += len;
+        return true;
+    }
+};
+
+// -------------- SaceEventCache -------------
+uint64_t SaceEventCache::hash (const char *data, size_t len) {
+    return fnv1a64(data, len);
+}
+
+uint32_t SaceEventCache::resolve_id (const SaceCommandParams *params, const string &id) {
+    uid_t value;
+
+    /* unresolvable falls back to the default id at start, same as the text path */
+    if (!params->decode_uid(id, &value))
+        return ID_NONE;
+
+    return value;
+}
+
+void SaceEventCache::stat_sources (const vector<string> &files, vector<Source> &sources) {
+    struct stat st;
+
+    for (auto &file : files) {
+        if (stat(file.c_str(), &st) < 0)
+            continue;
+
+        Source source;
+        source.path = file;
+        source.ino  = st.st_ino;
+        source.size = st.st_size;
+        source.mtime_ns = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+        sources.push_back(source);
+    }
+}
+
+/* Event Format
+ * name | command | uid | gid | supp_gids | seclabel | capabilities
+ * | rlimits(resource soft hard) | boot | properties(key value)
+ */
+void SaceEventCache::encode_event (Writer &out, sp<SaceCommand> cmd) {
+    shared_ptr<SaceEventParams> params = static_pointer_cast<SaceEventParams>(cmd->command_params);
+
+    out.put_str(cmd->name);
+    out.put_str(cmd->command);
+
+    out.put<uint32_t>(resolve_id(params.get(), params->uid));
+    out.put<uint32_t>(resolve_id(params.get(), params->gid));
+
+    vector<uint32_t> supp_gids;
+    for (auto &g : params->supp_gids) {
+        uint32_t gid = resolve_id(params.get(), g);
+        if (gid != ID_NONE)
+            supp_gids.push_back(gid);
+    }
+
+    out.put<uint32_t>(supp_gids.size());
+    for (auto gid : supp_gids)
+        out.put<uint32_t>(gid);
+
+    out.put_str(params->seclabel);
+    out.put<uint64_t>(params->capabilities.to_ullong());
+
+    out.put<uint32_t>(params->rlimits.size());
+    for (auto &rlm : params->rlimits) {
+        int32_t resource = -1, soft = 0, hard = 0;
+        sscanf(rlm.c_str(), "%d %d %d", &resource, &soft, &hard);
+
+        out.put<int32_t>(resource);
+        out.put<int32_t>(soft);
+        out.put<int32_t>(hard);
+    }
+
+    out.put<uint8_t>(params->boot);
+
+    out.put<uint32_t>(params->property_key.size());
+    for (size_t i = 0; i < params->property_key.size(); i++) {
+        out.put_str(params->property_key[i]);
+        out.put_str(params->property_value[i]);
+    }
+}
+
+bool SaceEventCache::decode_event (Reader &in, sp<SaceCommand> &cmd) {
+    shared_ptr<SaceEventParams> params = make_shared<SaceEventParams>();
+    uint32_t uid, gid, count;
+    uint64_t caps;
+    uint8_t boot;
+
+    cmd = new SaceCommand();
+    cmd->command_params = params;
+
+    if (!in.get_str(cmd->name) || !in.get_str(cmd->command) || !in.get(uid) || !in.get(gid))
+        return false;
+
+    if (uid != ID_NONE)
+        params->set_uid(static_cast<uid_t>(uid));
+    if (gid != ID_NONE)
+        params->set_gid(static_cast<gid_t>(gid));
+
+    if (!in.get(count))
+        return false;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!in.get(gid))
+            return false;
+        params->add_gids(static_cast<gid_t>(gid));
+    }
+
+    if (!in.get_str(params->seclabel) || !in.get(caps))
+        return false;
+    params->capabilities = CapSet(caps);
+
+    if (!in.get(count))
+        return false;
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t resource, soft, hard;
+        if (!in.get(resource) || !in.get(soft) || !in.get(hard))
+            return false;
+        params->add_rlimits(resource, soft, hard);
+    }
+
+    if (!in.get(boot) || !in.get(count))
+        return false;
+    params->set_boot(boot);
+
+    for (uint32_t i = 0; i < count; i++) {
+        string key, value;
+        if (!in.get_str(key) || !in.get_str(value))
+            return false;
+        params->add_property(key, value);
+    }
+
+    return true;
+}
+
+bool SaceEventCache::load (const char *path, const vector<Source> &sources, vector<vector<sp<SaceCommand>>> &cmds) {
+    bool ok = false;
+    CacheHeader header;
+    struct stat st;
+    void *addr;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            SACE_LOGE("%s open %s errno=%d errstr=%s", NAME, path, errno, strerror(errno));
+        return false;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(header)) {
+        close(fd);
+        return false;
+    }
+
+    addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        SACE_LOGE("%s mmap %s errno=%d errstr=%s", NAME, path, errno, strerror(errno));
+        return false;
+    }
+
+    const char *data = static_cast<const char*>(addr);
+    const char *payload = data + sizeof(header);
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION
+            || header.payload_len != st.st_size - sizeof(header)
+            || header.sources != sources.size()) {
+        SACE_LOGI("%s %s stale header", NAME, path);
+        goto out;
+    }
+
+    {
+        Reader in(payload, header.payload_len);
+
+        /* cheap staleness check first, the hash walks whole payload */
+        for (auto &source : sources) {
+            Source cached;
+            if (!in.get_str(cached.path) || !in.get(cached.ino) || !in.get(cached.size) || !in.get(cached.mtime_ns))
+                goto corrupt;
+
+            if (cached.path != source.path || cached.ino != source.ino
+                    || cached.size != source.size || cached.mtime_ns != source.mtime_ns) {
+                SACE_LOGI("%s %s changed since cache written", NAME, source.path.c_str());
+                goto out;
+            }
+        }
+
+        if (hash(payload, header.payload_len) != header.payload_hash)
+            goto corrupt;
+
+        cmds.resize(sources.size());
+        for (auto &source_cmds : cmds) {
+            uint32_t count;
+            if (!in.get(count) || count > header.events)
+                goto corrupt;
+
+            source_cmds.reserve(count);
+            for (uint32_t i = 0; i < count; i++) {
+                sp<SaceCommand> cmd;
+                if (!decode_event(in, cmd))
+                    goto corrupt;
+                source_cmds.push_back(cmd);
+            }
+        }
+
+        if (!in.done())
+            goto corrupt;
+    }
+
+    ok = true;
+    goto out;
+
+corrupt:
+    SACE_LOGE("%s %s corrupted, ignore", NAME, path);
+    cmds.clear();
+out:
+    munmap(addr, st.st_size);
+    return ok;
+}
+
+bool SaceEventCache::store (const char *path, const vector<Source> &sources, const vector<vector<sp<SaceCommand>>> &cmds) {
+    uint32_t events = 0;
+    Writer out;
+    for (auto &source : sources) {
+        out.put_str(source.path);
+        out.put<uint64_t>(source.ino);
+        out.put<int64_t>(source.size);
+        out.put<int64_t>(source.mtime_ns);
+    }
+
+    for (auto &source_cmds : cmds) {
+        out.put<uint32_t>(source_cmds.size());
+        for (auto &cmd : source_cmds)
+            encode_event(out, cmd);
+        events += source_cmds.size();
+    }
+
+    CacheHeader header;
+    header.magic   = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.sources = sources.size();
+    header.events  = events;
+    header.payload_len  = out.data.size();
+    header.payload_hash = hash(out.data.data(), out.data.size());
+
+    string tmp = string(path) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        SACE_LOGE("%s open %s errno=%d errstr=%s", NAME, tmp.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    if (!write_fully(fd, (const char*)&header, sizeof(header))
+            || !write_fully(fd, out.data.data(), out.data.size()) || fsync(fd) < 0) {
+        SACE_LOGE("%s write %s errno=%d errstr=%s", NAME, tmp.c_str(), errno, strerror(errno));
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    close(fd);
+
+    if (rename(tmp.c_str(), path) < 0) {
+        SACE_LOGE("%s rename %s errno=%d errstr=%s", NAME, path, errno, strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    SACE_LOGI("%s store %u events into %s", NAME, events, path);
+    return true;
+}
+
+}; // namespace android
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_EVENT_CACHE_H_
+#define _SACE_EVENT_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <SaceTypes.h>
+
+#define DATA_CACHE_FILE "/data/sace/sace_event.cache"
+
+using namespace std;
+
+namespace android {
+
+/* Compiled form of the event configs.
+ * Stored next to the ini files and keyed by path, inode, size and mtime of
+ * every source. Users and groups are resolved to numeric ids when the cache
+ * is written, so a cache load never goes through getpwnam. Events are kept
+ * per source, overridden ones included, so reload can diff single files.
+ */
+class SaceEventCache {
+public:
+    struct Source {
+        string path;
+        uint64_t ino;
+        int64_t size;
+        int64_t mtime_ns;
+    };
+
+    /* existing files only, in the given order */
+    static void stat_sources (const vector<string> &files, vector<Source> &sources);
+
+    /* events of each source in file order, false if missing, stale or corrupted */
+    static bool load (const char *path, const vector<Source> &sources, vector<vector<sp<SaceCommand>>> &cmds);
+    static bool store (const char *path, const vector<Source> &sources, const vector<vector<sp<SaceCommand>>> &cmds);
+
+private:
+    static const char *NAME;
+    static const uint32_t CACHE_MAGIC;
+    static const uint32_t CACHE_VERSION;
+    static const uint32_t ID_NONE;
+
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sources;
+        uint32_t events;
+        uint64_t payload_len;
+        uint64_t payload_hash;  /* sources and events */
+    };
+
+    class Writer;
+    class Reader;
+
+    static uint64_t hash (const char *data, size_t len);
+    static uint32_t resolve_id (const SaceCommandParams *params, const string &id);
+
+    static void encode_event (Writer &out, sp<SaceCommand> cmd);
+    static bool decode_event (Reader &in, sp<SaceCommand> &cmd);
+};
+
+}; // namespace android
+
+#endif
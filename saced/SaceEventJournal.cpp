@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SaceEventJournal.h"
+#include "SaceFileUtil.h"
+#include <SaceLog.h>
+
+namespace android {
+
+const char* SaceEventJournal::NAME = "SEJournal";
+const char* SaceEventJournal::THREAD_NAME = "SEJournal.MT";
+const uint32_t SaceEventJournal::RECORD_MAGIC = 0x53414a31; // SAJ1
+const size_t SaceEventJournal::COMPACT_THRESHOLD = 64;
+
+static void fsync_parent_dir (const string &path) {
+    string dir_path = path;
+    int fd = open(dirname(&dir_path[0]), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    fsync(fd);
+    close(fd);
+}
+
+SaceEventJournal::SaceEventJournal (const char* journal, const char* snapshot, Snapshot *provider) {
+    mJournal  = string(journal);
+    mSnapshot = string(snapshot);
+    mProvider = provider;
+
+    mFd = -1;
+    mRecords = 0;
+    mExit    = false;
+    mRunning = false;
+
+    pthread_mutex_init(&mMutex, nullptr);
+    pthread_cond_init(&mCond, nullptr);
+}
+
+SaceEventJournal::~SaceEventJournal () {
+    stop();
+
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mMutex);
+}
+
+uint32_t SaceEventJournal::checksum (uint32_t type, const char *data, size_t len) {
+    /* type little endian first, then the payload */
+    uint8_t type_bytes[4];
+    for (int i = 0; i < 4; i++)
+        type_bytes[i] = (type >> (i * 8)) & 0xff;
+
+    return fnv1a32(data, len, fnv1a32(type_bytes, sizeof(type_bytes)));
+}
+
+/* Record Format
+ * RecordHeader | name | '\0' | body
+ */
+void SaceEventJournal::encode (const Record &record, string &out) const {
+    string payload;
+    payload.reserve(record.name.size() + record.body.size() + 1);
+    payload.append(record.name).push_back('\0');
+    payload.append(record.body);
+
+    RecordHeader header;
+    header.magic = RECORD_MAGIC;
+    header.len   = payload.size();
+    header.type  = record.type;
+    header.checksum = checksum(header.type, payload.data(), payload.size());
+
+    out.append((const char*)&header, sizeof(header));
+    out.append(payload);
+}
+
+bool SaceEventJournal::replay (vector<Record> &records) {
+    int fd = open(mJournal.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT)
+            SACE_LOGE("%s open %s errno=%d errstr=%s", NAME, mJournal.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    string data;
+    char buf[4096];
+    ssize_t ret;
+    while ((ret = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)))) > 0)
+        data.append(buf, ret);
+    close(fd);
+
+    size_t pos = 0;
+    while (data.size() - pos >= sizeof(RecordHeader)) {
+        RecordHeader header;
+        memcpy(&header, data.data() + pos, sizeof(header));
+
+        if (header.magic != RECORD_MAGIC || header.len > data.size() - pos - sizeof(header))
+            break;
+
+        const char *payload = data.data() + pos + sizeof(header);
+        if (checksum(header.type, payload, header.len) != header.checksum)
+            break;
+
+        const char *name_end = (const char*)memchr(payload, '\0', header.len);
+        if (name_end == nullptr || (header.type != RECORD_ADD && header.type != RECORD_DEL))
+            break;
+
+        Record record;
+        record.type = static_cast<enum RecordType>(header.type);
+        record.name.assign(payload, name_end - payload);
+        record.body.assign(name_end + 1, payload + header.len - name_end - 1);
+        records.push_back(record);
+
+        pos += sizeof(header) + header.len;
+    }
+
+    /* crash in the middle of a group, drop the torn tail */
+    if (pos != data.size()) {
+        SACE_LOGW("%s drop %zu invalid bytes of %s", NAME, data.size() - pos, mJournal.c_str());
+        if (truncate(mJournal.c_str(), pos) < 0)
+            SACE_LOGE("%s truncate %s errno=%d errstr=%s", NAME, mJournal.c_str(), errno, strerror(errno));
+    }
+
+    mRecords = records.size();
+    return true;
+}
+
+bool SaceEventJournal::start () {
+    mFd = open(mJournal.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (mFd < 0) {
+        SACE_LOGE("%s open %s errno=%d errstr=%s", NAME, mJournal.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    mExit = false;
+    if (pthread_create(&journal_thread, nullptr, journal_thread_run, (void*)this)) {
+        SACE_LOGE("%s start journal_thread errno=%d errstr=%s", NAME, errno, strerror(errno));
+        close(mFd);
+        mFd = -1;
+        return false;
+    }
+
+    mRunning = true;
+    return true;
+}
+
+void SaceEventJournal::stop () {
+    if (!mRunning)
+        return;
+
+    pthread_mutex_lock(&mMutex);
+    mExit = true;
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mMutex);
+
+    pthread_join(journal_thread, nullptr);
+    mRunning = false;
+
+    close(mFd);
+    mFd = -1;
+}
+
+void SaceEventJournal::append (enum RecordType type, const string &name, const string &body) {
+    Record record;
+    record.type = type;
+    record.name = name;
+    record.body = body;
+
+    pthread_mutex_lock(&mMutex);
+    mPending.push_back(record);
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mMutex);
+}
+
+bool SaceEventJournal::commit (const vector<Record> &records) {
+    string group;
+    for (auto &record : records)
+        encode(record, group);
+
+    if (!write_fully(mFd, group.data(), group.size())) {
+        SACE_LOGE("%s write %zu records errno=%d errstr=%s", NAME, records.size(), errno, strerror(errno));
+        return false;
+    }
+
+    if (fdatasync(mFd) < 0)
+        SACE_LOGE("%s fdatasync errno=%d errstr=%s", NAME, errno, strerror(errno));
+
+    mRecords += records.size();
+    return true;
+}
+
+bool SaceEventJournal::compact () {
+    string snapshot = mProvider->onSnapshot();
+    string tmp = mSnapshot + ".tmp";
+
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        SACE_LOGE("%s open %s errno=%d errstr=%s", NAME, tmp.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    if (!write_fully(fd, snapshot.data(), snapshot.size()) || fsync(fd) < 0) {
+        SACE_LOGE("%s write %s errno=%d errstr=%s", NAME, tmp.c_str(), errno, strerror(errno));
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    close(fd);
+
+    if (rename(tmp.c_str(), mSnapshot.c_str()) < 0) {
+        SACE_LOGE("%s rename %s errno=%d errstr=%s", NAME, mSnapshot.c_str(), errno, strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+    fsync_parent_dir(mSnapshot);
+
+    /* records replayed over the new snapshot are harmless, so truncate after rename */
+    if (ftruncate(mFd, 0) < 0 || fdatasync(mFd) < 0)
+        SACE_LOGE("%s truncate %s errno=%d errstr=%s", NAME, mJournal.c_str(), errno, strerror(errno));
+
+    SACE_LOGI("%s compact %zu records into %s", NAME, mRecords, mSnapshot.c_str());
+    mRecords = 0;
+    return true;
+}
+
+void* SaceEventJournal::journal_thread_run (void *data) {
+    SaceEventJournal *self = static_cast<SaceEventJournal*>(data);
+    vector<Record> group;
+    bool exit = false;
+
+    prctl(PR_SET_NAME, THREAD_NAME);
+    while (!exit) {
+        pthread_mutex_lock(&self->mMutex);
+        while (self->mPending.empty() && !self->mExit)
+            pthread_cond_wait(&self->mCond, &self->mMutex);
+
+        /* group commit : everything queued while last group was written */
+        group.swap(self->mPending);
+        exit = self->mExit;
+        pthread_mutex_unlock(&self->mMutex);
+
+        if (!group.empty() && self->commit(group) && self->mRecords >= COMPACT_THRESHOLD)
+            self->compact();
+        group.clear();
+    }
+
+    return nullptr;
+}
+
+}; // namespace android
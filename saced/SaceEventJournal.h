@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_EVENT_JOURNAL_H_
+#define _SACE_EVENT_JOURNAL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define DATA_JOURNAL_FILE "/data/sace/sace_event.journal"
+
+using namespace std;
+
+namespace android {
+
+/* Append-only log of dynamic event changes.
+ * Records are queued by the caller and written by journal thread in groups,
+ * one fdatasync per group. Once enough records accumulated the whole table is
+ * compacted into the snapshot file (write tmp + fsync + rename) and the journal
+ * is truncated. Replay is idempotent: ADD replaces, DEL of a missing name is ignored.
+ */
+class SaceEventJournal {
+public:
+    enum RecordType {
+        RECORD_ADD = 1,
+        RECORD_DEL = 2,
+    };
+
+    struct Record {
+        enum RecordType type;
+        string name;
+        string body;   /* ini text of the event, only for RECORD_ADD */
+    };
+
+    class Snapshot {
+    public:
+        /* invoke in journal thread */
+        virtual string onSnapshot () = 0;
+        virtual ~Snapshot () {}
+    };
+
+    SaceEventJournal (const char* journal, const char* snapshot, Snapshot *provider);
+    ~SaceEventJournal ();
+
+    /* valid records, torn tail of the journal is dropped */
+    bool replay (vector<Record> &records);
+    bool start ();
+    void stop ();
+
+    void append (enum RecordType type, const string &name, const string &body);
+
+private:
+    static const char *NAME;
+    static const char *THREAD_NAME;
+    static const uint32_t RECORD_MAGIC;
+    static const size_t COMPACT_THRESHOLD;
+
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t len;       /* payload length */
+        uint32_t checksum;  /* over type and payload */
+        uint32_t type;
+    };
+
+    string mJournal;
+    string mSnapshot;
+    Snapshot *mProvider;
+
+    int mFd;
+    size_t mRecords;
+    bool mExit;
+    bool mRunning;
+
+    pthread_t journal_thread;
+    pthread_mutex_t mMutex;
+    pthread_cond_t  mCond;
+    /* need mMutex protect */
+    vector<Record> mPending;
+
+    static void* journal_thread_run (void *data);
+    static uint32_t checksum (uint32_t type, const char *data, size_t len);
+
+    void encode (const Record &record, string &out) const;
+    bool commit (const vector<Record> &records);
+    bool compact ();
+};
+
+}; // namespace android
+
+#endif
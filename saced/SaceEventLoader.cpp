@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "SaceEventLoader.h"
+#include <SaceLog.h>
+#include <sace/SaceParams.h>
+
+namespace android {
+
+const char* SaceEventLoader::NAME = "SEEventLoader";
+const unsigned SaceEventLoader::MAX_LOAD_THREADS = 4;
+
+#define CAP_MAP_ENTRY(cap)  { #cap, CAP_##cap }
+static const map<string, int, less<>> cap_map = {
+    CAP_MAP_ENTRY(CHOWN),
+    CAP_MAP_ENTRY(DAC_OVERRIDE),
+    CAP_MAP_ENTRY(DAC_READ_SEARCH),
+    CAP_MAP_ENTRY(FOWNER),
+    CAP_MAP_ENTRY(FSETID),
+    CAP_MAP_ENTRY(KILL),
+    CAP_MAP_ENTRY(SETGID),
+    CAP_MAP_ENTRY(SETUID),
+    CAP_MAP_ENTRY(SETPCAP),
+    CAP_MAP_ENTRY(LINUX_IMMUTABLE),
+    CAP_MAP_ENTRY(NET_BIND_SERVICE),
+    CAP_MAP_ENTRY(NET_BROADCAST),
+    CAP_MAP_ENTRY(NET_ADMIN),
+    CAP_MAP_ENTRY(NET_RAW),
+    CAP_MAP_ENTRY(IPC_LOCK),
+    CAP_MAP_ENTRY(IPC_OWNER),
+    CAP_MAP_ENTRY(SYS_MODULE),
+    CAP_MAP_ENTRY(SYS_RAWIO),
+    CAP_MAP_ENTRY(SYS_CHROOT),
+    CAP_MAP_ENTRY(SYS_PTRACE),
+    CAP_MAP_ENTRY(SYS_PACCT),
+    CAP_MAP_ENTRY(SYS_ADMIN),
+    CAP_MAP_ENTRY(SYS_BOOT),
+    CAP_MAP_ENTRY(SYS_NICE),
+    CAP_MAP_ENTRY(SYS_RESOURCE),
+    CAP_MAP_ENTRY(SYS_TIME),
+    CAP_MAP_ENTRY(SYS_TTY_CONFIG),
+    CAP_MAP_ENTRY(MKNOD),
+    CAP_MAP_ENTRY(LEASE),
+    CAP_MAP_ENTRY(AUDIT_WRITE),
+    CAP_MAP_ENTRY(AUDIT_CONTROL),
+    CAP_MAP_ENTRY(SETFCAP),
+    CAP_MAP_ENTRY(MAC_OVERRIDE),
+    CAP_MAP_ENTRY(MAC_ADMIN),
+    CAP_MAP_ENTRY(SYSLOG),
+    CAP_MAP_ENTRY(WAKE_ALARM),
+    CAP_MAP_ENTRY(BLOCK_SUSPEND),
+    CAP_MAP_ENTRY(AUDIT_READ),
+};
+
+#define RLIMIT_MAP_ENTRY(rlm) { #rlm, RLIMIT_##rlm }
+static const map<string, int, less<>> rlimit_names = {
+    RLIMIT_MAP_ENTRY(AS),
+    RLIMIT_MAP_ENTRY(CORE),
+    RLIMIT_MAP_ENTRY(CPU),
+    RLIMIT_MAP_ENTRY(DATA),
+    RLIMIT_MAP_ENTRY(FSIZE),
+    RLIMIT_MAP_ENTRY(LOCKS),
+    RLIMIT_MAP_ENTRY(MEMLOCK),
+    RLIMIT_MAP_ENTRY(MSGQUEUE),
+    RLIMIT_MAP_ENTRY(NICE),
+    RLIMIT_MAP_ENTRY(NOFILE),
+    RLIMIT_MAP_ENTRY(NPROC),
+    RLIMIT_MAP_ENTRY(RTPRIO),
+    RLIMIT_MAP_ENTRY(SIGPENDING),
+    RLIMIT_MAP_ENTRY(STACK),
+};
+
+const map<string, int, less<>>& SaceEventLoader::capability_map () {
+    return cap_map;
+}
+
+const map<string, int, less<>>& SaceEventLoader::rlimit_map () {
+    return rlimit_names;
+}
+
+// -------------- Tokenizer -------------
+/* whitespace separated views over one line, "" keeps spaces in a token */
+class SaceEventLoader::Tokenizer {
+    string_view mLine;
+    size_t mPos;
+
+    void skip_space () {
+        while (mPos < mLine.size() && isspace(static_cast<unsigned char>(mLine[mPos])))
+            mPos++;
+    }
+
+public:
+    int line;
+
+    Tokenizer (string_view data, int line_no):mLine(data),mPos(0),line(line_no) {
+        skip_space();
+    }
+
+    bool empty () const {
+        return mPos >= mLine.size();
+    }
+
+    char peek () const {
+        return mLine[mPos];
+    }
+
+    bool next (string_view &token) {
+        skip_space();
+        if (empty())
+            return false;
+
+        size_t start = mPos;
+        if (mLine[mPos] == '"') {
+            size_t close = mLine.find('"', mPos + 1);
+            if (close == string_view::npos) {
+                token = mLine.substr(start);
+                mPos  = mLine.size();
+                return false;
+            }
+
+            token = mLine.substr(start + 1, close - start - 1);
+            mPos  = close + 1;
+            return true;
+        }
+
+        while (mPos < mLine.size() && !isspace(static_cast<unsigned char>(mLine[mPos])))
+            mPos++;
+
+        token = mLine.substr(start, mPos - start);
+        return true;
+    }
+
+    /* remaining text without surrounding spaces */
+    string_view rest () {
+        skip_space();
+
+        size_t end = mLine.size();
+        while (end > mPos && isspace(static_cast<unsigned char>(mLine[end - 1])))
+            end--;
+
+        string_view remain = mLine.substr(mPos, end - mPos);
+        mPos = mLine.size();
+        return remain;
+    }
+
+    int column (string_view token) const {
+        return static_cast<int>(token.data() - mLine.data()) + 1;
+    }
+
+    int column () const {
+        return static_cast<int>(mPos) + 1;
+    }
+};
+
+static bool parse_int (string_view token, int &value) {
+    auto ret = from_chars(token.data(), token.data() + token.size(), value);
+    return ret.ec == errc() && ret.ptr == token.data() + token.size();
+}
+
+static void add_error (SaceEventLoader::Result &result, int line, int column, string msg) {
+    SaceEventLoader::Error error;
+    error.line   = line;
+    error.column = column;
+    error.msg    = msg;
+    result.errors.push_back(error);
+}
+
+// -------------- SaceEventLoader -------------
+/* Service Ini Format
+ * service_name service_cmd
+ * user   <uid | user_name>
+ * group  <gid | group_name>
+ * groups <gid | group_name> ...
+ * seclabel secontext
+ * capability capability_name ...
+ * trigger property:proper_name=property_value
+ * trigger boot <true | false>
+ * rlimits limit_name hard_limit soft_limit
+ */
+void SaceEventLoader::parse_service_attr (Tokenizer &tokens, SaceEventParams *params, Result &result) {
+    string_view tag, value;
+    tokens.next(tag);
+
+    if (tag == "user" || tag == "group" || tag == "seclabel") {
+        if (!tokens.next(value)) {
+            add_error(result, tokens.line, tokens.column(), string(tag) + " requires a value");
+            return;
+        }
+
+        if (tag == "user")
+            params->set_uid(string(value));
+        else if (tag == "group")
+            params->set_gid(string(value));
+        else
+            params->set_seclabel(string(value));
+    }
+    else if (tag == "capability") {
+        while (tokens.next(value)) {
+            auto e = cap_map.find(value);
+            if (e == cap_map.end())
+                add_error(result, tokens.line, tokens.column(value), "unknown capability " + string(value));
+            else
+                params->set_capabilities(e->second);
+        }
+    }
+    else if (tag == "groups") {
+        while (tokens.next(value))
+            params->add_gids(string(value));
+    }
+    else if (tag == "trigger") {
+        if (!tokens.next(value)) {
+            add_error(result, tokens.line, tokens.column(), "trigger requires a value");
+            return;
+        }
+
+        static const string_view property_prefix = "property:";
+        if (value.substr(0, property_prefix.size()) == property_prefix) {
+            string_view property = value.substr(property_prefix.size());
+            size_t equal_pos = property.find('=');
+            if (equal_pos == string_view::npos || equal_pos == 0)
+                add_error(result, tokens.line, tokens.column(value), "expect property:name=value");
+            else
+                params->add_property(string(property.substr(0, equal_pos)), string(property.substr(equal_pos + 1)));
+        }
+        else if (value == "boot")
+            params->set_boot(true);
+        else
+            add_error(result, tokens.line, tokens.column(value), "unknown trigger " + string(value));
+    }
+    else if (tag == "rlimits") {
+        string_view rlm_name, rlm_hard, rlm_soft;
+        int hard, soft;
+
+        if (!tokens.next(rlm_name) || !tokens.next(rlm_hard) || !tokens.next(rlm_soft)) {
+            add_error(result, tokens.line, tokens.column(), "expect rlimits limit_name hard_limit soft_limit");
+            return;
+        }
+
+        auto e = rlimit_names.find(rlm_name);
+        if (e == rlimit_names.end())
+            add_error(result, tokens.line, tokens.column(rlm_name), "unknown rlimit " + string(rlm_name));
+        else if (!parse_int(rlm_hard, hard))
+            add_error(result, tokens.line, tokens.column(rlm_hard), "invalid hard limit");
+        else if (!parse_int(rlm_soft, soft))
+            add_error(result, tokens.line, tokens.column(rlm_soft), "invalid soft limit");
+        else
+            params->add_rlimits(e->second, soft, hard);
+    }
+    else
+        add_error(result, tokens.line, tokens.column(tag), "unknown attribute " + string(tag));
+}
+
+void SaceEventLoader::parse (string_view data, Result &result) {
+    sp<SaceCommand> cmd;
+    shared_ptr<SaceEventParams> params;
+    int cmd_line = 0, line_no = 0;
+    size_t pos = 0;
+
+    auto finish_event = [&]() {
+        if (cmd == nullptr)
+            return;
+
+        Entry entry;
+        entry.cmd  = cmd;
+        entry.line = cmd_line;
+        result.entries.push_back(entry);
+        cmd = nullptr;
+    };
+
+    while (pos < data.size()) {
+        size_t end = data.find('\n', pos);
+        if (end == string_view::npos)
+            end = data.size();
+
+        Tokenizer tokens(data.substr(pos, end - pos), ++line_no);
+        pos = end + 1;
+
+        /* blank line over last event */
+        if (tokens.empty()) {
+            finish_event();
+            continue;
+        }
+
+        /* skip commit line */
+        if (tokens.peek() == '#')
+            continue;
+
+        if (cmd != nullptr) {
+            parse_service_attr(tokens, params.get(), result);
+            continue;
+        }
+
+        string_view name, command;
+        tokens.next(name);
+        command = tokens.rest();
+        if (command.empty()) {
+            add_error(result, line_no, tokens.column(name), "service " + string(name) + " without command");
+            continue;
+        }
+
+        params = make_shared<SaceEventParams>();
+        cmd = new SaceCommand();
+        cmd->name.assign(name.data(), name.size());
+        cmd->command.assign(command.data(), command.size());
+        cmd->command_params = params;
+        cmd_line = line_no;
+    }
+
+    /* finish finally event */
+    finish_event();
+}
+
+bool SaceEventLoader::load_file (const string &path, Result &result) {
+    result.path   = path;
+    result.loaded = false;
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SACE_LOGE("%s open %s errno=%d errstr=%s", NAME, path.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        SACE_LOGE("%s fstat %s errno=%d errstr=%s", NAME, path.c_str(), errno, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return (result.loaded = true);
+    }
+
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        SACE_LOGE("%s mmap %s errno=%d errstr=%s", NAME, path.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    parse(string_view(static_cast<const char*>(addr), st.st_size), result);
+    munmap(addr, st.st_size);
+
+    return (result.loaded = true);
+}
+
+void SaceEventLoader::load_files (const vector<string> &files, vector<Result> &results) {
+    results.clear();
+    results.resize(files.size());
+
+    unsigned threads = min<unsigned>(files.size(), min(MAX_LOAD_THREADS, max(1u, thread::hardware_concurrency())));
+    if (threads <= 1) {
+        for (size_t i = 0; i < files.size(); i++)
+            load_file(files[i], results[i]);
+        return;
+    }
+
+    atomic<size_t> next_file(0);
+    auto load_worker = [&]() {
+        size_t i;
+        while ((i = next_file.fetch_add(1)) < files.size())
+            load_file(files[i], results[i]);
+    };
+
+    vector<thread> workers;
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back(load_worker);
+
+    load_worker();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void SaceEventLoader::list_dir (const char *dir, vector<string> &files, const char *exclude) {
+    DIR *dp = opendir(dir);
+    if (dp == nullptr) {
+        if (errno != ENOENT)
+            SACE_LOGE("%s opendir %s errno=%d errstr=%s", NAME, dir, errno, strerror(errno));
+        return;
+    }
+
+    vector<string> names;
+    struct dirent *entry;
+    while ((entry = readdir(dp)) != nullptr) {
+        string_view name(entry->d_name);
+        if (name.size() <= 4 || name.substr(name.size() - 4) != ".ini")
+            continue;
+
+        string path = string(dir).append("/").append(name);
+        if (exclude != nullptr && path == exclude)
+            continue;
+
+        if (entry->d_type != DT_REG) {
+            struct stat st;
+            if (entry->d_type != DT_UNKNOWN || stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+                continue;
+        }
+
+        names.push_back(path);
+    }
+    closedir(dp);
+
+    sort(names.begin(), names.end());
+    files.insert(files.end(), names.begin(), names.end());
+}
+
+void SaceEventLoader::log_errors (const Result &result) {
+    for (auto &error : result.errors)
+        SACE_LOGE("%s %s:%d:%d %s", NAME, result.path.c_str(), error.line, error.column, error.msg.c_str());
+}
+
+}; // namespace android
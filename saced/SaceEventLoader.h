@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_EVENT_LOADER_H_
+#define _SACE_EVENT_LOADER_H_
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <SaceTypes.h>
+
+using namespace std;
+
+namespace android {
+
+/* Event config loader.
+ * Files are mapped and tokenized in place, strings are only materialized
+ * into the SaceCommand of each event. Errors carry file, line and column.
+ */
+class SaceEventLoader {
+public:
+    struct Entry {
+        sp<SaceCommand> cmd;    /* name, command and SaceEventParams */
+        int line;
+    };
+
+    struct Error {
+        int line;
+        int column;
+        string msg;
+    };
+
+    struct Result {
+        string path;
+        vector<Entry> entries;
+        vector<Error> errors;
+        bool loaded;
+    };
+
+    /* parse text in place, path is only used for reporting */
+    static void parse (string_view data, Result &result);
+    /* mmap and parse single file */
+    static bool load_file (const string &path, Result &result);
+    /* parse files in parallel, results keep the order of files */
+    static void load_files (const vector<string> &files, vector<Result> &results);
+    /* sorted *.ini of dir, skipping exclude */
+    static void list_dir (const char *dir, vector<string> &files, const char *exclude = nullptr);
+
+    static void log_errors (const Result &result);
+    static const map<string, int, less<>>& capability_map ();
+    static const map<string, int, less<>>& rlimit_map ();
+
+private:
+    static const char *NAME;
+    static const unsigned MAX_LOAD_THREADS;
+
+    class Tokenizer;
+    static void parse_service_attr (Tokenizer &tokens, SaceEventParams *params, Result &result);
+};
+
+}; // namespace android
+
+#endif
@@ -16,6 +16,8 @@
 
 #include <sys/wait.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
+#include <fcntl.h>
 #include <sys/capability.h>
 #include <unistd.h>
 #include <time.h>
@@ -23,6 +25,7 @@
 #include <selinux/android.h>
 
 #include "SaceExcutor.h"
+#include "SaceServiceTable.h"
 #include "SaceWriter.h"
 #include <SaceLog.h>
 
@@ -30,16 +33,6 @@ using namespace std;
 
 namespace android {
 
-template<typename T>
-void remove_vecotr_item (vector<T> list, T item) {
-    typename vector<T>::iterator it;
-    for (it = list.begin(); it != list.end(); it++)
-        if (*it == item) break;
-
-    if (it != list.end())
-        list.erase(it);
-}
-
 void set_proc_capability (CapSet &to_keep) {
     cap_t caps = cap_init();
     auto deleter = [](cap_t* p) { cap_free(*p); };
@@ -381,40 +374,38 @@ const string SaceServiceExcutor::ServiceInfo::to_string () {
 }
 
 SaceServiceExcutor::~SaceServiceExcutor () {
-    ServiceInfo *sveInfo = nullptr;
     SaceStatusResponse response;
     response.status = SACE_RESPONSE_STATUS_SIGNAL;
     response.type   = SACE_RESPONSE_TYPE_SERVICE;
 
-    vector<ServiceInfo*>::iterator it;
-    for (it = mRunningService.begin(); it != mRunningService.end(); it++) {
-        sveInfo = *it;
-        kill(sveInfo->pid, SIGKILL);
+    for (auto &sveInfo : mServices) {
+        kill(sveInfo.pid, SIGKILL);
 
-        response.label = sveInfo->label;
-        response.name  = sveInfo->name;
+        response.label = sveInfo.label;
+        response.name  = sveInfo.name;
 
-        SACE_LOGI("%s Kill Running Service : %s", getName(), sveInfo->to_string().c_str());
-        sveInfo->sendResponse(response);
-
-        delete sveInfo;
+        SACE_LOGI("%s Kill Running Service : %s", getName(), sveInfo.to_string().c_str());
+        sveInfo.sendResponse(response);
     }
 
-    mRunningService.clear();
-    mSeqService.clear();
+    mServices.clear();
     mNameService.clear();
 }
 
-void SaceServiceExcutor::onUninit() {
-    vector<ServiceInfo*>::iterator it;
-    for (it = mRunningService.begin(); it != mRunningService.end(); it++) {
-        ServiceInfo *sveInfo = *it;
+bool SaceServiceExcutor::onInit () {
+    /* optional, clients without it ask with SACE_SERVICE_CMD_INFO */
+    SaceServiceTable::initStatusPage();
+    return mSubscriptions.start();
+}
 
-        SACE_LOGI("%s Stop Running Service : %s", getName(), sveInfo->to_string().c_str());
-        kill(sveInfo->pid, SIGINT);
+void SaceServiceExcutor::onUninit() {
+    for (auto &sveInfo : mServices) {
+        SACE_LOGI("%s Stop Running Service : %s", getName(), sveInfo.to_string().c_str());
+        kill(sveInfo.pid, SIGINT);
     }
 
     monitor_service_status();
+    mSubscriptions.stop();
 }
 
 long SaceServiceExcutor::receive_msg_timeout () {
@@ -431,11 +422,21 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
 
     sp<SaceReaderMessage> saceMsg = (SaceReaderMessage*)msg.get();
     sp<SaceWriter> writer = saceMsg->msgWriter;
-    map<uint64_t, ServiceInfo*>::iterator it;
 
     pid_t pid;
     sp<SaceCommand> saceCmd = saceMsg->msgCmd;
 
+    /* the reader has answered already, no result */
+    if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_ATTACH) {
+        attach_writer(saceCmd, writer);
+        return;
+    }
+
+    if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_DETACH) {
+        mSubscriptions.removeAll(writer);
+        return;
+    }
+
     SaceResult result;
     result.sequence = saceCmd->sequence;
     result.name = saceCmd->name;
@@ -445,7 +446,6 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
     char *argv[] = {(char*)"sh", (char*)"-c", NULL, NULL};
     ServiceInfo *sveInfo = nullptr;
 
-    char cmd[CMD_BUFFER_LEN] = {0};
     if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_START) {
         string name = saceCmd->name;
 
@@ -456,61 +456,60 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
             goto end;
         }
 
-        sveInfo = new ServiceInfo();
-        sveInfo->state   = SaceServiceInfo::SERVICE_RUNNING;
-        sveInfo->cmdLine = saceCmd->command;
-        sveInfo->name = saceCmd->name;
-        sveInfo->label = (uint64_t)sveInfo;
-        sveInfo->flags = saceCmd->serviceFlags;
-        sveInfo->add_writer(writer);
-
         sp<CommandParams> param;
         if (saceCmd->command_params)
             param = saceCmd->command_params->parseCommandParams();
 
-        memcpy(cmd, saceCmd->command.c_str(), saceCmd->command.size());
         if ((pid = fork()) == 0) {
             handle_child_params(param);
             prctl(PR_SET_PDEATHSIG, SIGHUP);
-            prctl(PR_SET_NAME, sveInfo->name.c_str());
+            prctl(PR_SET_NAME, saceCmd->name.c_str());
 
-            argv[2] = cmd;
+            argv[2] = (char*)saceCmd->command.c_str();
             execv(BASH_PATH, argv);
             _exit(errno);
         }
         else if (pid > 0) {
-            sveInfo->pid = pid;
-            mRunningService.push_back(sveInfo);
-            mSeqService.insert(pair<uint64_t, ServiceInfo*>(sveInfo->label, sveInfo));
-            mNameService.insert(pair<string, ServiceInfo*>(sveInfo->name, sveInfo));
+            uint64_t label = mServices.insert(ServiceInfo());
+            mNameService.insert(pair<string, uint64_t>(name, label));
+
+            sveInfo = mServices.get(label);
+            sveInfo->state   = SaceServiceInfo::SERVICE_RUNNING;
+            sveInfo->cmdLine = saceCmd->command;
+            sveInfo->name  = name;
+            sveInfo->label = label;
+            sveInfo->flags = saceCmd->serviceFlags;
+            sveInfo->pid   = pid;
+            sveInfo->exitCode  = 0;
+            sveInfo->cpuTimeMs = 0;
+            sveInfo->add_writer(writer);
 
             time_t lt = time(NULL);
             struct tm *time = localtime(&lt);
             char buf[64] = {0};
             strftime(buf, sizeof(buf), "%Y_%m%d_%H%M%S", time);
             sveInfo->startTime = string(buf);
+            sveInfo->startedAt = lt;
+            state_changed(*sveInfo);
 
             /* Result */
             result.resultStatus = SACE_RESULT_STATUS_OK;
             result.resultType   = SACE_RESULT_TYPE_LABEL;
-            memcpy(result.resultExtra, &sveInfo->label, sizeof(uint64_t));
-            result.resultExtraLen = sizeof(uint64_t);
+            result.resultExtra.put(sveInfo->label);
             SACE_LOGI("Starting Service Name=%s Pid=%d", sveInfo->name.c_str(), sveInfo->pid);
         }
         else if (pid < 0) {
-            SACE_LOGE("fork process %s fail %s", sveInfo->name.c_str(), saceMsg->to_string().c_str());
-            delete sveInfo;
+            SACE_LOGE("fork process %s fail %s", name.c_str(), saceMsg->to_string().c_str());
             goto end;
         }
     }
     else if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_STOP) {
-        it = mSeqService.find(saceCmd->label);
-        if (it == mSeqService.end()) {
+        sveInfo = mServices.get(saceCmd->label);
+        if (sveInfo == nullptr) {
             SACE_LOGE("Invalid SACE_SERVICE_CMD_STOP for %s", saceMsg->to_string().c_str());
             goto end;
         }
 
-        sveInfo = it->second;
         if (sveInfo->state != SaceServiceInfo::SERVICE_RUNNING && sveInfo->state != SaceServiceInfo::SERVICE_PAUSED) {
             result.resultStatus = SACE_RESULT_STATUS_OK;
             SACE_LOGE("%s Has Stoped", saceMsg->to_string().c_str());
@@ -521,39 +520,38 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
 
             sveInfo->state = SaceServiceInfo::SERVICE_FINISHING_USER;
             result.resultStatus = SACE_RESULT_STATUS_OK;
+            state_changed(*sveInfo);
         }
     }
     else if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_PAUSE) {
-        it = mSeqService.find(saceCmd->label);
-        if (it == mSeqService.end()) {
+        sveInfo = mServices.get(saceCmd->label);
+        if (sveInfo == nullptr) {
             SACE_LOGE("Invalid SACE_SERVICE_CMD_PAUSE for %s", saceMsg->to_string().c_str());
             goto end;
         }
 
-        sveInfo = it->second;
         if (sveInfo->state == SaceServiceInfo::SERVICE_RUNNING) {
             kill(sveInfo->pid, SIGSTOP);
             sveInfo->state = SaceServiceInfo::SERVICE_PAUSED;
             result.resultStatus = SACE_RESULT_STATUS_OK;
+            state_changed(*sveInfo);
         }
         else {
             SACE_LOGW("service %s maybe stoped", sveInfo->to_string().c_str());
         }
     }
     else if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_RESTART) {
-        it = mSeqService.find(saceCmd->label);
-        if (it == mSeqService.end()) {
+        sveInfo = mServices.get(saceCmd->label);
+        if (sveInfo == nullptr) {
             SACE_LOGE("Invalid SACE_SERVICE_CMD_RESTART for %s", saceMsg->to_string().c_str());
             goto end;
         }
 
-        sveInfo = it->second;
         if (sveInfo->state == SaceServiceInfo::SERVICE_PAUSED) {
             kill(sveInfo->pid, SIGCONT);
             sveInfo->state = SaceServiceInfo::SERVICE_RUNNING;
             result.resultStatus = SACE_RESULT_STATUS_OK;
-
-            mRunningService.push_back(sveInfo);
+            state_changed(*sveInfo);
         }
         else {
             SACE_LOGW("service %s maybe stoped", sveInfo->to_string().c_str());
@@ -562,66 +560,169 @@ void SaceServiceExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
     else if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_INFO) {
         handleServiceInfo(saceCmd, writer, result);
     }
+    else if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_SUBSCRIBE) {
+        /* current states first, transitions follow in order */
+        vector<SaceServiceInfo::StateEvent> current;
+        for (auto &info : mServices)
+            current.push_back(state_event(info));
+
+        if (mSubscriptions.add(writer, *saceCmd, current))
+            result.resultStatus = SACE_RESULT_STATUS_OK;
+    }
+    else if (saceCmd->serviceCmdType == SACE_SERVICE_CMD_UNSUBSCRIBE) {
+        if (mSubscriptions.remove(writer, saceCmd->label))
+            result.resultStatus = SACE_RESULT_STATUS_OK;
+    }
 
 end:
+    /* a client may query right after this result, publish first */
+    publish_status();
     writer->sendResult(result);
     monitor_service_status();
 }
 
 void SaceServiceExcutor::handleServiceInfo (sp<SaceCommand> saceCmd, sp<SaceWriter> writer, SaceResult &result) {
-    string &cmd = saceCmd->command;
+    SaceServiceInfo::ServiceInfo info;
 
-    if (cmd == SaceServiceInfo::SERVICE_GET_BY_NAME) {
-        map<string, ServiceInfo*>::iterator it = mNameService.find(saceCmd->name);
-        if (it == mNameService.end()) {
-            SACE_LOGE("%s GET_SERVICE_INFO Unkown Service : %s", getName(), saceCmd->name.c_str());
-            return;
-        }
+    /* the table is current on this thread, same answer as the readers give */
+    if (!SaceServiceTable::query(*saceCmd, info)) {
+        SACE_LOGE("%s GET_SERVICE_INFO Unkown Service : %s", getName(), saceCmd->name.c_str());
+        return;
+    }
 
-        ServiceInfo *sveInfo = it->second;
-        if (sveInfo->flags != saceCmd->serviceFlags) {
-            SACE_LOGE("Invalide Service[%s] Type [%s:%s]", saceCmd->name.c_str(), SaceCommand::mapServiceFlagStr(saceCmd->serviceFlags).c_str(),
-                SaceCommand::mapServiceFlagStr(sveInfo->flags).c_str());
-            return;
-        }
+    writer->writeServiceInfo(info, result.resultExtra);
+    result.resultStatus = SACE_RESULT_STATUS_OK;
+    result.resultType   = SACE_RESULT_TYPE_EXTRA;
 
-        SaceServiceInfo::ServiceInfo info;
-        memset(&info, 0x00, sizeof(info));
-        info.label = sveInfo->label;
-        info.state = sveInfo->state;
-        strncpy(info.name, sveInfo->name.c_str(), sizeof(info.name) - 1);
-        strncpy(info.cmd, sveInfo->cmdLine.c_str(), sizeof(info.cmd) - 1);
+    mServices.get(info.label)->add_writer(writer);
+}
 
-        result.resultExtraLen = min(sizeof(result.resultExtra), sizeof(info));
-        memcpy(result.resultExtra, &info, result.resultExtraLen);
+void SaceServiceExcutor::attach_writer (sp<SaceCommand> saceCmd, sp<SaceWriter> writer) {
+    ServiceInfo *sveInfo = mServices.get(saceCmd->label);
+    if (sveInfo != nullptr) {
+        sveInfo->add_writer(writer);
+        return;
+    }
 
-        result.resultStatus = SACE_RESULT_STATUS_OK;
-        result.resultType   = SACE_RESULT_TYPE_EXTRA;
+    /* reaped after the answer, its exit went to the other writers only */
+    SaceStatusResponse response;
+    response.type   = SACE_RESPONSE_TYPE_SERVICE;
+    response.status = SACE_RESPONSE_STATUS_UNKNOWN;
+    response.label  = saceCmd->label;
+    response.name   = saceCmd->name;
+    writer->sendResponse(response);
+}
 
-        sveInfo->add_writer(writer);
+SaceServiceInfo::StateEvent SaceServiceExcutor::state_event (const ServiceInfo &sveInfo) {
+    SaceServiceInfo::StateEvent event;
+    event.label = sveInfo.label;
+    event.name  = sveInfo.name;
+    event.pid   = sveInfo.pid;
+    event.state = sveInfo.state;
+    event.exitCode = sveInfo.exitCode;
+    return event;
+}
+
+/* every transition goes to the table, the status page and the subscribers */
+void SaceServiceExcutor::state_changed (const ServiceInfo &sveInfo) {
+    mDirty = true;
+    mSubscriptions.publish(state_event(sveInfo));
+}
+
+/* record of sveInfo in the status page */
+void SaceServiceExcutor::write_status (const ServiceInfo &sveInfo) {
+    SaceServiceInfo::ServiceStatus status;
+    status.name  = sveInfo.name;
+    status.label = sveInfo.label;
+    status.pid   = sveInfo.pid;
+    status.state = sveInfo.state;
+    status.startTime = sveInfo.startedAt;
+    status.exitCode  = sveInfo.exitCode;
+    status.cpuTimeMs = sveInfo.cpuTimeMs;
+
+    SaceServiceTable::publishStatus(status);
+}
+
+/* utime + stime of a running service, fields 14 and 15 of /proc/pid/stat */
+void SaceServiceExcutor::refresh_cpu_time (ServiceInfo &sveInfo) {
+    char path[32], buf[512];
+    unsigned long long utime, stime;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", sveInfo.pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    ssize_t len = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf) - 1));
+    close(fd);
+    if (len <= 0)
+        return;
+    buf[len] = '\0';
+
+    /* comm may hold spaces and parentheses, fields restart after the last ')' */
+    char *fields = strrchr(buf, ')');
+    if (fields == nullptr || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*lu %*lu %*lu %*lu %llu %llu",
+            &utime, &stime) != 2)
+        return;
+
+    uint64_t cpuTimeMs = (utime + stime) * 1000 / sysconf(_SC_CLK_TCK);
+    if (cpuTimeMs != sveInfo.cpuTimeMs) {
+        sveInfo.cpuTimeMs = cpuTimeMs;
+        write_status(sveInfo);
+    }
+}
+
+void SaceServiceExcutor::publish_status () {
+    if (!mDirty)
+        return;
+
+    shared_ptr<SaceServiceTable::Snapshot> snapshot = make_shared<SaceServiceTable::Snapshot>();
+    snapshot->entries.reserve(mServices.size());
+    for (auto &sveInfo : mServices) {
+        SaceServiceTable::Entry entry;
+        entry.info.label = sveInfo.label;
+        entry.info.state = sveInfo.state;
+        entry.info.pid   = sveInfo.pid;
+        entry.info.name  = sveInfo.name;
+        entry.info.cmd   = sveInfo.cmdLine;
+        entry.info.startTime = sveInfo.startTime;
+        entry.flags = sveInfo.flags;
+        snapshot->add(std::move(entry));
+
+        write_status(sveInfo);
     }
+
+    SaceServiceTable::publish(snapshot);
+    mDirty = false;
 }
 
 void SaceServiceExcutor::monitor_service_status () {
-    vector<vector<SaceServiceExcutor::ServiceInfo*>::iterator> gcIterator;
+    vector<uint64_t> gcLabels;
     SaceServiceExcutor::ServiceInfo *sveInfo = nullptr;
+    struct rusage usage;
+    struct timespec now;
     int status;
 
-    for (vector<SaceServiceExcutor::ServiceInfo*>::iterator it = mRunningService.begin();
-        it != mRunningService.end(); it++) {
-        sveInfo = *it;
+    /* once a second, not on every command */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bool refresh = now.tv_sec != mCpuRefreshed;
+    mCpuRefreshed = now.tv_sec;
+
+    /* values are packed, the sweep walks one array */
+    for (auto &info : mServices) {
+        sveInfo = &info;
 
         if (sveInfo->state != SaceServiceInfo::SERVICE_PAUSED && sveInfo->state != SaceServiceInfo::SERVICE_RUNNING
             && sveInfo->state != SaceServiceInfo::SERVICE_STOPED && sveInfo->state != SaceServiceInfo::SERVICE_FINISHING_USER)
             continue;
 
         int ret;
-        if ((ret = waitpid(sveInfo->pid, &status, WNOHANG)) > 0) {
+        if ((ret = wait4(sveInfo->pid, &status, WNOHANG, &usage)) > 0) {
             SaceStatusResponse response;
 
             response.type = SACE_RESPONSE_TYPE_SERVICE;
             /* extra save exit status */
-            response.extraLen = sizeof(int32_t);
+            response.extra.put<int32_t>(0);
             response.label = sveInfo->label;
             response.name  = sveInfo->name;
 
@@ -629,12 +730,14 @@ void SaceServiceExcutor::monitor_service_status () {
                 int exit_ret = WEXITSTATUS(status);
                 sveInfo->state  = exit_ret == 0? SaceServiceInfo::SERVICE_FINISHED : SaceServiceInfo::SERVICE_DIED;
                 response.status = SACE_RESPONSE_STATUS_EXIT;
-                memcpy(response.extra, &exit_ret, response.extraLen);
+                response.extra.put<int32_t>(exit_ret);
+                sveInfo->exitCode = exit_ret;
                 SACE_LOGE("service [%s:%d] exit -> %d : %s", sveInfo->name.c_str(), sveInfo->pid, exit_ret,
                     exit_ret == 0? "no error" : strerror(exit_ret));
             }
             else if (WIFSIGNALED(status)) {
                 int signal_ret = WTERMSIG(status);
+                sveInfo->exitCode = signal_ret;
                 if (sveInfo->state == SaceServiceInfo::SERVICE_FINISHING_USER && signal_ret == SIGTERM) {
                     response.status = SACE_RESPONSE_STATUS_USER;
                     sveInfo->state  = SaceServiceInfo::SERVICE_FINISHED_USER;
@@ -643,36 +746,48 @@ void SaceServiceExcutor::monitor_service_status () {
                 else {
                     response.status = SACE_RESPONSE_STATUS_SIGNAL;
                     sveInfo->state  = SaceServiceInfo::SERVICE_DIED_SIGNAL;
-                    memcpy(response.extra, &signal_ret, response.extraLen);
+                    response.extra.put<int32_t>(signal_ret);
                     SACE_LOGE("service %s:%d exit for signal %d", sveInfo->name.c_str(), sveInfo->pid, signal_ret);
                 }
             }
             else {
                 sveInfo->state = SaceServiceInfo::SERVICE_DIED_UNKNOWN;
                 response.status = SACE_RESPONSE_STATUS_UNKNOWN;
-                memcpy(response.extra, &status, response.extraLen);
+                response.extra.put<int32_t>(status);
+                sveInfo->exitCode = status;
                 SACE_LOGE("service %s:%d eixt status = %d", sveInfo->name.c_str(), sveInfo->pid, status);
             }
 
-            gcIterator.push_back(it);
+            /* the record outlives the service until its slot is reused */
+            sveInfo->cpuTimeMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000ull
+                + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+            write_status(*sveInfo);
+
+            gcLabels.push_back(sveInfo->label);
             sveInfo->sendResponse(response);
+            state_changed(*sveInfo);
         }
+        else if (ret == 0 && refresh)
+            refresh_cpu_time(*sveInfo);
         else if (ret < 0) {
-            if (errno == ECHILD)
-                gcIterator.push_back(it);
-            SACE_LOGE("waitpid pid=%d errno=%d errstr=%s", sveInfo->pid, errno, strerror(errno));
+            if (errno == ECHILD) {
+                sveInfo->state = SaceServiceInfo::SERVICE_DIED_UNKNOWN;
+                write_status(*sveInfo);
+                gcLabels.push_back(sveInfo->label);
+                state_changed(*sveInfo);
+            }
+            SACE_LOGE("wait4 pid=%d errno=%d errstr=%s", sveInfo->pid, errno, strerror(errno));
         }
     }
 
-    for (size_t i = 0; i < gcIterator.size(); i++) {
-        sveInfo = *gcIterator[i];
-        mSeqService.erase(sveInfo->label);
+    /* erase moves values, never while iterating */
+    for (auto label : gcLabels) {
+        sveInfo = mServices.get(label);
         mNameService.erase(sveInfo->name);
-        mRunningService.erase(gcIterator[i]);
-        delete sveInfo;
+        mServices.erase(label);
     }
 
-    gcIterator.clear();
+    publish_status();
 } // }
 
 // ------------------------------------------------------------------ {
@@ -684,27 +799,23 @@ SaceNormalExcutor::~SaceNormalExcutor () {
     response.type = SACE_RESPONSE_TYPE_NORMAL;
     response.status = SACE_RESPONSE_STATUS_SIGNAL;
 
-    for (vector<CommandInfo*>::iterator it = mRunningCmd.begin(); it != mRunningCmd.end(); it++) {
-        CommandInfo *cmd = *it;
-        kill(cmd->pid, SIGKILL);
+    for (auto &cmd : mCommands) {
+        kill(cmd.pid, SIGKILL);
 
-        response.label = cmd->label;
-        response.name  = cmd->cmdLine;
-        cmd->writer->sendResponse(response);
+        response.label = cmd.label;
+        response.name  = cmd.cmdLine;
+        cmd.writer->sendResponse(response);
 
-        SACE_LOGE("%s Stop Running Command : %s", getName(), cmd->cmdLine.c_str());
-        delete cmd;
+        SACE_LOGE("%s Stop Running Command : %s", getName(), cmd.cmdLine.c_str());
     }
 
-    mRunningCmd.clear();
+    mCommands.clear();
 }
 
 void SaceNormalExcutor::onUninit() {
-    for (vector<CommandInfo*>::iterator it = mRunningCmd.begin(); it != mRunningCmd.end(); it++) {
-        CommandInfo *cmd = *it;
-
-        SACE_LOGE("%s Stop Running Command : %s", getName(), cmd->cmdLine.c_str());
-        kill(cmd->pid, SIGINT);
+    for (auto &cmd : mCommands) {
+        SACE_LOGE("%s Stop Running Command : %s", getName(), cmd.cmdLine.c_str());
+        kill(cmd.pid, SIGINT);
     }
 }
 
@@ -723,21 +834,20 @@ void SaceNormalExcutor::excuteNormal (sp<SaceMessageHeader> msg) {
 void SaceNormalExcutor::closeNormalCmd (sp<SaceReaderMessage> saceMsg) {
     sp<SaceCommand> saceCmd = saceMsg->msgCmd;
     sp<SaceWriter> writer = saceMsg->msgWriter;
-    map<uint64_t, CommandInfo*>::iterator it = mSeqCmd.find(saceCmd->label);
+    CommandInfo *cmdInfo = mCommands.get(saceCmd->label);
 
     SaceResult result;
     result.sequence = saceCmd->sequence;
 
-    if (it == mSeqCmd.end() || it->second->fd < 0) {
+    if (cmdInfo == nullptr || cmdInfo->fd < 0) {
         result.resultStatus = SACE_RESULT_STATUS_FAIL;
         result.resultType   = SACE_RESULT_TYPE_NONE;
         SACE_LOGE("Invalid SaceCommand Sequence OR Maybe Finished %s", saceMsg->to_string().c_str());
     }
     else {
-        CommandInfo *cmdInfo = it->second;
-
+        /* the label is stale from here on */
         sace_pclose(cmdInfo->fd);
-        remove_vecotr_item(mRunningCmd, cmdInfo);
+        mCommands.erase(saceCmd->label);
 
         result.resultStatus = SACE_RESULT_STATUS_OK;
         result.resultType   = SACE_RESULT_TYPE_NONE;
@@ -753,11 +863,10 @@ void SaceNormalExcutor::startNormalCmd (sp<SaceReaderMessage> saceMsg) {
     SaceResult result;
     result.sequence = saceCmd->sequence;
 
-    CommandInfo *cmdInfo = new CommandInfo();
-    cmdInfo->fd = -1;
-    cmdInfo->label = (uint64_t)cmdInfo;
-    cmdInfo->cmdLine = saceCmd->command;
-    cmdInfo->writer  = writer;
+    CommandInfo info;
+    info.fd = -1;
+    info.cmdLine = saceCmd->command;
+    info.writer  = writer;
 
     sp<CommandParams> param;
     if (saceCmd->command_params)
@@ -765,30 +874,28 @@ void SaceNormalExcutor::startNormalCmd (sp<SaceReaderMessage> saceMsg) {
     else
         param = nullptr;
 
-    int fd = sace_popen(cmdInfo->cmdLine.c_str(), saceCmd->flags == SACE_CMD_FLAG_OUT? "w" : "r", param, &cmdInfo->pid);
+    int fd = sace_popen(info.cmdLine.c_str(), saceCmd->flags == SACE_CMD_FLAG_OUT? "w" : "r", param, &info.pid);
     if (fd < 0) {
-        SACE_LOGE("popen %s fail %s", cmdInfo->cmdLine.c_str(), strerror(errno));
+        SACE_LOGE("popen %s fail %s", info.cmdLine.c_str(), strerror(errno));
         result.resultStatus = SACE_RESULT_STATUS_FAIL;
         result.resultType   = SACE_RESULT_TYPE_NONE;
         writer->sendResult(result);
-
-        delete cmdInfo;
         return;
     }
     else
         result.resultStatus = SACE_RESULT_STATUS_OK;
 
-    cmdInfo->fd = fd;
+    info.fd = fd;
 
-    mRunningCmd.push_back(cmdInfo);
-    mSeqCmd.insert(pair<uint64_t, CommandInfo*>(cmdInfo->label, cmdInfo));
+    uint64_t label = mCommands.insert(std::move(info));
+    CommandInfo *cmdInfo = mCommands.get(label);
+    cmdInfo->label = label;
 
     result.resultType = SACE_RESULT_TYPE_FD;
     result.resultStatus = SACE_RESULT_STATUS_OK;
 
     result.resultFd   = fd;
-    result.resultExtraLen = sizeof(uint64_t);
-    memcpy(result.resultExtra, &cmdInfo->label, result.resultExtraLen);
+    result.resultExtra.put(cmdInfo->label);
 
     writer->sendResult(result);
 } // }
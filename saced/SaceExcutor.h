@@ -20,6 +20,7 @@
 #include <semaphore.h>
 #include <vector>
 #include <queue>
+#include <unordered_map>
 #include <pthread.h>
 
 #include <SaceTypes.h>
@@ -27,6 +28,8 @@
 #include <SaceMessage.h>
 #include <SaceLog.h>
 #include <sace/SaceParams.h>
+#include "SaceSlotMap.h"
+#include "SaceSubscription.h"
 
 #define BASH_PATH "system/bin/sh"
 
@@ -86,33 +89,18 @@ protected:
 
 // ----------------------------------------------------------------
 class SaceServiceExcutor : public SaceExcutor {
-class ServiceInfo;
     static const char* THREAD_NAME;
     static const char* NAME;
     static const int   TIMEOUT;
 
-    vector<ServiceInfo*> mRunningService;
-    map<uint64_t, ServiceInfo*> mSeqService;
-    map<string, ServiceInfo*> mNameService;
-
-    void monitor_service_status();
-    void handleServiceInfo (sp<SaceCommand>, sp<SaceWriter>, SaceResult &);
-
-public:
-    SaceServiceExcutor():SaceExcutor(SACE_MESSAGE_HANDLER_SERVICE, NAME, THREAD_NAME) {}
-    ~SaceServiceExcutor();
-protected:
-    virtual void excuteNormal (sp<SaceMessageHeader>) override;
-    virtual long receive_msg_timeout();
-    virtual void excuteTimeout();
-    virtual void onUninit();
-
-private:
     class ServiceInfo {
     public:
         string name;
         pid_t pid;
         string startTime;
+        time_t startedAt;
+        int32_t exitCode;
+        uint64_t cpuTimeMs;
         enum SaceServiceInfo::ServiceState state;
         string cmdLine;
         vector<sp<SaceWriter>> writer;
@@ -127,18 +115,56 @@ private:
     private:
         string sveDescriptor;
     };
+
+    /* keyed by label, services stay until their process is reaped */
+    SaceSlotMap<ServiceInfo> mServices;
+    unordered_map<string, uint64_t> mNameService;
+    /* mServices changed since the last SaceServiceTable::publish */
+    bool mDirty;
+    /* CLOCK_MONOTONIC seconds, cpu times in the status page are this old */
+    time_t mCpuRefreshed;
+    SaceSubscriptions mSubscriptions;
+
+    void monitor_service_status();
+    void publish_status();
+    void state_changed (const ServiceInfo &);
+    static SaceServiceInfo::StateEvent state_event (const ServiceInfo &);
+    void write_status (const ServiceInfo &);
+    void refresh_cpu_time (ServiceInfo &);
+    void attach_writer (sp<SaceCommand>, sp<SaceWriter>);
+    void handleServiceInfo (sp<SaceCommand>, sp<SaceWriter>, SaceResult &);
+
+public:
+    SaceServiceExcutor():SaceExcutor(SACE_MESSAGE_HANDLER_SERVICE, NAME, THREAD_NAME) {
+        mDirty = false;
+        mCpuRefreshed = 0;
+    }
+    ~SaceServiceExcutor();
+protected:
+    virtual void excuteNormal (sp<SaceMessageHeader>) override;
+    virtual long receive_msg_timeout();
+    virtual void excuteTimeout();
+    virtual bool onInit();
+    virtual void onUninit();
 };
 
 // -------------------------------------------------------------
 
 class SaceNormalExcutor : public SaceExcutor {
-class CommandInfo;
     static const char* THREAD_NAME;
     static const char* NAME;
 
-    vector<CommandInfo*> mRunningCmd;
-    vector<CommandInfo*> mFinishedCmd;
-    map<uint64_t, CommandInfo*> mSeqCmd;
+    class CommandInfo {
+    public:
+        int fd;
+        string cmdLine;
+        uint64_t label;
+        sp<SaceWriter> writer;
+        pid_t pid;
+    };
+
+    /* keyed by label, commands stay until the client closes them */
+    SaceSlotMap<CommandInfo> mCommands;
 public:
     SaceNormalExcutor():SaceExcutor(SACE_MESSAGE_HANDLER_NORMAL, NAME, THREAD_NAME) {}
     ~SaceNormalExcutor();
@@ -149,15 +175,6 @@ protected:
 private:
     void startNormalCmd (sp<SaceReaderMessage>);
     void closeNormalCmd (sp<SaceReaderMessage>);
-
-    class CommandInfo {
-    public:
-        int fd;
-        string cmdLine;
-        uint64_t label;
-        sp<SaceWriter> writer;
-        pid_t pid;
-    };
 };
 
 void set_proc_capability (CapSet &);
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_FILE_UTIL_H_
+#define _SACE_FILE_UTIL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace android {
+
+/* Helpers shared by the files saced persists under /data/sace */
+
+constexpr uint32_t SACE_FNV32_BASIS = 2166136261u;
+constexpr uint64_t SACE_FNV64_BASIS = 14695981039346656037ull;
+
+/* false on any short write, the caller drops the file */
+inline bool write_fully (int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(fd, data, len));
+        if (ret <= 0)
+            return false;
+
+        data += ret;
+        len  -= ret;
+    }
+
+    return true;
+}
+
+/* FNV-1a, pass a previous result as hash to continue it */
+inline uint32_t fnv1a32 (const void *data, size_t len, uint32_t hash = SACE_FNV32_BASIS) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+inline uint64_t fnv1a64 (const void *data, size_t len, uint64_t hash = SACE_FNV64_BASIS) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+}; // namespace android
+
+#endif
@@ -23,6 +23,7 @@
 #include <utils/RefBase.h>
 
 #include <SaceTypes.h>
+#include <SacePool.h>
 
 namespace android {
 class SaceWriter;
@@ -58,8 +59,8 @@ private:
     string msgDescriptor;
 };
 
-/* Normal Message */
-class SaceReaderMessage : public SaceMessageHeader {
+/* Normal Message, one per request */
+class SaceReaderMessage : public SaceMessageHeader, public SacePooled<SaceReaderMessage> {
 public:
     sp<SaceCommand> msgCmd;
     sp<SaceWriter>  msgWriter;
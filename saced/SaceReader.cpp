@@ -14,10 +14,16 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/prctl.h>
 #include <unistd.h>
+#include <tuple>
 
 #include <binder/IServiceManager.h>
 #include <binder/IPCThreadState.h>
@@ -25,6 +31,7 @@
 #include <cutils/sockets.h>
 
 #include "SaceReader.h"
+#include "SaceServiceTable.h"
 #include "SaceWriter.h"
 #include "SaceLog.h"
 
@@ -52,7 +59,6 @@ SaceResult resultBySecure () {
     SaceResult result;
     result.resultType   = SACE_RESULT_TYPE_NONE;
     result.resultStatus = SACE_RESULT_STATUS_SECURE;
-    result.resultExtraLen = 0;
     result.resultFd = -1;
     return result;
 }
@@ -61,16 +67,68 @@ SaceResult resultByFailure () {
     SaceResult result;
     result.resultType   = SACE_RESULT_TYPE_NONE;
     result.resultStatus = SACE_RESULT_STATUS_FAIL;
-    result.resultExtraLen = 0;
     result.resultFd = -1;
     return result;
 }
 
+bool is_service_info (const SaceCommand &cmd) {
+    return cmd.type == SACE_TYPE_SERVICE && cmd.serviceCmdType == SACE_SERVICE_CMD_INFO;
+}
+
+/* Answer SACE_SERVICE_CMD_INFO from the published table on the reader
+ * thread. If found, msg becomes SACE_SERVICE_CMD_ATTACH; post it so its
+ * writer is told about later status like the excutor's own answer does.
+ */
+bool answer_service_info (sp<SaceReaderMessage> msg, SaceResult &result) {
+    sp<SaceCommand> cmd = msg->msgCmd;
+    SaceServiceInfo::ServiceInfo info;
+
+    result = resultByFailure();
+    result.sequence = cmd->sequence;
+    result.name     = cmd->name;
+    if (!SaceServiceTable::query(*cmd, info))
+        return false;
+
+    msg->msgWriter->writeServiceInfo(info, result.resultExtra);
+    result.resultStatus = SACE_RESULT_STATUS_OK;
+    result.resultType   = SACE_RESULT_TYPE_EXTRA;
+
+    cmd->serviceCmdType = SACE_SERVICE_CMD_ATTACH;
+    cmd->label = info.label;
+    cmd->name  = info.name;
+    return true;
+}
+
+bool is_status_page (const SaceCommand &cmd) {
+    return cmd.type == SACE_TYPE_SERVICE && cmd.serviceCmdType == SACE_SERVICE_CMD_STATUS;
+}
+
+/* the page stays ours, socket and binder both hand the client a dup */
+SaceResult answer_status_page (const SaceCommand &cmd) {
+    SaceResult result = resultByFailure();
+    result.sequence = cmd.sequence;
+    result.name     = cmd.name;
+
+    int fd = SaceServiceTable::statusPageFd();
+    if (fd >= 0) {
+        result.resultStatus = SACE_RESULT_STATUS_OK;
+        result.resultType   = SACE_RESULT_TYPE_FD;
+        result.resultFd     = fd;
+    }
+
+    return result;
+}
+
 // --------------------------------------------------------------------------------
 const char* SaceSocketReader::NAME        = "SRSocket";
 const char* SaceSocketReader::THREAD_NAME = "SRSocket.MT";
 const char* SaceSocketReader::WRITER_NAME = "SRSocket.SaceWriter";
-const int   SaceSocketReader::MONITOR_TIMEOUT = 1; //1s
+const int   SaceSocketReader::LISTEN_BACKLOG   = 128;
+const int   SaceSocketReader::MAX_EPOLL_EVENTS = 64;
+const size_t SaceSocketReader::RECV_BUF_SIZE   = 64 * 1024;
+const unsigned SaceSocketReader::URING_ENTRIES     = 256;
+const unsigned SaceSocketReader::URING_BUFFERS     = 256;
+const unsigned SaceSocketReader::URING_BUFFER_SIZE = 4096;
 
 status_t SaceSocketReader::MonitorThread::readyToRun () {
     SACE_LOGI("%s Starting %d:%d", mReader->getName(), getpid(), gettid());
@@ -81,166 +139,727 @@ bool SaceSocketReader::MonitorThread::threadLoop () {
     bool ret;
     do {
         ret = mReader->recv_data_or_connection();
-    } while(!exitPending() || ret);
+    } while(!exitPending() && ret);
 
     return false;
 }
 
-void SaceSocketReader::handle_socket_msg (ClientMsg &climsg) {
-    sp<SaceSocketWriter> writer = new SaceSocketWriter(NAME, climsg.pid, climsg.fd);
+void SaceSocketReader::handle_socket_msg (Client &client, sp<SaceCommand> command) {
+    /* no to_string here, it would allocate for every request */
+    SACE_LOGI("%s handle command : sequence=%" PRIu64 " type=%d pid=%d", getName(), command->sequence,
+        command->type, client.cred.pid);
+    if (!admit_request(client, command->sequence, command->type))
+        return;
 
-    SACE_LOGI("%s handle command : %s", getName(), climsg.command->to_string().c_str());
-    if (secured_by_uid_pid(climsg.uid, climsg.pid)) {
+    sp<SaceSocketWriter> writer = client.writer;
+    if (secured_by_uid_pid(client.cred.uid, client.cred.pid)) {
         sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
-        saceMsg->msgHandler = typeCmdToMsg(climsg.command->type);
-        saceMsg->msgCmd    = climsg.command;
+        saceMsg->msgHandler = typeCmdToMsg(command->type);
+        saceMsg->msgCmd    = command;
         saceMsg->msgWriter = writer;
+
+        /* status polls never wait behind a fork on SEService.MT */
+        if (is_service_info(*command)) {
+            SaceResult rslt;
+            bool found = answer_service_info(saceMsg, rslt);
+            writer->sendResult(rslt);
+            if (found)
+                post(saceMsg);
+            return;
+        }
+
+        if (is_status_page(*command)) {
+            writer->sendResult(answer_status_page(*command));
+            return;
+        }
+
         post(saceMsg);
     }
     else {
         SaceResult rslt = resultBySecure();
+        rslt.sequence = command->sequence;
         writer->sendResult(rslt);
     }
 }
 
-bool SaceSocketReader::recv_data_or_connection () {
-    fd_set fds_read;
-    struct stat fd_stat;
-    int max_sockfd = -1;
-    int i, ret;
-
-    FD_ZERO(&fds_read);
-    /* original socket monitor connection */
-    if (mSockFd >= 0) {
-        FD_SET(mSockFd, &fds_read);
-        max_sockfd = mSockFd;
-    }
-
-    /* connected clients */
-    for(i = 0; i < MAX_CLIENT_NUM; i++) {
-        if (mClients[i].fd > 0) {
-            FD_SET(mClients[i].fd, &fds_read);
-            max_sockfd = max(max_sockfd, mClients[i].fd);
+void SaceSocketReader::handle_socket_batch (Client &client, uint64_t sequence, const vector<sp<SaceCommand>> &commands) {
+    SACE_LOGI("%s handle batch : sequence=%" PRIu64 " commands=%zu", getName(), sequence, commands.size());
+    if (!admit_request(client, sequence, SACE_TYPE_BATCH))
+        return;
+
+    sp<SaceSocketWriter> writer = client.writer;
+    if (!secured_by_uid_pid(client.cred.uid, client.cred.pid)) {
+        SaceBatchResult batchRslt;
+        batchRslt.sequence = sequence;
+        for (auto &cmd : commands) {
+            SaceResult rslt = resultBySecure();
+            rslt.sequence = cmd->sequence;
+            batchRslt.results.push_back(rslt);
         }
+
+        writer->sendBatchResult(batchRslt);
+        return;
     }
 
-    /* no Valide fd */
-    if (max_sockfd < 0)
-        return false;
+    /* split into per excutor messages, the collector answers once for all */
+    sp<SaceBatchCollector> collector = new SaceBatchCollector(writer, sequence, commands);
+    for (size_t i = 0; i < commands.size(); i++) {
+        sp<SaceWriter> itemWriter = new SaceBatchItemWriter(NAME, client.cred.pid, collector, i);
+        enum SaceMessageHandlerType handler = typeCmdToMsg(commands[i]->type);
 
-    struct timeval timeout = {MONITOR_TIMEOUT, 0};
-    ret = select(max_sockfd + 1, &fds_read, nullptr, nullptr, &timeout);
-    if (ret == 0)
-        return false;
-    else if (ret < 0) {
-        SACE_LOGE("%s Monitor Clients fail %s", getName(), strerror(errno));
-        for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-            if (mClients[i].fd > 0 && fstat(mClients[i].fd, &fd_stat) < 0)
-                mClients[i].fd = -1;
+        if (handler == SACE_MESSAGE_HANDLER_UNKOWN) {
+            SaceResult rslt = resultByFailure();
+            rslt.sequence = commands[i]->sequence;
+            itemWriter->sendResult(rslt);
+            continue;
         }
 
-        if (fstat(mSockFd, &fd_stat) < 0)
-            mSockFd = -1;
+        sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
+        saceMsg->msgHandler = handler;
+        saceMsg->msgCmd    = commands[i];
+        saceMsg->msgWriter = itemWriter;
+        post(saceMsg);
+    }
+}
 
-        return true;
+void SaceSocketReader::accept_clients () {
+    /* edge triggered, take every pending connection */
+    while (true) {
+        int client_fd = accept4(mSockFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                SACE_LOGE("%s Accept Client %d fail %s", getName(), mSockFd, strerror(errno));
+            return;
+        }
+
+        add_client(client_fd);
+    }
+}
+
+void SaceSocketReader::add_client (int client_fd) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(struct ucred);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+        SACE_LOGE("%s SO_PEERCRED client %d fail %s", getName(), client_fd, strerror(errno));
+        close(client_fd);
+        return;
+    }
+
+    bool watched;
+    /* EPOLLOUT stays armed, edge triggered it only fires once the
+     * socket has room again after a write came short */
+    if (mUring == nullptr)
+        watched = watch_fd(client_fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+    /* stream data comes with the multishot recv; room is polled for only
+     * while output waits, see queue_backlog */
+    else if (mSockType == SOCK_STREAM)
+        watched = arm(client_fd, URING_RECV, 0);
+    else
+        watched = watch_fd(client_fd, POLLIN | POLLRDHUP);
+
+    if (!watched) {
+        SACE_LOGE("%s watch client %d fail %s", getName(), client_fd, strerror(errno));
+        unwatch_fd(client_fd);
+        close(client_fd);
+        return;
+    }
+
+    auto it = mClients.emplace(piecewise_construct, forward_as_tuple(client_fd),
+        forward_as_tuple(client_fd, cred, mSockType == SOCK_SEQPACKET)).first;
+    if (!on_accept(it->second)) {
+        SACE_LOGE("%s - %d pid %d refused", getName(), client_fd, cred.pid);
+        unwatch_fd(client_fd);
+        it->second.output->detach();
+        mClients.erase(it);
+        close(client_fd);
+        return;
+    }
+
+    it->second.writer = make_writer(it->second);
+    if (mUring != nullptr)
+        it->second.output->onBacklog([this, client_fd] { queue_backlog(client_fd); });
+}
+
+bool SaceSocketReader::watch_fd (int fd, uint32_t events) {
+    if (mUring != nullptr)
+        return arm(fd, URING_POLL, events & ~EPOLLET);
+
+    struct epoll_event ev;
+    ev.events  = events;
+    ev.data.fd = fd;
+    return epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+void SaceSocketReader::unwatch_fd (int fd) {
+    if (mUring != nullptr)
+        disarm(fd);
+    else
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+sp<SaceSocketWriter> SaceSocketReader::make_writer (Client &client) {
+    return new SaceSocketWriter(WRITER_NAME, client.cred.pid, client.output, client.codec, client.inflight);
+}
+
+void SaceSocketReader::close_client (int fd) {
+    auto it = mClients.find(fd);
+    if (it == mClients.end())
+        return;
+
+    Client &client = it->second;
+    SACE_LOGI("%s - %d closed pid %d bytes=%" PRIu64 " frames=%" PRIu64 " requests=%" PRIu64 " refused=%" PRIu64,
+        getName(), fd, client.cred.pid, client.stats.bytes, client.stats.frames, client.stats.requests, client.stats.refused);
+
+    /* writers still held by excutors must not reach a reused fd */
+    on_close(client);
+    client.output->detach();
+
+    /* subscriptions of the connection end with it */
+    sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
+    saceMsg->msgHandler = SACE_MESSAGE_HANDLER_SERVICE;
+    saceMsg->msgCmd = new SaceCommand();
+    saceMsg->msgCmd->type = SACE_TYPE_SERVICE;
+    saceMsg->msgCmd->serviceCmdType = SACE_SERVICE_CMD_DETACH;
+    saceMsg->msgWriter = client.writer;
+    post(saceMsg);
+
+    unwatch_fd(fd);
+    mClients.erase(it);
+    close(fd);
+}
+
+void SaceSocketReader::flush_client (int fd) {
+    auto client = mClients.find(fd);
+    if (client == mClients.end())
+        return;
+
+    if (!client->second.output->flush()) {
+        SACE_LOGE("%s - %d flush failed, Close Socket", getName(), fd);
+        close_client(fd);
     }
-    else if (!ret) {
-        SACE_LOGE("%s Monitor Clients Timeout", getName());
+}
+
+bool SaceSocketReader::admit_request (Client &client, uint64_t sequence, enum SaceCommandType type) {
+    client.stats.requests++;
+    if (client.inflight->admit(sequence, type))
         return true;
+
+    /* any answer would complete the request in flight on the client, drop it */
+    client.stats.refused++;
+    SACE_LOGE("%s - %d sequence %" PRIu64 " in flight already, dropped", getName(), client.fd, sequence);
+    return false;
+}
+
+void SaceSocketReader::handle_socket_hello (Client &client, const SaceCommand &hello) {
+    /* answer in Parcel, the client decodes it whatever it asked for */
+    sp<SaceSocketWriter> writer = new SaceSocketWriter(WRITER_NAME, client.cred.pid, client.output);
+
+    int codec = SACE_CODEC_PARCEL;
+    if (!hello.extra.empty() && (hello.extra[0] & (1 << SACE_CODEC_COMPACT)))
+        codec = SACE_CODEC_COMPACT;
+
+    SaceResult rslt;
+    rslt.sequence       = hello.sequence;
+    rslt.resultType     = SACE_RESULT_TYPE_EXTRA;
+    rslt.resultStatus   = SACE_RESULT_STATUS_OK;
+    rslt.resultExtra.put<uint8_t>(codec);
+    writer->sendResult(rslt);
+
+    /* requests already handed out keep the writer they got */
+    client.codec  = codec;
+    client.writer = make_writer(client);
+    SACE_LOGI("%s - %d pid %d codec %d", getName(), client.fd, client.cred.pid, codec);
+}
+
+void SaceSocketReader::handle_compact_frame (Client &client, const uint8_t *frame, size_t len) {
+    int kind = SaceCodec::kind(frame, len);
+
+    if (kind == SaceCodec::KIND_BATCH) {
+        uint64_t sequence;
+        vector<sp<SaceCommand>> commands;
+        if (!SaceCodec::decode(frame, len, sequence, commands)) {
+            SACE_LOGE("%s - %d Invalide compact SaceBatchCommand len %zu", getName(), client.fd, len);
+            return;
+        }
+
+        handle_socket_batch(client, sequence, commands);
+        return;
     }
 
-    if (FD_ISSET(mSockFd, &fds_read)) {
-        struct sockaddr addr;
-        socklen_t slen = sizeof(addr);
+    sp<SaceCommand> command = new SaceCommand();
+    if (kind != SaceCodec::KIND_COMMAND || !SaceCodec::decode(frame, len, *command)) {
+        SACE_LOGE("%s - %d Invalide compact frame kind %d len %zu", getName(), client.fd, kind, len);
+        return;
+    }
 
-        int client_fd = accept(mSockFd, &addr, &slen);
-        if (client_fd < 0) {
-            SACE_LOGE("%s Accept Client %d fail %s", getName(), mSockFd, strerror(errno));
-            return true;
+    handle_socket_msg(client, command);
+}
+
+void SaceSocketReader::handle_socket_frame (Client &client, const uint8_t *frame, size_t len) {
+    client.stats.frames++;
+
+    /* every frame tells its own encoding */
+    if (SaceCodec::isCompact(frame, len)) {
+        handle_compact_frame(client, frame, len);
+        return;
+    }
+
+    if (len < SaceCommandHeader::parcelSize()) {
+        SACE_LOGE("%s - %d Invalide SaceCommandHeader. Size %zu, Required %d", getName(), client.fd, len, SaceCommandHeader::parcelSize());
+        return;
+    }
+
+    Parcel parcel;
+    parcel.setData(frame, len);
+
+    SaceCommandHeader header;
+    header.readFromParcel(&parcel);
+    parcel.setDataPosition(0);
+
+    if (header.type == SACE_TYPE_BATCH) {
+        SaceBatchCommand batch;
+        if (batch.readFromParcel(&parcel) != OK) {
+            SACE_LOGE("%s - %d Invalide SaceBatchCommand %s", getName(), client.fd, batch.to_string().c_str());
+            return;
         }
 
-        for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-            if (mClients[i].fd < 0) {
-                mClients[i].fd = client_fd;
-                break;
-            }
+        vector<sp<SaceCommand>> commands;
+        for (auto &cmd : batch.commands)
+            commands.push_back(new SaceCommand(cmd));
+
+        handle_socket_batch(client, batch.sequence, commands);
+        return;
+    }
+
+    sp<SaceCommand> command = new SaceCommand();
+    command->readFromParcel(&parcel);
+
+    if (header.type == SACE_TYPE_HELLO) {
+        handle_socket_hello(client, *command);
+        return;
+    }
+
+    handle_socket_msg(client, command);
+}
+
+/* one chunk of a stream client, false once the client was closed */
+bool SaceSocketReader::consume_stream (Client &client, const uint8_t *buf, size_t len) {
+    SaceFrameBuffer &frames = client.frames;
+
+    if (frames.pending() > 0) {
+        frames.append(buf, len);
+        return drain_frames(client);
+    }
+
+    size_t offset = 0;
+    ssize_t frame_len;
+
+    /* pipelined commands are handled in order, decoded in place */
+    while ((frame_len = SaceFrameBuffer::peek(buf + offset, len - offset)) > 0) {
+        handle_socket_frame(client, buf + offset, frame_len);
+        offset += frame_len;
+    }
+
+    if (frame_len < 0) {
+        SACE_LOGE("%s - %d Invalide Frame Length, Close Socket", getName(), client.fd);
+        close_client(client.fd);
+        return false;
+    }
+
+    if (offset < len)
+        frames.append(buf + offset, len - offset);
+    return true;
+}
+
+bool SaceSocketReader::drain_frames (Client &client) {
+    SaceFrameBuffer &frames = client.frames;
+    const uint8_t *frame;
+    size_t len;
+
+    while (frames.next(&frame, &len))
+        handle_socket_frame(client, frame, len);
+
+    if (frames.corrupted()) {
+        SACE_LOGE("%s - %d Invalide Frame Length, Close Socket", getName(), client.fd);
+        close_client(client.fd);
+        return false;
+    }
+
+    /* back to the shared buffer, idle clients hold no memory */
+    if (frames.pending() == 0)
+        frames.release();
+    return true;
+}
+
+void SaceSocketReader::recv_client_data (int fd) {
+    auto it = mClients.find(fd);
+    if (it == mClients.end())
+        return;
+
+    Client &client = it->second;
+    if (mSockType == SOCK_SEQPACKET) {
+        recv_client_packets(client);
+        return;
+    }
+
+    SaceFrameBuffer &frames = client.frames;
+
+    /* edge triggered, read until EAGAIN */
+    while (true) {
+        /* the tail of a split frame continues in the client buffer, anything
+         * else lands in the shared one and is decoded from there */
+        bool shared = frames.pending() == 0;
+        uint8_t *buf = shared ? mRecvBuf.data() : frames.reserve(MAX_SOCKET_BUF);
+        size_t buf_len = shared ? mRecvBuf.size() : MAX_SOCKET_BUF;
+
+        int ret = TEMP_FAILURE_RETRY(read(fd, buf, buf_len));
+        if (ret <= 0) {
+            if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+
+            if (ret < 0)
+                SACE_LOGE("%s Receive Incomming Command fail %d : %s", getName(), fd, strerror(errno));
+            else
+                SACE_LOGE("%s Close Socket %d", getName(), fd);
+
+            close_client(fd);
+            return;
         }
+        client.stats.bytes += ret;
+
+        if (shared) {
+            if (!consume_stream(client, buf, ret))
+                return;
+            continue;
+        }
+        frames.commit(ret);
+
+        if (!drain_frames(client))
+            return;
     }
-    else {
-        struct msghdr msg;
-        struct iovec iov[1];
-        char temp[MAX_SOCKET_BUF] = {0};
+}
 
-        iov[0].iov_base = temp;
-        iov[0].iov_len  = MAX_SOCKET_BUF;
+/* the kernel keeps the boundaries, one packet is one whole frame */
+void SaceSocketReader::recv_client_packets (Client &client) {
+    int fd = client.fd;
 
-        msg.msg_name    = nullptr;
-        msg.msg_namelen = 0;
-        msg.msg_iov    = iov;
+    /* edge triggered, read until EAGAIN */
+    while (true) {
+        struct iovec iov = { mRecvBuf.data(), mRecvBuf.size() };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = &iov;
         msg.msg_iovlen = 1;
-        msg.msg_control    = nullptr;
-        msg.msg_controllen = 0;
 
-        for (i = 0; i < MAX_CLIENT_NUM; i++) {
-            int fd = mClients[i].fd;
-            if (fd < 0 || !FD_ISSET(fd, &fds_read))
-                continue;
+        ssize_t ret = TEMP_FAILURE_RETRY(recvmsg(fd, &msg, 0));
+        if (ret <= 0) {
+            if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
 
-            ret = TEMP_FAILURE_RETRY(read(fd, temp, MAX_SOCKET_BUF));
-            if (ret <= 0) {
-                if (ret < 0)
-                    SACE_LOGE("%s Receive Incomming Command fail %d : %s", getName(), fd, strerror(errno));
-                else
-                    SACE_LOGE("%s Close Socket %d", getName(), fd);
+            if (ret < 0)
+                SACE_LOGE("%s Receive Incomming Command fail %d : %s", getName(), fd, strerror(errno));
+            else
+                SACE_LOGE("%s Close Socket %d", getName(), fd);
 
-                close(mClients[i].fd);
-                mClients[i].fd = -1;
-                continue;
-            }
+            close_client(fd);
+            return;
+        }
+        client.stats.bytes += ret;
 
-            if ((size_t)ret < SaceCommandHeader::parcelSize()) {
-                SACE_LOGE("%s - %d Invalide SaceCommandHeader. Size %d, Required %d", getName(), fd, ret, SaceCommandHeader::parcelSize());
-                continue;
-            }
+        if ((msg.msg_flags & MSG_TRUNC) || SaceFrameBuffer::peek(mRecvBuf.data(), ret) != ret) {
+            SACE_LOGE("%s - %d Invalide Packet len %zd, Close Socket", getName(), fd, ret);
+            close_client(fd);
+            return;
+        }
 
-            Parcel parcel;
-            parcel.setData((uint8_t*)temp, ret);
+        handle_socket_frame(client, mRecvBuf.data(), ret);
+    }
+}
 
-            SaceCommandHeader header;
-            header.readFromParcel(&parcel);
-            if (parcel.dataSize() < header.len) {
-                SACE_LOGE("%s - %d Invalide SaceCommand. Size %d, Required %d", getName(), fd, (uint32_t)parcel.dataSize(), header.len);
-                continue;
-            }
+bool SaceSocketReader::handle_ready (int fd, uint32_t events) {
+    if (fd == mStopFd) {
+        SACE_LOGI("%s Monitor Stop Requested", getName());
+        return false;
+    }
+    else if (fd == mBacklogFd)
+        watch_backlog();
+    else if (fd == mSockFd)
+        accept_clients();
+    else if (handle_event(fd, events))
+        return true;
+    else {
+        /* a failed flush closes the client, the rest finds it gone */
+        if (events & EPOLLOUT)
+            flush_client(fd);
+
+        if (events & EPOLLIN)
+            recv_client_data(fd);
+        else if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            close_client(fd);
+    }
+
+    return true;
+}
 
-            struct ucred cred;
-            socklen_t len = sizeof(struct ucred);
-            getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len);
+bool SaceSocketReader::recv_data_or_connection () {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    if (mUring != nullptr)
+        return recv_uring_completions();
+
+    int ret = epoll_wait(mEpollFd, events, MAX_EPOLL_EVENTS, prepare_wait());
+    if (ret < 0) {
+        if (errno == EINTR)
+            return true;
+
+        SACE_LOGE("%s Monitor Clients fail %s", getName(), strerror(errno));
+        return false;
+    }
 
-            ClientMsg climsg;
-            climsg.fd = fd;
-            climsg.pid = cred.pid;
-            climsg.uid = cred.uid;
+    /* only ready fds are visited */
+    for (int i = 0; i < ret; i++) {
+        if (!handle_ready(events[i].data.fd, events[i].events))
+            return false;
+    }
 
-            parcel.setDataPosition(0);
-            climsg.command->readFromParcel(&parcel);
+    return true;
+}
+
+// ------------------------------------------------------------------
+/* user_data of a request: gen (24 bits), op (8 bits), fd (32 bits) */
+uint64_t SaceSocketReader::uring_tag (int fd, uint32_t gen, UringOp op) {
+    return ((uint64_t)(gen & 0xFFFFFF) << 40) | ((uint64_t)op << 32) | (uint32_t)fd;
+}
+
+bool SaceSocketReader::arm (int fd, UringOp op, uint32_t events) {
+    auto it = mArmed.find(fd);
+    if (it == mArmed.end())
+        it = mArmed.emplace(fd, UringArmed{ ++mArmGen & 0xFFFFFF, 0, false, false }).first;
+
+    uint64_t tag = uring_tag(fd, it->second.gen, op);
+    switch (op) {
+        case URING_ACCEPT:
+            return mUring->accept(fd, tag);
+        case URING_RECV:
+            return mUring->recv(fd, tag);
+        case URING_POLLOUT:
+            it->second.polling = true;
+            return mUring->poll(fd, POLLOUT, tag);
+        default:
+            it->second.events = events;
+            return mUring->poll(fd, events, tag);
+    }
+}
 
-            handle_socket_msg(climsg);
+/* the fd may be closed before the cancel goes in, the tags still match */
+void SaceSocketReader::disarm (int fd) {
+    auto it = mArmed.find(fd);
+    if (it == mArmed.end())
+        return;
+
+    mUring->cancel(uring_tag(fd, it->second.gen, URING_RECV));
+    mUring->cancel(uring_tag(fd, it->second.gen, URING_POLL));
+    if (it->second.polling)
+        mUring->cancel(uring_tag(fd, it->second.gen, URING_POLLOUT));
+    mArmed.erase(it);
+}
+
+bool SaceSocketReader::recv_uring_completions () {
+    SaceUring::Completion cqe;
+
+    /* submits everything armed since the last round in the same call */
+    int ret = mUring->wait(prepare_wait());
+    if (ret < 0) {
+        SACE_LOGE("%s Monitor Clients fail %s", getName(), strerror(-ret));
+        return false;
+    }
+
+    while (mUring->next(cqe)) {
+        int fd = (int)(uint32_t)cqe.data;
+        UringOp op = (UringOp)((cqe.data >> 32) & 0xFF);
+        auto armed = mArmed.find(fd);
+
+        /* cancelled, or left over from a closed client of the same fd */
+        if (cqe.data == SaceUring::CANCEL_DATA || armed == mArmed.end() || armed->second.gen != (cqe.data >> 40)) {
+            mUring->recycle(cqe);
+            continue;
         }
+
+        if (op == URING_RECV) {
+            handle_uring_recv(fd, cqe);
+            continue;
+        }
+        if (op == URING_POLLOUT) {
+            handle_uring_pollout(fd, cqe);
+            continue;
+        }
+
+        uint32_t gen    = armed->second.gen;
+        uint32_t events = armed->second.events;
+        if (op == URING_ACCEPT) {
+            if (cqe.res >= 0)
+                add_client(cqe.res);
+            else if (cqe.res != -EAGAIN && cqe.res != -EINTR)
+                SACE_LOGE("%s Accept Client %d fail %s", getName(), mSockFd, strerror(-cqe.res));
+        }
+        else if (cqe.res >= 0 && !handle_ready(fd, cqe.res))
+            return false;
+
+        /* a multishot request that ended is armed again while wanted */
+        armed = mArmed.find(fd);
+        if (!SaceUring::more(cqe) && armed != mArmed.end() && armed->second.gen == gen)
+            arm(fd, op, events);
     }
 
     return true;
 }
 
+void SaceSocketReader::handle_uring_recv (int fd, const SaceUring::Completion &cqe) {
+    auto it = mClients.find(fd);
+    const uint8_t *buf = mUring->buffer(cqe);
+    bool open = it != mClients.end();
+
+    if (open && cqe.res > 0 && buf != nullptr) {
+        it->second.stats.bytes += cqe.res;
+        open = consume_stream(it->second, buf, cqe.res);
+    }
+    mUring->recycle(cqe);
+
+    if (!open)
+        return;
+
+    if (cqe.res > 0 || cqe.res == -ENOBUFS) {
+        /* out of buffers ends the multishot, they are back by now */
+        if (!SaceUring::more(cqe))
+            arm(fd, URING_RECV, 0);
+        return;
+    }
+
+    if (cqe.res < 0)
+        SACE_LOGE("%s Receive Incomming Command fail %d : %s", getName(), fd, strerror(-cqe.res));
+    else
+        SACE_LOGE("%s Close Socket %d", getName(), fd);
+    close_client(fd);
+}
+
+/* room for the queued output of fd; once the queue is out the poll is
+ * cancelled, a full socket with nothing queued posts nothing */
+void SaceSocketReader::handle_uring_pollout (int fd, const SaceUring::Completion &cqe) {
+    uint32_t gen = mArmed[fd].gen;
+
+    /* a failed flush closes the client and disarms fd */
+    if (cqe.res > 0)
+        flush_client(fd);
+
+    auto armed = mArmed.find(fd);
+    if (armed == mArmed.end() || armed->second.gen != gen)
+        return;
+
+    auto client = mClients.find(fd);
+    if (armed->second.pollout && (client == mClients.end() || client->second.output->idle())) {
+        armed->second.pollout = false;
+        if (SaceUring::more(cqe))
+            mUring->cancel(uring_tag(fd, gen, URING_POLLOUT));
+    }
+
+    /* ended or cancelled, again if output backed up meanwhile */
+    if (!SaceUring::more(cqe)) {
+        armed->second.polling = false;
+        if (armed->second.pollout)
+            arm(fd, URING_POLLOUT, POLLOUT);
+    }
+}
+
+/* on the sending thread, the monitor thread alone touches the ring */
+void SaceSocketReader::queue_backlog (int fd) {
+    uint64_t one = 1;
+
+    {
+        lock_guard<mutex> lock(mBacklogMutex);
+        mBacklog.push_back(fd);
+    }
+
+    if (TEMP_FAILURE_RETRY(write(mBacklogFd, &one, sizeof(one))) < 0)
+        SACE_LOGE("%s wake MonitorThread fail %s", getName(), strerror(errno));
+}
+
+void SaceSocketReader::watch_backlog () {
+    uint64_t count;
+    vector<int> fds;
+
+    if (TEMP_FAILURE_RETRY(read(mBacklogFd, &count, sizeof(count))) < 0 && errno != EAGAIN)
+        SACE_LOGE("%s read backlog eventfd fail %s", getName(), strerror(errno));
+
+    {
+        lock_guard<mutex> lock(mBacklogMutex);
+        fds.swap(mBacklog);
+    }
+
+    for (int fd : fds) {
+        auto client = mClients.find(fd);
+        auto armed  = mArmed.find(fd);
+        if (client == mClients.end() || armed == mArmed.end() || client->second.output->idle())
+            continue;
+
+        armed->second.pollout = true;
+        if (!armed->second.polling)
+            arm(fd, URING_POLLOUT, POLLOUT);
+    }
+}
+
+bool SaceSocketReader::setup_uring () {
+    if (!SaceUring::available())
+        return false;
+
+    if ((mBacklogFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        SACE_LOGE("%s eventfd fail %s", getName(), strerror(errno));
+        return false;
+    }
+
+    mUring = new SaceUring();
+    if (mUring->init(URING_ENTRIES, URING_BUFFERS, URING_BUFFER_SIZE)
+            && arm(mSockFd, URING_ACCEPT, 0) && arm(mStopFd, URING_POLL, POLLIN)
+            && arm(mBacklogFd, URING_POLL, POLLIN)) {
+        SACE_LOGI("%s %s on io_uring", getName(), mSockName.c_str());
+        return true;
+    }
+
+    SACE_LOGE("%s io_uring setup fail, using epoll", getName());
+    delete mUring;
+    mUring = nullptr;
+    mArmed.clear();
+    close(mBacklogFd);
+    mBacklogFd = -1;
+    return false;
+}
+
 void SaceSocketReader::close_socket () {
-    for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-        if (mClients[i].fd > 0)
-            close(mClients[i].fd);
-        mClients[i].fd = -1;
+    for (auto &client : mClients) {
+        client.second.output->detach();
+        close(client.first);
     }
+    mClients.clear();
+
+    delete mUring;
+    mUring = nullptr;
+    mArmed.clear();
+
+    if (mEpollFd >= 0)
+        close(mEpollFd);
+    if (mStopFd >= 0)
+        close(mStopFd);
+    if (mBacklogFd >= 0)
+        close(mBacklogFd);
+    if (mSockFd >= 0)
+        close(mSockFd);
+
+    mEpollFd = mStopFd = mBacklogFd = mSockFd = -1;
 }
 
 int SaceSocketReader::setup_socket () {
+    struct epoll_event ev;
     int socket_id;
 
     socket_id = socket_local_server(mSockName.c_str(), ANDROID_SOCKET_NAMESPACE_ABSTRACT, mSockType);
@@ -248,14 +867,51 @@ int SaceSocketReader::setup_socket () {
         SACE_LOGE("%s create socket %s fail %s", getName(), mSockName.c_str(), strerror(errno));
         return 1;
     }
+    mSockFd = socket_id;
 
-    if (listen(socket_id, MAX_CLIENT_NUM) < 0) {
+    if (listen(socket_id, LISTEN_BACKLOG) < 0) {
         SACE_LOGE("%s initialize socket client number fail %s", getName(), strerror(errno));
-        return 1;
+        goto err;
+    }
+
+    if (fcntl(socket_id, F_SETFL, fcntl(socket_id, F_GETFL) | O_NONBLOCK) < 0
+            || fcntl(socket_id, F_SETFD, FD_CLOEXEC) < 0) {
+        SACE_LOGE("%s set socket nonblock fail %s", getName(), strerror(errno));
+        goto err;
+    }
+
+    if ((mStopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        SACE_LOGE("%s eventfd fail %s", getName(), strerror(errno));
+        goto err;
+    }
+
+    /* io_uring where the build and the kernel have it, epoll otherwise */
+    if (setup_uring())
+        return 0;
+
+    if ((mEpollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        SACE_LOGE("%s epoll_create1 fail %s", getName(), strerror(errno));
+        goto err;
+    }
+
+    ev.events  = EPOLLIN | EPOLLET;
+    ev.data.fd = mSockFd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mSockFd, &ev) < 0) {
+        SACE_LOGE("%s epoll_ctl add socket fail %s", getName(), strerror(errno));
+        goto err;
+    }
+
+    ev.events  = EPOLLIN;
+    ev.data.fd = mStopFd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mStopFd, &ev) < 0) {
+        SACE_LOGE("%s epoll_ctl add eventfd fail %s", getName(), strerror(errno));
+        goto err;
     }
 
-    mSockFd = socket_id;
     return 0;
+err:
+    close_socket();
+    return 1;
 }
 
 bool SaceSocketReader::startRead () {
@@ -268,7 +924,7 @@ bool SaceSocketReader::startRead () {
         mThread = new MonitorThread(this);
 
     if (mThread == nullptr) {
-        close(mSockFd);
+        close_socket();
         SACE_LOGE("%s initialize MonitorThread failed", getName());
         return false;
     }
@@ -278,47 +934,107 @@ bool SaceSocketReader::startRead () {
 }
 
 void SaceSocketReader::stopRead () {
-    close(mSockFd);
+    uint64_t stop = 1;
 
     SACE_LOGI("%s Stoping... ", getName());
-    for (int i = 0; i < MAX_CLIENT_NUM; i++)
-        if (mClients[i].fd > 0) shutdown(mClients[i].fd, SHUT_WR);
-
     if (mThread != nullptr) {
-        if (mThread->isRunning())
+        if (mThread->isRunning()) {
             mThread->requestExit();
+            if (TEMP_FAILURE_RETRY(write(mStopFd, &stop, sizeof(stop))) < 0)
+                SACE_LOGE("%s wake MonitorThread fail %s", getName(), strerror(errno));
+            mThread->join();
+        }
     }
+
+    /* clients only touched by MonitorThread, safe after join */
+    for (auto &client : mClients)
+        shutdown(client.first, SHUT_WR);
+
+    if (mSockFd >= 0)
+        close(mSockFd);
+    mSockFd = -1;
 }
 
 // ------------------------------------------------------------------
 const char* SaceBinderReader::NAME = "SRBinder";
 
-SaceResult SaceBinderReader::SaceManagerService::sendCommand (SaceCommand command) {
+SaceResult SaceBinderReader::SaceManagerService::sendCommand (const SaceCommand &command) {
+    return sendCommand(SaceCommand(command));
+}
+
+SaceResult SaceBinderReader::SaceManagerService::sendCommand (SaceCommand &&command) {
+    pid_t pid = IPCThreadState::self()->getCallingPid();
+    sp<SaceBinderWriter> writer = new SaceBinderWriter(NAME, pid, mListeners->find(pid));
+
+    dispatch(std::move(command), writer);
+    return writer->waitResult();
+}
+
+status_t SaceBinderReader::SaceManagerService::sendCommandAsync (const SaceCommand &command, const sp<ISaceListener> &listener) {
+    return sendCommandAsync(SaceCommand(command), listener);
+}
+
+/* Oneway, so the driver reports no calling pid. The listener names the
+ * client instead, an unregistered one only gets told so.
+ */
+status_t SaceBinderReader::SaceManagerService::sendCommandAsync (SaceCommand &&command, const sp<ISaceListener> &listener) {
+    if (listener == nullptr) {
+        SACE_LOGE("%s async command without listener : sequence=%" PRIu64, NAME, command.sequence);
+        return BAD_VALUE;
+    }
+
+    pid_t pid = mListeners->owner(listener);
+    if (pid < 0) {
+        SACE_LOGE("%s async command from unregistered listener : sequence=%" PRIu64, NAME, command.sequence);
+        SaceResult rslt = resultByFailure();
+        rslt.sequence = command.sequence;
+        listener->onResult(rslt);
+        return NO_ERROR;
+    }
+
+    dispatch(std::move(command), new SaceBinderWriter(NAME, pid, listener, true));
+    return NO_ERROR;
+}
+
+/* same order as handle_socket_msg, every answer goes through writer */
+void SaceBinderReader::SaceManagerService::dispatch (SaceCommand &&command, const sp<SaceBinderWriter> &writer) {
     if (mExit) {
-        SACE_LOGI("%s handle command : %s Ignored For Exited", NAME, command.to_string().c_str());
-        return resultByFailure();
+        SACE_LOGI("%s handle command : sequence=%" PRIu64 " type=%d Ignored For Exited", NAME, command.sequence, command.type);
+        SaceResult rslt = resultByFailure();
+        rslt.sequence = command.sequence;
+        writer->sendResult(rslt);
+        return;
     }
     else
-        SACE_LOGI("%s handle command : %s", NAME, command.to_string().c_str());
+        SACE_LOGI("%s handle command : sequence=%" PRIu64 " type=%d", NAME, command.sequence, command.type);
 
     if (!secured_by_uid_pid(IPCThreadState::self()->getCallingUid(), IPCThreadState::self()->getCallingPid())) {
         SaceResult rslt = resultBySecure();
-        return rslt;
+        rslt.sequence = command.sequence;
+        writer->sendResult(rslt);
+        return;
     }
 
-    SaceResult *result = new SaceResult();
-    map<pid_t, ISaceListener*>::iterator it = mPidListener.find(IPCThreadState::self()->getCallingPid());
-    sp<SaceBinderWriter> writer = new SaceBinderWriter(NAME, IPCThreadState::self()->getCallingPid(), it->second, result);
-
     sp<SaceReaderMessage> saceMsg = new SaceReaderMessage;
     saceMsg->msgHandler = typeCmdToMsg(command.type);
-    saceMsg->msgCmd  = new SaceCommand(command);
+    saceMsg->msgCmd  = new SaceCommand(std::move(command));
     saceMsg->msgWriter = writer;
 
-    post(saceMsg);
-    writer->waitResult();
+    if (is_service_info(*saceMsg->msgCmd)) {
+        SaceResult rslt;
+        bool found = answer_service_info(saceMsg, rslt);
+        writer->sendResult(rslt);
+        if (found)
+            post(saceMsg);
+        return;
+    }
 
-    return *result;
+    if (is_status_page(*saceMsg->msgCmd)) {
+        writer->sendResult(answer_status_page(*saceMsg->msgCmd));
+        return;
+    }
+
+    post(saceMsg);
 }
 
 void SaceBinderReader::SaceManagerService::unregisterListener () {
@@ -330,9 +1046,7 @@ void SaceBinderReader::SaceManagerService::unregisterListener () {
     else
         SACE_LOGI("SaceManagerService %d:%d unregisterListener", IPCThreadState::self()->getCallingUid(), IPCThreadState::self()->getCallingPid());
 
-    map<pid_t, ISaceListener*>::iterator it = mPidListener.find(IPCThreadState::self()->getCallingPid());
-    if (it != mPidListener.end())
-        mPidListener.erase(it);
+    mListeners->remove(IPCThreadState::self()->getCallingPid());
 }
 
 void SaceBinderReader::SaceManagerService::registerListener (sp<ISaceListener> listener) {
@@ -345,7 +1059,7 @@ void SaceBinderReader::SaceManagerService::registerListener (sp<ISaceListener> l
         SACE_LOGI("SaceManagerService %d:%d registerListener", IPCThreadState::self()->getCallingUid(), IPCThreadState::self()->getCallingPid());
 
     if (listener != nullptr)
-        mPidListener.insert(pair<pid_t, ISaceListener*>(IPCThreadState::self()->getCallingPid(), listener.get()));
+        mListeners->add(IPCThreadState::self()->getCallingPid(), listener);
     else
         SACE_LOGW("SaceManagerService NULL FeedBack Pid:%d", IPCThreadState::self()->getCallingPid());
 }
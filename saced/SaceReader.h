@@ -17,17 +17,21 @@
 #ifndef _SACE_READER_H
 #define _SACE_READER_H
 
+#include <string.h>
+#include <sys/socket.h>
 #include <string>
 #include <utils/Thread.h>
 #include <map>
 
 #include "SaceMessage.h"
+#include "SaceWriter.h"
+#include "SaceFrame.h"
+#include "SaceCodec.h"
 #include "SaceCommandDispatcher.h"
+#include "SaceUring.h"
 #include <ISaceManager.h>
 #include <ISaceListener.h>
 
-#define MAX_CLIENT_NUM 5
-
 namespace android {
 
 /* monitor message from outer */
@@ -52,10 +56,21 @@ class SaceSocketReader : public SaceReader, public MessageDistributable {
     static const char *NAME;
     static const char *THREAD_NAME;
     static const char *WRITER_NAME;
-    static const int  MONITOR_TIMEOUT;
+    static const int  LISTEN_BACKLOG;
+    static const int  MAX_EPOLL_EVENTS;
+    static const size_t RECV_BUF_SIZE;
+    static const unsigned URING_ENTRIES;
+    static const unsigned URING_BUFFERS;
+    static const unsigned URING_BUFFER_SIZE;
 
     int mSockFd;
     int mSockType;
+    int mEpollFd;
+    int mStopFd;
+    /* io_uring only, a writer queued output for the fds in mBacklog */
+    int mBacklogFd;
+    mutex mBacklogMutex;
+    vector<int> mBacklog;
     Thread *mThread;
     string mSockName;
 
@@ -63,21 +78,22 @@ public:
     SaceSocketReader (const char *sock_name, const int sock_type):SaceReader(NAME) {
         mSockName = string(sock_name);
         mSockType = sock_type;
+        mThread   = nullptr;
 
-        for (int i = 0; i < MAX_CLIENT_NUM; i++) {
-            memset((void*)&mClients[i], 0x0, sizeof(ClientSocket));
-            mClients[i].fd = -1;
-        }
-
-        mSockFd = -1;
+        mSockFd  = -1;
+        mEpollFd = -1;
+        mStopFd  = -1;
+        mBacklogFd = -1;
+        mUring   = nullptr;
+        mArmGen  = 0;
+        mRecvBuf.resize(RECV_BUF_SIZE);
     }
 
     virtual bool startRead();
     virtual void stopRead();
 
-    ~SaceSocketReader() {
-        for (int i = 0; i < MAX_CLIENT_NUM; i++)
-            if (mClients[i].fd > 0) close(mClients[i].fd);
+    virtual ~SaceSocketReader() {
+        close_socket();
     }
 private:
     /* listen client message */
@@ -92,35 +108,119 @@ private:
         bool threadLoop();
     };
 
-    struct ClientSocket {
-        int fd;
+protected:
+    /* per connection counters, logged when it closes */
+    struct ClientStats {
+        uint64_t bytes;
+        uint64_t frames;
+        uint64_t requests;
+        uint64_t refused;
     };
 
-    struct ClientMsg {
-        int  fd;
-        pid_t pid;
-        uid_t uid;
-        sp<SaceCommand> command;
+    /* One accepted connection, everything its requests share.
+     * The peer cannot change, its credentials are read once at accept.
+     */
+    struct Client {
+        int fd;
+        struct ucred cred;
+        SaceFrameBuffer frames;
+        /* results and responses go out in this, set by SACE_TYPE_HELLO */
+        int codec;
+        /* shared with the writers of the requests */
+        sp<SaceInflightRequests> inflight;
+        /* what the socket did not take yet, drained on EPOLLOUT */
+        sp<SaceOutputQueue> output;
+        /* handed to every request, made again when the codec changes */
+        sp<SaceSocketWriter> writer;
+        ClientStats stats;
 
-        ClientMsg () {
-            command = new SaceCommand();
+        explicit Client (int fd, const struct ucred &cred, bool packet):fd(fd), cred(cred), codec(SACE_CODEC_PARCEL) {
+            inflight = new SaceInflightRequests();
+            output   = new SaceOutputQueue(fd, packet);
+            memset(&stats, 0, sizeof(stats));
         }
+    };
 
-        ClientMsg (const ClientMsg &msg) {
-            fd  = msg.fd;
-            pid = msg.pid;
-            uid = msg.uid;
-            command = msg.command;
-        }
+    /* connected clients, only touched by MonitorThread */
+    map<int, Client> mClients;
+    /* shared by all clients, whole frames are handled in place.
+     * SOCK_SEQPACKET reads one packet into it, big enough for any frame */
+    vector<uint8_t> mRecvBuf;
+
+    /* Transports on top of the socket hook in here, all on MonitorThread.
+     * A client refused by on_accept is closed without on_close, the
+     * writer is made after it and again when SACE_TYPE_HELLO changes the
+     * codec. prepare_wait returns the epoll_wait timeout, handle_event
+     * takes fds of its own added by watch_fd.
+     */
+    virtual bool on_accept (Client &) {
+        return true;
+    }
+    virtual void on_close (Client &) {}
+    virtual sp<SaceSocketWriter> make_writer (Client &client);
+    virtual int prepare_wait () {
+        return -1;
+    }
+    virtual bool handle_event (int, uint32_t) {
+        return false;
+    }
+
+    /* fds of a subclass, handle_event gets their events */
+    bool watch_fd(int fd, uint32_t events);
+    void unwatch_fd(int fd);
+    void close_client(int fd);
+    void handle_socket_frame(Client &client, const uint8_t *frame, size_t len);
+
+private:
+    /* what a fd has armed on mUring, completions of an older gen are stale */
+    enum UringOp {
+        URING_ACCEPT = 1,
+        URING_RECV,
+        URING_POLL,
+        /* room for queued output, only while the queue has any */
+        URING_POLLOUT,
     };
 
-    /* child thread */
-    ClientSocket mClients[MAX_CLIENT_NUM];
+    struct UringArmed {
+        uint32_t gen;
+        uint32_t events;
+        /* POLLOUT wanted, and a POLLOUT request still in the ring */
+        bool pollout;
+        bool polling;
+    };
+
+    /* nullptr when the kernel or the build has no io_uring, epoll then */
+    SaceUring *mUring;
+    map<int, UringArmed> mArmed;
+    uint32_t mArmGen;
 
     int setup_socket();
+    bool setup_uring();
     void close_socket();
-    void handle_socket_msg(ClientMsg &);
     bool recv_data_or_connection();
+    bool recv_uring_completions();
+    bool handle_ready(int fd, uint32_t events);
+
+    static uint64_t uring_tag(int fd, uint32_t gen, UringOp op);
+    bool arm(int fd, UringOp op, uint32_t events);
+    void disarm(int fd);
+    void handle_uring_recv(int fd, const SaceUring::Completion &cqe);
+    void handle_uring_pollout(int fd, const SaceUring::Completion &cqe);
+    void queue_backlog(int fd);
+    void watch_backlog();
+
+    void accept_clients();
+    void add_client(int client_fd);
+    bool consume_stream(Client &client, const uint8_t *buf, size_t len);
+    bool drain_frames(Client &client);
+    void recv_client_data(int fd);
+    void recv_client_packets(Client &client);
+    void flush_client(int fd);
+    void handle_socket_msg(Client &client, sp<SaceCommand> command);
+    void handle_compact_frame(Client &client, const uint8_t *frame, size_t len);
+    void handle_socket_hello(Client &client, const SaceCommand &hello);
+    void handle_socket_batch(Client &client, uint64_t sequence, const vector<sp<SaceCommand>> &commands);
+    bool admit_request(Client &client, uint64_t sequence, enum SaceCommandType type);
 };
 
 // --------------------------------------
@@ -149,14 +249,18 @@ private:
     /* SACE Binder Service */
     class SaceManagerService : public BnSaceManager, public MessageDistributable {
         bool mExit;
-        map<pid_t, ISaceListener*> mPidListener;
+        sp<SaceListenerRegistry> mListeners;
+
+        void dispatch (SaceCommand &&command, const sp<SaceBinderWriter> &writer);
     public:
-        ~SaceManagerService () {
-            for (map<pid_t, ISaceListener*>::iterator it = mPidListener.begin(); it != mPidListener.end(); it++)
-                delete it->second;
+        SaceManagerService ():mExit(false) {
+            mListeners = new SaceListenerRegistry();
         }
 
-        virtual SaceResult sendCommand (SaceCommand);
+        virtual SaceResult sendCommand (const SaceCommand &command);
+        virtual SaceResult sendCommand (SaceCommand &&command);
+        virtual status_t sendCommandAsync (const SaceCommand &command, const sp<ISaceListener> &listener);
+        virtual status_t sendCommandAsync (SaceCommand &&command, const sp<ISaceListener> &listener);
         virtual void registerListener (sp<ISaceListener> listener);
         virtual void unregisterListener ();
 
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+#include "SaceRingReader.h"
+#include "SaceLog.h"
+
+namespace android {
+
+SaceRingConnection::SaceRingConnection () {
+    mSubmitFd   = -1;
+    mCompleteFd = -1;
+    mDetached   = false;
+}
+
+SaceRingConnection::~SaceRingConnection () {
+    if (mSubmitFd >= 0)
+        close(mSubmitFd);
+    if (mCompleteFd >= 0)
+        close(mCompleteFd);
+}
+
+bool SaceRingConnection::create () {
+    if (!mRegion.create())
+        return false;
+
+    /* non blocking for both sides, the flag is shared with the client */
+    if ((mSubmitFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+            || (mCompleteFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        SACE_LOGE("SaceRingConnection eventfd errno=%d errstr=%s", errno, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool SaceRingConnection::complete (const void *data, size_t len) {
+    lock_guard<mutex> lock(mMutex);
+    SaceRing &ring = mRegion.completions();
+
+    if (mDetached || !ring.push(data, len))
+        return false;
+
+    if (ring.wakeup()) {
+        uint64_t value = 1;
+        if (write(mCompleteFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+            SACE_LOGE("SaceRingConnection wake client errno=%d errstr=%s", errno, strerror(errno));
+    }
+
+    return true;
+}
+
+void SaceRingConnection::detach () {
+    lock_guard<mutex> lock(mMutex);
+    mDetached = true;
+}
+
+// ----------------------------------------------------------
+const char* SaceRingReader::WRITER_NAME    = "SRRing.SaceWriter";
+const int   SaceRingReader::MAX_DRAIN_FRAMES = 64;
+
+bool SaceRingReader::on_accept (Client &client) {
+    sp<SaceRingConnection> ring = new SaceRingConnection();
+
+    if (!ring->create())
+        return false;
+
+    /* the client waits for this before its first command */
+    uint32_t magic = SaceRingRegion::MAGIC;
+    int fds[3] = { ring->regionFd(), ring->submitFd(), ring->completeFd() };
+    if (!client.output->send(&magic, sizeof(magic), fds, 3)) {
+        SACE_LOGE("%s - %d send ring fail", getName(), client.fd);
+        return false;
+    }
+
+    if (!watch_fd(ring->submitFd(), EPOLLIN)) {
+        SACE_LOGE("%s watch ring %d fail %s", getName(), client.fd, strerror(errno));
+        return false;
+    }
+
+    mRings[client.fd] = ring;
+    mDoorbells[ring->submitFd()] = client.fd;
+    return true;
+}
+
+void SaceRingReader::on_close (Client &client) {
+    auto it = mRings.find(client.fd);
+    if (it == mRings.end())
+        return;
+
+    /* writers still held by excutors fall back to the detached output */
+    sp<SaceRingConnection> ring = it->second;
+    unwatch_fd(ring->submitFd());
+    mDoorbells.erase(ring->submitFd());
+    ring->detach();
+    mRings.erase(it);
+}
+
+sp<SaceSocketWriter> SaceRingReader::make_writer (Client &client) {
+    auto it = mRings.find(client.fd);
+    if (it == mRings.end())
+        return SaceSocketReader::make_writer(client);
+
+    return new SaceRingWriter(WRITER_NAME, client.cred.pid, client.output, client.codec, client.inflight, it->second);
+}
+
+bool SaceRingReader::handle_event (int fd, uint32_t events __unused) {
+    if (mDoorbells.find(fd) == mDoorbells.end())
+        return false;
+
+    /* only a doorbell, prepare_wait takes what it rang for */
+    uint64_t value;
+    if (read(fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        SACE_LOGE("%s read doorbell %d fail %s", getName(), fd, strerror(errno));
+    return true;
+}
+
+bool SaceRingReader::drain_rings () {
+    vector<int> broken;
+    bool found = false;
+
+    for (auto &it : mRings) {
+        auto client = mClients.find(it.first);
+        SaceRing &ring = it.second->submissions();
+        const uint8_t *frame;
+        size_t len;
+
+        if (client == mClients.end())
+            continue;
+
+        for (int i = 0; i < MAX_DRAIN_FRAMES && ring.next(&frame, &len); i++) {
+            /* the client can still write there, decode our own copy */
+            if (len > mRecvBuf.size()) {
+                broken.push_back(it.first);
+                break;
+            }
+            memcpy(mRecvBuf.data(), frame, len);
+            ring.pop();
+            client->second.stats.bytes += len;
+            found = true;
+
+            if (SaceFrameBuffer::peek(mRecvBuf.data(), len) != (ssize_t)len) {
+                SACE_LOGE("%s - %d Invalide ring frame len %zu", getName(), it.first, len);
+                broken.push_back(it.first);
+                break;
+            }
+
+            handle_socket_frame(client->second, mRecvBuf.data(), len);
+        }
+
+        if (ring.broken()) {
+            SACE_LOGE("%s - %d submission ring broken", getName(), it.first);
+            broken.push_back(it.first);
+        }
+    }
+
+    for (int fd : broken)
+        close_client(fd);
+
+    return found;
+}
+
+int SaceRingReader::prepare_wait () {
+    /* nobody needs to ring while we look */
+    for (auto &it : mRings)
+        it.second->submissions().awake();
+
+    if (drain_rings()) {
+        /* busy, the next commands are likely a few microseconds away */
+        while (mSpin.spin([this] { return drain_rings(); }))
+            ;
+    }
+
+    /* entries that came in meanwhile are taken without blocking */
+    for (auto &it : mRings) {
+        if (!it.second->submissions().sleep())
+            return 0;
+    }
+
+    return -1;
+}
+
+}; // namespace android
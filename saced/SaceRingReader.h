@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_RING_READER_H_
+#define _SACE_RING_READER_H_
+
+#include <map>
+#include <mutex>
+
+#include <SaceRing.h>
+#include "SaceReader.h"
+#include "SaceWriter.h"
+
+using namespace std;
+
+namespace android {
+
+/* Rings of one client, shared by its writers on the excutor threads and
+ * the reader. Results go into the completion ring under mMutex, so the
+ * ring keeps its single producer.
+ */
+class SaceRingConnection : public RefBase {
+    SaceRingRegion mRegion;
+    /* the client rings us on mSubmitFd, we ring it on mCompleteFd */
+    int mSubmitFd;
+    int mCompleteFd;
+    bool mDetached;
+    mutex mMutex;
+
+public:
+    SaceRingConnection ();
+    virtual ~SaceRingConnection ();
+
+    bool create ();
+
+    /* excutors, false if the frame has to take the socket */
+    bool complete (const void *data, size_t len);
+    /* before the reader closes the client, later results take the socket */
+    void detach ();
+
+    /* reader only */
+    SaceRing& submissions () {
+        return mRegion.submissions();
+    }
+
+    int regionFd () const {
+        return mRegion.fd();
+    }
+
+    int submitFd () const {
+        return mSubmitFd;
+    }
+
+    int completeFd () const {
+        return mCompleteFd;
+    }
+};
+
+/* Completes into the ring, results with fds and what the ring has no
+ * room for go out on the socket. */
+class SaceRingWriter : public SaceSocketWriter {
+    sp<SaceRingConnection> mRing;
+protected:
+    virtual bool deliver (const void *data, size_t len, const int *fds, size_t nfds) {
+        if (nfds == 0 && mRing->complete(data, len))
+            return true;
+
+        return SaceSocketWriter::deliver(data, len, fds, nfds);
+    }
+public:
+    explicit SaceRingWriter (const char* name, pid_t pid, sp<SaceOutputQueue> output, int codec,
+            sp<SaceInflightRequests> inflight, sp<SaceRingConnection> ring)
+        :SaceSocketWriter(name, pid, output, codec, inflight) {
+        mRing = ring;
+    }
+    virtual ~SaceRingWriter() {}
+};
+
+/* Shared memory transport next to SaceSocketReader.
+ * Every client of the SOCK_SEQPACKET side channel gets its own rings,
+ * handed over in the first packet with the two eventfds. Commands come in
+ * on the submission ring, the socket still takes what did not fit. Before
+ * blocking the monitor thread polls the rings for a while, the adaptive
+ * spin keeps that short unless commands keep coming.
+ */
+class SaceRingReader : public SaceSocketReader {
+    static const char *WRITER_NAME;
+    /* per ring and round, one busy client cannot starve the others */
+    static const int  MAX_DRAIN_FRAMES;
+
+    /* by client fd */
+    map<int, sp<SaceRingConnection>> mRings;
+    /* submission eventfd to client fd */
+    map<int, int> mDoorbells;
+    SaceAdaptiveSpin mSpin;
+
+    bool drain_rings ();
+
+protected:
+    virtual bool on_accept (Client &client);
+    virtual void on_close (Client &client);
+    virtual sp<SaceSocketWriter> make_writer (Client &client);
+    virtual int prepare_wait ();
+    virtual bool handle_event (int fd, uint32_t events);
+
+public:
+    explicit SaceRingReader (const char *sock_name):SaceSocketReader(sock_name, SOCK_SEQPACKET) {}
+    virtual ~SaceRingReader () {}
+};
+
+}; // namespace android
+
+#endif
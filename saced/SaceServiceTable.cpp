@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+
+#include "SaceServiceTable.h"
+#include <SaceLog.h>
+
+namespace android {
+
+const char* SaceServiceTable::NAME = "SEServiceTable";
+shared_ptr<const SaceServiceTable::Snapshot> SaceServiceTable::sSnapshot = make_shared<const Snapshot>();
+SaceStatusPage SaceServiceTable::sStatusPage;
+
+void SaceServiceTable::Snapshot::add (Entry &&entry) {
+    byName[entry.info.name]   = entries.size();
+    byLabel[entry.info.label] = entries.size();
+    entries.push_back(std::move(entry));
+}
+
+void SaceServiceTable::publish (shared_ptr<const Snapshot> snapshot) {
+    atomic_store(&sSnapshot, snapshot);
+}
+
+void SaceServiceTable::publishStatus (const SaceServiceInfo::ServiceStatus &status) {
+    sStatusPage.write(status);
+}
+
+bool SaceServiceTable::initStatusPage () {
+    if (sStatusPage.mapped())
+        return true;
+
+    if (!sStatusPage.create()) {
+        SACE_LOGE("%s no status page, clients fall back to SACE_SERVICE_CMD_INFO", NAME);
+        return false;
+    }
+
+    return true;
+}
+
+int SaceServiceTable::statusPageFd () {
+    return sStatusPage.fd();
+}
+
+bool SaceServiceTable::query (const SaceCommand &cmd, SaceServiceInfo::ServiceInfo &info) {
+    shared_ptr<const Snapshot> snapshot = atomic_load(&sSnapshot);
+
+    if (cmd.command == SaceServiceInfo::SERVICE_GET_BY_LABEL) {
+        auto it = snapshot->byLabel.find(cmd.label);
+        if (it == snapshot->byLabel.end())
+            return false;
+
+        info = snapshot->entries[it->second].info;
+        return true;
+    }
+
+    if (cmd.command == SaceServiceInfo::SERVICE_GET_BY_NAME) {
+        auto it = snapshot->byName.find(cmd.name);
+        if (it == snapshot->byName.end())
+            return false;
+
+        /* event services answer to event queries only */
+        const Entry &entry = snapshot->entries[it->second];
+        if (entry.flags != cmd.serviceFlags) {
+            SACE_LOGE("%s Invalide Service[%s] Type [%s:%s]", NAME, cmd.name.c_str(),
+                SaceCommand::mapServiceFlagStr(cmd.serviceFlags).c_str(), SaceCommand::mapServiceFlagStr(entry.flags).c_str());
+            return false;
+        }
+
+        info = entry.info;
+        return true;
+    }
+
+    SACE_LOGE("%s Unknown Info Command %s", NAME, cmd.command.c_str());
+    return false;
+}
+
+}; // namespace android
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_SERVICE_TABLE_H_
+#define _SACE_SERVICE_TABLE_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <SaceTypes.h>
+#include <SaceStatusPage.h>
+#include <sace/SaceServiceInfo.h>
+
+using namespace std;
+
+namespace android {
+
+/* Read only copy of the service excutor state.
+ * SEService.MT builds a new snapshot after every change and swaps it in;
+ * readers take a reference to the current one and never see it change,
+ * the last reference frees it. SACE_SERVICE_CMD_INFO is answered from here
+ * on the reader threads instead of queueing behind forks. The status page
+ * gives clients the same states without asking at all.
+ */
+class SaceServiceTable {
+public:
+    struct Entry {
+        SaceServiceInfo::ServiceInfo info;
+        enum SaceServiceFlags flags;
+    };
+
+    struct Snapshot {
+        vector<Entry> entries;
+        unordered_map<string, size_t>   byName;
+        unordered_map<uint64_t, size_t> byLabel;
+
+        void add (Entry &&entry);
+    };
+
+    /* SEService.MT only */
+    static void publish (shared_ptr<const Snapshot> snapshot);
+    /* SEService.MT only, the record of one service in the status page */
+    static void publishStatus (const SaceServiceInfo::ServiceStatus &status);
+
+    /* before the readers start, false if clients get no status page */
+    static bool initStatusPage ();
+    /* for SACE_SERVICE_CMD_STATUS, -1 without a page */
+    static int statusPageFd ();
+
+    /* any thread, false if cmd names no published service */
+    static bool query (const SaceCommand &cmd, SaceServiceInfo::ServiceInfo &info);
+
+private:
+    static const char *NAME;
+    static shared_ptr<const Snapshot> sSnapshot;
+    static SaceStatusPage sStatusPage;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_SLOT_MAP_H_
+#define _SACE_SLOT_MAP_H_
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace android {
+
+/* Objects addressed by a 64 bit label handed to clients.
+ * A label is the generation of its slot in the high word and the slot
+ * index + 1 in the low word. Erasing bumps the generation, so a stale
+ * label never finds the object that reuses the slot, and 0 is never a
+ * label. Values live packed in one array for sweeps; erase moves the last
+ * value into the hole, so pointers and iteration order do not survive an
+ * insert or erase.
+ * Not synchronized, the owning excutor thread is the only user.
+ */
+template<typename T> class SaceSlotMap {
+public:
+    typedef uint64_t Label;
+
+    size_t size () const {
+        return mValues.size();
+    }
+
+    bool empty () const {
+        return mValues.empty();
+    }
+
+    Label insert (T &&value) {
+        uint32_t index;
+
+        if (mFreeHead != NONE) {
+            index = mFreeHead;
+            mFreeHead = mSlots[index].pos;
+        }
+        else {
+            index = mSlots.size();
+            mSlots.push_back(Slot());
+        }
+
+        mSlots[index].pos = mValues.size();
+        mValues.push_back(std::move(value));
+        mOwners.push_back(index);
+
+        return label_of(index);
+    }
+
+    Label insert (const T &value) {
+        return insert(T(value));
+    }
+
+    /* nullptr for a stale or unknown label */
+    T* get (Label label) {
+        uint32_t index;
+        if (!resolve(label, index))
+            return nullptr;
+
+        return &mValues[mSlots[index].pos];
+    }
+
+    bool erase (Label label) {
+        uint32_t index;
+        if (!resolve(label, index))
+            return false;
+
+        uint32_t pos  = mSlots[index].pos;
+        uint32_t last = mValues.size() - 1;
+        if (pos != last) {
+            mValues[pos] = std::move(mValues[last]);
+            mOwners[pos] = mOwners[last];
+            mSlots[mOwners[pos]].pos = pos;
+        }
+        mValues.pop_back();
+        mOwners.pop_back();
+
+        /* 0 would make label 0 valid again */
+        if (++mSlots[index].generation == 0)
+            mSlots[index].generation = 1;
+        mSlots[index].pos = mFreeHead;
+        mFreeHead = index;
+        return true;
+    }
+
+    /* values by position, 0 <= pos < size() */
+    T& at (size_t pos) {
+        return mValues[pos];
+    }
+
+    Label labelAt (size_t pos) const {
+        return label_of(mOwners[pos]);
+    }
+
+    typename vector<T>::iterator begin () {
+        return mValues.begin();
+    }
+
+    typename vector<T>::iterator end () {
+        return mValues.end();
+    }
+
+    void clear () {
+        while (!mValues.empty())
+            erase(labelAt(mValues.size() - 1));
+    }
+
+private:
+    static const uint32_t NONE = 0xffffffff;
+
+    struct Slot {
+        uint32_t generation;
+        /* position in mValues while used, next free slot otherwise */
+        uint32_t pos;
+
+        Slot ():generation(1),pos(NONE) {}
+    };
+
+    vector<Slot> mSlots;
+    vector<T> mValues;
+    /* slot of each value */
+    vector<uint32_t> mOwners;
+    uint32_t mFreeHead = NONE;
+
+    Label label_of (uint32_t index) const {
+        return (uint64_t)mSlots[index].generation << 32 | (index + 1);
+    }
+
+    bool resolve (Label label, uint32_t &index) const {
+        uint32_t low = static_cast<uint32_t>(label);
+        if (low == 0 || low > mSlots.size())
+            return false;
+
+        index = low - 1;
+        return mSlots[index].generation == static_cast<uint32_t>(label >> 32) && mSlots[index].pos != NONE
+            && mSlots[index].pos < mValues.size() && mOwners[mSlots[index].pos] == index;
+    }
+};
+
+}; // namespace android
+
+#endif
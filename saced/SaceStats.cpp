@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SaceStats.h"
+#include "SaceCommandDispatcher.h"
+#include "SaceMessage.h"
+#include "SaceWriter.h"
+#include <SaceLog.h>
+
+namespace android {
+
+const char* SaceStats::NAME = "SEStats";
+
+void SaceStats::dump_pool (const char *type, const SacePoolStats &stats) {
+    uint64_t total = stats.hits + stats.misses;
+
+    SACE_LOGI("%s pool %-24s pooled=%zu hits=%llu misses=%llu hit=%llu%%", NAME, type, stats.pooled,
+        (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+        total == 0 ? 0ull : (unsigned long long)(stats.hits * 100 / total));
+}
+
+void SaceStats::dump () {
+    SACE_LOGI("%s ---- dump {", NAME);
+    dump_pool("SaceCommand", SacePooled<SaceCommand>::stats());
+    dump_pool("SaceReaderMessage", SacePooled<SaceReaderMessage>::stats());
+    dump_pool("SaceSocketWriter", SacePooled<SaceSocketWriter>::stats());
+    dump_pool("MessageHandlerWrapper", SacePooled<MessageDistributable::MessageHandlerWrapper>::stats());
+
+    SaceOutputStats output = SaceOutputQueue::stats();
+    SACE_LOGI("%s output deferred=%llu overflows=%llu", NAME,
+        (unsigned long long)output.deferred, (unsigned long long)output.overflows);
+    SACE_LOGI("%s ---- dump }", NAME);
+}
+
+}; // namespace android
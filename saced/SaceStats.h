@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_STATS_H_
+#define _SACE_STATS_H_
+
+#include <SacePool.h>
+
+namespace android {
+
+/* Runtime statistics of the daemon.
+ * sace_main calls dump() on SIGUSR1, everything goes to the log:
+ *     kill -USR1 $(pidof saced) && logcat -s SACE
+ */
+class SaceStats {
+public:
+    static void dump ();
+
+private:
+    static const char *NAME;
+
+    static void dump_pool (const char *type, const SacePoolStats &stats);
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include <sys/prctl.h>
+
+#include "SaceSubscription.h"
+#include <SaceLog.h>
+
+namespace android {
+
+const char *SaceSubscriptions::NAME = "SESubscription";
+const char *SaceSubscriptions::THREAD_NAME = "SESubscribe.MT";
+
+bool SaceSubscriptions::Subscriber::matches (const SaceServiceInfo::StateEvent &event) const {
+    switch (filter) {
+        case FILTER_NAME:
+            return event.name == name;
+        case FILTER_LABEL:
+            return event.label == label;
+        default:
+            return true;
+    }
+}
+
+SaceSubscriptions::SaceSubscriptions () {
+    mOwner = make_shared<Owner>();
+    mOwner->subscriptions = this;
+    mExit = false;
+    mStarted = false;
+}
+
+SaceSubscriptions::~SaceSubscriptions () {
+    /* waits for a drain handler inside drained, later ones find nobody */
+    {
+        lock_guard<mutex> lock(mOwner->lock);
+        mOwner->subscriptions = nullptr;
+    }
+    stop();
+}
+
+bool SaceSubscriptions::start () {
+    if (pthread_create(&mThread, nullptr, send_thread_run, (void*)this) != 0) {
+        SACE_LOGE("%s pthread_create errno=%d errstr=%s", NAME, errno, strerror(errno));
+        return false;
+    }
+
+    mStarted = true;
+    return true;
+}
+
+void SaceSubscriptions::stop () {
+    if (!mStarted)
+        return;
+
+    {
+        lock_guard<mutex> lock(mMutex);
+        mExit = true;
+    }
+    mCond.notify_one();
+    pthread_join(mThread, nullptr);
+    mStarted = false;
+
+    lock_guard<mutex> lock(mMutex);
+    mSubscribers.clear();
+    mReady.clear();
+}
+
+bool SaceSubscriptions::add (sp<SaceWriter> writer, const SaceCommand &cmd, const vector<SaceServiceInfo::StateEvent> &current) {
+    shared_ptr<Subscriber> subscriber = make_shared<Subscriber>();
+    subscriber->id     = cmd.sequence;
+    subscriber->writer = writer;
+    subscriber->label  = cmd.label;
+    subscriber->name   = cmd.name;
+    subscriber->queued   = false;
+    subscriber->draining = false;
+    subscriber->removed  = false;
+
+    if (cmd.command == SaceServiceInfo::SERVICE_GET_BY_NAME)
+        subscriber->filter = FILTER_NAME;
+    else if (cmd.command == SaceServiceInfo::SERVICE_GET_BY_LABEL)
+        subscriber->filter = FILTER_LABEL;
+    else if (cmd.command == SaceServiceInfo::SERVICE_GET_ALL)
+        subscriber->filter = FILTER_ALL;
+    else {
+        SACE_LOGE("%s Unknown Subscribe Filter %s", NAME, cmd.command.c_str());
+        return false;
+    }
+
+    lock_guard<mutex> lock(mMutex);
+    for (auto &other : mSubscribers) {
+        if (other->id == subscriber->id && other->writer->connection() == writer->connection()) {
+            SACE_LOGE("%s subscription exists %" PRIu64, NAME, subscriber->id);
+            return false;
+        }
+    }
+
+    mSubscribers.push_back(subscriber);
+    for (auto &event : current) {
+        if (subscriber->matches(event))
+            push_locked(subscriber, event);
+    }
+
+    return true;
+}
+
+bool SaceSubscriptions::remove (sp<SaceWriter> writer, uint64_t subscription) {
+    lock_guard<mutex> lock(mMutex);
+    for (auto it = mSubscribers.begin(); it != mSubscribers.end(); it++) {
+        if ((*it)->id == subscription && (*it)->writer->connection() == writer->connection()) {
+            /* the send thread may hold it, it skips removed ones */
+            (*it)->removed = true;
+            (*it)->pending.clear();
+            mSubscribers.erase(it);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SaceSubscriptions::removeAll (sp<SaceWriter> writer) {
+    lock_guard<mutex> lock(mMutex);
+    for (auto it = mSubscribers.begin(); it != mSubscribers.end();) {
+        if ((*it)->writer->connection() == writer->connection()) {
+            (*it)->removed = true;
+            (*it)->pending.clear();
+            it = mSubscribers.erase(it);
+        }
+        else
+            it++;
+    }
+}
+
+size_t SaceSubscriptions::size () {
+    lock_guard<mutex> lock(mMutex);
+    return mSubscribers.size();
+}
+
+void SaceSubscriptions::publish (const SaceServiceInfo::StateEvent &event) {
+    lock_guard<mutex> lock(mMutex);
+    for (auto &subscriber : mSubscribers) {
+        if (subscriber->matches(event))
+            push_locked(subscriber, event);
+    }
+}
+
+void SaceSubscriptions::push_locked (shared_ptr<Subscriber> subscriber, const SaceServiceInfo::StateEvent &event) {
+    SaceServiceInfo::StateEvent *slot = nullptr;
+
+    for (auto &pending : subscriber->pending) {
+        if (pending.label == event.label) {
+            slot = &pending;
+            break;
+        }
+    }
+
+    if (slot != nullptr) {
+        uint32_t coalesced = slot->coalesced + 1;
+        *slot = event;
+        slot->coalesced = coalesced;
+    }
+    else {
+        subscriber->pending.push_back(event);
+        slot = &subscriber->pending.back();
+    }
+    slot->subscription = subscriber->id;
+    queue_locked(subscriber);
+}
+
+/* a draining subscriber keeps coalescing until drained queues it */
+void SaceSubscriptions::queue_locked (shared_ptr<Subscriber> subscriber) {
+    if (subscriber->queued || subscriber->draining || subscriber->removed || subscriber->pending.empty())
+        return;
+
+    subscriber->queued = true;
+    mReady.push_back(subscriber);
+    mCond.notify_one();
+}
+
+/* from the reader flushing the connection of subscriber */
+void SaceSubscriptions::drained (shared_ptr<Subscriber> subscriber) {
+    lock_guard<mutex> lock(mMutex);
+    if (mExit)
+        return;
+
+    subscriber->draining = false;
+    queue_locked(subscriber);
+}
+
+void SaceSubscriptions::send (Subscriber &subscriber, vector<SaceServiceInfo::StateEvent> &events) {
+    SaceStatusResponse response;
+    response.type   = SACE_RESPONSE_TYPE_STATE;
+    response.status = SACE_RESPONSE_STATUS_CHANGED;
+
+    for (auto &event : events) {
+        response.label = event.label;
+        response.name  = event.name;
+        event.writeTo(response.extra);
+        subscriber.writer->sendResponse(response);
+    }
+}
+
+void* SaceSubscriptions::send_thread_run (void *data) {
+    SaceSubscriptions *self = (SaceSubscriptions*)data;
+    vector<SaceServiceInfo::StateEvent> events;
+
+    prctl(PR_SET_NAME, THREAD_NAME);
+    SACE_LOGI("%s Starting %d:%d", NAME, getpid(), gettid());
+
+    unique_lock<mutex> lock(self->mMutex);
+    while (true) {
+        self->mCond.wait(lock, [self] { return self->mExit || !self->mReady.empty(); });
+        if (self->mExit)
+            break;
+
+        shared_ptr<Subscriber> subscriber = self->mReady.front();
+        self->mReady.pop_front();
+        subscriber->queued = false;
+        if (subscriber->removed)
+            continue;
+
+        /* events stay pending and coalesce while the client has not taken
+         * what it got so far, drained queues the subscriber again */
+        subscriber->draining = true;
+        lock.unlock();
+        /* the queue may outlive the subscription and us */
+        weak_ptr<Subscriber> weak = subscriber;
+        shared_ptr<Owner> owner = self->mOwner;
+        bool backlogged = subscriber->writer->whenDrained([owner, weak] {
+            lock_guard<mutex> guard(owner->lock);
+            shared_ptr<Subscriber> drained = weak.lock();
+            if (owner->subscriptions != nullptr && drained != nullptr)
+                owner->subscriptions->drained(drained);
+        });
+        lock.lock();
+        if (backlogged || subscriber->removed)
+            continue;
+        subscriber->draining = false;
+
+        /* whatever comes in while we send waits coalesced for the next round */
+        events.clear();
+        events.swap(subscriber->pending);
+
+        lock.unlock();
+        self->send(*subscriber, events);
+        lock.lock();
+    }
+
+    return nullptr;
+}
+
+}; // namespace android
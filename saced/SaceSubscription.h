@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_SUBSCRIPTION_H_
+#define _SACE_SUBSCRIPTION_H_
+
+#include <pthread.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <SaceTypes.h>
+#include <sace/SaceServiceInfo.h>
+#include "SaceWriter.h"
+
+using namespace std;
+
+namespace android {
+
+/* Service state subscriptions of SEService.MT.
+ * The excutor publishes every transition, a thread of our own sends them,
+ * so a slow client never holds up the excutor. Transitions a subscriber
+ * has not been sent yet are kept one per service: a newer one replaces the
+ * older and counts it in coalesced, a subscriber that is behind gets the
+ * latest state of each service instead of an ever growing backlog.
+ * A subscriber is behind while its connection still has output queued, it
+ * is sent again once the reader drained that.
+ * A subscription is its SUBSCRIBE sequence on the connection of its writer.
+ */
+class SaceSubscriptions {
+public:
+    SaceSubscriptions ();
+    ~SaceSubscriptions ();
+
+    bool start ();
+    void stop ();
+
+    /* filter from SACE_SERVICE_CMD_SUBSCRIBE, current are the states to start with */
+    bool add (sp<SaceWriter> writer, const SaceCommand &cmd, const vector<SaceServiceInfo::StateEvent> &current);
+    bool remove (sp<SaceWriter> writer, uint64_t subscription);
+    /* every subscription of the connection of writer */
+    void removeAll (sp<SaceWriter> writer);
+
+    void publish (const SaceServiceInfo::StateEvent &event);
+
+    size_t size ();
+
+private:
+    static const char *NAME;
+    static const char *THREAD_NAME;
+
+    enum Filter {
+        FILTER_NAME,
+        FILTER_LABEL,
+        FILTER_ALL,
+    };
+
+    struct Subscriber {
+        uint64_t id;
+        enum Filter filter;
+        string name;
+        uint64_t label;
+        sp<SaceWriter> writer;
+        /* not sent yet, one per service */
+        vector<SaceServiceInfo::StateEvent> pending;
+        bool queued;
+        /* waits for the output queue of writer to drain */
+        bool draining;
+        bool removed;
+
+        bool matches (const SaceServiceInfo::StateEvent &event) const;
+    };
+
+    /* what drain handlers reach us through, output queues may outlive us */
+    struct Owner {
+        mutex lock;
+        SaceSubscriptions *subscriptions;
+    };
+
+    shared_ptr<Owner> mOwner;
+    mutex mMutex;
+    condition_variable mCond;
+    vector<shared_ptr<Subscriber>> mSubscribers;
+    /* subscribers with pending events, in the order they got them */
+    deque<shared_ptr<Subscriber>> mReady;
+    bool mExit;
+    bool mStarted;
+    pthread_t mThread;
+
+    void push_locked (shared_ptr<Subscriber> subscriber, const SaceServiceInfo::StateEvent &event);
+    void queue_locked (shared_ptr<Subscriber> subscriber);
+    void drained (shared_ptr<Subscriber> subscriber);
+    void send (Subscriber &subscriber, vector<SaceServiceInfo::StateEvent> &events);
+    static void* send_thread_run (void *data);
+};
+
+}; // namespace android
+
+#endif
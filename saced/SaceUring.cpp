@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "SaceUring.h"
+#include "SaceLog.h"
+
+#ifdef SACE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace android {
+
+const char *SaceUring::NAME = "SaceUring";
+const uint64_t SaceUring::CANCEL_DATA = ~0ull;
+
+SaceUring::SaceUring () {
+    mFd = -1;
+    mRing = mSqes = mCqes = mBufRing = nullptr;
+    mRingSize = mSqesSize = mBufRingSize = 0;
+    mSqHead = mSqTail = mCqHead = mCqTail = nullptr;
+    mSqMask = mSqEntries = mSqLocalTail = mQueued = 0;
+    mCqMask = mBufMask = 0;
+    mBufTail = 0;
+    mBufferSize = 0;
+    mEnters = 0;
+}
+
+SaceUring::~SaceUring () {
+    release();
+}
+
+#ifdef SACE_IO_URING
+/* bionic has no wrappers, neither has glibc */
+static int uring_setup (unsigned entries, struct io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_register (int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+bool SaceUring::available () {
+    static int sAvailable = -1;
+    /* SEND_ZC came with multishot recv in 6.0, there is no probe for flags */
+    static const uint8_t REQUIRED_OPS[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL, IORING_OP_SEND_ZC,
+    };
+
+    if (sAvailable >= 0)
+        return sAvailable;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    sAvailable = 0;
+
+    /* seccomp or selinux may refuse it as well as an old kernel */
+    int fd = uring_setup(4, &params);
+    if (fd < 0) {
+        SACE_LOGI("%s io_uring_setup errno=%d errstr=%s, using epoll", NAME, errno, strerror(errno));
+        return false;
+    }
+
+    const uint32_t features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    size_t probe_len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    vector<uint8_t> buf(probe_len, 0);
+    struct io_uring_probe *probe = (struct io_uring_probe*)buf.data();
+
+    if ((params.features & features) == features && uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        sAvailable = 1;
+        for (uint8_t op : REQUIRED_OPS) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+                sAvailable = 0;
+        }
+    }
+    close(fd);
+
+    SACE_LOGI("%s %s", NAME, sAvailable ? "available" : "lacks features, using epoll");
+    return sAvailable;
+}
+
+bool SaceUring::init (unsigned entries, unsigned buffers, unsigned bufferSize) {
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+
+    memset(&params, 0, sizeof(params));
+    /* every multishot request keeps posting, leave room for them */
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * 4;
+
+    release();
+    if ((mFd = uring_setup(entries, &params)) < 0) {
+        SACE_LOGE("%s io_uring_setup errno=%d errstr=%s", NAME, errno, strerror(errno));
+        return false;
+    }
+
+    mRingSize = max(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+    mRing = mmap(nullptr, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+    if (mRing == MAP_FAILED) {
+        mRing = nullptr;
+        SACE_LOGE("%s mmap ring errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err;
+    }
+
+    mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    mSqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES);
+    if (mSqes == MAP_FAILED) {
+        mSqes = nullptr;
+        SACE_LOGE("%s mmap sqes errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err;
+    }
+
+    mSqHead    = (uint32_t*)((uint8_t*)mRing + params.sq_off.head);
+    mSqTail    = (uint32_t*)((uint8_t*)mRing + params.sq_off.tail);
+    mSqMask    = *(uint32_t*)((uint8_t*)mRing + params.sq_off.ring_mask);
+    mSqEntries = params.sq_entries;
+    mSqLocalTail = *mSqTail;
+    mCqHead = (uint32_t*)((uint8_t*)mRing + params.cq_off.head);
+    mCqTail = (uint32_t*)((uint8_t*)mRing + params.cq_off.tail);
+    mCqMask = *(uint32_t*)((uint8_t*)mRing + params.cq_off.ring_mask);
+    mCqes   = (uint8_t*)mRing + params.cq_off.cqes;
+
+    /* sqes are used in ring order, the index array never changes */
+    for (uint32_t i = 0; i < mSqEntries; i++)
+        ((uint32_t*)((uint8_t*)mRing + params.sq_off.array))[i] = i;
+
+    /* buffers must be a power of two, the kernel picks them for recv */
+    mBufRingSize = (buffers * sizeof(struct io_uring_buf) + 4095) & ~(size_t)4095;
+    mBufRing = mmap(nullptr, mBufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mBufRing == MAP_FAILED) {
+        mBufRing = nullptr;
+        SACE_LOGE("%s mmap buffers errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)mBufRing;
+    reg.ring_entries = buffers;
+    reg.bgid         = 0;
+    if (uring_register(mFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        SACE_LOGE("%s register buffers errno=%d errstr=%s", NAME, errno, strerror(errno));
+        goto err;
+    }
+
+    mBuffers.assign((size_t)buffers * bufferSize, 0);
+    mBufferSize = bufferSize;
+    mBufMask = buffers - 1;
+    mBufTail = 0;
+    for (unsigned i = 0; i < buffers; i++)
+        provide(i);
+    return true;
+
+err:
+    release();
+    return false;
+}
+
+void SaceUring::release () {
+    /* closing the ring cancels everything still armed */
+    if (mFd >= 0)
+        close(mFd);
+    if (mRing != nullptr)
+        munmap(mRing, mRingSize);
+    if (mSqes != nullptr)
+        munmap(mSqes, mSqesSize);
+    if (mBufRing != nullptr)
+        munmap(mBufRing, mBufRingSize);
+
+    mFd = -1;
+    mRing = mSqes = mCqes = mBufRing = nullptr;
+    mQueued = 0;
+    vector<uint8_t>().swap(mBuffers);
+}
+
+struct io_uring_sqe* SaceUring::get_sqe () {
+    /* full, hand what is there to the kernel first */
+    if (mSqLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) >= mSqEntries && enter(mQueued, 0, 0) < 0)
+        return nullptr;
+    if (mSqLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) >= mSqEntries)
+        return nullptr;
+
+    struct io_uring_sqe *sqe = (struct io_uring_sqe*)mSqes + (mSqLocalTail & mSqMask);
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/* sqe filled in, visible to the next enter */
+#define SQE_QUEUE() do { \
+    mSqLocalTail++; \
+    mQueued++; \
+    __atomic_store_n(mSqTail, mSqLocalTail, __ATOMIC_RELEASE); \
+} while (0)
+
+bool SaceUring::accept (int fd, uint64_t data) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd     = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = data;
+    SQE_QUEUE();
+    return true;
+}
+
+bool SaceUring::recv (int fd, uint64_t data) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd     = fd;
+    sqe->flags  = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = data;
+    SQE_QUEUE();
+    return true;
+}
+
+bool SaceUring::poll (int fd, uint32_t events, uint64_t data) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd     = fd;
+    sqe->poll32_events = events;
+    sqe->len    = IORING_POLL_ADD_MULTI;
+    sqe->user_data = data;
+    SQE_QUEUE();
+    return true;
+}
+
+bool SaceUring::cancel (uint64_t data) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd     = -1;
+    sqe->addr   = data;
+    sqe->user_data = CANCEL_DATA;
+    SQE_QUEUE();
+    return true;
+}
+
+int SaceUring::enter (unsigned submit, unsigned wait, int timeout) {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+    memset(&arg, 0, sizeof(arg));
+    if (wait > 0 && timeout >= 0) {
+        ts.tv_sec  = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    mEnters++;
+    int ret = syscall(__NR_io_uring_enter, mFd, submit, wait, flags,
+        (flags & IORING_ENTER_EXT_ARG) ? (void*)&arg : nullptr, sizeof(arg));
+    if (ret < 0)
+        return -errno;
+
+    mQueued -= min((unsigned)ret, mQueued);
+    return ret;
+}
+
+int SaceUring::wait (int timeout) {
+    /* what is already there is taken without waiting */
+    bool ready = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE) != *mCqHead;
+    if (timeout == 0 || ready) {
+        if (mQueued == 0)
+            return 0;
+        timeout = 0;
+    }
+
+    int ret = enter(mQueued, timeout == 0 ? 0 : 1, timeout);
+    /* timed out, interrupted or the completion queue overflowed,
+     * the caller takes what is there */
+    if (ret == -ETIME || ret == -EINTR || ret == -EBUSY || ret == -EAGAIN)
+        return 0;
+
+    return ret < 0 ? ret : 0;
+}
+
+bool SaceUring::next (Completion &cqe) {
+    uint32_t head = *mCqHead;
+    if (head == __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    struct io_uring_cqe *entry = (struct io_uring_cqe*)mCqes + (head & mCqMask);
+    cqe.data  = entry->user_data;
+    cqe.res   = entry->res;
+    cqe.flags = entry->flags;
+    __atomic_store_n(mCqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool SaceUring::more (const Completion &cqe) {
+    return cqe.flags & IORING_CQE_F_MORE;
+}
+
+const uint8_t* SaceUring::buffer (const Completion &cqe) const {
+    if (!(cqe.flags & IORING_CQE_F_BUFFER))
+        return nullptr;
+
+    return mBuffers.data() + (size_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT) * mBufferSize;
+}
+
+void SaceUring::recycle (const Completion &cqe) {
+    if (cqe.flags & IORING_CQE_F_BUFFER)
+        provide(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+}
+
+void SaceUring::provide (uint16_t bid) {
+    struct io_uring_buf_ring *ring = (struct io_uring_buf_ring*)mBufRing;
+    /* not ring->bufs, the flex array gets an empty struct ahead of it in C++ */
+    struct io_uring_buf *buf = (struct io_uring_buf*)mBufRing + (mBufTail & mBufMask);
+
+    buf->addr = (uint64_t)(uintptr_t)(mBuffers.data() + (size_t)bid * mBufferSize);
+    buf->len  = mBufferSize;
+    buf->bid  = bid;
+    mBufTail++;
+    __atomic_store_n(&ring->tail, mBufTail, __ATOMIC_RELEASE);
+}
+
+#else
+bool SaceUring::available () {
+    return false;
+}
+
+bool SaceUring::init (unsigned, unsigned, unsigned) {
+    return false;
+}
+
+void SaceUring::release () {}
+
+bool SaceUring::accept (int, uint64_t) {
+    return false;
+}
+
+bool SaceUring::recv (int, uint64_t) {
+    return false;
+}
+
+bool SaceUring::poll (int, uint32_t, uint64_t) {
+    return false;
+}
+
+bool SaceUring::cancel (uint64_t) {
+    return false;
+}
+
+int SaceUring::wait (int) {
+    return -ENOSYS;
+}
+
+bool SaceUring::next (Completion &) {
+    return false;
+}
+
+bool SaceUring::more (const Completion &) {
+    return false;
+}
+
+const uint8_t* SaceUring::buffer (const Completion &) const {
+    return nullptr;
+}
+
+void SaceUring::recycle (const Completion &) {}
+#endif
+
+}; // namespace android
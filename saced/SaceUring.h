@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SACE_URING_H_
+#define _SACE_URING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+struct io_uring_sqe;
+
+namespace android {
+
+/* io_uring engine of the socket readers.
+ * Only what the readers need: multishot accept, poll and recv, the recv
+ * data in buffers of our own provided to the kernel, and cancel by tag.
+ * Everything queued goes in with the wait of the next loop, so one loop
+ * costs one io_uring_enter however many clients it serves. Built with
+ * SACE_IO_URING only; available() also probes the running kernel, which
+ * needs 6.0 for multishot recv, and falls back to epoll otherwise.
+ */
+class SaceUring {
+public:
+    struct Completion {
+        uint64_t data;
+        int32_t  res;
+        uint32_t flags;
+    };
+
+    /* tag of cancel completions, never one of ours */
+    static const uint64_t CANCEL_DATA;
+
+    static bool available ();
+
+    SaceUring ();
+    ~SaceUring ();
+
+    /* entries of the submission queue, buffers of bufferSize for recv */
+    bool init (unsigned entries, unsigned buffers, unsigned bufferSize);
+
+    bool accept (int fd, uint64_t data);
+    bool recv (int fd, uint64_t data);
+    bool poll (int fd, uint32_t events, uint64_t data);
+    bool cancel (uint64_t data);
+
+    /* submits what is queued, then waits up to timeout ms (-1 forever,
+     * 0 not at all) for a completion; -errno on failure */
+    int wait (int timeout);
+    bool next (Completion &cqe);
+
+    /* the multishot request goes on producing completions */
+    static bool more (const Completion &cqe);
+    /* data of a recv completion, hand it back with recycle once consumed */
+    const uint8_t* buffer (const Completion &cqe) const;
+    void recycle (const Completion &cqe);
+
+    /* io_uring_enter calls so far */
+    uint64_t enters () const {
+        return mEnters;
+    }
+
+private:
+    static const char *NAME;
+
+    int mFd;
+    void *mRing;
+    size_t mRingSize;
+    void *mSqes;
+    size_t mSqesSize;
+
+    /* submission queue */
+    uint32_t *mSqHead;
+    uint32_t *mSqTail;
+    uint32_t mSqMask;
+    uint32_t mSqEntries;
+    uint32_t mSqLocalTail;
+    uint32_t mQueued;
+
+    /* completion queue */
+    uint32_t *mCqHead;
+    uint32_t *mCqTail;
+    uint32_t mCqMask;
+    void *mCqes;
+
+    /* provided buffers, group 0 */
+    void *mBufRing;
+    size_t mBufRingSize;
+    uint32_t mBufMask;
+    uint16_t mBufTail;
+    vector<uint8_t> mBuffers;
+    unsigned mBufferSize;
+
+    uint64_t mEnters;
+
+    struct io_uring_sqe* get_sqe ();
+    int enter (unsigned submit, unsigned wait, int timeout);
+    void provide (uint16_t bid);
+    void release ();
+};
+
+}; // namespace android
+
+#endif
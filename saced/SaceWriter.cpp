@@ -15,77 +15,523 @@
  */
 
 
+#include <fcntl.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <cutils/sockets.h>
 #include "SaceWriter.h"
 
 namespace android {
 
-void SaceSocketWriter::sendResult (const SaceResult &result) {
-    struct iovec  iov[1];
-    struct msghdr msg;
-    struct cmsghdr *pcmsg;
-
-    union {
-        struct cmsghdr cm;
-        char control[CMSG_SPACE(sizeof(int))];
-    } control_un;
-
-    Parcel parcel;
-    result.writeToParcel(&parcel);
-
-    iov[0].iov_base = (void*)parcel.data();
-    iov[0].iov_len  = parcel.dataSize();
+/* room for the fds of one frame, the most a batch result carries */
+union SendControl {
+    struct cmsghdr cm;
+    char control[CMSG_SPACE(sizeof(int) * SACE_BATCH_MAX_ITEMS)];
+};
 
+/* msg carries iov and fds in one SCM_RIGHTS, control is the storage */
+static void fill_msg (struct msghdr &msg, struct iovec *iov, size_t iovlen, const int *fds, size_t nfds, SendControl &control) {
     msg.msg_name    = nullptr;
     msg.msg_namelen = 0;
     msg.msg_iov    = iov;
-    msg.msg_iovlen = 1;
+    msg.msg_iovlen = iovlen;
     msg.msg_control    = nullptr;
     msg.msg_controllen = 0;
+    msg.msg_flags      = 0;
 
-    if (result.resultType == SACE_RESULT_TYPE_FD) {
-        msg.msg_control    = control_un.control;
-        msg.msg_controllen = sizeof(control_un.control);
+    if (nfds > 0) {
+        msg.msg_control    = control.control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
 
-        pcmsg = CMSG_FIRSTHDR(&msg);
-        pcmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg);
+        pcmsg->cmsg_len   = CMSG_LEN(sizeof(int) * nfds);
         pcmsg->cmsg_level = SOL_SOCKET;
         pcmsg->cmsg_type  = SCM_RIGHTS;
-        *((int*)CMSG_DATA(pcmsg)) = result.resultFd;
+        memcpy(CMSG_DATA(pcmsg), fds, sizeof(int) * nfds);
+    }
+}
+
+/* one sendmsg, never waits for room */
+static ssize_t send_iov (int fd, struct iovec *iov, size_t iovlen, const int *fds, size_t nfds) {
+    struct msghdr msg;
+    SendControl control;
+
+    fill_msg(msg, iov, iovlen, fds, nfds, control);
+    /* a client gone away must not take us down with SIGPIPE */
+    return TEMP_FAILURE_RETRY(sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT));
+}
+
+/* Reply buffers of the calling excutor thread, reused for every frame it
+ * sends. Resetting the size keeps the capacity of both.
+ */
+static thread_local Parcel reply_parcel;
+static thread_local string reply_compact;
+
+/* encode msg in codec, iov points into parcel or compact */
+template<typename T> static void encode_frame (const T &msg, int codec, Parcel &parcel, string &compact, struct iovec &iov) {
+    if (codec == SACE_CODEC_COMPACT) {
+        SaceCodec::encode(msg, compact);
+        iov.iov_base = (void*)compact.data();
+        iov.iov_len  = compact.size();
+        return;
+    }
+
+    parcel.setDataSize(0);
+    parcel.setDataPosition(0);
+    msg.writeToParcel(&parcel);
+    iov.iov_base = (void*)parcel.data();
+    iov.iov_len  = parcel.dataSize();
+}
+
+// ----------------------------------------------------------
+const char *SaceOutputQueue::NAME = "SWOutput";
+const size_t SaceOutputQueue::MAX_QUEUED_BYTES = 1024 * 1024;
+const int    SaceOutputQueue::MAX_FLUSH_IOV    = 64;
+
+atomic<uint64_t> SaceOutputQueue::sDeferred(0);
+atomic<uint64_t> SaceOutputQueue::sOverflows(0);
+
+SaceOutputQueue::SaceOutputQueue (int fd, bool packet) {
+    mFd = fd;
+    mPacket = packet;
+    mBytes = 0;
+    mOverflowed = false;
+}
+
+SaceOutputQueue::~SaceOutputQueue () {
+    lock_guard<mutex> lock(mMutex);
+    drop_locked();
+}
+
+bool SaceOutputQueue::send (const void *data, size_t len, const int *fds, size_t nfds) {
+    size_t sent = 0;
+
+    if (nfds > SACE_BATCH_MAX_ITEMS) {
+        SACE_LOGE("%s - %d frame with %zu fds dropped", NAME, mFd, nfds);
+        return false;
+    }
+
+    lock_guard<mutex> lock(mMutex);
+    if (mFd < 0 || mOverflowed)
+        return false;
+
+    /* nothing ahead of it, the socket takes it directly most of the time */
+    if (mFrames.empty()) {
+        struct iovec iov = { (void*)data, len };
+        ssize_t ret = send_iov(mFd, &iov, 1, fds, nfds);
+        if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            /* the reader sees the hangup and closes the connection */
+            SACE_LOGE("%s - %d send errno=%d errstr=%s", NAME, mFd, errno, strerror(errno));
+            return false;
+        }
+
+        if (ret > 0)
+            sent = ret;
+        if (sent == len)
+            return true;
+    }
+
+    if (mBytes + len - sent > MAX_QUEUED_BYTES) {
+        SACE_LOGE("%s - %d client not reading, %zu bytes queued, disconnect", NAME, mFd, mBytes);
+        sOverflows++;
+        mOverflowed = true;
+        drop_locked();
+        shutdown(mFd, SHUT_RDWR);
+        return false;
+    }
+
+    Frame frame;
+    frame.data.assign((const char*)data + sent, len - sent);
+    frame.offset = 0;
+
+    /* fds went with the first byte if any was sent, else the caller may
+     * close them before the frame is out, keep our own */
+    for (size_t i = 0; sent == 0 && i < nfds; i++) {
+        int fd = fcntl(fds[i], F_DUPFD_CLOEXEC, 0);
+        if (fd < 0) {
+            SACE_LOGE("%s - %d dup fd errno=%d errstr=%s", NAME, mFd, errno, strerror(errno));
+            for (int dup : frame.fds)
+                close(dup);
+            return false;
+        }
+        frame.fds.push_back(fd);
+    }
+
+    bool backlog = mFrames.empty();
+    mBytes += frame.data.size();
+    mFrames.push_back(std::move(frame));
+    sDeferred++;
+
+    /* under the lock, so none runs once detach returned */
+    if (backlog && mOnBacklog)
+        mOnBacklog();
+    return true;
+}
+
+bool SaceOutputQueue::flush () {
+    vector<DrainHandler> drained;
+    bool ret;
+    {
+        lock_guard<mutex> lock(mMutex);
+        if (mFd < 0 || mOverflowed)
+            return true;
+
+        ret = mPacket ? flush_packets_locked() : flush_locked();
+        if (ret && mFrames.empty())
+            drained.swap(mDrained);
+    }
+
+    /* outside the lock, handlers may send again */
+    for (auto &handler : drained)
+        handler();
+    return ret;
+}
+
+/* one message per frame; fds of one frame per sendmmsg, the next frame
+ * with fds starts the next call */
+bool SaceOutputQueue::flush_packets_locked () {
+    struct mmsghdr msgs[MAX_FLUSH_IOV];
+    struct iovec iov[MAX_FLUSH_IOV];
+    SendControl control;
+
+    while (!mFrames.empty()) {
+        size_t count = 0;
+        bool attached = false;
+
+        for (auto &frame : mFrames) {
+            if (count == (size_t)MAX_FLUSH_IOV || (attached && !frame.fds.empty()))
+                break;
+
+            iov[count].iov_base = (void*)frame.data.data();
+            iov[count].iov_len  = frame.data.size();
+            fill_msg(msgs[count].msg_hdr, &iov[count], 1, frame.fds.data(), frame.fds.size(), control);
+            msgs[count].msg_len = 0;
+            attached |= !frame.fds.empty();
+            count++;
+        }
+
+        int ret = TEMP_FAILURE_RETRY(sendmmsg(mFd, msgs, count, MSG_NOSIGNAL | MSG_DONTWAIT));
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+
+            SACE_LOGE("%s - %d flush errno=%d errstr=%s", NAME, mFd, errno, strerror(errno));
+            return false;
+        }
+
+        /* a packet goes whole or not at all */
+        for (int i = 0; i < ret; i++) {
+            Frame &frame = mFrames.front();
+            for (int fd : frame.fds)
+                close(fd);
+
+            mBytes -= frame.data.size();
+            mFrames.pop_front();
+        }
+    }
+
+    return true;
+}
+
+/* as many frames per sendmsg as fit, their fds all travel with the first
+ * byte, the client takes them in frame order */
+bool SaceOutputQueue::flush_locked () {
+    struct iovec iov[MAX_FLUSH_IOV];
+    int fds[SACE_BATCH_MAX_ITEMS];
+
+    while (!mFrames.empty()) {
+        size_t count = 0, nfds = 0;
+
+        for (auto &frame : mFrames) {
+            if (count == (size_t)MAX_FLUSH_IOV || nfds + frame.fds.size() > SACE_BATCH_MAX_ITEMS)
+                break;
+
+            iov[count].iov_base = (void*)(frame.data.data() + frame.offset);
+            iov[count].iov_len  = frame.data.size() - frame.offset;
+            memcpy(fds + nfds, frame.fds.data(), sizeof(int) * frame.fds.size());
+            nfds += frame.fds.size();
+            count++;
+        }
+
+        ssize_t ret = send_iov(mFd, iov, count, fds, nfds);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+
+            SACE_LOGE("%s - %d flush errno=%d errstr=%s", NAME, mFd, errno, strerror(errno));
+            return false;
+        }
+
+        /* every fd went with the first byte, the kernel holds its own references now */
+        for (size_t i = 0; i < count && nfds > 0; i++) {
+            for (int fd : mFrames[i].fds)
+                close(fd);
+            mFrames[i].fds.clear();
+        }
+
+        size_t left = ret;
+        for (size_t i = 0; i < count; i++) {
+            Frame &frame = mFrames.front();
+            size_t remain = frame.data.size() - frame.offset;
+            if (left < remain) {
+                frame.offset += left;
+                mBytes -= left;
+                break;
+            }
+
+            left   -= remain;
+            mBytes -= remain;
+            mFrames.pop_front();
+        }
     }
 
-    int ret = TEMP_FAILURE_RETRY(sendmsg(sockfd, &msg, MSG_WAITALL));
-    if (ret <= 0)
-        SACE_LOGE("%s handle result fail %s errno=%d errstr=%s", getName(), result.to_string().c_str(), errno, strerror(errno));
+    return true;
+}
+
+void SaceOutputQueue::detach () {
+    lock_guard<mutex> lock(mMutex);
+    drop_locked();
+    mFd = -1;
+    mOnBacklog = nullptr;
+}
+
+void SaceOutputQueue::onBacklog (BacklogHandler handler) {
+    lock_guard<mutex> lock(mMutex);
+    mOnBacklog = handler;
+}
+
+bool SaceOutputQueue::idle () {
+    lock_guard<mutex> lock(mMutex);
+    return mFrames.empty();
+}
+
+bool SaceOutputQueue::whenDrained (DrainHandler handler) {
+    lock_guard<mutex> lock(mMutex);
+    /* nothing will drain a dropped queue, its frames are gone anyway */
+    if (mFd < 0 || mOverflowed || mFrames.empty())
+        return false;
+
+    mDrained.push_back(handler);
+    return true;
+}
+
+void SaceOutputQueue::drop_locked () {
+    for (auto &frame : mFrames) {
+        for (int fd : frame.fds)
+            close(fd);
+    }
+
+    mFrames.clear();
+    mBytes = 0;
+    mDrained.clear();
+}
+
+SaceOutputStats SaceOutputQueue::stats () {
+    SaceOutputStats stats;
+    stats.deferred  = sDeferred;
+    stats.overflows = sOverflows;
+    return stats;
+}
+
+// ----------------------------------------------------------
+bool SaceInflightRequests::admit (uint64_t sequence, enum SaceCommandType type) {
+    lock_guard<mutex> lock(mMutex);
+    return mTable.insert(sequence, type);
+}
+
+void SaceInflightRequests::complete (uint64_t sequence) {
+    lock_guard<mutex> lock(mMutex);
+    mTable.erase(sequence);
+}
+
+size_t SaceInflightRequests::size () {
+    lock_guard<mutex> lock(mMutex);
+    return mTable.size();
+}
+
+// ----------------------------------------------------------
+void SaceSocketWriter::sendResult (const SaceResult &result) {
+    struct iovec iov;
+
+    /* the client may reuse the sequence as soon as it has the result */
+    if (inflight != nullptr)
+        inflight->complete(result.sequence);
+
+    encode_frame(result, codec, reply_parcel, reply_compact, iov);
+
+    size_t nfds = result.resultType == SACE_RESULT_TYPE_FD ? 1 : 0;
+    if (!deliver(iov.iov_base, iov.iov_len, &result.resultFd, nfds))
+        SACE_LOGE("%s handle result fail %s", getName(), result.to_string().c_str());
 }
 
 void SaceSocketWriter::sendResponse (const SaceStatusResponse &response) {
-    struct iovec  iov[1];
-    struct msghdr msg;
+    struct iovec iov;
 
     SACE_LOGI("%s writeResponse %s", getName(), response.to_string().c_str());
-    Parcel parcel;
-    response.writeToParcel(&parcel);
+    encode_frame(response, codec, reply_parcel, reply_compact, iov);
 
-    iov[0].iov_base = (void*)parcel.data();
-    iov[0].iov_len  = parcel.dataSize();
+    if (!deliver(iov.iov_base, iov.iov_len, nullptr, 0))
+        SACE_LOGE("%s response fail %s", getName(), response.to_string().c_str());
+}
 
-    msg.msg_name    = nullptr;
-    msg.msg_namelen = 0;
-    msg.msg_iov    = iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control    = nullptr;
-    msg.msg_controllen = 0;
+void SaceSocketWriter::sendBatchResult (const SaceBatchResult &batchRslt) {
+    struct iovec iov;
+    vector<int> fds;
+
+    for (auto &rslt : batchRslt.results) {
+        if (rslt.resultType == SACE_RESULT_TYPE_FD)
+            fds.push_back(rslt.resultFd);
+    }
+
+    if (inflight != nullptr)
+        inflight->complete(batchRslt.sequence);
+
+    encode_frame(batchRslt, codec, reply_parcel, reply_compact, iov);
 
-    int ret = TEMP_FAILURE_RETRY(sendmsg(sockfd, &msg, 0));
-    if (ret <= 0)
-        SACE_LOGE("%s response fail. %s", getName(), strerror(errno));
+    if (!deliver(iov.iov_base, iov.iov_len, fds.data(), fds.size()))
+        SACE_LOGE("%s handle batch result fail %s", getName(), batchRslt.to_string().c_str());
+}
+
+// ----------------------------------------------------------
+const char *SaceBatchCollector::NAME = "SWBatch";
+
+SaceBatchCollector::SaceBatchCollector (sp<SaceSocketWriter> writer, uint64_t sequence, const vector<sp<SaceCommand>> &commands) {
+    mWriter  = writer;
+    mPending = commands.size();
+    mSent    = false;
+    mDone.assign(mPending, false);
+
+    mResult.sequence = sequence;
+    mResult.results.resize(mPending);
+    for (size_t i = 0; i < mPending; i++) {
+        mResult.results[i].sequence     = commands[i]->sequence;
+        mResult.results[i].resultType   = SACE_RESULT_TYPE_NONE;
+        mResult.results[i].resultStatus = SACE_RESULT_STATUS_FAIL;
+    }
+}
+
+SaceBatchCollector::~SaceBatchCollector () {
+    lock_guard<mutex> lock(mMutex);
+
+    /* item writers are gone, the rest will never report */
+    if (!mSent) {
+        SACE_LOGW("%s %zu items never reported %s", NAME, mPending, mResult.to_string().c_str());
+        send_locked();
+    }
+}
+
+void SaceBatchCollector::complete (size_t index, const SaceResult &result) {
+    lock_guard<mutex> lock(mMutex);
+
+    if (mSent || index >= mDone.size() || mDone[index]) {
+        SACE_LOGW("%s late result %s", NAME, result.to_string().c_str());
+        return;
+    }
+
+    mDone[index] = true;
+    mResult.results[index] = result;
+
+    /* the excutor keeps its fd, hold our own until the frame is out */
+    if (result.resultType == SACE_RESULT_TYPE_FD) {
+        mResult.results[index].resultFd = fcntl(result.resultFd, F_DUPFD_CLOEXEC, 0);
+        if (mResult.results[index].resultFd < 0) {
+            SACE_LOGE("%s dup fd errno=%d errstr=%s", NAME, errno, strerror(errno));
+            mResult.results[index].resultType   = SACE_RESULT_TYPE_NONE;
+            mResult.results[index].resultStatus = SACE_RESULT_STATUS_FAIL;
+        }
+    }
+
+    if (--mPending == 0)
+        send_locked();
+}
+
+void SaceBatchCollector::send_locked () {
+    mSent = true;
+    mWriter->sendBatchResult(mResult);
+
+    for (auto &rslt : mResult.results) {
+        if (rslt.resultType == SACE_RESULT_TYPE_FD && rslt.resultFd >= 0)
+            close(rslt.resultFd);
+    }
+}
+
+// ----------------------------------------------------------
+void SaceListenerRegistry::add (pid_t pid, const sp<ISaceListener> &listener) {
+    sp<ISaceListener> replaced;
+    {
+        lock_guard<mutex> lock(mMutex);
+        sp<ISaceListener> &slot = mListeners[pid];
+        replaced = slot;
+        slot = listener;
+    }
+
+    /* outside the lock, binderDied may be waiting for it */
+    if (replaced != nullptr)
+        IInterface::asBinder(replaced)->unlinkToDeath(this);
+    IInterface::asBinder(listener)->linkToDeath(this);
+}
+
+void SaceListenerRegistry::remove (pid_t pid) {
+    sp<ISaceListener> removed;
+    {
+        lock_guard<mutex> lock(mMutex);
+        map<pid_t, sp<ISaceListener>>::iterator it = mListeners.find(pid);
+        if (it == mListeners.end())
+            return;
+        removed = it->second;
+        mListeners.erase(it);
+    }
+
+    IInterface::asBinder(removed)->unlinkToDeath(this);
+}
+
+sp<ISaceListener> SaceListenerRegistry::find (pid_t pid) const {
+    lock_guard<mutex> lock(mMutex);
+    map<pid_t, sp<ISaceListener>>::const_iterator it = mListeners.find(pid);
+    return it == mListeners.end()? nullptr : it->second;
+}
+
+pid_t SaceListenerRegistry::owner (const sp<ISaceListener> &listener) const {
+    if (listener == nullptr)
+        return -1;
+
+    sp<IBinder> binder = IInterface::asBinder(listener);
+    lock_guard<mutex> lock(mMutex);
+    for (auto &entry : mListeners) {
+        if (IInterface::asBinder(entry.second) == binder)
+            return entry.first;
+    }
+    return -1;
+}
+
+size_t SaceListenerRegistry::size () const {
+    lock_guard<mutex> lock(mMutex);
+    return mListeners.size();
+}
+
+void SaceListenerRegistry::binderDied (const wp<IBinder> &who) {
+    lock_guard<mutex> lock(mMutex);
+    for (map<pid_t, sp<ISaceListener>>::iterator it = mListeners.begin(); it != mListeners.end(); ) {
+        if (IInterface::asBinder(it->second).get() == who.unsafe_get()) {
+            SACE_LOGI("SaceListenerRegistry pid %d died", it->first);
+            it = mListeners.erase(it);
+        }
+        else
+            it++;
+    }
 }
 
 // ----------------------------------------------------------
 void SaceBinderWriter::sendResult (const SaceResult &result) {
-    *(this->result) = result;
+    if (async) {
+        if (listener != nullptr)
+            listener->onResult(result);
+        else
+            SACE_LOGE("%s no listener for %s", getName(), result.to_string().c_str());
+        return;
+    }
+
+    this->result = result;
     if (sem_post(&sync_sem) < 0)
         SACE_LOGE("%s sem_post errno%d errstr=%s", getName(), errno, strerror(errno));
 }
@@ -97,9 +543,11 @@ void SaceBinderWriter::sendResponse (const SaceStatusResponse &response) {
         SACE_LOGE("%s writeResponse %s", getName(), response.to_string().c_str());
 }
 
-void SaceBinderWriter::waitResult () {
+SaceResult SaceBinderWriter::waitResult () {
     if (TEMP_FAILURE_RETRY(sem_wait(&sync_sem)) < 0)
         SACE_LOGE("%s sem_wait errno=%d errstr=%s", getName(), errno, strerror(errno));
+
+    return std::move(result);
 }
 
 }; //namespace android
@@ -17,13 +17,23 @@
 #ifndef _SACE_WRITER_H
 #define _SACE_WRITER_H
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <utils/RefBase.h>
 #include <semaphore.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <binder/IBinder.h>
 #include <ISaceListener.h>
 #include <SaceTypes.h>
+#include <SaceCodec.h>
+#include <SacePool.h>
+#include <SaceInflight.h>
 #include <SaceLog.h>
 
 namespace android {
@@ -50,6 +60,31 @@ public:
     virtual void sendResult (const SaceResult &) = 0;
     virtual void sendResponse (const SaceStatusResponse &) = 0;
 
+    /* the same for all writers of one client connection */
+    virtual const void* connection () const {
+        return this;
+    }
+
+    /* what frames to this client are encoded in */
+    virtual int getCodec () const {
+        return SACE_CODEC_PARCEL;
+    }
+
+    /* SACE_SERVICE_CMD_INFO answer, Parcel clients may be of older builds */
+    void writeServiceInfo (const SaceServiceInfo::ServiceInfo &info, SacePayload &payload) const {
+        if (getCodec() == SACE_CODEC_COMPACT)
+            info.writeTo(payload);
+        else
+            info.writeLegacyTo(payload);
+    }
+
+    /* false if the client has taken everything sent so far, else handler
+     * runs once it has, writers without an output queue never wait */
+    virtual bool whenDrained (function<void ()> handler) {
+        (void)handler;
+        return false;
+    }
+
     bool operator == (SaceWriter* writer) const {
         return writer == nullptr? false : mId == writer->mId;
     }
@@ -60,27 +95,217 @@ public:
 };
 
 // ---------------------------------------------------------
-class SaceSocketWriter : public SaceWriter {
-    int sockfd;
+/* Requests of one connection waiting for their result.
+ * The reader admits a sequence before posting it, the writer of the
+ * request drops it when the result goes out. A sequence the client reuses
+ * while in flight is refused instead of answering the wrong caller.
+ */
+class SaceInflightRequests : public RefBase {
+    mutex mMutex;
+    SaceInflightTable<enum SaceCommandType> mTable;
+public:
+    /* false if sequence is in flight already */
+    bool admit (uint64_t sequence, enum SaceCommandType type);
+    void complete (uint64_t sequence);
+    size_t size ();
+};
+
+// ---------------------------------------------------------
+/* deferred frames had to wait for EPOLLOUT, overflows cut a client off */
+struct SaceOutputStats {
+    uint64_t deferred;
+    uint64_t overflows;
+};
+
+/* Frames of one client connection the socket has not taken yet.
+ * Writers send on the excutor thread as far as the socket takes it and
+ * queue the rest, the reader drains the queue once the socket is writable
+ * again, so no excutor ever waits for a client. A client that lets more
+ * than MAX_QUEUED_BYTES pile up is cut off: its frames are dropped and the
+ * socket shut down, the reader closes the connection on the hangup.
+ * On a packet socket every frame is one message and is never split, the
+ * queue is drained with sendmmsg instead of gathering frames.
+ */
+class SaceOutputQueue : public RefBase {
 public:
-    explicit SaceSocketWriter (const char* name, pid_t pid, int fd):SaceWriter(name, pid) {
-        sockfd = fd;
+    static const size_t MAX_QUEUED_BYTES;
+    typedef function<void ()> DrainHandler;
+    typedef function<void ()> BacklogHandler;
+
+    /* fd stays owned by the reader, packet for SOCK_SEQPACKET */
+    explicit SaceOutputQueue (int fd, bool packet = false);
+    virtual ~SaceOutputQueue ();
+
+    /* fds go with the first byte of the frame, false if it was dropped */
+    bool send (const void *data, size_t len, const int *fds, size_t nfds);
+    /* on EPOLLOUT, false if the connection failed */
+    bool flush ();
+    /* before the reader closes fd, later frames are dropped */
+    void detach ();
+    /* false if nothing is queued, else handler runs once, by the flush
+     * that empties the queue */
+    bool whenDrained (DrainHandler handler);
+    /* handler runs on the sending thread, under the queue lock, whenever
+     * a frame has to wait in an empty queue; the reader then watches for room */
+    void onBacklog (BacklogHandler handler);
+    bool idle ();
+
+    static SaceOutputStats stats ();
+
+private:
+    static const char *NAME;
+    static const int  MAX_FLUSH_IOV;
+
+    struct Frame {
+        string data;
+        size_t offset;
+        /* our own dups, closed once sent */
+        vector<int> fds;
+    };
+
+    mutex mMutex;
+    int mFd;
+    bool mPacket;
+    deque<Frame> mFrames;
+    size_t mBytes;
+    bool mOverflowed;
+    vector<DrainHandler> mDrained;
+    BacklogHandler mOnBacklog;
+
+    static atomic<uint64_t> sDeferred;
+    static atomic<uint64_t> sOverflows;
+
+    bool flush_locked ();
+    bool flush_packets_locked ();
+    void drop_locked ();
+};
+
+class SaceSocketWriter : public SaceWriter, public SacePooled<SaceSocketWriter> {
+    int codec;
+    sp<SaceInflightRequests> inflight;
+protected:
+    sp<SaceOutputQueue> output;
+
+    /* every frame of the connection goes out here */
+    virtual bool deliver (const void *data, size_t len, const int *fds, size_t nfds) {
+        return output->send(data, len, fds, nfds);
+    }
+public:
+    /* codec is what the client asked for in SACE_TYPE_HELLO,
+     * results complete their sequence in inflight if given */
+    explicit SaceSocketWriter (const char* name, pid_t pid, sp<SaceOutputQueue> output, int codec = SACE_CODEC_PARCEL,
+            sp<SaceInflightRequests> inflight = nullptr):SaceWriter(name, pid) {
+        this->output = output;
+        this->codec = codec;
+        this->inflight = inflight;
     }
     virtual ~SaceSocketWriter() {}
 
     virtual void sendResult (const SaceResult &);
     virtual void sendResponse (const SaceStatusResponse &);
+    /* one frame, fds of all SACE_RESULT_TYPE_FD items in one SCM_RIGHTS */
+    void sendBatchResult (const SaceBatchResult &);
+
+    virtual int getCodec () const {
+        return codec;
+    }
+
+    virtual bool whenDrained (function<void ()> handler) {
+        return output->whenDrained(handler);
+    }
+
+    /* the in flight table lives as long as the connection or a writer of it */
+    virtual const void* connection () const {
+        return inflight != nullptr ? (const void*)inflight.get() : (const void*)this;
+    }
+};
+
+// ---------------------------------------------------------
+/* Gathers the item results of one SaceBatchCommand.
+ * Items run on their own excutors; the batch frame goes out when the last
+ * one reports, or with the missing ones failed once nobody can report.
+ */
+class SaceBatchCollector : public RefBase {
+    static const char *NAME;
+
+    sp<SaceSocketWriter> mWriter;
+    SaceBatchResult mResult;
+    vector<bool> mDone;
+    size_t mPending;
+    bool mSent;
+    mutex mMutex;
+
+    void send_locked ();
+public:
+    SaceBatchCollector (sp<SaceSocketWriter> writer, uint64_t sequence, const vector<sp<SaceCommand>> &commands);
+    virtual ~SaceBatchCollector ();
+
+    void complete (size_t index, const SaceResult &result);
+    sp<SaceSocketWriter> getWriter () const {
+        return mWriter;
+    }
+};
+
+/* Writer handed to the excutor for one batch item */
+class SaceBatchItemWriter : public SaceWriter {
+    sp<SaceBatchCollector> mCollector;
+    size_t mIndex;
+public:
+    explicit SaceBatchItemWriter (const char* name, pid_t pid, sp<SaceBatchCollector> collector, size_t index)
+        :SaceWriter(name, pid) {
+        mCollector = collector;
+        mIndex = index;
+    }
+    virtual ~SaceBatchItemWriter() {}
+
+    virtual void sendResult (const SaceResult &result) {
+        mCollector->complete(mIndex, result);
+    }
+
+    /* later status of a started item goes to the client directly */
+    virtual void sendResponse (const SaceStatusResponse &response) {
+        mCollector->getWriter()->sendResponse(response);
+    }
+
+    virtual const void* connection () const {
+        return mCollector->getWriter()->connection();
+    }
+};
+
+// ---------------------------------------------------------
+/* ISaceListener of each binder client by pid.
+ * Binder threads register, drop and look up concurrently. A listener is
+ * dropped with unregisterListener or once its process dies, so a reused pid
+ * never reaches a stale callback.
+ */
+class SaceListenerRegistry : public IBinder::DeathRecipient {
+    mutable mutex mMutex;
+    map<pid_t, sp<ISaceListener>> mListeners;
+public:
+    /* replaces the listener pid had */
+    void add (pid_t pid, const sp<ISaceListener> &listener);
+    void remove (pid_t pid);
+    /* nullptr if pid has none */
+    sp<ISaceListener> find (pid_t pid) const;
+    /* pid that registered listener, -1 if none did */
+    pid_t owner (const sp<ISaceListener> &listener) const;
+    size_t size () const;
+
+    virtual void binderDied (const wp<IBinder> &who);
 };
 
 // ---------------------------------------------------------
 class SaceBinderWriter : public SaceWriter {
-    ISaceListener *listener;
-    SaceResult    *result;
+    sp<ISaceListener> listener;
+    /* sendCommandAsync, results go to the listener instead of waitResult */
+    bool          async;
+    /* owned here, an excutor may still hold the writer after the call returned */
+    SaceResult    result;
     sem_t         sync_sem;
 public:
-    explicit SaceBinderWriter (const char* name, pid_t pid, ISaceListener *listener, SaceResult *rslt):SaceWriter(name, pid) {
+    explicit SaceBinderWriter (const char* name, pid_t pid, const sp<ISaceListener> &listener, bool async = false):SaceWriter(name, pid) {
         this->listener = listener;
-        this->result   = rslt;
+        this->async    = async;
 
         if (sem_init(&sync_sem, 0, 0) < 0)
             SACE_LOGE("%s sem_init errno=%d errstr=%s", getName(), errno, strerror(errno));
@@ -90,7 +315,11 @@ public:
     virtual void sendResult (const SaceResult &);
     virtual void sendResponse (const SaceStatusResponse &);
 
-    void waitResult();
+    virtual const void* connection () const {
+        return listener.get();
+    }
+
+    SaceResult waitResult();
 };
 
 }; //namespace android
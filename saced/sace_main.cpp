@@ -26,6 +26,7 @@
 #include "SaceCommandMonitor.h"
 #include "SaceCommandDispatcher.h"
 #include "SaceMessage.h"
+#include "SaceStats.h"
 
 using namespace android;
 using namespace std;
@@ -34,7 +35,10 @@ static shared_ptr<SaceCommandDispatcher> sace_cmd_dispatcher;
 static unique_ptr<SaceCommandMonitor>    sace_cmd_monitor;
 
 static int g_event_fd = -1;
+/* eventfd adds up pending writes, exits count in the low word, dumps in the high */
 static const uint64_t EVENT_EXIT = 0x01;
+static const uint64_t EVENT_DUMP = 0x100000000ull;
+static const uint64_t EVENT_EXIT_MASK = 0xffffffffull;
 
 static void sig_handler (int sig) {
     uint64_t val = EVENT_EXIT;
@@ -44,10 +48,18 @@ static void sig_handler (int sig) {
         SACE_LOGE("write EVENT_EXIT SACE Main Thread fail errno=%d errstr=%s", errno, strerror(errno));
 }
 
+static void dump_handler (int) {
+    uint64_t val = EVENT_DUMP;
+
+    if (TEMP_FAILURE_RETRY(write(g_event_fd, &val, sizeof(uint64_t))) < 0)
+        SACE_LOGE("write EVENT_DUMP SACE Main Thread fail errno=%d errstr=%s", errno, strerror(errno));
+}
+
 static void handle_abort_exit () {
     signal(SIGINT, sig_handler);
     signal(SIGQUIT, sig_handler);
     signal(SIGTERM, sig_handler);
+    signal(SIGUSR1, dump_handler);
 }
 
 static void exit_sace () {
@@ -94,8 +106,10 @@ int main(void) {
             continue;
         }
 
-        if (value == EVENT_EXIT)
+        if (value & EVENT_EXIT_MASK)
             break;
+
+        SaceStats::dump();
     }
 
     exit_sace();
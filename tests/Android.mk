@@ -8,3 +8,125 @@ LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE)
 LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libsace
 LOCAL_MODULE := test_cmd
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS += -std=c++17
+LOCAL_SRC_FILES  := bench_loader.cpp ../saced/SaceEventLoader.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace $(LOCAL_PATH)/../saced
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder
+LOCAL_STATIC_LIBRARIES := libsace
+LOCAL_MODULE := bench_loader
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES  := test_load.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libsace
+LOCAL_MODULE := test_load
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES  := bench_codec.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder
+LOCAL_STATIC_LIBRARIES := libsace
+LOCAL_MODULE := bench_codec
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES  := fuzz_frame.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace
+LOCAL_STATIC_LIBRARIES := libsace liblog libcutils libutils libbinder
+LOCAL_MODULE := sace_frame_fuzzer
+include $(BUILD_FUZZ_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS += -fexceptions
+LOCAL_SRC_FILES  := test_alloc.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libsace
+LOCAL_MODULE := test_alloc
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES  := test_inflight.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_MODULE := test_inflight
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES  := bench_slotmap.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../saced
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_MODULE := bench_slotmap
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS += -fexceptions
+LOCAL_SRC_FILES  := bench_info.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE)
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libsace
+LOCAL_MODULE := bench_info
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES  := test_status_page.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder
+LOCAL_STATIC_LIBRARIES := libsace
+LOCAL_MODULE := test_status_page
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS += -std=c++17
+LOCAL_SRC_FILES  := test_subscription.cpp ../saced/SaceSubscription.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace $(LOCAL_PATH)/../saced
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder
+LOCAL_STATIC_LIBRARIES := libsace
+LOCAL_MODULE := test_subscription
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS += -std=c++17
+LOCAL_SRC_FILES  := test_output_queue.cpp ../saced/SaceWriter.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace $(LOCAL_PATH)/../saced
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder
+LOCAL_STATIC_LIBRARIES := libsace
+LOCAL_MODULE := test_output_queue
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS += -std=c++17
+LOCAL_SRC_FILES  := test_binder_async.cpp ../saced/SaceWriter.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace $(LOCAL_PATH)/../saced
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder
+LOCAL_STATIC_LIBRARIES := libsace
+LOCAL_MODULE := test_binder_async
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES  := test_ring.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder
+LOCAL_STATIC_LIBRARIES := libsace
+LOCAL_MODULE := test_ring
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS += -std=c++17
+LOCAL_CFLAGS += -DSACE_IO_URING
+LOCAL_SRC_FILES  := bench_uring.cpp ../saced/SaceUring.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../libsace $(LOCAL_PATH)/../saced
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils
+LOCAL_STATIC_LIBRARIES := libsace
+LOCAL_MODULE := bench_uring
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS += -fexceptions
+LOCAL_SRC_FILES  := bench_transport.cpp
+LOCAL_C_INCLUDES := $(LIB_SACE_C_INCLUDE) $(LOCAL_PATH)/../libsace
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libbinder libsace
+LOCAL_MODULE := bench_transport
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018-2024 The Service-And-Command Excutor Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SACE_TEST_H
+#define _SACE_TEST_H
+
+#include <stdio.h>
+#include <sys/cdefs.h>
+#include <time.h>
+
+#include <log/log.h>
+
+/* Helpers of the test and bench executables, each is a single source file */
+
+/* failed EXPECTs, main exits non zero if any */
+static int failures __unused = 0;
+
+/* count a failure and leave the test function */
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #cond); \
+        ALOGE("FAIL %s:%d %s", __FILE__, __LINE__, #cond); \
+        failures++; \
+        return; \
+    } \
+} while (0)
+
+/* CLOCK_MONOTONIC since begin */
+static inline long elapsed_ns (const struct timespec &begin) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - begin.tv_sec) * 1000000000L + (now.tv_nsec - begin.tv_nsec);
+}
+
+static inline long elapsed_us (const struct timespec &begin) {
+    return elapsed_ns(begin) / 1000;
+}
+
+#endif
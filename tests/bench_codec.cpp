@@ -0,0 +1,108 @@
+#define LOG_TAG "BENCH_CODEC"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <binder/Parcel.h>
+#include <log/log.h>
+#include <SaceTypes.h>
+#include <SaceCodec.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define DEFAULT_ROUNDS 100000
+
+static void report (const char *msg, const char *codec, long encode_ns, long decode_ns, int rounds, size_t bytes) {
+    printf("%-10s %-8s encode %6ld ns/op  decode %6ld ns/op  %5zu bytes\n",
+        msg, codec, encode_ns / rounds, decode_ns / rounds, bytes);
+    ALOGI("%s %s encode %ld ns/op decode %ld ns/op %zu bytes", msg, codec, encode_ns / rounds, decode_ns / rounds, bytes);
+}
+
+/* same message both ways; T needs readFromParcel and a SaceCodec overload */
+template<typename T> static void bench (const char *name, const T &msg, int rounds) {
+    struct timespec begin;
+    long encode_ns, decode_ns;
+
+    /* fresh buffers per round, the same as one sent frame */
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < rounds; i++) {
+        Parcel parcel;
+        msg.writeToParcel(&parcel);
+    }
+    encode_ns = elapsed_ns(begin);
+
+    Parcel parcel;
+    msg.writeToParcel(&parcel);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < rounds; i++) {
+        T decoded;
+        parcel.setDataPosition(0);
+        decoded.readFromParcel(&parcel);
+    }
+    decode_ns = elapsed_ns(begin);
+    report(name, "parcel", encode_ns, decode_ns, rounds, parcel.dataSize());
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < rounds; i++) {
+        string compact;
+        SaceCodec::encode(msg, compact);
+    }
+    encode_ns = elapsed_ns(begin);
+
+    string compact;
+    SaceCodec::encode(msg, compact);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < rounds; i++) {
+        T decoded;
+        if (!SaceCodec::decode((const uint8_t*)compact.data(), compact.size(), decoded)) {
+            printf("%s compact decode failed\n", name);
+            exit(1);
+        }
+    }
+    decode_ns = elapsed_ns(begin);
+    report(name, "compact", encode_ns, decode_ns, rounds, compact.size());
+}
+
+/* encode/decode cost and frame size of the Parcel and compact codecs */
+int main (int argc, char **argv) {
+    int rounds = argc > 1? atoi(argv[1]) : DEFAULT_ROUNDS;
+
+    SaceCommand normal;
+    normal.type = SACE_TYPE_NORMAL;
+    normal.normalCmdType = SACE_NORMAL_CMD_START;
+    normal.flags = SACE_CMD_FLAG_OUT;
+    normal.command = "ls -l /data/local/tmp";
+    bench("command", normal, rounds);
+
+    SaceCommand service;
+    service.type = SACE_TYPE_SERVICE;
+    service.serviceCmdType = SACE_SERVICE_CMD_START;
+    service.serviceFlags = SACE_SERVICE_FLAG_NORMAL;
+    service.name = "bench_service";
+    service.command = "sleep 100";
+    shared_ptr<SaceCommandParams> params = make_shared<SaceCommandParams>();
+    params->set_uid(1000);
+    params->set_gid(1000);
+    params->set_seclabel("u:r:shell:s0");
+    service.command_params = params;
+    bench("service", service, rounds);
+
+    SaceResult result;
+    result.sequence     = normal.sequence;
+    result.resultType   = SACE_RESULT_TYPE_LABEL;
+    result.resultStatus = SACE_RESULT_STATUS_OK;
+    result.resultExtra.put<uint64_t>(0x1234567890ull);
+    bench("result", result, rounds);
+
+    SaceBatchCommand batch;
+    for (int i = 0; i < 16; i++)
+        batch.commands.push_back(normal);
+    bench("batch16", batch, rounds / 16 + 1);
+
+    return 0;
+}
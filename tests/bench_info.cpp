@@ -0,0 +1,87 @@
+#define LOG_TAG "BENCH_INFO"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <log/log.h>
+#include <sace/SaceManager.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define DEFAULT_POLLS    2000
+#define DEFAULT_SPAWNERS 4
+
+/* getState (or peekState from the status page) latency percentiles over polls */
+static void poll_state (const char *phase, sp<SaceServiceObj> sve, int polls, bool peek) {
+    vector<long> latency;
+    struct timespec begin;
+
+    for (int i = 0; i < polls; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        if ((peek ? sve->peekState() : sve->getState()) != SaceServiceInfo::SERVICE_RUNNING) {
+            printf("%s: target not running\n", phase);
+            return;
+        }
+        latency.push_back(elapsed_us(begin));
+    }
+
+    sort(latency.begin(), latency.end());
+    const char *call = peek ? "peekState" : "getState";
+    printf("%-6s %-9s p50 %5ldus  p99 %5ldus  max %6ldus\n", phase, call,
+        latency[polls / 2], latency[polls * 99 / 100], latency.back());
+    ALOGI("%s %s p50 %ldus p99 %ldus max %ldus", phase, call,
+        latency[polls / 2], latency[polls * 99 / 100], latency.back());
+}
+
+/* usage: bench_info [polls] [spawners], INFO latency while other threads keep saced forking */
+int main (int argc, char **argv) {
+    int polls    = argc > 1? atoi(argv[1]) : DEFAULT_POLLS;
+    int spawners = argc > 2? atoi(argv[2]) : DEFAULT_SPAWNERS;
+    sp<SaceManager> manager = SaceManager::getInstance();
+
+    sp<SaceServiceObj> target = manager->checkService("bench_info_target", "sleep 3600");
+    if (!target.get()) {
+        printf("start target failed, is saced running?\n");
+        return 1;
+    }
+
+    try {
+        poll_state("idle", target, polls, false);
+        poll_state("idle", target, polls, true);
+
+        atomic<bool> stop(false);
+        atomic<long> spawned(0);
+        vector<thread> workers;
+        for (int i = 0; i < spawners; i++) {
+            workers.emplace_back([&manager, &stop, &spawned, i] () {
+                for (long n = 0; !stop; n++) {
+                    string name = "bench_info_" + to_string(i) + "_" + to_string(n);
+                    if (manager->checkService(name.c_str(), "true").get())
+                        spawned++;
+                }
+            });
+        }
+
+        poll_state("spawn", target, polls, false);
+        poll_state("spawn", target, polls, true);
+        stop = true;
+        for (auto &worker : workers)
+            worker.join();
+        printf("%ld services spawned meanwhile\n", spawned.load());
+
+        target->stop();
+    }
+    catch (exception &e) {
+        printf("%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
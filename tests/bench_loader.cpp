@@ -0,0 +1,262 @@
+#define LOG_TAG "BENCH_LOADER"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <log/log.h>
+#include <sace/SaceParams.h>
+#include <SaceEventLoader.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define DEFAULT_EVENTS  10000
+#define DEFAULT_ROUNDS  5
+#define DROPIN_FILES    4
+#define DEFAULT_DIR     "/data/local/tmp"
+
+/* events first..last-1 in the shape of sace_event.ini */
+static bool write_config (const string &path, int first, int last) {
+    FILE *fp = fopen(path.c_str(), "we");
+    if (fp == nullptr) {
+        printf("open %s failed: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    fprintf(fp, "# generated by bench_loader\n\n");
+    for (int i = first; i < last; i++) {
+        fprintf(fp, "bench_event_%d /system/bin/sleep %d\n", i, i % 60);
+        fprintf(fp, "    user system\n");
+        fprintf(fp, "    group system\n");
+        fprintf(fp, "    groups inet net_admin\n");
+        fprintf(fp, "    seclabel u:r:shell:s0\n");
+        fprintf(fp, "    capability NET_ADMIN NET_RAW\n");
+        fprintf(fp, "    rlimits NOFILE 1024 4096\n");
+        if (i % 2 == 0)
+            fprintf(fp, "    trigger boot\n");
+        else
+            fprintf(fp, "    trigger property:sys.bench.event=%d\n", i);
+        fprintf(fp, "\n");
+    }
+
+    fclose(fp);
+    return true;
+}
+
+// ------------------------------------------------------------------
+/* The getline/stringstream path SaceEvent used before SaceEventLoader,
+ * kept here as the baseline. It builds the same SaceCommand per event.
+ */
+class LegacyLoader {
+    map<string, sp<SaceCommand>> mEvents;
+    sp<SaceCommand> mCommand;
+
+    static string trim_space_char (string line) {
+        size_t i = 0, j = 0;
+
+        for (i = 0; i < line.size() && isspace(line[i]); i++);
+        line.erase(0, i);
+
+        size_t len = line.size();
+        for (i = len > 0? len -1 : 0, j = len; i > 0 && isspace(line[i]); i--, j--);
+        line.erase(j);
+
+        return line;
+    }
+
+    static bool next_token (string &line, string &token) {
+        string str;
+        for (size_t i = 0; i < line.length(); i++) {
+            if (line[i] == ' ' || line[i] == '\t' || line[i] == '\n')
+                break;
+            str.push_back(line[i]);
+        }
+
+        if (str.empty())
+            return false;
+        line.erase(0, str.size());
+        token.assign(str);
+        return true;
+    }
+
+    void parse_service_attr (string line) {
+        shared_ptr<SaceEventParams> params = static_pointer_cast<SaceEventParams>(mCommand->command_params);
+        stringstream out_stream(line);
+        string tag, value;
+
+        out_stream>>tag;
+        if (tag == "user") {
+            if (out_stream>>value)
+                params->set_uid(value);
+        }
+        else if (tag == "group") {
+            if (out_stream>>value)
+                params->set_gid(value);
+        }
+        else if (tag == "seclabel") {
+            if (out_stream>>value)
+                params->set_seclabel(value);
+        }
+        else if (tag == "groups") {
+            while (out_stream>>value)
+                params->add_gids(value);
+        }
+        else if (tag == "capability") {
+            const map<string, int, less<>> &caps = SaceEventLoader::capability_map();
+            while (out_stream>>value) {
+                auto e = caps.find(value);
+                params->set_capabilities(e != caps.end()? e->second : -1);
+            }
+        }
+        else if (tag == "trigger") {
+            if (!(out_stream>>value))
+                return;
+
+            if (!strncmp(value.data(), "property", strlen("property"))) {
+                size_t colon_pos = value.find(':');
+                size_t equal_pos = value.find('=', colon_pos);
+                if (colon_pos != string::npos && equal_pos != string::npos)
+                    params->add_property(value.substr(colon_pos, equal_pos - colon_pos), value.substr(equal_pos));
+            }
+            else if (!strncmp(value.data(), "boot", strlen("boot")))
+                params->set_boot(true);
+        }
+        else if (tag == "rlimits") {
+            string name;
+            int hard, soft;
+            if (out_stream>>name>>hard>>soft) {
+                const map<string, int, less<>> &rlimits = SaceEventLoader::rlimit_map();
+                auto e = rlimits.find(name);
+                params->add_rlimits(e != rlimits.end()? e->second : -1, hard, soft);
+            }
+        }
+    }
+
+    void parse_line (const string &line_token) {
+        string line = trim_space_char(line_token);
+
+        if (line.empty() || (line.size() == 1 && line[0] == '\0')) {
+            if (mCommand != nullptr)
+                mEvents[mCommand->name] = mCommand;
+            mCommand = nullptr;
+            return;
+        }
+
+        if (line[0] == '#')
+            return;
+
+        if (mCommand == nullptr) {
+            string name;
+            if (next_token(line, name) && line.size() > 0) {
+                mCommand = new SaceCommand();
+                mCommand->command_params = make_shared<SaceEventParams>();
+                mCommand->name = name;
+                mCommand->command = line;
+            }
+        }
+        else
+            parse_service_attr(line);
+    }
+
+public:
+    size_t load (const string &path) {
+        ifstream conf_in(path);
+        char buf[128] = {0};
+        string line;
+
+        while (conf_in.good()) {
+            conf_in.getline(buf, sizeof(buf));
+            line.assign(buf, conf_in.gcount());
+            if (conf_in.eof()) {
+                if (line.size() > 0)
+                    parse_line(line);
+                break;
+            }
+            parse_line(line);
+        }
+        parse_line(string());
+
+        return mEvents.size();
+    }
+};
+
+// ------------------------------------------------------------------
+static size_t count_entries (const vector<SaceEventLoader::Result> &results) {
+    size_t events = 0;
+    for (auto &result : results)
+        events += result.entries.size();
+    return events;
+}
+
+static void report (const char *name, long best_ns, long total_ns, int rounds, size_t events) {
+    printf("%-16s best %8.2f ms  avg %8.2f ms  %6zu events\n", name,
+        best_ns / 1e6, total_ns / 1e6 / rounds, events);
+    ALOGI("%s best %ld ns avg %ld ns %zu events", name, best_ns, total_ns / rounds, events);
+}
+
+/* time fn over rounds, fn returns the events it loaded */
+template<typename F> static void bench (const char *name, int rounds, F fn) {
+    long best = 0, total = 0;
+    size_t events = 0;
+
+    for (int i = 0; i < rounds; i++) {
+        struct timespec begin;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        events = fn();
+        long ns = elapsed_ns(begin);
+
+        total += ns;
+        if (i == 0 || ns < best)
+            best = ns;
+    }
+
+    report(name, best, total, rounds, events);
+}
+
+/* usage: bench_loader [events] [rounds] [dir] */
+int main (int argc, char **argv) {
+    int events = argc > 1? atoi(argv[1]) : DEFAULT_EVENTS;
+    int rounds = argc > 2? atoi(argv[2]) : DEFAULT_ROUNDS;
+    string dir = argc > 3? argv[3] : DEFAULT_DIR;
+
+    string single = dir + "/bench_loader.ini";
+    vector<string> dropins;
+    if (!write_config(single, 0, events))
+        return 1;
+    for (int i = 0; i < DROPIN_FILES; i++) {
+        dropins.push_back(dir + "/bench_loader_" + to_string(i) + ".ini");
+        if (!write_config(dropins.back(), events * i / DROPIN_FILES, events * (i + 1) / DROPIN_FILES))
+            return 1;
+    }
+
+    bench("getline", rounds, [&single] {
+        LegacyLoader legacy;
+        return legacy.load(single);
+    });
+
+    bench("loader", rounds, [&single] {
+        vector<SaceEventLoader::Result> results;
+        SaceEventLoader::load_files(vector<string>(1, single), results);
+        return count_entries(results);
+    });
+
+    bench("loader dropins", rounds, [&dropins] {
+        vector<SaceEventLoader::Result> results;
+        SaceEventLoader::load_files(dropins, results);
+        return count_entries(results);
+    });
+
+    unlink(single.c_str());
+    for (auto &path : dropins)
+        unlink(path.c_str());
+    return 0;
+}
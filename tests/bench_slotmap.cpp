@@ -0,0 +1,136 @@
+#define LOG_TAG "BENCH_SLOTMAP"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <log/log.h>
+#include <SaceSlotMap.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define DEFAULT_ENTRIES 100000
+
+/* about the size of a service entry in saced */
+struct Entry {
+    string name;
+    int pid;
+    uint64_t label;
+    int state;
+};
+
+static void report (const char *op, long slot_ns, long map_ns, int ops) {
+    printf("%-8s slotmap %6ld ns/op  map %6ld ns/op\n", op, slot_ns / ops, map_ns / ops);
+    ALOGI("%s slotmap %ld ns/op map %ld ns/op", op, slot_ns / ops, map_ns / ops);
+}
+
+/* stale labels must miss after their slot is reused */
+static bool check_stale (void) {
+    SaceSlotMap<Entry> slots;
+    uint64_t label = slots.insert(Entry());
+
+    slots.erase(label);
+    uint64_t reused = slots.insert(Entry());
+    if (slots.get(label) != nullptr || slots.get(reused) == nullptr || slots.get(0) != nullptr || label == reused) {
+        printf("stale label resolved\n");
+        return false;
+    }
+
+    return true;
+}
+
+/* the old layout: heap objects keyed by their address in a std::map */
+int main (int argc, char **argv) {
+    int entries = argc > 1? atoi(argv[1]) : DEFAULT_ENTRIES;
+    mt19937 rand(entries);
+    struct timespec begin;
+    long slot_ns, map_ns;
+    volatile long sink = 0;
+
+    if (!check_stale())
+        return 1;
+
+    SaceSlotMap<Entry> slots;
+    map<uint64_t, Entry*> tree;
+    vector<uint64_t> slotLabels, treeLabels;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < entries; i++) {
+        Entry entry;
+        entry.pid = i;
+        slotLabels.push_back(slots.insert(std::move(entry)));
+    }
+    slot_ns = elapsed_ns(begin);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < entries; i++) {
+        Entry *entry = new Entry();
+        entry->pid = i;
+        entry->label = (uint64_t)entry;
+        tree.insert(make_pair(entry->label, entry));
+        treeLabels.push_back(entry->label);
+    }
+    map_ns = elapsed_ns(begin);
+    report("insert", slot_ns, map_ns, entries);
+
+    /* random lookups, what STOP/PAUSE/RESTART do */
+    vector<int> order(entries);
+    for (int i = 0; i < entries; i++)
+        order[i] = rand() % entries;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i : order)
+        sink += slots.get(slotLabels[i])->pid;
+    slot_ns = elapsed_ns(begin);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i : order)
+        sink += tree.find(treeLabels[i])->second->pid;
+    map_ns = elapsed_ns(begin);
+    report("lookup", slot_ns, map_ns, entries);
+
+    /* status sweep over every entry, once per excutor timeout */
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (auto &entry : slots)
+        sink += entry.state;
+    slot_ns = elapsed_ns(begin);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (auto &it : tree)
+        sink += it.second->state;
+    map_ns = elapsed_ns(begin);
+    report("sweep", slot_ns, map_ns, entries);
+
+    /* services exit and new ones start */
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i : order) {
+        slots.erase(slotLabels[i]);
+        slotLabels[i] = slots.insert(Entry());
+    }
+    slot_ns = elapsed_ns(begin);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i : order) {
+        auto it = tree.find(treeLabels[i]);
+        delete it->second;
+        tree.erase(it);
+
+        Entry *entry = new Entry();
+        entry->label = (uint64_t)entry;
+        tree.insert(make_pair(entry->label, entry));
+        treeLabels[i] = entry->label;
+    }
+    map_ns = elapsed_ns(begin);
+    report("churn", slot_ns, map_ns, entries);
+
+    for (auto &it : tree)
+        delete it.second;
+
+    printf("%d entries, checksum %ld\n", entries, (long)sink);
+    return 0;
+}
@@ -0,0 +1,102 @@
+#define LOG_TAG "BENCH_TRANSPORT"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <log/log.h>
+#include <SaceSender.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define DEFAULT_ROUNDS  5000
+#define DEFAULT_THREADS 4
+
+/* answered by the reader thread of saced, so only the transport is measured.
+ * Nothing has the name, an answer fails but carries it back. */
+static SaceCommand info_command () {
+    SaceCommand cmd;
+    cmd.type = SACE_TYPE_SERVICE;
+    cmd.serviceCmdType = SACE_SERVICE_CMD_INFO;
+    cmd.serviceFlags   = SACE_SERVICE_FLAG_NORMAL;
+    cmd.command.assign(SaceServiceInfo::SERVICE_GET_BY_NAME);
+    cmd.name.assign("bench_transport_none");
+    return cmd;
+}
+
+/* round trip percentiles of one caller */
+static bool bench_latency (const char *mode, sp<SaceSender> sender, int rounds) {
+    SaceCommand cmd = info_command();
+    vector<long> latency;
+    struct timespec begin;
+
+    for (int i = 0; i < rounds; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        SaceResult rslt = sender->excuteCommand(cmd);
+        if (rslt.name != cmd.name) {
+            printf("%s: no answer, is saced running?\n", mode);
+            return false;
+        }
+        latency.push_back(elapsed_us(begin));
+    }
+
+    sort(latency.begin(), latency.end());
+    printf("%-10s latency     p50 %5ldus  p99 %5ldus  max %6ldus\n", mode,
+        latency[rounds / 2], latency[rounds * 99 / 100], latency.back());
+    ALOGI("%s latency p50 %ldus p99 %ldus max %ldus", mode,
+        latency[rounds / 2], latency[rounds * 99 / 100], latency.back());
+    return true;
+}
+
+/* requests per second with threads sharing the connection */
+static void bench_throughput (const char *mode, sp<SaceSender> sender, int rounds, int threads) {
+    atomic<long> done(0);
+    vector<thread> workers;
+    struct timespec begin;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&sender, &done, rounds] () {
+            SaceCommand cmd = info_command();
+            for (int n = 0; n < rounds; n++) {
+                SaceResult rslt = sender->excuteCommand(cmd);
+                if (rslt.name == cmd.name)
+                    done++;
+            }
+        });
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+
+    long us = elapsed_us(begin);
+    long rate = us > 0 ? done.load() * 1000000L / us : 0;
+    printf("%-10s throughput  %d threads %8ld req/s  (%ld of %ld answered)\n", mode, threads, rate,
+        done.load(), (long)rounds * threads);
+    ALOGI("%s throughput %d threads %ld req/s", mode, threads, rate);
+}
+
+/* usage: bench_transport [rounds] [threads], framed stream against seqpacket and rings */
+int main (int argc, char **argv) {
+    int rounds  = argc > 1? atoi(argv[1]) : DEFAULT_ROUNDS;
+    int threads = argc > 2? atoi(argv[2]) : DEFAULT_THREADS;
+
+    sp<SaceSender> stream = new SaceSocketSender("sace_socket", SOCK_STREAM);
+    sp<SaceSender> packet = new SaceSocketSender("sace_seqpacket", SOCK_SEQPACKET);
+    sp<SaceSender> ring   = new SaceRingSender("sace_ring");
+
+    if (!bench_latency("stream", stream, rounds) || !bench_latency("seqpacket", packet, rounds)
+            || !bench_latency("ring", ring, rounds))
+        return 1;
+
+    bench_throughput("stream", stream, rounds, threads);
+    bench_throughput("seqpacket", packet, rounds, threads);
+    bench_throughput("ring", ring, rounds, threads);
+    return 0;
+}
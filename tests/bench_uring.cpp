@@ -0,0 +1,214 @@
+#define LOG_TAG "BENCH_URING"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <vector>
+
+#include <log/log.h>
+#include <SaceFrame.h>
+#include <SaceUring.h>
+
+using namespace android;
+
+#define DEFAULT_ROUNDS  20000
+#define DEFAULT_CLIENTS 4
+#define FRAME_SIZE      64
+
+static long now_ns () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/* one client: a request, then wait for its answer */
+struct Client {
+    int fd;
+    int rounds;
+    vector<long> latencies;
+};
+
+static void* client_run (void *data) {
+    Client *client = (Client*)data;
+    uint8_t frame[FRAME_SIZE];
+    uint32_t len = FRAME_SIZE;
+
+    memset(frame, 'c', sizeof(frame));
+    memcpy(frame, &len, sizeof(len));
+
+    for (int i = 0; i < client->rounds; i++) {
+        long begin = now_ns();
+        if (TEMP_FAILURE_RETRY(write(client->fd, frame, sizeof(frame))) != sizeof(frame))
+            break;
+
+        size_t got = 0;
+        while (got < sizeof(frame)) {
+            ssize_t ret = TEMP_FAILURE_RETRY(read(client->fd, frame + got, sizeof(frame) - got));
+            if (ret <= 0)
+                return nullptr;
+            got += ret;
+        }
+        client->latencies.push_back((now_ns() - begin) / 1000);
+    }
+
+    shutdown(client->fd, SHUT_WR);
+    return nullptr;
+}
+
+/* server side of the run, what the engine cost */
+struct Server {
+    vector<int> fds;
+    vector<SaceFrameBuffer> frames;
+    long requests;
+    long syscalls;
+};
+
+/* answers every whole frame, false once the client is done */
+static bool serve (Server &server, size_t index, const uint8_t *data, size_t len) {
+    SaceFrameBuffer &frames = server.frames[index];
+    const uint8_t *frame;
+    size_t frame_len;
+
+    frames.append(data, len);
+    while (frames.next(&frame, &frame_len)) {
+        server.syscalls++;
+        if (TEMP_FAILURE_RETRY(write(server.fds[index], frame, frame_len)) != (ssize_t)frame_len)
+            return false;
+        server.requests++;
+    }
+
+    return !frames.corrupted();
+}
+
+/* epoll_wait, then read until EAGAIN, as SaceSocketReader without io_uring */
+static void run_epoll (Server &server) {
+    struct epoll_event events[64];
+    uint8_t buf[4096];
+    size_t open = server.fds.size();
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; i < server.fds.size(); i++) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.u64 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, server.fds[i], &ev);
+    }
+
+    while (open > 0) {
+        server.syscalls++;
+        int ret = epoll_wait(epfd, events, 64, -1);
+        for (int i = 0; i < ret; i++) {
+            size_t index = events[i].data.u64;
+
+            while (true) {
+                server.syscalls++;
+                ssize_t len = read(server.fds[index], buf, sizeof(buf));
+                if (len < 0 && errno == EAGAIN)
+                    break;
+                if (len <= 0 || !serve(server, index, buf, len)) {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, server.fds[index], nullptr);
+                    open--;
+                    break;
+                }
+            }
+        }
+    }
+    close(epfd);
+}
+
+/* multishot recv on every client, one io_uring_enter per round */
+static void run_uring (Server &server) {
+    SaceUring uring;
+    SaceUring::Completion cqe;
+    size_t open = server.fds.size();
+
+    if (!uring.init(64, 64, 4096))
+        return;
+    for (size_t i = 0; i < server.fds.size(); i++)
+        uring.recv(server.fds[i], i);
+
+    while (open > 0 && uring.wait(-1) == 0) {
+        while (uring.next(cqe)) {
+            size_t index = cqe.data;
+            const uint8_t *buf = uring.buffer(cqe);
+            bool alive = cqe.res == -ENOBUFS || (cqe.res > 0 && serve(server, index, buf, cqe.res));
+
+            uring.recycle(cqe);
+            if (!alive)
+                open--;
+            else if (!SaceUring::more(cqe))
+                uring.recv(server.fds[index], index);
+        }
+    }
+    server.syscalls += uring.enters();
+}
+
+static void bench (const char *engine, void (*run)(Server&), int clients, int rounds) {
+    vector<Client> peers(clients);
+    vector<pthread_t> threads(clients);
+    Server server;
+
+    server.requests = server.syscalls = 0;
+    for (int i = 0; i < clients; i++) {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        server.fds.push_back(fds[0]);
+        server.frames.emplace_back();
+        peers[i].fd = fds[1];
+        peers[i].rounds = rounds;
+        peers[i].latencies.reserve(rounds);
+    }
+
+    long begin = now_ns();
+    for (int i = 0; i < clients; i++)
+        pthread_create(&threads[i], nullptr, client_run, &peers[i]);
+    run(server);
+    for (int i = 0; i < clients; i++)
+        pthread_join(threads[i], nullptr);
+    long elapsed = now_ns() - begin;
+
+    vector<long> all;
+    for (auto &peer : peers) {
+        all.insert(all.end(), peer.latencies.begin(), peer.latencies.end());
+        close(peer.fd);
+    }
+    for (int fd : server.fds)
+        close(fd);
+
+    if (all.empty() || server.requests == 0) {
+        printf("%-6s no requests answered\n", engine);
+        return;
+    }
+
+    sort(all.begin(), all.end());
+    long p50 = all[all.size() / 2];
+    long p99 = all[all.size() * 99 / 100];
+    double per_request = (double)server.syscalls / server.requests;
+    printf("%-6s %d clients %7ld req/s  %.2f syscalls/req  p50 %4ldus  p99 %5ldus\n", engine, clients,
+        server.requests * 1000000000L / elapsed, per_request, p50, p99);
+    ALOGI("%s %d clients %.2f syscalls/req p50 %ldus p99 %ldus", engine, clients, per_request, p50, p99);
+}
+
+/* usage: bench_uring [rounds] [clients], the engines of SaceSocketReader
+ * serving ping-pong clients; syscalls counted on the server side only */
+int main (int argc, char **argv) {
+    int rounds  = argc > 1? atoi(argv[1]) : DEFAULT_ROUNDS;
+    int clients = argc > 2? atoi(argv[2]) : DEFAULT_CLIENTS;
+
+    bench("epoll", run_epoll, clients, rounds);
+    if (!SaceUring::available()) {
+        printf("io_uring not available on this kernel or build\n");
+        return 0;
+    }
+    bench("uring", run_uring, clients, rounds);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SaceFrame.h>
+
+using namespace android;
+
+#define FUZZ_MAX_FRAME 4096
+
+/* First byte picks the chunk size the stream is delivered in, the rest is the
+ * stream itself. Emitted frames must be exactly the leading bytes of the
+ * stream, each carrying its own length, whatever the chunking.
+ */
+extern "C" int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size) {
+    if (size < 1)
+        return 0;
+
+    size_t chunk = data[0] + 1;
+    data++;
+    size--;
+
+    SaceFrameBuffer frames(FUZZ_MAX_FRAME);
+    size_t fed = 0, emitted = 0;
+
+    while (fed < size && !frames.corrupted()) {
+        size_t len = min(chunk, size - fed);
+
+        /* alternate both ways of feeding */
+        if ((fed / chunk) % 2) {
+            memcpy(frames.reserve(len), data + fed, len);
+            frames.commit(len);
+        }
+        else
+            frames.append(data + fed, len);
+        fed += len;
+
+        const uint8_t *frame;
+        size_t frame_len;
+        while (frames.next(&frame, &frame_len)) {
+            uint32_t prefix;
+            memcpy(&prefix, frame, sizeof(prefix));
+
+            if (prefix != frame_len || frame_len > FUZZ_MAX_FRAME)
+                abort();
+            if (emitted + frame_len > fed || memcmp(frame, data + emitted, frame_len))
+                abort();
+            emitted += frame_len;
+        }
+    }
+
+    if (!frames.corrupted() && emitted + frames.pending() != fed)
+        abort();
+
+    /* walking the stream in place must find the same frames */
+    size_t offset = 0;
+    ssize_t frame_len;
+    while (offset < emitted && (frame_len = SaceFrameBuffer::peek(data + offset, size - offset, FUZZ_MAX_FRAME)) > 0)
+        offset += frame_len;
+    if (offset != emitted)
+        abort();
+
+    return 0;
+}
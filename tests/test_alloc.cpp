@@ -0,0 +1,154 @@
+#define LOG_TAG "TEST_ALLOC"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+
+#include <log/log.h>
+#include <sace/SaceManager.h>
+#include <SaceTypes.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define WARMUP_ROUNDS     16
+#define MEASURE_ROUNDS    100
+/* client side of one runCommand + close, measured on the default codec */
+#define MAX_ROUNDTRIP_ALLOCS 48
+
+static atomic<bool> sCounting(false);
+static atomic<long> sAllocs(0);
+
+void* operator new (size_t size) {
+    if (sCounting.load(memory_order_relaxed))
+        sAllocs.fetch_add(1, memory_order_relaxed);
+
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+        throw bad_alloc();
+    return ptr;
+}
+
+void* operator new[] (size_t size) {
+    return operator new(size);
+}
+
+void operator delete (void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[] (void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete (void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[] (void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static void begin_count () {
+    sAllocs = 0;
+    sCounting = true;
+}
+
+static long end_count () {
+    sCounting = false;
+    return sAllocs;
+}
+
+static void check (const char *name, long allocs, long bound) {
+    bool ok = allocs <= bound;
+    printf("%-28s %5ld allocs (bound %ld) %s\n", name, allocs, bound, ok ? "OK" : "FAIL");
+    ALOGI("%s %ld allocs bound %ld %s", name, allocs, bound, ok ? "OK" : "FAIL");
+    if (!ok)
+        failures++;
+}
+
+static SaceCommand large_command () {
+    SaceCommand cmd;
+    cmd.type = SACE_TYPE_SERVICE;
+    cmd.serviceCmdType = SACE_SERVICE_CMD_START;
+    cmd.name.assign(64, 'n');
+    cmd.command.assign(256, 'c');
+    cmd.extra.resize(1024);
+    return cmd;
+}
+
+/* moving must steal strings and payloads, not copy them */
+static void test_move () {
+    SaceCommand cmd = large_command();
+    SaceResult rlt;
+    rlt.resultExtra.resize(1024);
+
+    begin_count();
+    SaceCommand moved(std::move(cmd));
+    SaceCommand assigned;
+    assigned = std::move(moved);
+    SaceResult rltMoved(std::move(rlt));
+    SaceResult rltAssigned;
+    rltAssigned = std::move(rltMoved);
+    check("move command/result", end_count(), 0);
+}
+
+/* freed commands go back to the free list and are handed out again */
+static void test_pool () {
+    SaceCommand *cmds[WARMUP_ROUNDS];
+
+    for (int i = 0; i < WARMUP_ROUNDS; i++)
+        cmds[i] = new SaceCommand();
+    for (int i = 0; i < WARMUP_ROUNDS; i++)
+        delete cmds[i];
+
+    uint64_t hits = SacePooled<SaceCommand>::stats().hits;
+    begin_count();
+    for (int i = 0; i < MEASURE_ROUNDS; i++) {
+        SaceCommand *cmd = new SaceCommand();
+        delete cmd;
+    }
+    check("pooled new/delete", end_count(), 0);
+
+    /* every round above was a hit */
+    check("pool misses", MEASURE_ROUNDS - (long)(SacePooled<SaceCommand>::stats().hits - hits), 0);
+}
+
+/* client side allocations of one command against a running saced */
+static void test_roundtrip (long bound) {
+    sp<SaceManager> manager = SaceManager::getInstance();
+    long total = 0;
+
+    for (int i = 0; i < WARMUP_ROUNDS + MEASURE_ROUNDS; i++) {
+        bool measure = i >= WARMUP_ROUNDS;
+
+        if (measure)
+            begin_count();
+        sp<SaceCommandObj> cmd = manager->runCommand("true");
+        if (cmd.get() == nullptr) {
+            sCounting = false;
+            printf("runCommand failed, is saced running?\n");
+            failures++;
+            return;
+        }
+        cmd->close();
+        cmd.clear();
+        if (measure)
+            total += end_count();
+    }
+
+    check("runCommand round trip", total / MEASURE_ROUNDS, bound);
+}
+
+/* usage: test_alloc [roundtrip bound] */
+int main (int argc, char **argv) {
+    long bound = argc > 1? atol(argv[1]) : MAX_ROUNDTRIP_ALLOCS;
+
+    test_move();
+    test_pool();
+    test_roundtrip(bound);
+
+    return failures == 0 ? 0 : 1;
+}
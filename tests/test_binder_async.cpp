@@ -0,0 +1,380 @@
+#define LOG_TAG "TEST_BINDER_ASYNC"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <log/log.h>
+#include <ISaceManager.h>
+#include <SaceSender.h>
+#include <SaceWriter.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define ASYNC_COMMANDS  32
+#define REGISTRY_THREADS 8
+#define REGISTRY_ROUNDS  1000
+#define WAIT_TIMEOUT_MS  3000
+
+static SaceResult make_result (uint64_t sequence, enum SaceResultStatus status) {
+    SaceResult rslt;
+    rslt.sequence     = sequence;
+    rslt.resultType   = SACE_RESULT_TYPE_NONE;
+    rslt.resultStatus = status;
+    return rslt;
+}
+
+/* client side, keeps what onResult brought */
+class LocalListener : public BnSaceListener {
+    mutex mMutex;
+    condition_variable mCond;
+    vector<SaceResult> mResults;
+public:
+    void onResponsed (const SaceStatusResponse &) {}
+
+    void onResult (const SaceResult &result) {
+        lock_guard<mutex> lock(mMutex);
+        mResults.push_back(result);
+        mCond.notify_all();
+    }
+
+    size_t count () {
+        lock_guard<mutex> lock(mMutex);
+        return mResults.size();
+    }
+
+    /* false if fewer than count arrived in time */
+    bool wait (size_t count, vector<SaceResult> &results) {
+        unique_lock<mutex> lock(mMutex);
+        bool arrived = mCond.wait_for(lock, chrono::milliseconds(WAIT_TIMEOUT_MS),
+            [this, count] { return mResults.size() >= count; });
+        results = mResults;
+        return arrived;
+    }
+};
+
+/* Stands in for saced's SaceManagerService behind a local binder, so the
+ * proxy, the parcels and the writers are the real ones without a driver.
+ * The worker plays the excutor and only answers while released.
+ */
+class LocalManager : public BnSaceManager {
+    mutex mMutex;
+    condition_variable mCond;
+    deque<pair<SaceCommand, sp<SaceBinderWriter>>> mQueue;
+    bool mHeld;
+    bool mExit;
+    thread mWorker;
+
+    void run () {
+        unique_lock<mutex> lock(mMutex);
+        while (true) {
+            mCond.wait(lock, [this] { return mExit || (!mHeld && !mQueue.empty()); });
+            if (mExit)
+                return;
+
+            pair<SaceCommand, sp<SaceBinderWriter>> item = std::move(mQueue.front());
+            mQueue.pop_front();
+            lock.unlock();
+
+            item.second->sendResult(make_result(item.first.sequence, SACE_RESULT_STATUS_OK));
+            lock.lock();
+        }
+    }
+public:
+    enum Mode {
+        MODE_ASYNC,
+        /* an older service, registerListener answers nothing */
+        MODE_LEGACY,
+        /* sendCommandAsync fails, optionally after onResult got out */
+        MODE_REJECT,
+        MODE_ANSWER_REJECT,
+    };
+
+    sp<SaceListenerRegistry> mListeners;
+    Mode mMode;
+
+    explicit LocalManager (Mode mode = MODE_ASYNC):mHeld(false),mExit(false),mMode(mode) {
+        mListeners = new SaceListenerRegistry();
+        mWorker = thread(&LocalManager::run, this);
+    }
+
+    ~LocalManager () {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mExit = true;
+        }
+        mCond.notify_all();
+        mWorker.join();
+    }
+
+    void hold (bool held) {
+        {
+            lock_guard<mutex> lock(mMutex);
+            mHeld = held;
+        }
+        mCond.notify_all();
+    }
+
+    status_t onTransact (uint32_t code, const Parcel &data, Parcel *reply, uint32_t flags) {
+        if (mMode == MODE_LEGACY && code == TRANSACT_REGISTERLISTENER)
+            reply = nullptr;
+        return BnSaceManager::onTransact(code, data, reply, flags);
+    }
+
+    SaceResult sendCommand (const SaceCommand &command) {
+        return make_result(command.sequence, SACE_RESULT_STATUS_OK);
+    }
+
+    status_t sendCommandAsync (const SaceCommand &command, const sp<ISaceListener> &listener) {
+        if (listener == nullptr)
+            return BAD_VALUE;
+
+        if (mMode == MODE_ANSWER_REJECT)
+            listener->onResult(make_result(command.sequence, SACE_RESULT_STATUS_OK));
+        if (mMode == MODE_REJECT || mMode == MODE_ANSWER_REJECT)
+            return UNKNOWN_ERROR;
+
+        pid_t pid = mListeners->owner(listener);
+        if (pid < 0) {
+            listener->onResult(make_result(command.sequence, SACE_RESULT_STATUS_FAIL));
+            return NO_ERROR;
+        }
+
+        {
+            lock_guard<mutex> lock(mMutex);
+            mQueue.emplace_back(command, new SaceBinderWriter("LocalManager", pid, listener, true));
+        }
+        mCond.notify_all();
+        return NO_ERROR;
+    }
+
+    void registerListener (sp<ISaceListener> listener) {
+        mListeners->add(getpid(), listener);
+    }
+
+    void unregisterListener () {
+        mListeners->remove(getpid());
+    }
+};
+
+/* the sender on a local service, binderDied at hand */
+class TestSender : public SaceBinderSender {
+public:
+    explicit TestSender (const sp<IBinder> &binder):SaceBinderSender(binder) {}
+
+    void died () {
+        fail_async();
+    }
+};
+
+static SaceCommand make_command () {
+    SaceCommand cmd;
+    cmd.type = SACE_TYPE_NORMAL;
+    cmd.normalCmdType = SACE_NORMAL_CMD_START;
+    cmd.command = "true";
+    return cmd;
+}
+
+/* every call returns before the excutor answered, each result exactly once */
+static void test_oneway () {
+    sp<LocalManager> service = new LocalManager();
+    sp<BpSaceManager> manager = new BpSaceManager(service);
+    sp<LocalListener> listener = new LocalListener();
+    set<uint64_t> sent;
+
+    manager->registerListener(listener);
+    EXPECT(manager->asyncSupported());
+
+    service->hold(true);
+    for (int i = 0; i < ASYNC_COMMANDS; i++) {
+        SaceCommand cmd = make_command();
+        sent.insert(cmd.sequence);
+        EXPECT(manager->sendCommandAsync(cmd, listener) == NO_ERROR);
+    }
+    EXPECT(listener->count() == 0);
+    service->hold(false);
+
+    vector<SaceResult> results;
+    EXPECT(listener->wait(ASYNC_COMMANDS, results));
+    EXPECT(listener->count() == ASYNC_COMMANDS);
+    for (auto &rslt : results) {
+        EXPECT(rslt.resultStatus == SACE_RESULT_STATUS_OK);
+        EXPECT(sent.erase(rslt.sequence) == 1);
+    }
+    EXPECT(sent.empty());
+
+    manager->unregisterListener();
+    EXPECT(service->mListeners->size() == 0);
+}
+
+/* a listener nobody registered is told the command failed */
+static void test_unregistered () {
+    sp<LocalManager> service = new LocalManager();
+    sp<BpSaceManager> manager = new BpSaceManager(service);
+    sp<LocalListener> listener = new LocalListener();
+    vector<SaceResult> results;
+    SaceCommand cmd;
+
+    EXPECT(manager->sendCommandAsync(cmd, listener) == NO_ERROR);
+    EXPECT(listener->wait(1, results));
+    EXPECT(results[0].sequence == cmd.sequence);
+    EXPECT(results[0].resultStatus == SACE_RESULT_STATUS_FAIL);
+}
+
+/* sync writers hand the result to waitResult, and live without a listener */
+static void test_sync_writer () {
+    sp<SaceBinderWriter> writer = new SaceBinderWriter("TestWriter", getpid(), nullptr);
+
+    writer->sendResult(make_result(7, SACE_RESULT_STATUS_OK));
+    SaceResult rslt = writer->waitResult();
+    EXPECT(rslt.sequence == 7);
+    EXPECT(rslt.resultStatus == SACE_RESULT_STATUS_OK);
+
+    writer->sendResponse(SaceStatusResponse());
+}
+
+/* binder threads register, look up and drop at the same time */
+static void test_registry () {
+    sp<SaceListenerRegistry> registry = new SaceListenerRegistry();
+    vector<thread> threads;
+    atomic<int> misses(0);
+
+    for (int t = 0; t < REGISTRY_THREADS; t++) {
+        threads.emplace_back([registry, t, &misses] {
+            sp<ISaceListener> listener = new LocalListener();
+            pid_t pid = 1000 + t;
+
+            for (int i = 0; i < REGISTRY_ROUNDS; i++) {
+                registry->add(pid, listener);
+                if (registry->find(pid) != listener || registry->owner(listener) != pid)
+                    misses++;
+                registry->remove(pid);
+            }
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+
+    EXPECT(misses == 0);
+    EXPECT(registry->size() == 0);
+
+    sp<ISaceListener> first  = new LocalListener();
+    sp<ISaceListener> second = new LocalListener();
+    registry->add(1, first);
+    registry->add(1, second);
+    EXPECT(registry->size() == 1);
+    EXPECT(registry->find(1) == second);
+    EXPECT(registry->find(2) == nullptr);
+    EXPECT(registry->owner(second) == 1);
+    EXPECT(registry->owner(first) == -1);
+}
+
+/* without sendCommandAsync in saced the handler runs before the call returns */
+static void test_sender_fallback () {
+    sp<LocalManager> service = new LocalManager(LocalManager::MODE_LEGACY);
+    sp<LocalListener> sink = new LocalListener();
+    TestSender sender(service);
+    SaceCommand cmd = make_command();
+    vector<SaceResult> results;
+
+    service->hold(true);
+    sender.excuteCommandAsync(cmd, [sink] (const SaceResult &rslt) { sink->onResult(rslt); });
+    EXPECT(sink->count() == 1);
+    EXPECT(sink->wait(1, results));
+    EXPECT(results[0].sequence == cmd.sequence);
+    EXPECT(results[0].resultStatus == SACE_RESULT_STATUS_OK);
+}
+
+/* a sequence already in flight fails at once, the first still completes */
+static void test_sender_duplicate () {
+    sp<LocalManager> service = new LocalManager();
+    sp<LocalListener> sink = new LocalListener();
+    TestSender sender(service);
+    SaceCommand cmd = make_command();
+    vector<SaceResult> results;
+
+    service->hold(true);
+    sender.excuteCommandAsync(cmd, [sink] (const SaceResult &rslt) { sink->onResult(rslt); });
+    EXPECT(sink->count() == 0);
+    sender.excuteCommandAsync(cmd, [sink] (const SaceResult &rslt) { sink->onResult(rslt); });
+    EXPECT(sink->count() == 1);
+    service->hold(false);
+
+    EXPECT(sink->wait(2, results));
+    EXPECT(results.size() == 2);
+    EXPECT(results[0].sequence == cmd.sequence && results[0].resultStatus == SACE_RESULT_STATUS_FAIL);
+    EXPECT(results[1].sequence == cmd.sequence && results[1].resultStatus == SACE_RESULT_STATUS_OK);
+}
+
+/* a failed send completes the handler once, also when onResult beat it */
+static void test_sender_rejected () {
+    LocalManager::Mode modes[] = { LocalManager::MODE_REJECT, LocalManager::MODE_ANSWER_REJECT };
+    enum SaceResultStatus expected[] = { SACE_RESULT_STATUS_FAIL, SACE_RESULT_STATUS_OK };
+
+    for (int i = 0; i < 2; i++) {
+        sp<LocalManager> service = new LocalManager(modes[i]);
+        sp<LocalListener> sink = new LocalListener();
+        TestSender sender(service);
+        SaceCommand cmd = make_command();
+        vector<SaceResult> results;
+
+        sender.excuteCommandAsync(cmd, [sink] (const SaceResult &rslt) { sink->onResult(rslt); });
+        EXPECT(sink->wait(1, results));
+        EXPECT(sink->count() == 1);
+        EXPECT(results[0].sequence == cmd.sequence);
+        EXPECT(results[0].resultStatus == expected[i]);
+    }
+}
+
+/* binderDied fails every handler still pending */
+static void test_sender_died () {
+    sp<LocalManager> service = new LocalManager();
+    sp<LocalListener> sink = new LocalListener();
+    TestSender sender(service);
+    set<uint64_t> sent;
+    vector<SaceResult> results;
+
+    /* held for good, the sender goes before anything is answered */
+    service->hold(true);
+    for (int i = 0; i < ASYNC_COMMANDS; i++) {
+        SaceCommand cmd = make_command();
+        sent.insert(cmd.sequence);
+        sender.excuteCommandAsync(cmd, [sink] (const SaceResult &rslt) { sink->onResult(rslt); });
+    }
+    EXPECT(sink->count() == 0);
+
+    sender.died();
+    EXPECT(sink->wait(ASYNC_COMMANDS, results));
+    for (auto &rslt : results) {
+        EXPECT(rslt.resultStatus == SACE_RESULT_STATUS_FAIL);
+        EXPECT(sent.erase(rslt.sequence) == 1);
+    }
+    EXPECT(sent.empty());
+
+    /* nothing left for a second one */
+    sender.died();
+    EXPECT(sink->count() == ASYNC_COMMANDS);
+}
+
+int main (void) {
+    test_oneway();
+    test_unregistered();
+    test_sync_writer();
+    test_registry();
+    test_sender_fallback();
+    test_sender_duplicate();
+    test_sender_rejected();
+    test_sender_died();
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
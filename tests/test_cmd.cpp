@@ -2,7 +2,10 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
 #include <iostream>
+#include <thread>
+#include <vector>
 #include <sys/socket.h>
 
 #include <log/log.h>
@@ -84,9 +87,99 @@ void test_event (const char* name, const char* cm) {
     }
 }
 
+void test_reload () {
+    sp<SaceManager> manager = SaceManager::getInstance();
+
+    ALOGI("reloadEvents");
+    if (!manager->reloadEvents())
+        ALOGE("reload Events Failed");
+}
+
+/* all threads share one connection, commands overlap in flight */
+void test_concurrent (int threads, int rounds) {
+    sp<SaceManager> manager = SaceManager::getInstance();
+    vector<thread> workers;
+    atomic<int> failed(0);
+
+    ALOGI("concurrent %d threads x %d", threads, rounds);
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&manager, &failed, rounds] () {
+            for (int j = 0; j < rounds; j++) {
+                sp<SaceCommandObj> cmd = manager->runCommand("true");
+                if (cmd->getError() != ERR_OK) {
+                    failed++;
+                    continue;
+                }
+                cmd->close();
+            }
+        });
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+
+    ALOGI("concurrent done failed=%d", failed.load());
+}
+
+/* one thread issues all commands before collecting any result */
+void test_async (int count) {
+    sp<SaceManager> manager = SaceManager::getInstance();
+    vector<future<sp<SaceCommandObj>>> results;
+    atomic<int> completed(0);
+    int failed = 0;
+
+    ALOGI("async %d commands", count);
+    for (int i = 0; i < count; i++)
+        results.push_back(manager->runCommandAsync("true"));
+
+    for (int i = 0; i < count; i++) {
+        manager->checkServiceAsync("event", nullptr, nullptr, [&completed] (sp<SaceServiceObj>) {
+            completed++;
+        });
+    }
+
+    for (auto &result : results) {
+        sp<SaceCommandObj> cmd = result.get();
+        if (cmd->getError() != ERR_OK) {
+            failed++;
+            continue;
+        }
+        cmd->close();
+    }
+
+    /* callbacks finish at the latest with their timeout */
+    while (completed < count)
+        usleep(10 * 1000);
+
+    ALOGI("async done failed=%d", failed);
+}
+
+/* one frame out and one back for the whole batch */
+void test_batch (int count) {
+    sp<SaceManager> manager = SaceManager::getInstance();
+    vector<string> cmds(count, "true");
+    int failed = 0;
+
+    ALOGI("batch %d commands", count);
+    vector<sp<SaceCommandObj>> cmdObjs = manager->runCommands(cmds);
+    for (auto &cmd : cmdObjs) {
+        if (cmd->getError() != ERR_OK) {
+            failed++;
+            continue;
+        }
+        cmd->close();
+    }
+
+    ALOGI("batch done %zu results failed=%d", cmdObjs.size(), failed);
+}
+
 int main (void) {
     test_command("ls /sdcard");
     test_service("service", "ping www.baidu.com");
     test_event("event", "ping www.baidu.com");
+    test_reload();
+    test_concurrent(16, 20);
+    test_async(200);
+    test_batch(50);
     return 0;
 }
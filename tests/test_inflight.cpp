@@ -0,0 +1,114 @@
+#define LOG_TAG "TEST_INFLIGHT"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <map>
+#include <random>
+
+#include <log/log.h>
+#include <SaceInflight.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define DEFAULT_OPS   1000000
+#define BENCH_ENTRIES 1024
+
+/* random inserts, erases, finds and sweeps checked against std::map */
+static void test_random (int ops, uint64_t range) {
+    mt19937_64 rand(range);
+    SaceInflightTable<int> table;
+    map<uint64_t, int> expect;
+
+    for (int i = 0; i < ops; i++) {
+        uint64_t sequence = rand() % range + 1;
+
+        switch (rand() % 4) {
+            case 0:
+            case 1:
+                EXPECT(table.insert(sequence, i) == expect.insert(make_pair(sequence, i)).second);
+                break;
+            case 2:
+                EXPECT(table.erase(sequence) == (expect.erase(sequence) == 1));
+                break;
+            default: {
+                int *value = table.find(sequence);
+                auto it = expect.find(sequence);
+                EXPECT((value != nullptr) == (it != expect.end()));
+                EXPECT(value == nullptr || *value == it->second);
+            }
+        }
+
+        /* the same sweep the sender runs for expired async commands */
+        if (i % 10000 == 0) {
+            uint64_t rest = rand() % 3;
+            table.erase_if([rest] (uint64_t seq, int) { return seq % 3 == rest; });
+            for (auto it = expect.begin(); it != expect.end();) {
+                if (it->first % 3 == rest)
+                    it = expect.erase(it);
+                else
+                    it++;
+            }
+        }
+
+        EXPECT(table.size() == expect.size());
+    }
+
+    size_t visited = 0;
+    table.for_each([&] (uint64_t seq, int value) {
+        auto it = expect.find(seq);
+        if (it != expect.end() && it->second == value)
+            visited++;
+    });
+    EXPECT(visited == expect.size());
+
+    /* 0 is the free slot marker and never a sequence */
+    EXPECT(!table.insert(0, 0));
+    EXPECT(table.find(0) == nullptr);
+}
+
+/* insert + find + erase of consecutive sequences, as the sender does */
+static void bench_complete (int ops) {
+    SaceInflightTable<int> table;
+    map<uint64_t, int> tree;
+    struct timespec begin;
+    uint64_t sequence = 1;
+
+    for (int i = 0; i < BENCH_ENTRIES; i++, sequence++) {
+        table.insert(sequence, i);
+        tree.insert(make_pair(sequence, i));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < ops; i++) {
+        table.insert(sequence + i, i);
+        table.find(sequence + i - BENCH_ENTRIES);
+        table.erase(sequence + i - BENCH_ENTRIES);
+    }
+    long table_ns = elapsed_ns(begin);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < ops; i++) {
+        tree.insert(make_pair(sequence + i, i));
+        auto it = tree.find(sequence + i - BENCH_ENTRIES);
+        tree.erase(it);
+    }
+    long tree_ns = elapsed_ns(begin);
+
+    printf("%d in flight: table %ld ns/op  map %ld ns/op\n", BENCH_ENTRIES, table_ns / ops, tree_ns / ops);
+    ALOGI("%d in flight: table %ld ns/op map %ld ns/op", BENCH_ENTRIES, table_ns / ops, tree_ns / ops);
+}
+
+/* usage: test_inflight [ops] */
+int main (int argc, char **argv) {
+    int ops = argc > 1? atoi(argv[1]) : DEFAULT_OPS;
+
+    /* dense keys collide a lot, sparse ones grow the table */
+    test_random(ops, 500);
+    test_random(ops, 1ull << 40);
+    bench_complete(ops);
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#define LOG_TAG "TEST_LOAD"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <binder/Parcel.h>
+#include <cutils/sockets.h>
+#include <log/log.h>
+#include <sace/SaceServiceInfo.h>
+#include <SaceTypes.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define DEFAULT_CLIENT_NUM 1000
+#define RESULT_TIMEOUT     10000 //10s
+
+/* N clients connected at once, each queries a missing event and waits for the result */
+int main (int argc, char **argv) {
+    int client_num = argc > 1? atoi(argv[1]) : DEFAULT_CLIENT_NUM;
+    struct timespec begin;
+    vector<int> fds;
+
+    struct rlimit limit = { (rlim_t)client_num + 64, (rlim_t)client_num + 64 };
+    if (setrlimit(RLIMIT_NOFILE, &limit) < 0)
+        ALOGW("setrlimit NOFILE %d failed %s", client_num + 64, strerror(errno));
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < client_num; i++) {
+        int fd = socket_local_client("sace_socket", ANDROID_SOCKET_NAMESPACE_ABSTRACT, SOCK_STREAM);
+        if (fd < 0) {
+            ALOGE("connect client %d failed %s", i, strerror(errno));
+            break;
+        }
+        fds.push_back(fd);
+    }
+    printf("connected %zu clients in %ldus\n", fds.size(), elapsed_us(begin));
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    SaceCommand cmd;
+    cmd.type = SACE_TYPE_EVENT;
+    cmd.eventType  = SACE_EVENT_TYPE_INFO;
+    cmd.eventFlags = SACE_EVENT_FLAG_NONE;
+    cmd.command.assign(SaceServiceInfo::SERVICE_GET_BY_NAME);
+    cmd.name.assign("test_load_missing_event");
+
+    Parcel parcel;
+    cmd.writeToParcel(&parcel);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (auto fd : fds) {
+        struct epoll_event ev;
+        ev.events  = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+
+        if (TEMP_FAILURE_RETRY(write(fd, parcel.data(), parcel.dataSize())) != (ssize_t)parcel.dataSize())
+            ALOGE("send command on %d failed %s", fd, strerror(errno));
+    }
+
+    size_t results = 0;
+    struct epoll_event events[64];
+    while (results < fds.size()) {
+        int ret = epoll_wait(epfd, events, 64, RESULT_TIMEOUT);
+        if (ret <= 0)
+            break;
+
+        for (int i = 0; i < ret; i++) {
+            char buf[1024];
+            if (TEMP_FAILURE_RETRY(read(events[i].data.fd, buf, sizeof(buf))) > 0)
+                results++;
+            epoll_ctl(epfd, EPOLL_CTL_DEL, events[i].data.fd, nullptr);
+        }
+    }
+
+    long cost = elapsed_us(begin);
+    printf("received %zu/%zu results in %ldus, %ldus per client\n", results, fds.size(), cost,
+        fds.empty()? 0 : cost / (long)fds.size());
+
+    for (auto fd : fds)
+        close(fd);
+    close(epfd);
+
+    return results == fds.size()? 0 : 1;
+}
@@ -0,0 +1,256 @@
+#define LOG_TAG "TEST_OUTPUT_QUEUE"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+
+#include <log/log.h>
+#include <SaceWriter.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define FRAME_SIZE 4096
+
+/* fds[0] is ours with a small send buffer, fds[1] the client */
+static bool socket_pair (int fds[2], int type = SOCK_STREAM) {
+    int sndbuf = FRAME_SIZE;
+
+    if (socketpair(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) < 0)
+        return false;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    return true;
+}
+
+static string frame_of (int index) {
+    return string(FRAME_SIZE, (char)('a' + index % 26));
+}
+
+/* reads what is there, or one packet if once, fds received are appended to fds */
+static size_t drain (int fd, string &data, vector<int> *fds = nullptr, bool once = false) {
+    char buf[FRAME_SIZE];
+    size_t total = 0;
+
+    while (true) {
+        union {
+            struct cmsghdr cm;
+            char control[CMSG_SPACE(sizeof(int) * SACE_BATCH_MAX_ITEMS)];
+        } control_un;
+        struct iovec iov = { buf, sizeof(buf) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control_un.control;
+        msg.msg_controllen = sizeof(control_un.control);
+
+        ssize_t ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (ret <= 0)
+            return total;
+
+        for (struct cmsghdr *pcmsg = CMSG_FIRSTHDR(&msg); pcmsg != nullptr; pcmsg = CMSG_NXTHDR(&msg, pcmsg)) {
+            int *received = (int*)CMSG_DATA(pcmsg);
+            size_t nfds = (pcmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < nfds; i++) {
+                if (fds != nullptr)
+                    fds->push_back(received[i]);
+                else
+                    close(received[i]);
+            }
+        }
+
+        data.append(buf, ret);
+        total += ret;
+        if (once)
+            return total;
+    }
+}
+
+/* frames that do not fit wait in order, the sender never blocks */
+static void test_deferred () {
+    int fds[2];
+    EXPECT(socket_pair(fds));
+
+    sp<SaceOutputQueue> output = new SaceOutputQueue(fds[0]);
+    uint64_t deferred = SaceOutputQueue::stats().deferred;
+    string expected, received;
+
+    for (int i = 0; i < 32; i++) {
+        string frame = frame_of(i);
+        EXPECT(output->send(frame.data(), frame.size(), nullptr, 0));
+        expected += frame;
+    }
+    EXPECT(SaceOutputQueue::stats().deferred > deferred);
+
+    /* what the reader does on EPOLLOUT */
+    for (int round = 0; received.size() < expected.size() && round < 1000; round++) {
+        drain(fds[1], received);
+        EXPECT(output->flush());
+    }
+    EXPECT(received == expected);
+
+    output->detach();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* an fd queued behind other frames still arrives after the caller closed it */
+static void test_fds () {
+    int fds[2], pipefd[2];
+    EXPECT(socket_pair(fds));
+    EXPECT(pipe2(pipefd, O_CLOEXEC) == 0);
+
+    sp<SaceOutputQueue> output = new SaceOutputQueue(fds[0]);
+    string filler = frame_of(0);
+    for (int i = 0; i < 8; i++)
+        EXPECT(output->send(filler.data(), filler.size(), nullptr, 0));
+
+    string frame = frame_of(1);
+    EXPECT(output->send(frame.data(), frame.size(), &pipefd[1], 1));
+    close(pipefd[1]);
+
+    string received;
+    vector<int> passed;
+    for (int round = 0; received.size() < filler.size() * 8 + frame.size() && round < 1000; round++) {
+        drain(fds[1], received, &passed);
+        EXPECT(output->flush());
+    }
+    EXPECT(passed.size() == 1);
+
+    char c = 'x';
+    EXPECT(write(passed[0], &c, 1) == 1);
+    close(passed[0]);
+    c = 0;
+    EXPECT(read(pipefd[0], &c, 1) == 1 && c == 'x');
+
+    close(pipefd[0]);
+    output->detach();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* a client that never reads is cut off instead of growing the queue */
+static void test_overflow () {
+    int fds[2];
+    EXPECT(socket_pair(fds));
+
+    sp<SaceOutputQueue> output = new SaceOutputQueue(fds[0]);
+    uint64_t overflows = SaceOutputQueue::stats().overflows;
+    string frame = frame_of(2);
+    size_t sent = 0;
+
+    while (output->send(frame.data(), frame.size(), nullptr, 0))
+        sent += frame.size();
+    EXPECT(sent <= SaceOutputQueue::MAX_QUEUED_BYTES + (size_t)FRAME_SIZE * 64);
+    EXPECT(SaceOutputQueue::stats().overflows == overflows + 1);
+    EXPECT(!output->send(frame.data(), frame.size(), nullptr, 0));
+
+    /* shut down, the client reads what got through and then the end */
+    string received;
+    drain(fds[1], received);
+    char c;
+    EXPECT(read(fds[1], &c, 1) == 0);
+
+    output->detach();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* on a packet socket every frame arrives whole and alone */
+static void test_packets () {
+    int fds[2], pipefd[2];
+    EXPECT(socket_pair(fds, SOCK_SEQPACKET));
+    EXPECT(pipe2(pipefd, O_CLOEXEC) == 0);
+
+    sp<SaceOutputQueue> output = new SaceOutputQueue(fds[0], true);
+    const int frames = 32;
+    for (int i = 0; i < frames; i++) {
+        string frame = frame_of(i);
+        bool fd = i == frames / 2;
+        EXPECT(output->send(frame.data(), frame.size(), fd ? &pipefd[1] : nullptr, fd ? 1 : 0));
+    }
+    close(pipefd[1]);
+
+    vector<int> passed;
+    int received = 0;
+    for (int round = 0; received < frames && round < 1000; round++) {
+        string packet;
+        size_t len;
+        while ((len = drain(fds[1], packet, &passed, true)) > 0) {
+            EXPECT(len == FRAME_SIZE && packet == frame_of(received));
+            packet.clear();
+            received++;
+        }
+        EXPECT(output->flush());
+    }
+    EXPECT(received == frames);
+    EXPECT(passed.size() == 1);
+
+    for (int fd : passed)
+        close(fd);
+    close(pipefd[0]);
+    output->detach();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_detach () {
+    int fds[2];
+    EXPECT(socket_pair(fds));
+
+    sp<SaceOutputQueue> output = new SaceOutputQueue(fds[0]);
+    output->detach();
+    close(fds[0]);
+
+    string frame = frame_of(3);
+    EXPECT(!output->send(frame.data(), frame.size(), nullptr, 0));
+    EXPECT(output->flush());
+    close(fds[1]);
+}
+
+/* drain handlers run once, by the flush that empties the queue */
+static void test_drained () {
+    int fds[2];
+    EXPECT(socket_pair(fds));
+
+    sp<SaceOutputQueue> output = new SaceOutputQueue(fds[0]);
+    int drained = 0;
+    EXPECT(!output->whenDrained([&drained] { drained++; }));
+
+    string frame = frame_of(4);
+    for (int i = 0; i < 8; i++)
+        EXPECT(output->send(frame.data(), frame.size(), nullptr, 0));
+    EXPECT(output->whenDrained([&drained] { drained++; }));
+
+    /* the socket holds the tail once the queue is empty */
+    string received;
+    for (int round = 0; drained == 0 && round < 1000; round++) {
+        drain(fds[1], received);
+        EXPECT(output->flush());
+    }
+    drain(fds[1], received);
+    EXPECT(received.size() == frame.size() * 8);
+    EXPECT(drained == 1);
+    EXPECT(output->flush());
+    EXPECT(drained == 1);
+
+    output->detach();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main (void) {
+    test_deferred();
+    test_fds();
+    test_overflow();
+    test_packets();
+    test_detach();
+    test_drained();
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+#define LOG_TAG "TEST_RING"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include <log/log.h>
+#include <SaceRing.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define THREAD_FRAMES 200000
+
+static string frame_of (int index, size_t len) {
+    return string(len, (char)('a' + index % 26));
+}
+
+/* a ring on plain memory, size bytes of data */
+struct LocalRing {
+    SaceRing::Control control;
+    string data;
+    SaceRing producer;
+    SaceRing consumer;
+
+    explicit LocalRing (uint32_t size):data(size, '\0') {
+        control.head = control.tail = control.sleeping = 0;
+        producer.attach(&control, (uint8_t*)&data[0], size);
+        consumer.attach(&control, (uint8_t*)&data[0], size);
+    }
+};
+
+/* odd sizes wrap at every position, entries come out whole and in order */
+static void test_wrap () {
+    LocalRing ring(4096);
+    const uint8_t *frame;
+    size_t len;
+
+    for (int i = 0; i < 2000; i++) {
+        string sent = frame_of(i, 1 + (i * 37) % 700);
+        EXPECT(ring.producer.push(sent.data(), sent.size()));
+        EXPECT(ring.consumer.next(&frame, &len));
+        EXPECT(string((const char*)frame, len) == sent);
+        ring.consumer.pop();
+        EXPECT(ring.consumer.empty());
+    }
+    EXPECT(!ring.consumer.broken());
+}
+
+static void test_full () {
+    LocalRing ring(4096);
+    string sent = frame_of(0, 1000);
+    const uint8_t *frame;
+    size_t len;
+
+    EXPECT(!ring.producer.push(sent.data(), ring.producer.maxFrame() + 1));
+
+    int pushed = 0;
+    while (ring.producer.push(sent.data(), 1000))
+        pushed++;
+    EXPECT(pushed == 4);
+
+    /* room comes back only once the consumer pops */
+    EXPECT(ring.consumer.next(&frame, &len));
+    EXPECT(!ring.producer.push(sent.data(), 1000));
+    ring.consumer.pop();
+    EXPECT(ring.producer.push(sent.data(), 1000));
+}
+
+/* the producer sees the ring drained only once every entry is popped */
+static void test_drained () {
+    LocalRing ring(4096);
+    string sent = frame_of(0, 100);
+    const uint8_t *frame;
+    size_t len;
+
+    EXPECT(ring.producer.drained());
+    EXPECT(ring.producer.push(sent.data(), sent.size()));
+    EXPECT(ring.producer.push(sent.data(), sent.size()));
+    EXPECT(!ring.producer.drained());
+
+    EXPECT(ring.consumer.next(&frame, &len));
+    EXPECT(!ring.producer.drained());
+    ring.consumer.pop();
+    EXPECT(!ring.producer.drained());
+
+    EXPECT(ring.consumer.next(&frame, &len));
+    ring.consumer.pop();
+    EXPECT(ring.producer.drained());
+}
+
+/* the producer kicks exactly once per sleep */
+static void test_sleep () {
+    LocalRing ring(4096);
+    string sent = frame_of(1, 64);
+    const uint8_t *frame;
+    size_t len;
+
+    EXPECT(ring.producer.push(sent.data(), sent.size()));
+    EXPECT(!ring.producer.wakeup());
+    EXPECT(!ring.consumer.sleep());
+
+    EXPECT(ring.consumer.next(&frame, &len));
+    ring.consumer.pop();
+    EXPECT(ring.consumer.sleep());
+
+    EXPECT(ring.producer.push(sent.data(), sent.size()));
+    EXPECT(ring.producer.wakeup());
+    EXPECT(!ring.producer.wakeup());
+    EXPECT(!ring.consumer.empty());
+}
+
+/* nothing the other side wrote is followed out of the ring */
+static void test_broken () {
+    LocalRing overrun(4096);
+    overrun.control.tail = 8192;
+    const uint8_t *frame;
+    size_t len;
+
+    EXPECT(!overrun.consumer.next(&frame, &len));
+    EXPECT(overrun.consumer.broken());
+
+    LocalRing length(4096);
+    string sent = frame_of(2, 64);
+    EXPECT(length.producer.push(sent.data(), sent.size()));
+    uint32_t bogus = 4000;
+    memcpy(&length.data[0], &bogus, sizeof(bogus));
+    EXPECT(!length.consumer.next(&frame, &len));
+    EXPECT(length.consumer.broken());
+    EXPECT(!length.consumer.sleep());
+
+    LocalRing head(4096);
+    head.control.head = 100000;
+    EXPECT(!head.producer.push(sent.data(), sent.size()));
+    EXPECT(head.producer.broken());
+}
+
+struct Producer {
+    SaceRing *ring;
+    int frames;
+};
+
+static void* produce (void *data) {
+    Producer *producer = (Producer*)data;
+
+    for (int i = 0; i < producer->frames; ) {
+        string sent = frame_of(i, 8 + i % 300);
+        memcpy(&sent[0], &i, sizeof(i));
+        if (producer->ring->push(sent.data(), sent.size()))
+            i++;
+        else
+            sched_yield();
+    }
+    return nullptr;
+}
+
+/* two mappings of one region, one thread on each side */
+static void test_threads () {
+    SaceRingRegion server, client;
+    EXPECT(server.create());
+    EXPECT(client.attach(dup(server.fd())));
+
+    Producer producer = { &client.submissions(), THREAD_FRAMES };
+    pthread_t thread;
+    EXPECT(pthread_create(&thread, nullptr, produce, &producer) == 0);
+
+    SaceRing &ring = server.submissions();
+    SaceAdaptiveSpin spin;
+    int received = 0;
+    bool ordered = true;
+    while (received < THREAD_FRAMES && !ring.broken()) {
+        const uint8_t *frame;
+        size_t len;
+
+        if (!spin.spin([&] { return ring.next(&frame, &len); })) {
+            sched_yield();
+            continue;
+        }
+
+        int index;
+        memcpy(&index, frame, sizeof(index));
+        if (index != received || len != (size_t)(8 + index % 300))
+            ordered = false;
+        ring.pop();
+        received++;
+    }
+    pthread_join(thread, nullptr);
+
+    EXPECT(!ring.broken());
+    EXPECT(ordered);
+    EXPECT(received == THREAD_FRAMES);
+    EXPECT(server.completions().empty());
+}
+
+int main (void) {
+    test_wrap();
+    test_full();
+    test_drained();
+    test_sleep();
+    test_broken();
+    test_threads();
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
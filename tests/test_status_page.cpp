@@ -0,0 +1,151 @@
+#define LOG_TAG "TEST_STATUS_PAGE"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <log/log.h>
+#include <SaceStatusPage.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+#define DEFAULT_WRITES 1000000
+#define TEST_SLOTS     4
+
+/* every field follows from n, a torn read breaks the relation */
+static SaceServiceInfo::ServiceStatus status_of (uint64_t label, uint64_t n) {
+    SaceServiceInfo::ServiceStatus status;
+    status.label = label;
+    status.pid   = (pid_t)(n & 0x7fffffff);
+    status.state = (enum SaceServiceInfo::ServiceState)(n % SaceServiceInfo::SERVICE_UNKNOWN);
+    status.startTime = n;
+    status.exitCode  = (int32_t)(n * 5);
+    status.cpuTimeMs = n * 7;
+    status.name = "service_" + to_string(n);
+    return status;
+}
+
+static bool consistent (const SaceServiceInfo::ServiceStatus &status) {
+    SaceServiceInfo::ServiceStatus expect = status_of(status.label, status.startTime);
+
+    return status.pid == expect.pid && status.state == expect.state && status.exitCode == expect.exitCode
+        && status.cpuTimeMs == expect.cpuTimeMs && status.name == expect.name;
+}
+
+/* label of slot index + 1 in its first generation, as SaceSlotMap hands them out */
+static uint64_t label_of (uint32_t slot) {
+    return (1ull << 32) | slot;
+}
+
+/* what a client gets: a dup of the fd, mapped read only */
+static bool attach_client (const SaceStatusPage &page, SaceStatusPage &client) {
+    return client.attach(dup(page.fd()));
+}
+
+static void test_basic () {
+    SaceStatusPage page, client;
+    SaceServiceInfo::ServiceStatus status;
+
+    EXPECT(page.create());
+    EXPECT(attach_client(page, client));
+
+    EXPECT(!client.read(label_of(1), status));
+    EXPECT(!client.find("service_1", status));
+
+    page.write(status_of(label_of(1), 1));
+    EXPECT(client.read(label_of(1), status));
+    EXPECT(consistent(status) && status.startTime == 1);
+    EXPECT(client.find("service_1", status));
+    EXPECT(status.label == label_of(1));
+
+    /* slot reused by the next generation, the old label is gone */
+    page.write(status_of(label_of(1) + (1ull << 32), 2));
+    EXPECT(!client.read(label_of(1), status));
+    EXPECT(client.read(label_of(1) + (1ull << 32), status));
+
+    /* a reaped service stays findable, the live one of the same name wins */
+    status = status_of(label_of(2), 3);
+    status.name  = "service_dup";
+    status.state = SaceServiceInfo::SERVICE_FINISHED;
+    page.write(status);
+    status.label = label_of(3);
+    status.state = SaceServiceInfo::SERVICE_RUNNING;
+    status.startTime = 0;
+    page.write(status);
+    EXPECT(client.find("service_dup", status));
+    EXPECT(status.label == label_of(3));
+
+    EXPECT(!SaceStatusPage::covers(0));
+    EXPECT(!SaceStatusPage::covers(label_of(SaceStatusPage::CAPACITY + 1)));
+    EXPECT(SaceStatusPage::covers(label_of(SaceStatusPage::CAPACITY)));
+
+    /* clients must not get a writable mapping of a sealed page */
+    int fd = dup(page.fd());
+    void *rw = mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (rw != MAP_FAILED) {
+        printf("WARN writable mapping allowed, kernel without F_SEAL_FUTURE_WRITE\n");
+        munmap(rw, 4096);
+    }
+    close(fd);
+}
+
+/* one writer, readers on the other cores never see a torn record */
+static void test_concurrent (long writes) {
+    SaceStatusPage page;
+    EXPECT(page.create());
+
+    for (uint32_t slot = 1; slot <= TEST_SLOTS; slot++)
+        page.write(status_of(label_of(slot), 0));
+
+    atomic<bool> stop(false);
+    atomic<long> reads(0), torn(0);
+    vector<thread> readers;
+    for (int i = 0; i < 2; i++) {
+        readers.emplace_back([&page, &stop, &reads, &torn] () {
+            SaceStatusPage client;
+            if (!attach_client(page, client)) {
+                torn++;
+                return;
+            }
+
+            SaceServiceInfo::ServiceStatus status;
+            for (uint64_t n = 0; !stop; n++) {
+                if (!client.read(label_of(n % TEST_SLOTS + 1), status) || !consistent(status))
+                    torn++;
+                reads++;
+            }
+        });
+    }
+
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (long n = 1; n <= writes; n++)
+        page.write(status_of(label_of(n % TEST_SLOTS + 1), n));
+    long write_ns = elapsed_ns(begin);
+
+    stop = true;
+    for (auto &reader : readers)
+        reader.join();
+
+    printf("%ld writes %ld ns/op, %ld reads, %ld torn\n", writes, write_ns / writes, reads.load(), torn.load());
+    ALOGI("%ld writes %ld ns/op, %ld reads, %ld torn", writes, write_ns / writes, reads.load(), torn.load());
+    EXPECT(torn == 0);
+}
+
+/* usage: test_status_page [writes] */
+int main (int argc, char **argv) {
+    long writes = argc > 1? atol(argv[1]) : DEFAULT_WRITES;
+
+    test_basic();
+    test_concurrent(writes);
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
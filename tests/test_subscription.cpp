@@ -0,0 +1,249 @@
+#define LOG_TAG "TEST_SUBSCRIPTION"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <semaphore.h>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <log/log.h>
+#include <SaceSubscription.h>
+#include "SaceTest.h"
+
+using namespace android;
+
+/* records what the send thread delivers, can hold it up like a slow client
+ * or keep output queued like a client that does not read */
+class RecordWriter : public SaceWriter {
+    sem_t mGate;
+    sem_t mEntered;
+    sem_t mSent;
+    sem_t mWaiting;
+    bool mGated;
+    bool mBacklogged;
+    function<void ()> mDrained;
+public:
+    mutex mMutex;
+    vector<SaceServiceInfo::StateEvent> mEvents;
+
+    RecordWriter (bool gated):SaceWriter("RecordWriter", getpid()) {
+        mGated = gated;
+        mBacklogged = false;
+        sem_init(&mGate, 0, 0);
+        sem_init(&mEntered, 0, 0);
+        sem_init(&mSent, 0, 0);
+        sem_init(&mWaiting, 0, 0);
+    }
+
+    virtual void sendResult (const SaceResult &) {}
+
+    virtual bool whenDrained (function<void ()> handler) {
+        {
+            lock_guard<mutex> lock(mMutex);
+            if (!mBacklogged)
+                return false;
+            mDrained = handler;
+        }
+        sem_post(&mWaiting);
+        return true;
+    }
+
+    virtual void sendResponse (const SaceStatusResponse &response) {
+        if (mGated) {
+            sem_post(&mEntered);
+            sem_wait(&mGate);
+        }
+
+        SaceServiceInfo::StateEvent event;
+        event.readFrom(response.extra);
+        {
+            lock_guard<mutex> lock(mMutex);
+            mEvents.push_back(event);
+        }
+        sem_post(&mSent);
+    }
+
+    void open (int count) {
+        for (int i = 0; i < count; i++)
+            sem_post(&mGate);
+    }
+
+    /* the send thread is held up in here */
+    void entered () {
+        sem_wait(&mEntered);
+    }
+
+    void wait (int count) {
+        for (int i = 0; i < count; i++)
+            sem_wait(&mSent);
+    }
+
+    void backlog () {
+        lock_guard<mutex> lock(mMutex);
+        mBacklogged = true;
+    }
+
+    /* the send thread saw the backlog and waits for drain */
+    void waiting () {
+        sem_wait(&mWaiting);
+    }
+
+    /* as the reader does once the socket took the queue */
+    void drain () {
+        function<void ()> drained;
+        {
+            lock_guard<mutex> lock(mMutex);
+            mBacklogged = false;
+            drained.swap(mDrained);
+        }
+        if (drained)
+            drained();
+    }
+};
+
+static SaceServiceInfo::StateEvent event_of (uint64_t label, const char *name, enum SaceServiceInfo::ServiceState state) {
+    SaceServiceInfo::StateEvent event;
+    event.label = label;
+    event.name  = name;
+    event.pid   = (pid_t)label;
+    event.state = state;
+    return event;
+}
+
+static SaceCommand subscribe_command (const string &filter, const char *name, uint64_t label) {
+    SaceCommand cmd;
+    cmd.type = SACE_TYPE_SERVICE;
+    cmd.serviceCmdType = SACE_SERVICE_CMD_SUBSCRIBE;
+    cmd.command = filter;
+    cmd.name  = name;
+    cmd.label = label;
+    return cmd;
+}
+
+/* filters, initial states and removal */
+static void test_filters () {
+    SaceSubscriptions subscriptions;
+    EXPECT(subscriptions.start());
+
+    sp<RecordWriter> byName  = new RecordWriter(false);
+    sp<RecordWriter> byLabel = new RecordWriter(false);
+    sp<RecordWriter> all     = new RecordWriter(false);
+
+    vector<SaceServiceInfo::StateEvent> current;
+    current.push_back(event_of(1, "one", SaceServiceInfo::SERVICE_RUNNING));
+    current.push_back(event_of(2, "two", SaceServiceInfo::SERVICE_PAUSED));
+
+    SaceCommand nameCmd = subscribe_command(SaceServiceInfo::SERVICE_GET_BY_NAME, "two", 0);
+    EXPECT(subscriptions.add(byName, nameCmd, current));
+    EXPECT(!subscriptions.add(byName, nameCmd, current));
+    EXPECT(subscriptions.add(byLabel, subscribe_command(SaceServiceInfo::SERVICE_GET_BY_LABEL, "", 1), current));
+    EXPECT(subscriptions.add(all, subscribe_command(SaceServiceInfo::SERVICE_GET_ALL, "", 0), current));
+    EXPECT(!subscriptions.add(all, subscribe_command("GET_NOTHING", "", 0), current));
+
+    byName->wait(1);
+    byLabel->wait(1);
+    all->wait(2);
+    EXPECT(byName->mEvents[0].label == 2 && byName->mEvents[0].subscription == nameCmd.sequence);
+    EXPECT(byLabel->mEvents[0].label == 1);
+
+    subscriptions.publish(event_of(2, "two", SaceServiceInfo::SERVICE_RUNNING));
+    byName->wait(1);
+    all->wait(1);
+    EXPECT(byName->mEvents.back().state == SaceServiceInfo::SERVICE_RUNNING);
+    EXPECT(all->mEvents.size() == 3);
+
+    EXPECT(subscriptions.remove(byName, nameCmd.sequence));
+    EXPECT(!subscriptions.remove(byName, nameCmd.sequence));
+    subscriptions.removeAll(all);
+    EXPECT(subscriptions.size() == 1);
+
+    subscriptions.stop();
+    EXPECT(byName->mEvents.size() == 2);
+}
+
+/* a held up subscriber gets the latest state per service, the rest are counted */
+static void test_coalesce () {
+    SaceSubscriptions subscriptions;
+    EXPECT(subscriptions.start());
+
+    sp<RecordWriter> slow = new RecordWriter(true);
+    sp<RecordWriter> fast = new RecordWriter(false);
+    EXPECT(subscriptions.add(slow, subscribe_command(SaceServiceInfo::SERVICE_GET_ALL, "", 0), {}));
+    EXPECT(subscriptions.add(fast, subscribe_command(SaceServiceInfo::SERVICE_GET_BY_LABEL, "", 2), {}));
+
+    /* the first one is taken by the send thread and blocks there */
+    subscriptions.publish(event_of(1, "one", SaceServiceInfo::SERVICE_RUNNING));
+    slow->entered();
+    for (int i = 0; i < 10; i++) {
+        subscriptions.publish(event_of(1, "one", i % 2 ? SaceServiceInfo::SERVICE_RUNNING : SaceServiceInfo::SERVICE_PAUSED));
+        subscriptions.publish(event_of(2, "two", SaceServiceInfo::SERVICE_RUNNING));
+    }
+    subscriptions.publish(event_of(1, "one", SaceServiceInfo::SERVICE_FINISHED));
+
+    slow->open(3);
+    slow->wait(3);
+    fast->wait(1);
+
+    EXPECT(slow->mEvents.size() == 3);
+    EXPECT(slow->mEvents[1].label == 1 && slow->mEvents[1].state == SaceServiceInfo::SERVICE_FINISHED);
+    EXPECT(slow->mEvents[1].coalesced == 10);
+    EXPECT(slow->mEvents[2].label == 2 && slow->mEvents[2].coalesced == 9);
+
+    subscriptions.stop();
+}
+
+/* nothing goes out while the connection has output queued, the drain sends
+ * the latest state per service */
+static void test_backlog () {
+    SaceSubscriptions subscriptions;
+    EXPECT(subscriptions.start());
+
+    sp<RecordWriter> writer = new RecordWriter(false);
+    writer->backlog();
+    EXPECT(subscriptions.add(writer, subscribe_command(SaceServiceInfo::SERVICE_GET_ALL, "", 0), {}));
+
+    subscriptions.publish(event_of(1, "one", SaceServiceInfo::SERVICE_RUNNING));
+    writer->waiting();
+    for (int i = 0; i < 10; i++) {
+        subscriptions.publish(event_of(1, "one", i % 2 ? SaceServiceInfo::SERVICE_RUNNING : SaceServiceInfo::SERVICE_PAUSED));
+        subscriptions.publish(event_of(2, "two", SaceServiceInfo::SERVICE_RUNNING));
+    }
+    subscriptions.publish(event_of(1, "one", SaceServiceInfo::SERVICE_FINISHED));
+    EXPECT(writer->mEvents.empty());
+
+    writer->drain();
+    writer->wait(2);
+    subscriptions.stop();
+
+    EXPECT(writer->mEvents.size() == 2);
+    EXPECT(writer->mEvents[0].label == 1 && writer->mEvents[0].state == SaceServiceInfo::SERVICE_FINISHED);
+    EXPECT(writer->mEvents[0].coalesced == 11);
+    EXPECT(writer->mEvents[1].label == 2 && writer->mEvents[1].coalesced == 9);
+}
+
+/* a queue drained after the subscriptions are gone finds nobody to call */
+static void test_drain_after_destroy () {
+    sp<RecordWriter> writer = new RecordWriter(false);
+    writer->backlog();
+    {
+        SaceSubscriptions subscriptions;
+        EXPECT(subscriptions.start());
+        EXPECT(subscriptions.add(writer, subscribe_command(SaceServiceInfo::SERVICE_GET_ALL, "", 0), {}));
+        subscriptions.publish(event_of(1, "one", SaceServiceInfo::SERVICE_RUNNING));
+        writer->waiting();
+    }
+
+    writer->drain();
+    EXPECT(writer->mEvents.empty());
+}
+
+int main (void) {
+    test_filters();
+    test_coalesce();
+    test_backlog();
+    test_drain_after_destroy();
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}